@@ -0,0 +1,68 @@
+# GeneratePluginRegistry.cmake
+#
+# Script mode helper for plugin_registry(). Invoked as
+#
+#   cmake -DNAME=<name> -DOUTPUT=<file> -DSOURCES=<src>|<src>... -P GeneratePluginRegistry.cmake
+
+string(REPLACE "|" ";" SOURCES "${SOURCES}")
+
+# Returns the name of the function declared or defined on the given line.
+function(_function_name var line)
+  string(REGEX MATCH "[A-Za-z_][A-Za-z0-9_]*[ \t]*\\(" _match "${line}")
+  string(REGEX REPLACE "[ \t]*\\($" "" _name "${_match}")
+  set(${var} "${_name}" PARENT_SCOPE)
+endfunction(_function_name)
+
+set(_names "")
+foreach(_src ${SOURCES})
+  # Functions with a static prototype are not visible outside the library and
+  # can not be resolved, even if their definition is marked __PLUGIN__.
+  set(_statics "")
+  file(STRINGS ${_src} _lines REGEX "^static[^(=]*\\(")
+  foreach(_line ${_lines})
+    _function_name(_name "${_line}")
+    list(APPEND _statics ${_name})
+  endforeach(_line)
+
+  file(STRINGS ${_src} _lines REGEX "^(__PLUGIN__|__DLL_EXPORT__)[^(]*\\(")
+  foreach(_line ${_lines})
+    _function_name(_name "${_line}")
+    list(FIND _statics "${_name}" _static)
+    if(_name AND _static EQUAL -1 AND NOT _name STREQUAL "_obl_init")
+      list(APPEND _names ${_name})
+    endif(_name AND _static EQUAL -1 AND NOT _name STREQUAL "_obl_init")
+  endforeach(_line)
+endforeach(_src)
+if(_names)
+  list(REMOVE_DUPLICATES _names)
+  list(SORT _names)
+endif(_names)
+
+set(_decls "")
+set(_entries "")
+foreach(_name ${_names})
+  set(_decls "${_decls}extern void ${_name}(void);\n")
+  set(_entries "${_entries}  { .name = \"${_name}\", .fnc = (void_t) ${_name} },\n")
+endforeach(_name)
+
+file(WRITE ${OUTPUT}.tmp
+"/*
+ * ${NAME}_registry.c - Generated by GeneratePluginRegistry.cmake. Do not edit.
+ */
+
+#include <oblconfig.h>
+#include <resolve.h>
+
+${_decls}
+static resolve_static_t _${NAME}_registry[] = {
+${_entries}  { .name = NULL, .fnc = NULL }
+};
+
+static void _${NAME}_register(void) __attribute__((constructor));
+
+void _${NAME}_register(void) {
+  resolve_register_functions(_${NAME}_registry);
+}
+")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
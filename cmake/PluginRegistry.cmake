@@ -0,0 +1,38 @@
+# PluginRegistry.cmake
+#
+# Generates static function tables for libraries that export functions which
+# are looked up by name at runtime (grammar actions, native script functions,
+# database drivers). The generated source registers the table with resolve
+# when the library is loaded, both when it is linked into the executable and
+# when it is opened by resolve_library. Functions in a registered table are
+# found by a binary search instead of going through dlsym.
+#
+# plugin_registry(<var> <name> <source>...)
+#
+# Scans the given sources for functions declared __PLUGIN__ or __DLL_EXPORT__
+# and sets <var> to the name of the generated source, which should be added to
+# the library's sources. <var> is empty if OBELIX_PLUGIN_REGISTRY is off.
+
+option(OBELIX_PLUGIN_REGISTRY "Resolve plugin functions using generated static tables" ON)
+
+function(plugin_registry var name)
+  if(OBELIX_PLUGIN_REGISTRY)
+    set(_sources "")
+    foreach(_src ${ARGN})
+      list(APPEND _sources ${CMAKE_CURRENT_SOURCE_DIR}/${_src})
+    endforeach(_src)
+    string(REPLACE ";" "|" _sources_arg "${_sources}")
+    set(_output ${CMAKE_CURRENT_BINARY_DIR}/${name}_registry.c)
+    add_custom_command(
+      OUTPUT ${_output}
+      COMMAND ${CMAKE_COMMAND} -DNAME=${name} -DOUTPUT=${_output} "-DSOURCES=${_sources_arg}"
+              -P ${PROJECT_SOURCE_DIR}/cmake/GeneratePluginRegistry.cmake
+      DEPENDS ${_sources} ${PROJECT_SOURCE_DIR}/cmake/GeneratePluginRegistry.cmake
+      COMMENT "Generating static function table for ${name}"
+      VERBATIM
+    )
+    set(${var} ${_output} PARENT_SCOPE)
+  else(OBELIX_PLUGIN_REGISTRY)
+    set(${var} "" PARENT_SCOPE)
+  endif(OBELIX_PLUGIN_REGISTRY)
+endfunction(plugin_registry)
@@ -0,0 +1,114 @@
+/*
+ * bitset.h - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BITSET_H__
+#define __BITSET_H__
+
+#include <core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Dense set of small non-negative integers, for example token codes. The
+ * set grows as needed when bits beyond its current capacity are added.
+ *
+ * The bitset_bits_ functions work on bare arrays of words of a fixed size,
+ * for callers that keep many sets of the same size packed in one block.
+ */
+
+typedef unsigned long bitset_word_t;
+
+#define BITSET_WORD_BITS      (8 * sizeof(bitset_word_t))
+#define bitset_words(n)       (((n) + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS)
+
+static inline void bitset_bits_set(bitset_word_t *bits, int bit) {
+  bits[bit / BITSET_WORD_BITS] |= ((bitset_word_t) 1) << (bit % BITSET_WORD_BITS);
+}
+
+static inline void bitset_bits_unset(bitset_word_t *bits, int bit) {
+  bits[bit / BITSET_WORD_BITS] &= ~(((bitset_word_t) 1) << (bit % BITSET_WORD_BITS));
+}
+
+static inline int bitset_bits_has(bitset_word_t *bits, int bit) {
+  return (bits[bit / BITSET_WORD_BITS] >> (bit % BITSET_WORD_BITS)) & 1;
+}
+
+/*
+ * Adds all elements of src to dest. Returns non-zero if dest changed.
+ */
+static inline int bitset_bits_union(bitset_word_t *dest, bitset_word_t *src, int words) {
+  int           ix;
+  bitset_word_t old;
+  int           changed = 0;
+
+  for (ix = 0; ix < words; ix++) {
+    old = dest[ix];
+    dest[ix] |= src[ix];
+    changed |= (dest[ix] != old);
+  }
+  return changed;
+}
+
+typedef struct _bitset {
+  int            words;
+  bitset_word_t *bits;
+  char          *str;
+} bitset_t;
+
+OBLCORE_IMPEXP bitset_t * bitset_create(int);
+OBLCORE_IMPEXP void       bitset_free(bitset_t *);
+OBLCORE_IMPEXP bitset_t * bitset_copy(bitset_t *);
+OBLCORE_IMPEXP bitset_t * bitset_resize(bitset_t *, int);
+OBLCORE_IMPEXP bitset_t * bitset_clear(bitset_t *);
+OBLCORE_IMPEXP int        bitset_union(bitset_t *, bitset_t *);
+OBLCORE_IMPEXP int        bitset_disjoint(bitset_t *, bitset_t *);
+OBLCORE_IMPEXP int        bitset_size(bitset_t *);
+OBLCORE_IMPEXP void *     bitset_reduce(bitset_t *, reduce_t, void *);
+OBLCORE_IMPEXP char *     bitset_tostring(bitset_t *);
+
+static inline int bitset_has(bitset_t *set, int bit) {
+  return (set && (bit >= 0) && (bit / (int) BITSET_WORD_BITS < set -> words))
+    ? bitset_bits_has(set -> bits, bit)
+    : 0;
+}
+
+static inline bitset_t * bitset_add(bitset_t *set, int bit) {
+  if (bit / (int) BITSET_WORD_BITS >= set -> words) {
+    bitset_resize(set, bit + 1);
+  }
+  bitset_bits_set(set -> bits, bit);
+  return set;
+}
+
+static inline bitset_t * bitset_remove(bitset_t *set, int bit) {
+  if (bit / (int) BITSET_WORD_BITS < set -> words) {
+    bitset_bits_unset(set -> bits, bit);
+  }
+  return set;
+}
+
+#define bitset_empty(s)       (bitset_size((s)) == 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BITSET_H__ */
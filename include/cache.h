@@ -0,0 +1,70 @@
+/*
+ * /obelix/include/cache.h - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <core.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A cache maps strings to pointers and is meant for tables that are filled
+ * lazily and then mostly read, by any number of threads. Lookups take no
+ * lock at all. Entries can be added but never replaced or removed, and
+ * additions are serialized with a spin lock, so a caller that has to do
+ * expensive work on a miss should hold its own lock while doing it.
+ *
+ * When the table grows the old one is kept until the cache is freed, for
+ * readers that may still be probing it.
+ */
+
+typedef struct _cacheentry {
+  char         *key;
+  unsigned int  hash;
+  void         *value;
+} cacheentry_t;
+
+typedef struct _cachetable {
+  struct _cachetable     *prev;
+  size_t                  capacity;
+  cacheentry_t * volatile slots[];
+} cachetable_t;
+
+typedef struct _cache {
+  cachetable_t * volatile table;
+  volatile int            size;
+  volatile int            busy;
+  free_t                  free_value;
+} cache_t;
+
+OBLCORE_IMPEXP cache_t * cache_create(free_t);
+OBLCORE_IMPEXP void      cache_free(cache_t *);
+OBLCORE_IMPEXP void *    cache_get(cache_t *, const char *);
+OBLCORE_IMPEXP void *    cache_put(cache_t *, const char *, void *);
+OBLCORE_IMPEXP void *    cache_reduce(cache_t *, reduce_t, void *);
+OBLCORE_IMPEXP int       cache_size(cache_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* __CACHE_H__ */
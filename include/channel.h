@@ -0,0 +1,92 @@
+/*
+ * /obelix/include/channel.h - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include <data.h>
+#include <mutex.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A channel is a bounded queue that any number of threads can send to and
+ * receive from. Sending and receiving are lock free as long as the channel
+ * is neither full nor empty: every slot in the ring carries a sequence
+ * number, and senders and receivers claim slots by advancing their
+ * position with compare-and-swap. Only a thread that has to wait takes a
+ * lock, and only then does the other side pay for a wakeup.
+ *
+ * Once a channel is closed sending fails, but receivers still get the
+ * values that were sent before. All timeouts are in milliseconds, and a
+ * negative timeout waits forever. The blocking functions return 0 (or, for
+ * channel_select, the index of the channel) on success and -1 on failure,
+ * with errno set to ETIMEDOUT when the timeout expired or EPIPE when the
+ * channel is closed (and, for receivers, drained).
+ */
+
+#define CHANNEL_PAD    64
+
+struct _chanlink;
+
+typedef struct _chanslot {
+  volatile size_t   sequence;
+  data_t           *value;
+} chanslot_t;
+
+typedef struct _channel {
+  data_t            _d;
+  size_t            capacity;
+  chanslot_t       *slots;
+  char              _pad0[CHANNEL_PAD];
+  volatile size_t   enqueue_pos;
+  char              _pad1[CHANNEL_PAD];
+  volatile size_t   dequeue_pos;
+  char              _pad2[CHANNEL_PAD];
+  volatile int      closed;
+  volatile int      senders;
+  volatile int      waiting_senders;
+  volatile int      waiting_receivers;
+  condition_t      *not_full;
+  condition_t      *not_empty;
+  struct _chanlink *send_waiters;
+  struct _chanlink *recv_waiters;
+} channel_t;
+
+OBLCORE_IMPEXP channel_t * channel_create(int);
+OBLCORE_IMPEXP int         channel_send(channel_t *, data_t *, long);
+OBLCORE_IMPEXP int         channel_recv(channel_t *, data_t **, long);
+OBLCORE_IMPEXP int         channel_close(channel_t *);
+OBLCORE_IMPEXP int         channel_closed(channel_t *);
+OBLCORE_IMPEXP int         channel_size(channel_t *);
+OBLCORE_IMPEXP int         channel_select(channel_t **, int, data_t **, long);
+
+OBLCORE_IMPEXP int Channel;
+OBLCORE_IMPEXP int ChannelIterator;
+OBLCORE_IMPEXP int channel_debug;
+
+type_skel(channel, Channel, channel_t);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* __CHANNEL_H__ */
@@ -0,0 +1,74 @@
+/*
+ * /obelix/include/coroutine.h - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+#include <data.h>
+#include <thread.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Green threads. A coroutine has its own stack and its own thread_t, so
+ * thread_self(), the VM stack frames and the exit code belong to the
+ * coroutine and not to the OS thread running it. Runnable coroutines are
+ * multiplexed over a small set of carrier threads. A coroutine that waits
+ * for a file descriptor or sleeps is suspended and registered with a
+ * reactor thread, which makes it runnable again when the descriptor is
+ * ready or the timeout expires.
+ *
+ * Mutexes and rwlocks belong to the carrier thread that took them, so a
+ * green thread holding one is never suspended: its waits block the carrier
+ * until the lock is released. Mutex and condition waits always block the
+ * carrier. Servers doing either per connection should use OS threads.
+ *
+ * Only available if the platform has ucontext and epoll. Otherwise
+ * coroutine_spawn returns NULL, and callers fall back to thread_new.
+ */
+
+#define COROUTINE_STACK_SIZE     (512 * 1024)
+#define COROUTINE_MAX_CARRIERS   256
+
+typedef enum _coroutine_event {
+  CoroutineRead  = 0x01,
+  CoroutineWrite = 0x02
+} coroutine_event_t;
+
+OBLCORE_IMPEXP thread_t *    coroutine_spawn(char *, threadproc_t, void *);
+OBLCORE_IMPEXP coroutine_t * coroutine_current(void);
+OBLCORE_IMPEXP int           coroutine_yield(void);
+OBLCORE_IMPEXP int           coroutine_sleep(long);
+OBLCORE_IMPEXP int           coroutine_wait_fd(int, int, long);
+OBLCORE_IMPEXP int           coroutine_interrupt(coroutine_t *);
+OBLCORE_IMPEXP void          coroutine_lock_acquired(void);
+OBLCORE_IMPEXP void          coroutine_lock_released(void);
+OBLCORE_IMPEXP void          coroutine_free(coroutine_t *);
+OBLCORE_IMPEXP int           coroutine_carriers(void);
+OBLCORE_IMPEXP int           coroutine_set_carriers(int);
+
+OBLCORE_IMPEXP int coroutine_debug;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* __COROUTINE_H__ */
@@ -22,6 +22,7 @@
 
 #include <core.h>
 #include <array.h>
+#include <cache.h>
 #include <dict.h>
 
 #ifdef  __cplusplus
@@ -124,6 +125,8 @@ typedef enum _vtable_id {
   FunctionUsr8,         /* 47 */
   FunctionUsr9,         /* 48 */
   FunctionUsr10,        /* 49 */
+  FunctionPack,         /* 50 */
+  FunctionUnpack,       /* 51 */
   FunctionEndOfListDummy
 } vtable_id_t;
 
@@ -174,10 +177,10 @@ typedef data_t * (*method_t)(data_t *, char *, arguments_t *);
 /* ------------------------------------------------------------------------ */
 
 typedef struct _kind {
-  data_t  _d;
-  int     type;
-  char   *name;
-  dict_t *methods;
+  data_t   _d;
+  int      type;
+  char    *name;
+  cache_t *methods;
 } kind_t;
 
 typedef struct _interface {
@@ -152,18 +152,31 @@ static inline void_t data_get_function(void  *data, vtable_id_t func) {
       : NULL;
 }
 
+/*
+ * Constant atoms are immortal: they are never freed and their reference
+ * count is left alone, so handing them around never writes to the memory
+ * they live in. That keeps pages shared with a forked child clean.
+ */
 static inline data_t * data_copy(void *src) {
   data_t *s = data_as_data(src);
-  if (s) {
-    s -> refs++;
+  if (s && (s -> free_me != Constant)) {
+    __sync_add_and_fetch(&s -> refs, 1);
   }
   return s;
 }
 
 static inline data_t * data_uncopy(void *src) {
+  data_t *s = data_as_data(src);
+  if (s && (s -> free_me != Constant)) {
+    __sync_sub_and_fetch(&s -> refs, 1);
+  }
+  return s;
+}
+
+static inline data_t * data_make_immortal(void *src) {
   data_t *s = data_as_data(src);
   if (s) {
-    s -> refs--;
+    s -> free_me = Constant;
   }
   return s;
 }
@@ -25,6 +25,9 @@
 #include <sys/stat.h>
 
 #include <core.h>
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif /* HAVE_SYS_UIO_H */
 #include <data.h>
 #include <list.h>
 #include <str.h>
@@ -34,25 +37,75 @@ extern "C" {
 #endif
 
 #define STREAM_BUFSZ       16384
+#define FILE_MMAP_WINDOW   (64 * 1024 * 1024)
 
 extern int file_debug;
 
+#ifdef HAVE_SYS_UIO_H
+typedef int          (*writev_t)(void *, struct iovec *, int);
+#else
+typedef void_t       writev_t;
+#endif /* HAVE_SYS_UIO_H */
+
+typedef enum _stream_bufmode {
+  StreamBuffered,
+  StreamLineBuffered,
+  StreamUnbuffered
+} stream_bufmode_t;
+
+/*
+ * Reads are served from a linear buffer of bufsize bytes. Unconsumed data
+ * lives between pos and len; refilling moves it to the front first. Reads
+ * larger than the buffer bypass it and go to the reader directly.
+ *
+ * Writes collect in wbuffer until it fills up, a line is completed on a
+ * line buffered stream, the stream is about to block reading, or it is
+ * flushed or closed. A write that does not fit is sent together with the
+ * pending data in one vwriter call when the stream has one. Streams with
+ * a write buffer are chained through wprev/wnext so that pending output
+ * can be flushed when the process exits.
+ *
+ * A mapped stream's buffer is a read-only window onto a memory mapped file
+ * and is never copied into; refilling slides the window forward instead.
+ * Files are only mapped on request; see file_map().
+ */
 typedef struct _stream {
-  data_t     _d;
-  str_t     *buffer;
-  read_t     reader;
-  write_t    writer;
-  int        _eof;
-  int        _errno;
-  data_t    *error;
+  data_t           _d;
+  char            *buffer;
+  int              bufsize;
+  int              pos;
+  int              len;
+  int              mapped;
+  char            *wbuffer;
+  int              wlen;
+  int              wsize;
+  stream_bufmode_t bufmode;
+  read_t           reader;
+  write_t          writer;
+  writev_t         vwriter;
+  struct _stream  *wprev;
+  struct _stream  *wnext;
+  int              _eof;
+  int              _errno;
+  data_t          *error;
 } stream_t;
 
 OBLCORE_IMPEXP stream_t *   stream_init(stream_t *, read_t, write_t);
 OBLCORE_IMPEXP data_t *     stream_error(stream_t *);
 OBLCORE_IMPEXP int          stream_read(stream_t *, char *, int);
+OBLCORE_IMPEXP int          stream_readsome(stream_t *, char *, int);
 OBLCORE_IMPEXP int          stream_write(stream_t *, char *, int);
 OBLCORE_IMPEXP int          stream_getchar(stream_t *);
+OBLCORE_IMPEXP int          stream_peek(stream_t *);
+OBLCORE_IMPEXP int          stream_fill(stream_t *);
 OBLCORE_IMPEXP char *       stream_readline(stream_t *);
+OBLCORE_IMPEXP char *       stream_readslice(stream_t *, int *);
+OBLCORE_IMPEXP char *       stream_readall(stream_t *, int *);
+OBLCORE_IMPEXP stream_t *   stream_set_bufsize(stream_t *, int);
+OBLCORE_IMPEXP stream_t *   stream_discard(stream_t *);
+OBLCORE_IMPEXP stream_t *   stream_set_bufmode(stream_t *, stream_bufmode_t);
+OBLCORE_IMPEXP int          stream_flush(stream_t *);
+OBLCORE_IMPEXP void         stream_flush_all(void);
 OBLCORE_IMPEXP int          stream_print(stream_t *, char *, arguments_t *);
 OBLCORE_IMPEXP int          stream_vprintf(stream_t *, char *, va_list);
 OBLCORE_IMPEXP int          stream_printf(stream_t *, char *, ...);
@@ -62,6 +115,8 @@ typedef struct _file {
   stream_t  _stream;
   int       fh;
   char     *fname;
+  off_t     mapoff;
+  off_t     mapsize;
 } file_t;
 
 OBLCORE_IMPEXP int          file_flags(char *);
@@ -74,8 +129,12 @@ OBLCORE_IMPEXP char *       file_name(file_t *);
 OBLCORE_IMPEXP unsigned int file_hash(file_t *);
 OBLCORE_IMPEXP int          file_cmp(file_t *, file_t *);
 OBLCORE_IMPEXP int          file_write(file_t *, char *, int);
+#ifdef HAVE_SYS_UIO_H
+OBLCORE_IMPEXP int          file_writev(file_t *, struct iovec *, int);
+#endif /* HAVE_SYS_UIO_H */
 OBLCORE_IMPEXP int          file_read(file_t *, char *, int);
 OBLCORE_IMPEXP int          file_seek(file_t *, int);
+OBLCORE_IMPEXP int          file_map(file_t *);
 OBLCORE_IMPEXP int          file_isopen(file_t *);
 OBLCORE_IMPEXP int          file_flush(file_t *);
 OBLCORE_IMPEXP int          file_redirect(file_t *, char *);
@@ -91,6 +150,7 @@ type_skel(file, File, file_t);
 #define file_errno(f)              (((stream_t *) (f)) -> _errno)
 #define file_error(f)              (stream_error((stream_t *) (f)))
 #define file_eof(f)                (((stream_t *) (f)) -> _eof)
+#define file_ismapped(f)           (((stream_t *) (f)) -> mapped)
 #define file_getchar(f)            (stream_getchar((stream_t *) (f)))
 #define file_readline(f)           (stream_readline((stream_t *) (f)))
 #define file_print(s, f, a, kw)    (stream_print((stream_t *) (s), (f), (a), (kw)))
@@ -0,0 +1,69 @@
+/*
+ * /obelix/include/future.h - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+
+#include <data.h>
+#include <mutex.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+struct _future;
+
+typedef void (*future_cancel_t)(struct _future *, void *);
+
+/*
+ * A future holds the result of a computation that completes on another
+ * thread. The completing thread hands over its result with future_complete
+ * and never takes a reference to the future itself, so that a future
+ * nobody waits for anymore is freed right away instead of when the work is
+ * done. Instead, whoever completes a future must be told when the future is
+ * freed before it completes. That is what the cancel
+ * callback is for. It runs while the future is being freed, and once it
+ * returns the future must no longer be completed.
+ */
+typedef struct _future {
+  data_t           _d;
+  condition_t     *condition;
+  data_t          *result;
+  int              done;
+  future_cancel_t  cancel;
+  void            *context;
+} future_t;
+
+OBLCORE_IMPEXP future_t * future_create(future_cancel_t, void *);
+OBLCORE_IMPEXP future_t * future_completed(data_t *);
+OBLCORE_IMPEXP int        future_complete(future_t *, data_t *);
+OBLCORE_IMPEXP int        future_done(future_t *);
+OBLCORE_IMPEXP data_t *   future_wait(future_t *);
+OBLCORE_IMPEXP data_t *   future_result(future_t *);
+OBLCORE_IMPEXP data_t *   future_wait_all(datalist_t *);
+
+OBLCORE_IMPEXP int Future;
+
+type_skel(future, Future, future_t);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* __FUTURE_H__ */
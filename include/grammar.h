@@ -23,6 +23,7 @@
 
 #include <oblconfig.h>
 #include <array.h>
+#include <bitset.h>
 #include <dict.h>
 #include <function.h>
 #include <lexer.h>
@@ -88,16 +89,16 @@ typedef struct _nonterminal {
   int                      state;
   char                    *name;
   array_t                 *rules;
-  set_t                   *firsts;
-  set_t                   *follows;
+  bitset_t                *firsts;
+  bitset_t                *follows;
   dict_t                  *parse_table;
 } nonterminal_t;
 
 typedef struct _rule {
   ge_t                     ge;
   array_t                 *entries;
-  set_t                   *firsts;
-  set_t                   *follows;
+  bitset_t                *firsts;
+  bitset_t                *follows;
 } rule_t;
 
 typedef struct _rule_entry {
@@ -109,6 +110,32 @@ typedef struct _rule_entry {
   };
 } rule_entry_t;
 
+typedef struct _lr_production {
+  int                      lhs;
+  int                      length;
+  int                     *rhs;
+  int                      num_actions;
+  grammar_action_t       **actions;
+  int                      lookahead;
+  rule_t                  *rule;
+} lr_production_t;
+
+typedef struct _lr_table {
+  int                      num_terminals;
+  int                      num_nonterminals;
+  int                      num_productions;
+  int                      num_states;
+  int                      max_code;
+  int                     *terminals;
+  lr_production_t         *productions;
+  int                     *action;
+  int                     *goto_table;
+  int                     *default_reduction;
+  unsigned int             fingerprint;
+  void                    *image;
+  size_t                   image_size;
+} lr_table_t;
+
 typedef struct _grammar {
   ge_t            ge;
   dict_t         *nonterminals;
@@ -120,6 +147,7 @@ typedef struct _grammar {
   char           *build_func;
   array_t        *libs;
   int             dryrun;
+  lr_table_t     *lr_table;
 } grammar_t;
 
 /* ----------------------------------------------------------------------- */
@@ -204,6 +232,33 @@ OBLGRAMMAR_IMPEXP rule_entry_t *          rule_entry_empty(rule_t *);
 #define rule_entry_free(re)               (data_free((data_t *) (re)))
 #define rule_entry_tostring(re)           (data_tostring((data_t *) (re)))
 
+OBLGRAMMAR_IMPEXP lr_table_t *            lr_table_create(grammar_t *);
+OBLGRAMMAR_IMPEXP void                    lr_table_free(lr_table_t *);
+OBLGRAMMAR_IMPEXP void                    lr_table_set_image_dir(char *);
+OBLGRAMMAR_IMPEXP char *                  lr_table_get_image_dir(void);
+
+/*
+ * Action table encoding: 0 is a syntax error, a positive value n is a shift
+ * to state n - 1, and a negative value n is a reduction by production
+ * -n - 1. A reduction by production 0 (the augmented start production)
+ * means the input is accepted.
+ */
+static inline int lr_table_action(lr_table_t *table, int state, int code) {
+  int terminal;
+
+  if ((code < 0) || (code > table -> max_code)) {
+    return 0;
+  }
+  terminal = table -> terminals[code];
+  return (terminal >= 0)
+    ? table -> action[state * table -> num_terminals + terminal]
+    : 0;
+}
+
+static inline int lr_table_goto(lr_table_t *table, int state, int nonterminal) {
+  return table -> goto_table[state * table -> num_nonterminals + nonterminal];
+}
+
 #ifdef __cplusplus
 }
 #endif
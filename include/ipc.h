@@ -28,8 +28,10 @@
 #include <arguments.h>
 #include <data.h>
 #include <dictionary.h>
+#include <future.h>
 #include <name.h>
 #include <net.h>
+#include <thread.h>
 
 #define FunctionRegisterServer          FunctionUsr1
 #define FunctionUnregisterServer        FunctionUsr2
@@ -47,15 +49,30 @@ typedef struct _mountpoint {
   condition_t *wait;
   char        *prefix;
   char        *version;
+  int          binary;
   int          maxclients;
   int          current;
   list_t      *clients;
+  list_t      *shared;
 } mountpoint_t;
 
+/*
+ * A client on a binary connection can be shared by several threads. The
+ * send lock serializes writing requests. Futures for requests that are in
+ * flight are kept in pending, keyed by request id, and guarded by lock. A
+ * reader thread completes them as the replies come in.
+ */
 typedef struct _client {
   data_t        _d;
   mountpoint_t *mountpoint;
   stream_t     *socket;
+  int           binary;
+  unsigned int  next_id;
+  mutex_t      *send_lock;
+  condition_t  *lock;
+  dict_t       *pending;
+  thread_t     *reader;
+  int           dead;
 } client_t;
 
 typedef struct _remote {
@@ -64,22 +81,44 @@ typedef struct _remote {
   name_t       *name;
 } remote_t;
 
+/*
+ * With maxinflight set, CALLs on a binary connection are submitted to the
+ * thread pool and answered as they complete, while the connection keeps
+ * reading. Once maxinflight calls are in flight the connection is paused,
+ * and the call that completes first resumes it. The counters are guarded
+ * by lock; send_lock serializes writing replies.
+ */
 typedef struct _server {
-  data_t    _d;
-  data_t   *engine;
-  stream_t *stream;
-  data_t   *mountpoint;
-  data_t   *data;
+  data_t        _d;
+  data_t       *engine;
+  stream_t     *stream;
+  data_t       *mountpoint;
+  data_t       *data;
+  int           binary;
+  int           maxinflight;
+  int           inflight;
+  int           paused;
+  connection_t *connection;
+  condition_t  *lock;
+  mutex_t      *send_lock;
 } server_t;
 
+/*
+ * Messages travel either as a text line optionally followed by a JSON
+ * payload, or as a binary frame carrying packed arguments and payload. A
+ * binary message carries the id of the request it answers, which allows a
+ * client to have several requests outstanding on one connection.
+ */
 typedef struct _servermessage {
-  data_t      _d;
-  int         code;
-  char       *tag;
-  datalist_t *args;
-  data_t     *payload;
-  char       *encoded;
-  int         payload_size;
+  data_t        _d;
+  int           code;
+  char         *tag;
+  unsigned int  id;
+  int           binary;
+  datalist_t   *args;
+  data_t       *payload;
+  char         *encoded;
+  int           payload_size;
 } servermessage_t;
 
 /* ------------------------------------------------------------------------ */
@@ -91,6 +130,7 @@ type_skel(mountpoint, Mountpoint, mountpoint_t);
 OBLIPC_IMPEXP data_t *       mountpoint_create(uri_t *, char *);
 OBLIPC_IMPEXP data_t *       mountpoint_checkout_client(mountpoint_t *);
 OBLIPC_IMPEXP mountpoint_t * mountpoint_return_client(mountpoint_t *, client_t *);
+OBLIPC_IMPEXP data_t *       mountpoint_call_async(mountpoint_t *, remote_t *, arguments_t *);
 
 /* ------------------------------------------------------------------------ */
 
@@ -98,6 +138,8 @@ OBLIPC_IMPEXP int Remote;
 
 type_skel(remote, Remote, remote_t);
 
+OBLIPC_IMPEXP data_t *      remote_call_async(remote_t *, arguments_t *);
+
 /* ------------------------------------------------------------------------ */
 
 OBLIPC_IMPEXP int Client;
@@ -105,13 +147,21 @@ OBLIPC_IMPEXP int Client;
 type_skel(client, Client, client_t);
 
 OBLIPC_IMPEXP data_t *      client_create(mountpoint_t *);
+OBLIPC_IMPEXP data_t *      client_submit(client_t *, remote_t *, arguments_t *);
+OBLIPC_IMPEXP data_t *      client_receive(client_t *);
+OBLIPC_IMPEXP data_t *      client_result(servermessage_t *);
 OBLIPC_IMPEXP data_t *      client_run(client_t *, remote_t *, arguments_t *);
+OBLIPC_IMPEXP data_t *      client_call_async(client_t *, remote_t *, arguments_t *);
+OBLIPC_IMPEXP int           client_inflight(client_t *);
 
 /* ------------------------------------------------------------------------ */
 
 OBLIPC_IMPEXP server_t *    server_create(data_t *, stream_t *);
+OBLIPC_IMPEXP server_t *    server_set_maxinflight(server_t *, int);
 OBLIPC_IMPEXP server_t *    server_run(server_t *);
-OBLIPC_IMPEXP int           server_start(data_t *, int);
+OBLIPC_IMPEXP int           server_start(data_t *, int, int);
+OBLIPC_IMPEXP int           server_start_byservice(data_t *, char *);
+OBLIPC_IMPEXP int           server_serve(data_t *, char *, int);
 
 OBLIPC_IMPEXP int           Server;
 
@@ -130,6 +180,7 @@ OBLIPC_IMPEXP data_t *          servermessage_match_payload(servermessage_t *, i
 OBLIPC_IMPEXP servermessage_t * servermessage_push_int(servermessage_t *, int);
 OBLIPC_IMPEXP servermessage_t * servermessage_push(servermessage_t *, char *);
 OBLIPC_IMPEXP servermessage_t * servermessage_set_payload(servermessage_t *, data_t *);
+OBLIPC_IMPEXP servermessage_t * servermessage_encode_payload(servermessage_t *);
 
 type_skel(servermessage, ServerMessage, servermessage_t);
 
@@ -146,10 +197,11 @@ OBLIPC_IMPEXP data_t *      protocol_readline(stream_t *);
 OBLIPC_IMPEXP data_t *      protocol_send_data(stream_t *, int code, data_t *);
 OBLIPC_IMPEXP data_t *      protocol_send_message(stream_t *, servermessage_t *);
 OBLIPC_IMPEXP data_t *      protocol_send_handshake(stream_t *, mountpoint_t *);
-OBLIPC_IMPEXP data_t *      protocol_return_result(stream_t *, data_t *);
+OBLIPC_IMPEXP data_t *      protocol_return_result(stream_t *, servermessage_t *, data_t *);
 
 OBLIPC_IMPEXP data_t *      protocol_expect(stream_t *, int, int, ...);
 OBLIPC_IMPEXP data_t *      protocol_read_message(stream_t *);
+OBLIPC_IMPEXP int           protocol_message_buffered(stream_t *);
 
 OBLIPC_IMPEXP name_t *      protocol_build_name(char *);
 
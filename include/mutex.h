@@ -35,8 +35,42 @@
 extern "C" {
 #endif
 
+typedef enum _mutexflag {
+  MutexNone      = 0x0000,
+  MutexRecursive = 0x0001
+} mutexflag_t;
+
+/*
+ * Every lock keeps counters of how often it was taken, how often it was
+ * already held by another thread, how long threads waited for it in total
+ * and the longest time it was held. The counters of a mutex are only
+ * updated by the thread holding it, those of a rwlock atomically. Hold
+ * times are only measured while the 'lockprofile' category is enabled.
+ * Times are in nanoseconds. All locks are linked in a process wide list
+ * that mutex_report uses to list the most contended ones.
+ */
+typedef struct _lockstats {
+  struct _lockstats  *prev;
+  struct _lockstats  *next;
+  data_t             *lock;
+  unsigned long       acquisitions;
+  unsigned long       contended;
+  unsigned long long  wait_time;
+  unsigned long long  max_hold;
+} lockstats_t;
+
+/*
+ * A contended mutex is first spun on for a while before the thread parks.
+ * The number of spins adapts to how long it took to get the mutex in the
+ * past, and there is no spinning at all on a single CPU.
+ */
 typedef struct _mutex {
   data_t             _d;
+  int                flags;
+  int                spin;
+  int                depth;
+  unsigned long long held_since;
+  lockstats_t        stats;
 #ifdef HAVE_PTHREAD_H
   pthread_mutex_t    mutex;
 #elif defined(HAVE_INITIALIZECRITICALSECTION)
@@ -44,6 +78,19 @@ typedef struct _mutex {
 #endif /* HAVE_PTHREAD_H */
 } mutex_t;
 
+typedef struct _rwlock {
+  data_t             _d;
+  int                spin;
+  volatile int       writer;
+  unsigned long long held_since;
+  lockstats_t        stats;
+#ifdef HAVE_PTHREAD_H
+  pthread_rwlock_t   rwlock;
+#elif defined(HAVE_INITIALIZECRITICALSECTION)
+  SRWLOCK            rwlock;
+#endif /* HAVE_PTHREAD_H */
+} rwlock_t;
+
 typedef struct _condition {
   data_t             _d;
   mutex_t           *mutex;
@@ -57,11 +104,20 @@ typedef struct _condition {
 
 OBLCORE_IMPEXP mutex_t *     mutex_create(void);
 OBLCORE_IMPEXP mutex_t *     mutex_create_withname(char *);
+OBLCORE_IMPEXP mutex_t *     mutex_create_with_flags(char *, int);
 OBLCORE_IMPEXP unsigned int  mutex_hash(mutex_t *);
 OBLCORE_IMPEXP int           mutex_cmp(mutex_t *, mutex_t *);
 OBLCORE_IMPEXP int           mutex_lock(mutex_t *);
 OBLCORE_IMPEXP int           mutex_trylock(mutex_t *);
 OBLCORE_IMPEXP int           mutex_unlock(mutex_t *);
+OBLCORE_IMPEXP char *        mutex_report(int);
+
+OBLCORE_IMPEXP rwlock_t *    rwlock_create(char *);
+OBLCORE_IMPEXP int           rwlock_rdlock(rwlock_t *);
+OBLCORE_IMPEXP int           rwlock_wrlock(rwlock_t *);
+OBLCORE_IMPEXP int           rwlock_tryrdlock(rwlock_t *);
+OBLCORE_IMPEXP int           rwlock_trywrlock(rwlock_t *);
+OBLCORE_IMPEXP int           rwlock_unlock(rwlock_t *);
 
 OBLCORE_IMPEXP condition_t * condition_create();
 OBLCORE_IMPEXP unsigned int  condition_hash(condition_t *);
@@ -70,7 +126,9 @@ OBLCORE_IMPEXP int           condition_acquire(condition_t *);
 OBLCORE_IMPEXP int           condition_tryacquire(condition_t *);
 OBLCORE_IMPEXP int           condition_release(condition_t *);
 OBLCORE_IMPEXP int           condition_wakeup(condition_t *);
+OBLCORE_IMPEXP int           condition_broadcast(condition_t *);
 OBLCORE_IMPEXP int           condition_sleep(condition_t *);
+OBLCORE_IMPEXP int           condition_sleep_timeout(condition_t *, long);
 
 #define data_is_mutex(d)      ((d) && (data_hastype((d), Mutex)))
 #define data_as_mutex(d)      ((mutex_t *) (data_is_mutex((d)) ? (d) : NULL))
@@ -78,12 +136,21 @@ OBLCORE_IMPEXP int           condition_sleep(condition_t *);
 #define mutex_tostring(o)     (data_tostring((data_t *) (o)))
 #define mutex_copy(o)         ((mutex_t *) data_copy((data_t *) (o)))
 
+#define data_is_rwlock(d)     ((d) && (data_hastype((d), RWLock)))
+#define data_as_rwlock(d)     ((rwlock_t *) (data_is_rwlock((d)) ? (d) : NULL))
+#define rwlock_free(o)        (data_free((data_t *) (o)))
+#define rwlock_tostring(o)    (data_tostring((data_t *) (o)))
+#define rwlock_copy(o)        ((rwlock_t *) data_copy((data_t *) (o)))
+
 #define data_is_condition(d)  ((d) && (data_hastype((d), Condition)))
 #define data_as_condition(d)  ((condition_t *) (data_is_condition((d)) ? (d) : NULL))
 #define condition_free(o)     (data_free((data_t *) (o)))
 #define condition_tostring(o) (data_tostring((data_t *) (o)))
 #define condition_copy(o)     ((condition_t *) data_copy((data_t *) (o)))
 
+OBLCORE_IMPEXP int RWLock;
+OBLCORE_IMPEXP int mutex_profile;
+
 #ifdef	__cplusplus
 }
 #endif
@@ -75,15 +75,58 @@ type_skel(uri, URI, uri_t);
 
 /* ------------------------------------------------------------------------ */
 
+/*
+ * state is for the service. It can keep per-connection data there between
+ * calls made with SERVICE_KEEPALIVE, and it is freed with the connection.
+ * resume and resumed are used by connection_resume().
+ */
 typedef struct _connection {
   struct _socket *server;
   struct _socket *client;
   data_t         *context;
+  data_t         *state;
   thread_t       *thread;
+  condition_t    *resume;
+  int             resumed;
 } connection_t;
 
 typedef void * (*service_t)(connection_t *);
 
+/*
+ * A service called through socket_serve() can return SERVICE_KEEPALIVE to
+ * hand the connection back to the event loop. It is then called again when
+ * the client sends more data. Any other return value closes the connection.
+ */
+#define SERVICE_KEEPALIVE          ((void *) -1)
+
+/*
+ * Like SERVICE_KEEPALIVE, for a service that found only part of a request
+ * in the stream buffer. It is not called again until more data arrives.
+ */
+#define SERVICE_INCOMPLETE         ((void *) -2)
+
+/*
+ * Like SERVICE_KEEPALIVE, but the connection is not read and the service
+ * is not called again until somebody calls connection_resume(). A resume
+ * that comes in before the service returned is not lost.
+ */
+#define SERVICE_PAUSE              ((void *) -3)
+#define SOCKET_DEFAULT_BACKLOG     128
+
+/*
+ * A service name of the form "unix:/path/to/socket" selects a Unix domain
+ * stream socket instead of TCP.
+ */
+#define SOCKET_UNIX_PREFIX         "unix:"
+#define SOCKET_UNIX_HOST           "localhost"
+
+typedef struct _serve_options {
+  int backlog;          /* listen(2) backlog. 0: SOCKET_DEFAULT_BACKLOG     */
+  int max_connections;  /* Connections beyond this are refused. 0: no limit */
+  int workers;          /* Threads running service calls. 0: 2 per CPU      */
+  int acceptors;        /* Listening sockets sharing the port. 0: 1         */
+} serve_options_t;
+
 typedef struct _socket {
   stream_t   _stream;
   SOCKET     fh;
@@ -94,6 +137,11 @@ typedef struct _socket {
   service_t  service_handler;
   thread_t  *thread;
   void      *context;
+  int        read_timeout;
+  int        write_timeout;
+  int        green;
+  long       unix_owner;
+  long       unix_inode;
 } socket_t;
 
 OBLNET_IMPEXP socket_t *           socket_create(char *, int);
@@ -102,20 +150,29 @@ OBLNET_IMPEXP socket_t *           socket_open(uri_t *);
 OBLNET_IMPEXP socket_t *           serversocket_create(int);
 OBLNET_IMPEXP socket_t *           serversocket_create_byservice(char *);
 OBLNET_IMPEXP int                  socket_close(socket_t *);
+OBLNET_IMPEXP int                  socket_shutdown(socket_t *);
 OBLNET_IMPEXP unsigned int         socket_hash(socket_t *);
 OBLNET_IMPEXP int                  socket_cmp(socket_t *, socket_t *);
 OBLNET_IMPEXP int                  socket_listen(socket_t *, service_t, void *);
 OBLNET_IMPEXP int                  socket_listen_detach(socket_t *, service_t, void *);
+OBLNET_IMPEXP int                  socket_listen_green(socket_t *, service_t, void *);
+OBLNET_IMPEXP int                  socket_serve(socket_t *, service_t, void *, serve_options_t *);
+OBLNET_IMPEXP int                  socket_serve_detach(socket_t *, service_t, void *, serve_options_t *);
 OBLNET_IMPEXP socket_t *           socket_interrupt(socket_t *);
 OBLNET_IMPEXP socket_t *           socket_nonblock(socket_t *);
+OBLNET_IMPEXP socket_t *           socket_set_timeout(socket_t *, int, int);
 OBLNET_IMPEXP int                  socket_read(socket_t *, void *, int);
 OBLNET_IMPEXP int                  socket_write(socket_t *, void *, int);
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UIO_H)
+OBLNET_IMPEXP int                  socket_writev(socket_t *, struct iovec *, int);
+#endif
 OBLNET_IMPEXP socket_t *           socket_clear_error(socket_t *);
 OBLNET_IMPEXP socket_t *           socket_set_errormsg(socket_t *, char *, ...);
 OBLNET_IMPEXP socket_t *           socket_set_error(socket_t *, data_t *);
 OBLNET_IMPEXP socket_t *           socket_set_errno(socket_t *, char *);
 
 OBLNET_IMPEXP void *               connection_listener_service(connection_t *);
+OBLNET_IMPEXP void                 connection_resume(connection_t *);
 
 OBLNET_IMPEXP int Socket;
 OBLNET_IMPEXP int ErrorSocket;
@@ -136,6 +193,10 @@ static inline data_t * socket_error(socket_t *socket) {
   return ((stream_t *) socket) -> error;
 }
 
+static inline int socket_is_unix_service(char *service) {
+  return service && !strncmp(service, SOCKET_UNIX_PREFIX, strlen(SOCKET_UNIX_PREFIX));
+}
+
 #ifdef	__cplusplus
 }
 #endif
@@ -0,0 +1,95 @@
+/*
+ * /obelix/include/pack.h - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include <stdint.h>
+#include <data.h>
+
+/*
+ * Compact binary encoding of data_t values. Every value starts with a one
+ * byte tag. Integers and lengths are varints, floats are 8 bytes in network
+ * byte order, strings are length-prefixed and containers are prefixed with
+ * their element count.
+ *
+ * Types can take part by implementing FunctionPack, which returns a value
+ * of the types above describing the object, and FunctionUnpack, which
+ * rebuilds the object from it. Such a value is packed as PackTyped followed
+ * by the varint type id of its type, or as PackNamed followed by the type
+ * name if the type has no id in the registry. Values of all other types are
+ * packed in the form data_serialize produces and rebuilt with
+ * data_deserialize.
+ */
+
+typedef enum _packtag {
+  PackNull = 0,
+  PackFalse,
+  PackTrue,
+  PackInt,
+  PackFloat,
+  PackString,
+  PackList,
+  PackDictionary,
+  PackSerialized,
+  PackTyped,
+  PackNamed
+} packtag_t;
+
+/*
+ * Type ids on the wire. They must never change once assigned. Types outside
+ * libcore register their ids with pack_register_type, starting at
+ * PackTypeUser.
+ */
+typedef enum _packtypeid {
+  PackTypeNone = 0,
+  PackTypeArguments,
+  PackTypeException,
+  PackTypeUser = 64,
+  PackTypeDatetime = PackTypeUser,
+  PackTypeDate,
+  PackTypeTime
+} packtypeid_t;
+
+/* FunctionPack and FunctionUnpack */
+typedef data_t * (*pack_t)(data_t *);
+typedef data_t * (*unpack_t)(int, data_t *);
+
+typedef struct _packer {
+  unsigned char *buffer;
+  size_t         len;
+  size_t         size;
+  int            depth;
+  int            serialized;
+  int            error;
+} packer_t;
+
+OBLCORE_IMPEXP packer_t *  packer_init(packer_t *);
+OBLCORE_IMPEXP void        packer_release(packer_t *);
+OBLCORE_IMPEXP packer_t *  packer_reset(packer_t *);
+OBLCORE_IMPEXP packer_t *  packer_write(packer_t *, const void *, size_t);
+OBLCORE_IMPEXP packer_t *  packer_write_varint(packer_t *, uint64_t);
+OBLCORE_IMPEXP packer_t *  packer_pack(packer_t *, data_t *);
+
+OBLCORE_IMPEXP int         pack_register_type(int, unsigned int);
+OBLCORE_IMPEXP size_t      pack_read_varint(const unsigned char *, size_t, uint64_t *);
+OBLCORE_IMPEXP char *      data_pack(data_t *, size_t *);
+OBLCORE_IMPEXP data_t *    data_unpack(const void *, size_t, size_t *);
+
+#endif /* __PACK_H__ */
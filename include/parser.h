@@ -50,6 +50,11 @@ typedef enum {
   ParserStateError = 0x20
 } parser_state_t;
 
+typedef struct _parser_lr_entry {
+  int             state;
+  token_t        *token;
+} parser_lr_entry_t;
+
 typedef struct _parser {
   dictionary_t    _d;
   grammar_t      *grammar;
@@ -61,6 +66,9 @@ typedef struct _parser {
   data_t         *error;
   datastack_t    *stack;
   dict_t         *variables;
+  parser_lr_entry_t *lr_stack;
+  int             lr_top;
+  int             lr_size;
 } parser_t;
 
 type_skel(parser, Parser, parser_t);
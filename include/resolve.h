@@ -22,6 +22,7 @@
 #define __RESOLVE_H__
 
 #include <list.h>
+#include <cache.h>
 #include <dict.h>
 #include <mutex.h>
 
@@ -42,17 +43,32 @@ typedef struct _resolve_handle {
   struct _resolve_handle *next;
 } resolve_handle_t;
 
+/*
+ * Entry in a static function table. Libraries register a table of the
+ * functions they export, sorted by name, when they are loaded; see
+ * cmake/PluginRegistry.cmake.
+ * Names found in a registered table are resolved without going through
+ * dlsym/GetProcAddress. The table is terminated by an entry with a NULL
+ * name.
+ */
+typedef struct _resolve_static {
+  char             *name;
+  void_t            fnc;
+} resolve_static_t;
+
 typedef struct _resolve {
   resolve_handle_t *images;
-  dict_t           *functions;
+  cache_t          *functions;
 } resolve_t;
 
 OBLCORE_IMPEXP resolve_t * resolve_get(void);
 OBLCORE_IMPEXP void        resolve_free(void);
 OBLCORE_IMPEXP resolve_t * resolve_open(resolve_t *, char *);
 OBLCORE_IMPEXP void_t      resolve_resolve(resolve_t *, char *);
+OBLCORE_IMPEXP int         resolve_register_functions(resolve_static_t *);
 
 OBLCORE_IMPEXP int         resolve_library(char *);
 OBLCORE_IMPEXP void_t      resolve_function(char *);
+OBLCORE_IMPEXP unsigned int resolve_build_id(void *, unsigned char *, unsigned int);
 
   #endif /* __RESOLVE_H__ */
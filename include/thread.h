@@ -47,9 +47,13 @@ typedef enum _thread_status_flag {
   TSFLeave = 0x0001
 } thread_status_flag_t;
 
+/* Green threads, see coroutine.h */
+typedef struct _coroutine coroutine_t;
+
 typedef struct _thread {
   data_t           _d;
   _thr_t           thread;
+  coroutine_t     *coroutine;
   mutex_t         *mutex;
   struct _thread  *parent;
   data_t          *kernel;
@@ -57,6 +61,7 @@ typedef struct _thread {
   free_t           onfree;
   int              status;
   data_t          *exit_code;
+  volatile int     interrupted;
   char            *name;
   int              _errno;
 } thread_t;
@@ -66,6 +71,8 @@ typedef void * (*threadproc_t)(void *);
 OBLCORE_IMPEXP thread_t *    thread_create(_thr_t, char *);
 OBLCORE_IMPEXP thread_t *    thread_new(char *, threadproc_t, void *);
 OBLCORE_IMPEXP thread_t *    thread_self(void);
+OBLCORE_IMPEXP thread_t *    thread_create_green(coroutine_t *, char *);
+OBLCORE_IMPEXP thread_t *    thread_switch(thread_t *);
 OBLCORE_IMPEXP unsigned int  thread_hash(thread_t *);
 OBLCORE_IMPEXP int           thread_cmp(thread_t *, thread_t *);
 OBLCORE_IMPEXP int           thread_interruptable(thread_t *);
@@ -88,6 +95,21 @@ OBLCORE_IMPEXP data_t *      data_thread_set_exit_code(data_t *);
 OBLCORE_IMPEXP data_t *      data_thread_exit_code(void);
 OBLCORE_IMPEXP void          data_thread_clear_exit_code(void);
 
+/*
+ * Safepoints. Code running scripts does not look at the exit code and the
+ * interrupt flag of its thread all the time. Instead it polls
+ * thread_safepoint at loop back-edges and calls, and only when that is
+ * non-zero calls thread_safepoint_poll. thread_safepoint counts the
+ * pending requests: exit codes set, interrupts not yet picked up by their
+ * thread, and signals. thread_safepoint_signal is async signal safe.
+ */
+OBLCORE_IMPEXP void          thread_safepoint_request(void);
+OBLCORE_IMPEXP void          thread_safepoint_release(void);
+OBLCORE_IMPEXP void          thread_safepoint_signal(int);
+OBLCORE_IMPEXP data_t *      thread_safepoint_poll(void);
+
+OBLCORE_IMPEXP volatile int thread_safepoint;
+
 OBLCORE_IMPEXP int thread_debug;
 
 type_skel(thread, Thread, thread_t);
@@ -0,0 +1,66 @@
+/*
+ * /obelix/include/threadpool.h - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <data.h>
+#include <future.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Process wide pool of worker threads. Every worker owns a queue of jobs.
+ * Jobs submitted from a worker go to the back of its own queue and are
+ * picked up from there first; idle workers steal from the front of the
+ * queues of the others. At most threadpool_size() workers run jobs at the
+ * same time. A worker that blocks in future_wait does not count against
+ * that bound, and if that would leave queued jobs without a worker an
+ * extra one is started.
+ */
+
+#define THREADPOOL_MAX_WORKERS     256
+
+typedef data_t * (*pooljob_t)(void *);
+
+OBLCORE_IMPEXP future_t * threadpool_submit(char *, pooljob_t, void *, free_t);
+OBLCORE_IMPEXP int        threadpool_size(void);
+OBLCORE_IMPEXP int        threadpool_set_size(int);
+OBLCORE_IMPEXP int        threadpool_enter_blocking(void);
+OBLCORE_IMPEXP void       threadpool_leave_blocking(void);
+
+/*
+ * Parallel map, filter and reduce. The values are collected up front and
+ * split in chunks that run as pool jobs; results are combined in the order
+ * of the values. These wait for all chunks, so they can be called from a
+ * pool worker.
+ */
+OBLCORE_IMPEXP data_t *   threadpool_map(data_t *, data_t *, int);
+OBLCORE_IMPEXP data_t *   threadpool_filter(data_t *, data_t *, int);
+OBLCORE_IMPEXP data_t *   threadpool_reduce(data_t *, data_t *, data_t *, int);
+
+OBLCORE_IMPEXP int threadpool_debug;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* __THREADPOOL_H__ */
@@ -30,6 +30,7 @@
 #include <name.h>
 #include <nvp.h>
 #include <set.h>
+#include <thread.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -96,6 +97,7 @@ struct _module {
   data_t      *source;
   namespace_t *ns;
   modstate_t   state;
+  thread_t    *loader;
   object_t    *obj;
   closure_t   *closure;
   set_t       *imports;
@@ -121,16 +123,20 @@ type_skel(mod, Module, module_t);
 /* -- N A M E S P A C E _ T ----------------------------------------------- */
 
 struct _namespace {
-  data_t    _d;
-  char     *name;
-  void     *import_ctx;
-  import_t  import_fnc;
-  data_t   *exit_code;
-  dict_t   *modules;
+  data_t       _d;
+  char        *name;
+  void        *import_ctx;
+  import_t     import_fnc;
+  data_t      *exit_code;
+  cache_t     *modules;
+  condition_t *loaded;
+  dict_t      *waits;
 };
 
 OBLVM_IMPEXP namespace_t * ns_create(char *, void *, import_t);
 OBLVM_IMPEXP data_t *      ns_import(namespace_t *, name_t *);
+OBLVM_IMPEXP module_t *    ns_declare(namespace_t *, name_t *);
+OBLVM_IMPEXP namespace_t * ns_make_immortal(namespace_t *);
 OBLVM_IMPEXP data_t *      ns_execute(namespace_t *, name_t *, arguments_t *);
 OBLVM_IMPEXP data_t *      ns_get(namespace_t *, name_t *);
 OBLVM_IMPEXP namespace_t * ns_exit(namespace_t *, data_t *);
@@ -470,6 +476,10 @@ typedef struct _debugger {
   debugcmd_t     last_command;
 } debugger_t;
 
+/*
+ * Only while the 'trace' category is enabled do VMs use the instrumented
+ * dispatch path and create a debugger_t, which starts out single stepping.
+ */
 OBLVM_IMPEXP debugger_t * debugger_create(vm_t *vm, data_t *scope);
 OBLVM_IMPEXP void         debugger_start(debugger_t *);
 OBLVM_IMPEXP debugcmd_t   debugger_step_before(debugger_t *, instruction_t *);
@@ -0,0 +1,332 @@
+/*
+ * forkserver.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <oblconfig.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+
+#include "obelix.h"
+#include <ipc.h>
+
+/*
+ * The fork server initializes a script loader once, imports the modules
+ * it is told to preload, and then forks a child for every script it is
+ * asked to run. The children start out with the grammar, the loader and
+ * the preloaded modules in place, and share the pages they live in with
+ * the server until they write to them. To keep it that way the preloaded
+ * modules are made immortal, so that using them doesn't touch their
+ * reference counts.
+ *
+ * A client connects to the server's Unix socket and sends a request. That
+ * is a 32 bit length in host byte order, which carries the client's stdin,
+ * stdout and stderr as SCM_RIGHTS ancillary data, followed by that many
+ * bytes of NUL terminated strings: the client's working directory, the
+ * script, and the script's arguments. The child running the script writes
+ * directly to the client's descriptors, and when it is done it sends back
+ * the exit code as a line of text. If the connection is closed without an
+ * exit code the child died.
+ */
+
+#define FORKSERVER_FDS           3
+#define FORKSERVER_MAX_REQUEST   (1024 * 1024)
+
+static char *   _forkserver_append(char *, size_t *, char *);
+static int      _forkserver_send(int, char *, size_t);
+static char *   _forkserver_receive(int, size_t *);
+static int      _forkserver_read(int, char *, size_t);
+static int      _forkserver_child(obelix_t *, scriptloader_t *, int);
+static data_t * _forkserver_preload(scriptloader_t *, array_t *);
+
+/* ------------------------------------------------------------------------ */
+
+char * _forkserver_append(char *request, size_t *len, char *s) {
+  size_t sz = strlen(s) + 1;
+
+  request = (char *) resize_block(request, *len + sz, *len);
+  memcpy(request + *len, s, sz);
+  *len += sz;
+  return request;
+}
+
+int _forkserver_send(int fd, char *request, size_t len) {
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  uint32_t        sz = (uint32_t) len;
+  int             fds[FORKSERVER_FDS] = { 0, 1, 2 };
+  char            control[CMSG_SPACE(sizeof(fds))];
+  ssize_t         written;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  iov.iov_base = &sz;
+  iov.iov_len = sizeof(sz);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg -> cmsg_level = SOL_SOCKET;
+  cmsg -> cmsg_type = SCM_RIGHTS;
+  cmsg -> cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  while (((written = sendmsg(fd, &msg, 0)) < 0) && (errno == EINTR));
+  if (written != (ssize_t) sizeof(sz)) {
+    return -1;
+  }
+  for (; len; len -= written, request += written) {
+    while (((written = write(fd, request, len)) < 0) && (errno == EINTR));
+    if (written <= 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int _forkserver_read(int fd, char *buf, size_t len) {
+  ssize_t r;
+
+  for (; len; len -= r, buf += r) {
+    while (((r = read(fd, buf, len)) < 0) && (errno == EINTR));
+    if (r <= 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Reads a request and installs the descriptors that came with it as this
+ * process' stdin, stdout and stderr.
+ */
+char * _forkserver_receive(int fd, size_t *len) {
+  struct msghdr   msg;
+  struct iovec    iov;
+  struct cmsghdr *cmsg;
+  uint32_t        sz = 0;
+  int             fds[FORKSERVER_FDS];
+  char            control[CMSG_SPACE(sizeof(fds))];
+  char           *request;
+  ssize_t         r;
+  int             ix;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &sz;
+  iov.iov_len = sizeof(sz);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  while (((r = recvmsg(fd, &msg, 0)) < 0) && (errno == EINTR));
+  if ((r != (ssize_t) sizeof(sz)) || !sz || (sz > FORKSERVER_MAX_REQUEST)) {
+    return NULL;
+  }
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || (cmsg -> cmsg_type != SCM_RIGHTS) ||
+      (cmsg -> cmsg_len != CMSG_LEN(sizeof(fds)))) {
+    return NULL;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  for (ix = 0; ix < FORKSERVER_FDS; ix++) {
+    dup2(fds[ix], ix);
+    close(fds[ix]);
+  }
+  request = (char *) _new(sz + 1);
+  if (_forkserver_read(fd, request, sz)) {
+    free(request);
+    return NULL;
+  }
+  *len = sz;
+  return request;
+}
+
+int _forkserver_child(obelix_t *obelix, scriptloader_t *loader, int fd) {
+  char        *request;
+  char        *ptr;
+  size_t       len = 0;
+  name_t      *script;
+  arguments_t *args;
+  data_t      *ret;
+  exception_t *ex;
+  int          code;
+
+  signal(SIGCHLD, SIG_DFL);
+  if (!(request = _forkserver_receive(fd, &len))) {
+    error("Fork server: invalid request");
+    return 1;
+  }
+  ptr = request + strlen(request) + 1;
+  if ((ptr >= request + len) || chdir(request)) {
+    fprintf(stderr, "Error: Fork server could not run request\n");
+    code = 1;
+  } else {
+    scriptloader_add_loadpath(loader, request);
+    script = protocol_build_name(ptr);
+    args = arguments_create(NULL, NULL);
+    for (ptr += strlen(ptr) + 1; ptr < request + len; ptr += strlen(ptr) + 1) {
+      arguments_push(args, str_to_data(ptr));
+    }
+    debug(obelix, "Fork server running '%s'", name_tostring(script));
+    ret = scriptloader_run(loader, script, args);
+    if ((ex = data_as_exception(ret)) && (ex -> code == ErrorExit)) {
+      ret = data_copy(ex -> throwable);
+    }
+    code = obelix_exit_code(ret);
+  }
+  /* The child leaves with _exit(), which does not run the atexit handlers */
+  stream_flush_all();
+  fflush(stdout);
+  fflush(stderr);
+  dprintf(fd, "%d\n", code);
+  return code;
+}
+
+data_t * _forkserver_preload(scriptloader_t *loader, array_t *preload) {
+  name_t *name;
+  data_t *mod;
+  int     ix;
+
+  for (ix = 0; preload && (ix < array_size(preload)); ix++) {
+    name = name_parse(str_array_get(preload, ix));
+    mod = scriptloader_import(loader, name);
+    name_free(name);
+    if (!data_is_mod(mod)) {
+      return (data_is_exception(mod))
+        ? mod
+        : data_exception(ErrorName, "Could not preload '%s'", str_array_get(preload, ix));
+    }
+    debug(obelix, "Fork server preloaded '%s'", mod_tostring(data_as_mod(mod)));
+    data_free(mod);
+  }
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Runs the fork server on the socket given by the <code>forkserver</code>
+ * option. Only returns if the server could not be started.
+ */
+data_t * obelix_forkserver(obelix_t *obelix) {
+  array_t        *path;
+  scriptloader_t *loader;
+  socket_t       *server;
+  data_t         *ret = NULL;
+  pid_t           pid;
+  int             fd;
+
+  path = (obelix -> basepath) ? array_split(obelix -> basepath, ":")
+                              : str_array_create(0);
+  loader = scriptloader_create(obelix -> syspath, path, obelix -> grammar);
+  array_free(path);
+  if (!loader) {
+    return data_exception(ErrorInternalError, "Could not create script loader");
+  }
+  scriptloader_set_options(loader, obelix -> options);
+  if ((ret = _forkserver_preload(loader, obelix -> preload))) {
+    return ret;
+  }
+  ns_make_immortal(loader -> ns);
+
+  server = serversocket_create_byservice(obelix -> forkserver);
+  if (socket_error(server)) {
+    return data_copy(socket_error(server));
+  }
+  if (listen(server -> fh, SOCKET_DEFAULT_BACKLOG)) {
+    return data_exception_from_errno();
+  }
+  signal(SIGCHLD, SIG_IGN);
+  info("Fork server listening on '%s'", obelix -> forkserver);
+  for (;;) {
+    fflush(stdout);
+    fflush(stderr);
+    if ((fd = accept(server -> fh, NULL, NULL)) < 0) {
+      if (errno != EINTR) {
+        error("Fork server: accept() failed: %s", strerror(errno));
+      }
+      continue;
+    }
+    if (!(pid = fork())) {
+      close(server -> fh);
+      _exit(_forkserver_child(obelix, loader, fd) & 0xFF);
+    } else if (pid < 0) {
+      error("Fork server: fork() failed: %s", strerror(errno));
+    }
+    close(fd);
+  }
+  return ret;
+}
+
+/**
+ * Asks the fork server to run the script given on the command line. Returns
+ * NULL if there is no fork server listening on the socket, so that the
+ * caller can run the script itself.
+ */
+data_t * obelix_forkclient(obelix_t *obelix) {
+  socket_t *client;
+  char     *request;
+  size_t    len = 0;
+  char     *cwd;
+  char      status[32];
+  size_t    ix;
+  data_t   *ret;
+
+  client = socket_create_byservice(SOCKET_UNIX_HOST, obelix -> forkserver);
+  if (socket_error(client)) {
+    debug(obelix, "No fork server: %s", data_tostring(socket_error(client)));
+    socket_free(client);
+    return NULL;
+  }
+  cwd = getcwd(NULL, 0);
+  request = _forkserver_append(NULL, &len, cwd);
+  request = _forkserver_append(request, &len, name_tostring(obelix -> script));
+  for (ix = 0; ix < (size_t) arguments_args_size(obelix -> script_args); ix++) {
+    request = _forkserver_append(request, &len,
+                                 arguments_arg_tostring(obelix -> script_args, (int) ix));
+  }
+  free(cwd);
+
+  ret = NULL;
+  if (_forkserver_send(client -> fh, request, len)) {
+    ret = data_exception_from_errno();
+  }
+  for (ix = 0; !ret && (ix < sizeof(status) - 1); ix++) {
+    if (_forkserver_read(client -> fh, status + ix, 1)) {
+      ret = data_exception(ErrorInternalError,
+                           "Fork server did not return an exit code");
+    } else if (status[ix] == '\n') {
+      status[ix] = 0;
+      ret = int_to_data(atoi(status));
+    }
+  }
+  if (!ret) {
+    ret = data_exception(ErrorProtocol, "Invalid fork server exit code");
+  }
+  free(request);
+  socket_free(client);
+  return ret;
+}
@@ -18,6 +18,7 @@
  */
 
 #include <oblconfig.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <time.h>
 #ifdef HAVE_PTHREAD_H
@@ -27,8 +28,15 @@
 #include "obelix.h"
 #include <fsentry.h>
 #include <grammarparser.h>
+#include <threadpool.h>
 #include <user.h>
 
+typedef struct _compilejob {
+  scriptloader_t *loader;
+  module_t       *mod;
+  future_t       *future;
+} compilejob_t;
+
 extern grammar_t *      grammar_build(void);
 
 static void             __scriptloader_init(void);
@@ -38,6 +46,12 @@ static data_t *         _scriptloader_get_object(scriptloader_t *, int, ...);
 static data_t *         _scriptloader_set_value(scriptloader_t *, data_t *, char *, data_t *);
 static data_t *         _scriptloader_import_sys(scriptloader_t *);
 static data_t *         _scriptloader_set_loadpath(scriptloader_t *, array_t *);
+static data_t *         _scriptloader_compile(scriptloader_t *, module_t *);
+static char *           _scriptloader_image_dir(scriptloader_t *, module_t *);
+static void             _scriptloader_prefetch(scriptloader_t *, module_t *);
+static void             _scriptloader_prefetch_module(scriptloader_t *, char *);
+static data_t *         _scriptloader_compile_job(compilejob_t *);
+static void             _scriptloader_compile_job_free(compilejob_t *);
 
 static scriptloader_t * _scriptloader_new(scriptloader_t *, va_list);
 static void             _scriptloader_free(scriptloader_t *);
@@ -76,6 +90,9 @@ void __scriptloader_init(void) {
     typedescr_register(ScriptLoader, scriptloader_t);
   }
   if (!_obelix_grammar) {
+    if (!lr_table_get_image_dir() && getenv("OBL_IMAGE_DIR")) {
+      lr_table_set_image_dir(getenv("OBL_IMAGE_DIR"));
+    }
     _obelix_grammar = grammar_build();
   }
 }
@@ -85,7 +102,8 @@ void __scriptloader_init(void) {
 scriptloader_t * _scriptloader_new(scriptloader_t *loader, va_list args) {
   char             *obl_dir = getenv("OBL_DIR");
   char             *sys_dir = va_arg(args, char *);
-  array_t          *user_path = va_arg(args, array_t *);
+  array_t          *path = va_arg(args, array_t *);
+  array_t          *user_path = path;
   char             *grammarpath = va_arg(args, char *);
   grammar_parser_t *gp;
   data_t           *file;
@@ -116,18 +134,15 @@ scriptloader_t * _scriptloader_new(scriptloader_t *loader, va_list args) {
     strcat(loader -> system_dir, "/");
   }
 
+  /* The path passed in belongs to the caller */
   if (!user_path || !array_size(user_path)) {
-    if (user_path) {
-      array_free(user_path);
-    }
-    if (getenv("OBL_USER_PATH")) {
-      user_path = array_split(getenv("OBL_USER_PATH"), ":");
-    }
+    user_path = (getenv("OBL_USER_PATH"))
+      ? array_split(getenv("OBL_USER_PATH"), ":")
+      : NULL;
   }
   if (!user_path || !array_size(user_path)) {
-    if (!user_path) {
-      str_array_create(1);
-    }
+    array_free(user_path);
+    user_path = str_array_create(1);
     array_push(user_path, strdup("./"));
   }
 
@@ -155,6 +170,8 @@ scriptloader_t * _scriptloader_new(scriptloader_t *loader, va_list args) {
   }
 
   loader -> load_path = (datalist_t *) data_create(List, 1, str_to_data(loader -> system_dir));
+  loader -> compiled = strdata_dict_create();
+  loader -> compiled_mutex = mutex_create();
   loader -> ns = ns_create("loader", loader, (import_t) scriptloader_load);
   root = ns_import(loader -> ns, NULL);
   if (!data_is_mod(root)) {
@@ -183,6 +200,9 @@ scriptloader_t * _scriptloader_new(scriptloader_t *loader, va_list args) {
     loader -> cookie = strrand(NULL, COOKIE_SZ - 1);
     loader -> lastused = time(NULL);
   }
+  if (user_path != path) {
+    array_free(user_path);
+  }
   log_timestamp_end(obelix, ts, "scriptloader created in ");
   return loader;
 }
@@ -198,6 +218,8 @@ void _scriptloader_free(scriptloader_t *loader) {
     free(loader -> cookie);
     grammar_free(loader -> grammar);
     ns_free(loader -> ns);
+    dict_free(loader -> compiled);
+    mutex_free(loader -> compiled_mutex);
   }
 }
 
@@ -377,6 +399,155 @@ static data_t * _scriptloader_set_loadpath(scriptloader_t *loader, array_t *user
   return (data_t *) loader;
 }
 
+/*
+ * Modules from the system directory are compiled once and then loaded from
+ * a script image in the image directory, if one is set. User scripts change
+ * too often to make that worthwhile. Listings need the parser to run, so no
+ * images are used when they are requested.
+ */
+char * _scriptloader_image_dir(scriptloader_t *loader, module_t *mod) {
+  char *dir = lr_table_get_image_dir();
+
+  if (!dir || !mod -> source || scriptloader_get_option(loader, ObelixOptionList) ||
+      strncmp(data_tostring(mod -> source), loader -> system_dir, strlen(loader -> system_dir))) {
+    return NULL;
+  }
+  return dir;
+}
+
+/*
+ * Parses a module into a script, after handing the modules it imports to
+ * the thread pool. Those are compiled while this one is, but they are only
+ * run when their import statements are executed, in the usual order.
+ * System modules with a current script image are not parsed at all.
+ */
+data_t * _scriptloader_compile(scriptloader_t *loader, module_t *mod) {
+  data_t   *rdr;
+  data_t   *ret;
+  parser_t *parser;
+  script_t *script = NULL;
+  char     *image_dir;
+
+  if ((rdr = _scriptloader_open_reader(loader, mod))) {
+    _scriptloader_prefetch(loader, mod);
+    if ((image_dir = _scriptloader_image_dir(loader, mod))) {
+      script = script_image_load(mod,
+                                 (name_size(mod -> name)) ? name_tostring(mod -> name) : "__root__",
+                                 image_dir);
+    }
+    if (script) {
+      data_free(rdr);
+      return (data_t *) script;
+    }
+    ret = scriptloader_load_fromreader(loader, mod, rdr);
+    parser = (parser_t *) mod -> parser;
+    if (!data_is_exception(ret)) {
+      ret = parser_end(parser);
+    }
+    if (!data_is_exception(ret)) {
+      ret = data_copy(parser_get(parser, "script"));
+      if (image_dir && data_is_script(ret)) {
+        script_image_save(data_as_script(ret), image_dir);
+      }
+    }
+    parser_free(parser);
+    mod -> parser = NULL;
+    data_free(rdr);
+  } else {
+    ret = data_exception(ErrorName, "Could not load '%s'",
+                         (name_size(mod -> name)) ? name_tostring(mod -> name) : "__root__");
+  }
+  return ret;
+}
+
+/*
+ * Looks for import statements in the source of a module. This is only a
+ * quick scan of the text: an import that is missed here is compiled when
+ * it is executed, and one that is never executed is compiled for nothing.
+ * Nothing is compiled ahead when bytecode listings are requested, to keep
+ * them in import order.
+ */
+void _scriptloader_prefetch(scriptloader_t *loader, module_t *mod) {
+  FILE *fh;
+  char  line[256];
+  char *ptr;
+  char *end;
+  int   comment = FALSE;
+
+  if (!mod -> source || scriptloader_get_option(loader, ObelixOptionList)) {
+    return;
+  }
+  if (!(fh = fopen(data_tostring(mod -> source), "r"))) {
+    return;
+  }
+  while (fgets(line, sizeof(line), fh)) {
+    for (ptr = line; isspace(*ptr); ptr++);
+    if (comment || !strncmp(ptr, "/*", 2)) {
+      comment = !strstr(ptr, "*/");
+      continue;
+    }
+    if (strncmp(ptr, "import", 6) || !isspace(ptr[6])) {
+      continue;
+    }
+    for (ptr += 6; isspace(*ptr); ptr++);
+    for (end = ptr; isalnum(*end) || (*end == '_') || (*end == '.'); end++);
+    *end = 0;
+    if (*ptr) {
+      _scriptloader_prefetch_module(loader, ptr);
+    }
+  }
+  fclose(fh);
+}
+
+/*
+ * The future is claimed in the compiled dictionary before the job is
+ * submitted, so that modules importing each other are compiled only once.
+ * The import that uses the compile takes the future out again.
+ */
+void _scriptloader_prefetch_module(scriptloader_t *loader, char *modname) {
+  name_t       *name;
+  module_t     *mod;
+  future_t     *future = NULL;
+  compilejob_t *job;
+
+  name = name_parse(modname);
+  mod = ns_declare(loader -> ns, name);
+  mutex_lock(loader -> compiled_mutex);
+  if ((mod -> state == ModStateUninitialized) &&
+      !dict_has_key(loader -> compiled, name_tostring(name))) {
+    future = future_create(NULL, NULL);
+    dict_put(loader -> compiled, strdup(name_tostring(name)), future);
+  }
+  mutex_unlock(loader -> compiled_mutex);
+  if (!future) {
+    mod_free(mod);
+    name_free(name);
+    return;
+  }
+  debug(obelix, "Compiling '%s' ahead of its import", name_tostring(name));
+  job = NEW(compilejob_t);
+  job -> loader = scriptloader_copy(loader);
+  job -> mod = mod;
+  job -> future = future_copy(future);
+  future_free(threadpool_submit(name_tostring(name),
+                                (pooljob_t) _scriptloader_compile_job,
+                                job,
+                                (free_t) _scriptloader_compile_job_free));
+  name_free(name);
+}
+
+data_t * _scriptloader_compile_job(compilejob_t *job) {
+  future_complete(job -> future, _scriptloader_compile(job -> loader, job -> mod));
+  return NULL;
+}
+
+void _scriptloader_compile_job_free(compilejob_t *job) {
+  future_free(job -> future);
+  mod_free(job -> mod);
+  scriptloader_free(job -> loader);
+  free(job);
+}
+
 static data_t * _scriptloader_import_sys(scriptloader_t *loader) {
   name_t *name;
   data_t *ret;
@@ -491,31 +662,25 @@ data_t * scriptloader_import(scriptloader_t *loader, name_t *name) {
 }
 
 data_t * scriptloader_load(scriptloader_t *loader, module_t *mod) {
-  data_t   *rdr;
   data_t   *ret = (data_t *) mod;
   char     *script_name;
   name_t   *name = mod -> name;
-  parser_t *parser;
+  future_t *compiled;
 
   assert(loader);
   assert(name);
   script_name = strdup((name_size(mod -> name)) ? name_tostring(mod -> name) : "__root__");
   debug(obelix, "scriptloader_load('%s')", script_name);
   if (mod -> state == ModStateLoading) {
-    if ((rdr = _scriptloader_open_reader(loader, mod))) {
-      ret = scriptloader_load_fromreader(loader, mod, rdr);
-      parser = (parser_t *) mod -> parser;
-      if (!data_is_exception(ret)) {
-        ret = parser_end(parser);
-      }
-      if (!data_is_exception(ret)) {
-        ret = data_copy(parser_get(parser, "script"));
-      }
-      parser_free(parser);
-      mod -> parser = NULL;
-      data_free(rdr);
+    mutex_lock(loader -> compiled_mutex);
+    compiled = (future_t *) dict_pop(loader -> compiled, name_tostring(name));
+    mutex_unlock(loader -> compiled_mutex);
+    if (compiled) {
+      debug(obelix, "Module '%s' was compiled ahead of its import", script_name);
+      ret = data_copy(future_wait(compiled));
+      future_free(compiled);
     } else {
-      ret = data_exception(ErrorName, "Could not load '%s'", script_name);
+      ret = _scriptloader_compile(loader, mod);
     }
   } else {
     debug(obelix, "Module '%s' is already active. Skipped.", name_tostring(mod -> name));
@@ -17,6 +17,7 @@
  * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -28,6 +29,8 @@
 #endif /* WITH_READLINE */
 
 #include <ipc.h>
+#include <thread.h>
+#include <threadpool.h>
 
 #define PS1   ">> "
 #define PS2   " - "
@@ -38,11 +41,22 @@ static data_t * _obelix_new(obelix_t *, va_list);
 static void     _obelix_free(obelix_t *);
 static char *   _obelix_tostring(obelix_t *);
 static data_t * _obelix_resolve(obelix_t *, char *);
+static data_t * _obelix_register_server(obelix_t *, server_t *, servermessage_t *);
+static data_t * _obelix_unregister_server(obelix_t *, server_t *, servermessage_t *);
+static data_t * _obelix_remote_call(obelix_t *, server_t *, servermessage_t *);
 
 static data_t * _obelix_set_grammar(obelix_t *, char *, data_t *);
 static data_t * _obelix_get_grammar(obelix_t *, char *);
+static data_t * _obelix_set_imagedir(obelix_t *, char *, data_t *);
+static data_t * _obelix_get_imagedir(obelix_t *, char *);
 static data_t * _obelix_set_port(obelix_t *, char *, data_t *);
 static data_t * _obelix_get_port(obelix_t *, char *);
+static data_t * _obelix_set_serversocket(obelix_t *, char *, data_t *);
+static data_t * _obelix_get_serversocket(obelix_t *, char *);
+static data_t * _obelix_set_concurrency(obelix_t *, char *, data_t *);
+static int_t *  _obelix_get_concurrency(obelix_t *, char *);
+static data_t * _obelix_set_poolsize(obelix_t *, char *, data_t *);
+static int_t *  _obelix_get_poolsize(obelix_t *, char *);
 static data_t * _obelix_set_syspath(obelix_t *, char *, data_t *);
 static data_t * _obelix_get_syspath(obelix_t *, char *);
 static data_t * _obelix_set_basepath(obelix_t *, char *, data_t *);
@@ -51,32 +65,47 @@ static data_t * _obelix_set_list(obelix_t *, char *, data_t *);
 static int_t *  _obelix_get_list(obelix_t *, char *);
 static data_t * _obelix_set_trace(obelix_t *, char *, data_t *);
 static int_t *  _obelix_get_trace(obelix_t *, char *);
+static data_t * _obelix_set_forkserver(obelix_t *, char *, data_t *);
+static data_t * _obelix_get_forkserver(obelix_t *, char *);
+static data_t * _obelix_set_preload(obelix_t *, char *, data_t *);
+static data_t * _obelix_get_preload(obelix_t *, char *);
 
 static data_t * _obelix_get(data_t *, char *, arguments_t *);
 static data_t * _obelix_run(data_t *, char *, arguments_t *);
 static data_t * _obelix_mount(data_t *, char *, arguments_t *);
+static data_t * _obelix_async(data_t *, char *, arguments_t *);
 static data_t * _obelix_startserver(data_t *, char *, arguments_t *);
 
 static void *   _obelix_startserver_thread(void *);
 static void     _obelix_debug_settings(obelix_t *);
 static data_t * _obelix_cmdline(obelix_t *);
 static data_t * _obelix_interactive(obelix_t *);
+static void     _obelix_sigint(int);
 
 _unused_ static vtable_t _vtable_Obelix[] = {
   { .id = FunctionNew,          .fnc = (void_t) _obelix_new },
   { .id = FunctionFree,         .fnc = (void_t) _obelix_free },
   { .id = FunctionStaticString, .fnc = (void_t) _obelix_tostring },
   { .id = FunctionResolve,      .fnc = (void_t) _obelix_resolve },
+  { .id = FunctionRegisterServer,   .fnc = (void_t) _obelix_register_server },
+  { .id = FunctionUnregisterServer, .fnc = (void_t) _obelix_unregister_server },
+  { .id = FunctionRemoteCall,       .fnc = (void_t) _obelix_remote_call },
   { .id = FunctionNone,         .fnc = NULL }
 };
 
 static accessor_t _accessors_Obelix[] = {
     { .name = "grammar",      .setter = (setvalue_t) _obelix_set_grammar,  .resolver = (resolve_name_t) _obelix_get_grammar },
+    { .name = "imagedir",     .setter = (setvalue_t) _obelix_set_imagedir, .resolver = (resolve_name_t) _obelix_get_imagedir },
     { .name = "serverport",   .setter = (setvalue_t) _obelix_set_port,     .resolver = (resolve_name_t) _obelix_get_port },
+    { .name = "serversocket", .setter = (setvalue_t) _obelix_set_serversocket, .resolver = (resolve_name_t) _obelix_get_serversocket },
+    { .name = "concurrency",  .setter = (setvalue_t) _obelix_set_concurrency, .resolver = (resolve_name_t) _obelix_get_concurrency },
+    { .name = "poolsize",     .setter = (setvalue_t) _obelix_set_poolsize, .resolver = (resolve_name_t) _obelix_get_poolsize },
     { .name = "syspath",      .setter = (setvalue_t) _obelix_set_syspath,  .resolver = (resolve_name_t) _obelix_get_syspath },
     { .name = "basepath",     .setter = (setvalue_t) _obelix_set_basepath, .resolver = (resolve_name_t) _obelix_get_basepath },
     { .name = "list",         .setter = (setvalue_t) _obelix_set_list,     .resolver = (resolve_name_t) _obelix_get_list },
     { .name = "trace",        .setter = (setvalue_t) _obelix_set_trace,    .resolver = (resolve_name_t) _obelix_get_trace },
+    { .name = "forkserver",   .setter = (setvalue_t) _obelix_set_forkserver, .resolver = (resolve_name_t) _obelix_get_forkserver },
+    { .name = "preload",      .setter = (setvalue_t) _obelix_set_preload,  .resolver = (resolve_name_t) _obelix_get_preload },
     { .name = NULL,           .setter = NULL,                              .resolver = NULL },
 };
 
@@ -84,6 +113,7 @@ _unused_ static methoddescr_t _methods_Obelix[] = {
   { .type = Any,    .name = "obelix",  .method = _obelix_get,         .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
   { .type = -1,     .name = "run",     .method = _obelix_run,         .argtypes = { String, Any, NoType },    .minargs = 1, .varargs = 1 },
   { .type = -1,     .name = "mount",   .method = _obelix_mount,       .argtypes = { String, NoType, NoType }, .minargs = 1, .varargs = 0 },
+  { .type = -1,     .name = "async",   .method = _obelix_async,       .argtypes = { Any, Any, NoType },       .minargs = 1, .varargs = 1 },
   { .type = -1,     .name = "server",  .method = _obelix_startserver, .argtypes = { Int, NoType, NoType },    .minargs = 1, .varargs = 0 },
   { .type = NoType, .name = NULL,      .method = NULL,                .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 }
 };
@@ -133,6 +163,9 @@ char * _obelix_tostring(obelix_t *obelix) {
 void _obelix_free(obelix_t *obelix) {
   if (obelix) {
     free(obelix -> cookie);
+    free(obelix -> server_socket);
+    free(obelix -> forkserver);
+    array_free(obelix -> preload);
     array_free(obelix -> options);
     arguments_free(obelix -> script_args);
     name_free(obelix -> script);
@@ -173,6 +206,45 @@ data_t * _obelix_get_port(obelix_t *obelix, _unused_ char *name) {
   return int_to_data(obelix -> server);
 }
 
+data_t * _obelix_set_serversocket(obelix_t *obelix, _unused_ char *name, data_t *value) {
+  free(obelix -> server_socket);
+  asprintf(&obelix -> server_socket, "%s%s", SOCKET_UNIX_PREFIX, data_tostring(value));
+  return (data_t *) obelix;
+}
+
+data_t * _obelix_get_serversocket(obelix_t *obelix, _unused_ char *name) {
+  return (obelix -> server_socket)
+    ? str_to_data(obelix -> server_socket + strlen(SOCKET_UNIX_PREFIX))
+    : data_null();
+}
+
+data_t * _obelix_set_concurrency(obelix_t *obelix, _unused_ char *name, data_t *value) {
+  int c = data_intval(value);
+
+  if (c < 0) {
+    return data_exception(ErrorParameterValue,
+        "Invalid concurrency value '%s'", data_tostring(value));
+  }
+  obelix -> concurrency = c;
+  return (data_t *) obelix;
+}
+
+int_t * _obelix_get_concurrency(obelix_t *obelix, _unused_ char *name) {
+  return int_create(obelix -> concurrency);
+}
+
+data_t * _obelix_set_poolsize(obelix_t *obelix, _unused_ char *name, data_t *value) {
+  if (threadpool_set_size((int) data_intval(value))) {
+    return data_exception(ErrorParameterValue,
+        "Invalid pool size '%s'", data_tostring(value));
+  }
+  return (data_t *) obelix;
+}
+
+int_t * _obelix_get_poolsize(_unused_ obelix_t *obelix, _unused_ char *name) {
+  return int_create(threadpool_size());
+}
+
 data_t * _obelix_set_syspath(obelix_t *obelix, _unused_ char *name, data_t *value) {
   obelix -> syspath = data_tostring(value);
   return (data_t *) obelix;
@@ -200,6 +272,15 @@ data_t * _obelix_get_grammar(obelix_t *obelix, _unused_ char *name) {
   return str_to_data(obelix -> grammar);
 }
 
+data_t * _obelix_set_imagedir(obelix_t *obelix, _unused_ char *name, data_t *value) {
+  lr_table_set_image_dir(data_tostring(value));
+  return (data_t *) obelix;
+}
+
+data_t * _obelix_get_imagedir(_unused_ obelix_t *obelix, _unused_ char *name) {
+  return (lr_table_get_image_dir()) ? str_to_data(lr_table_get_image_dir()) : data_null();
+}
+
 data_t * _obelix_set_list(obelix_t *obelix, _unused_ char *name, data_t *value) {
   obelix_set_option(obelix, ObelixOptionList, data_intval(value));
   return (data_t *) obelix;
@@ -222,6 +303,30 @@ int_t * _obelix_get_trace(obelix_t *obelix, _unused_ char *name) {
   return bool_get(obelix_get_option(obelix, ObelixOptionTrace));
 }
 
+data_t * _obelix_set_forkserver(obelix_t *obelix, _unused_ char *name, data_t *value) {
+  free(obelix -> forkserver);
+  asprintf(&obelix -> forkserver, "%s%s", SOCKET_UNIX_PREFIX, data_tostring(value));
+  return (data_t *) obelix;
+}
+
+data_t * _obelix_get_forkserver(obelix_t *obelix, _unused_ char *name) {
+  return (obelix -> forkserver)
+    ? str_to_data(obelix -> forkserver + strlen(SOCKET_UNIX_PREFIX))
+    : data_null();
+}
+
+data_t * _obelix_set_preload(obelix_t *obelix, _unused_ char *name, data_t *value) {
+  array_free(obelix -> preload);
+  obelix -> preload = array_split(data_tostring(value), ",");
+  return (data_t *) obelix;
+}
+
+data_t * _obelix_get_preload(obelix_t *obelix, _unused_ char *name) {
+  return (obelix -> preload)
+    ? str_to_data(array_tostring(obelix -> preload))
+    : data_null();
+}
+
 /* ------------------------------------------------------------------------ */
 
 data_t * _obelix_register_server(obelix_t *obelix, server_t *server, servermessage_t *msg) {
@@ -249,6 +354,17 @@ data_t * _obelix_register_server(obelix_t *obelix, server_t *server, servermessa
   return ret;
 }
 
+/*
+ * Every connection gets a script loader of its own, which goes away with
+ * the connection.
+ */
+data_t * _obelix_unregister_server(obelix_t *obelix, server_t *server, _unused_ servermessage_t *msg) {
+  if (server -> data) {
+    obelix_decommission_loader(obelix, data_tostring(server -> data));
+  }
+  return NULL;
+}
+
 data_t * _obelix_remote_call(obelix_t *obelix, server_t *server, servermessage_t *msg) {
   scriptloader_t *loader = NULL;
   data_t         *ret;
@@ -314,7 +430,7 @@ static data_t * _obelix_mount(data_t *self, _unused_ char *name, arguments_t *ar
   uri_t          *uri;
   scriptloader_t *loader;
 
-  uri = uri_create(arguments_arg_tostring(args, 1));
+  uri = uri_create(arguments_arg_tostring(args, 0));
   if (uri -> error) {
     ret = data_copy(uri -> error);
   } else {
@@ -331,8 +447,30 @@ static data_t * _obelix_mount(data_t *self, _unused_ char *name, arguments_t *ar
   return ret;
 }
 
+/*
+ * Calls a remote function without waiting for the result, and returns a
+ * future. Many of these can be in flight over the same connection.
+ */
+static data_t * _obelix_async(_unused_ data_t *self, _unused_ char *name, arguments_t *args) {
+  data_t      *remote;
+  data_t      *ret;
+  arguments_t *a;
+
+  a = arguments_shift(args, &remote);
+  if (!data_is_remote(remote)) {
+    ret = data_exception(ErrorType,
+        "async() expects a remote function, not '%s'", data_typename(remote));
+  } else {
+    ret = remote_call_async(data_as_remote(remote), a);
+  }
+  data_free(remote);
+  arguments_free(a);
+  return ret;
+}
+
 void * _obelix_startserver_thread(void *port) {
-  return (void *) (intptr_t) server_start((data_t *) _obelix, (int) (intptr_t) port);
+  return (void *) (intptr_t) server_start((data_t *) _obelix, (int) (intptr_t) port,
+                                          _obelix -> concurrency);
 }
 
 data_t * _obelix_startserver(data_t *self, _unused_ char *name, arguments_t *args) {
@@ -436,12 +574,18 @@ static app_description_t _app_descr_obelix = {
     .legal       = "(c) Jan de Visser <jan@finiandarcy.com> 2014-2017",
     .options     = {
         { .longopt = "grammar",    .shortopt = 'g', .description = "Grammar file",        .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
+        { .longopt = "imagedir",   .shortopt = 'I', .description = "Image directory",     .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
         { .longopt = "syspath",    .shortopt = 's', .description = "System path",         .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
         { .longopt = "basepath",   .shortopt = 'p', .description = "Base path",           .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
         { .longopt = "serverport", .shortopt = 'S', .description = "Server port",         .flags = CMDLINE_OPTION_FLAG_OPTIONAL_ARG },
+        { .longopt = "serversocket", .shortopt = 'U', .description = "Server socket path",  .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
+        { .longopt = "concurrency", .shortopt = 'C', .description = "Concurrent calls per server connection", .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
+        { .longopt = "poolsize",   .shortopt = 'P', .description = "Async functions running at the same time", .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
         { .longopt = "initfile",   .shortopt = 'i', .description = "Initialization file", .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
         { .longopt = "list",       .shortopt = 'l', .description = "List bytecode",       .flags = 0 },
         { .longopt = "trace",      .shortopt = 't', .description = "Trace execution",     .flags = 0 },
+        { .longopt = "forkserver", .shortopt = 'F', .description = "Fork server socket path", .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
+        { .longopt = "preload",    .shortopt = 'M', .description = "Modules preloaded by the fork server", .flags = CMDLINE_OPTION_FLAG_REQUIRED_ARG },
         { .longopt = NULL,         .shortopt = 0,   .description = NULL,                  .flags = 0 }
     }
 };
@@ -456,7 +600,7 @@ obelix_t * obelix_initialize(int argc, char **argv) {
   }
   app = (application_t *) _obelix;
   application_parse_args(app, &_app_descr_obelix, argc, argv);
-  if (!_obelix -> server) {
+  if (!_obelix -> server && !_obelix -> server_socket) {
     if (application_has_args(app)) {
       _obelix -> script_args = arguments_shift(app -> args, &script);
       _obelix -> script = protocol_build_name(data_tostring(script));
@@ -495,7 +639,7 @@ data_t * obelix_get_loader(obelix_t *obelix, char *cookie) {
     loader = scriptloader_create(obelix->syspath, path, obelix->grammar);
     if (loader) {
       scriptloader_set_options(loader, obelix->options);
-      dictionary_set(obelix->loaders, cookie, loader);
+      dictionary_set(obelix->loaders, (cookie) ? cookie : loader->cookie, loader);
     }
     array_free(path);
     ret = (data_t *) loader;
@@ -537,33 +681,56 @@ data_t * obelix_run(obelix_t *obelix, name_t *name, arguments_t *args) {
   return ret;
 }
 
+/**
+ * Reports an exception returned by a script on stderr and translates the
+ * script's return value into a process exit code.
+ */
+int obelix_exit_code(data_t *data) {
+  exception_t *ex;
+
+  if (!data) {
+    return 0;
+  } else if ((ex = data_as_exception(data))) {
+    fprintf(stderr, "Error: %s\n", ex -> msg);
+    return 0 - (int) ex -> code;
+  } else {
+    return (int) data_intval(data);
+  }
+}
+
+/*
+ * The first ^C makes the script exit at its next safepoint, so that the
+ * contexts it is in are left properly. A second one kills it right away.
+ */
+void _obelix_sigint(int sig) {
+  signal(sig, SIG_DFL);
+  thread_safepoint_signal(sig);
+}
+
 /* ------------------------------------------------------------------------ */
 
 int main(int argc, char **argv) {
   obelix_t    *obelix;
-  int          ret = 0;
   data_t      *data = NULL;
-  exception_t *ex;
 
   if (!(obelix = obelix_initialize(argc, argv))) {
     fprintf(stderr, "Usage: obelix [options ...] [<script filename> [script arguments]]\n");
     exit(1);
   }
 
-  if (obelix -> server) {
-    server_start((data_t *) obelix, obelix -> server);
+  if (obelix -> server_socket) {
+    server_serve((data_t *) obelix, obelix -> server_socket, obelix -> concurrency);
+  } else if (obelix -> server) {
+    server_start((data_t *) obelix, obelix -> server, obelix -> concurrency);
+  } else if (obelix -> forkserver && !obelix -> script) {
+    data = obelix_forkserver(obelix);
   } else if (obelix -> script) {
-    data = _obelix_cmdline(obelix);
+    if (!obelix -> forkserver || !(data = obelix_forkclient(obelix))) {
+      signal(SIGINT, _obelix_sigint);
+      data = _obelix_cmdline(obelix);
+    }
   } else {
     data = _obelix_interactive(obelix);
   }
-  if (data) {
-    if ((ex = data_as_exception(data))) {
-      fprintf(stderr, "Error: %s\n", ex -> msg);
-      ret = 0 - (int) ex -> code;
-    } else {
-      ret = data_intval(data);
-    }
-  }
-  return ret;
+  return obelix_exit_code(data);
 }
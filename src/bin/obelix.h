@@ -46,6 +46,8 @@ typedef struct _scriptloader {
   char          *system_dir;
   grammar_t     *grammar;
   namespace_t   *ns;
+  dict_t        *compiled;
+  mutex_t       *compiled_mutex;
   array_t       *options;
   char          *cookie;
   time_t         lastused;
@@ -60,9 +62,13 @@ typedef struct _obelix {
   char           *syspath;
   array_t        *options;
   int             server;
+  char           *server_socket;
+  int             concurrency;
   char           *init_file;
   char           *cookie;
   dictionary_t   *loaders;
+  char           *forkserver;
+  array_t        *preload;
 } obelix_t;
 
 extern name_t *            obelix_build_name(char *);
@@ -74,6 +80,9 @@ extern obelix_t       *    obelix_decommission_loader(obelix_t *, char *);
 extern obelix_t *          obelix_set_option(obelix_t *, obelix_option_t, long);
 extern long                obelix_get_option(obelix_t *, obelix_option_t);
 extern data_t *            obelix_run(obelix_t *, name_t *, arguments_t *);
+extern int                 obelix_exit_code(data_t *);
+extern data_t *            obelix_forkserver(obelix_t *);
+extern data_t *            obelix_forkclient(obelix_t *);
 
 extern int Obelix;
 
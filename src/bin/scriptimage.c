@@ -0,0 +1,671 @@
+/*
+ * /obelix/src/bin/scriptimage.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <oblconfig.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "scriptparse.h"
+#include <exception.h>
+#include <function.h>
+#include <lexer.h>
+#include <resolve.h>
+
+/*
+ * Compiled script images.
+ *
+ * Parsing the modules every run starts with, like the root module and sys,
+ * is most of what is left of startup once the LALR(1) tables come from an
+ * image. A script image stores the bytecode of a compiled module: its
+ * instructions with their labels and constant values, and the functions,
+ * lambdas and native function declarations it defines. Loading an image
+ * recreates the script without parsing the source. Native functions are
+ * resolved again while loading.
+ *
+ * An image is only used if it was written by the same build of the
+ * executable and the libraries that compile scripts, and if the source file
+ * still has the size and modification time it had when it was compiled.
+ * Scripts holding constants that can't be stored, which the parser does not
+ * currently produce, are simply not written.
+ */
+
+#define SCRIPT_IMAGE_MAGIC       "OBLSCRP1"
+#define SCRIPT_IMAGE_VERSION     1
+#define SCRIPT_IMAGE_BUILD_ID    128
+
+typedef struct _script_image_header {
+  char          magic[8];
+  unsigned int  version;
+  unsigned int  build_id_len;
+  unsigned char build_id[SCRIPT_IMAGE_BUILD_ID];
+  int64_t       source_size;
+  int64_t       source_mtime;
+  int64_t       source_mtime_nsec;
+  size_t        size;
+} script_image_header_t;
+
+typedef struct _script_image_writer {
+  FILE *f;
+  int   ok;
+} script_image_writer_t;
+
+typedef struct _script_image_reader {
+  char *ptr;
+  char *end;
+  int   ok;
+} script_image_reader_t;
+
+static unsigned char  _image_build_id[SCRIPT_IMAGE_BUILD_ID];
+static unsigned int   _image_build_id_len = 0;
+static pthread_once_t _image_build_id_once = PTHREAD_ONCE_INIT;
+
+static void _image_write_script(script_image_writer_t *, script_t *);
+static int  _image_read_script(script_image_reader_t *, script_t *);
+
+/* ------------------------------------------------------------------------ */
+
+static void _image_build_id_init(void) {
+  void         *objects[] = { NULL,
+                              (void *) script_image_load,
+                              (void *) script_create,
+                              (void *) parser_create,
+                              (void *) lexer_create,
+                              (void *) data_create };
+  unsigned int  len = 0;
+  int           ix;
+
+  for (ix = 0; ix < (int) (sizeof(objects) / sizeof(objects[0])); ix++) {
+    len += resolve_build_id(objects[ix], _image_build_id + len, SCRIPT_IMAGE_BUILD_ID - len);
+  }
+  if (!len) {
+    len = (unsigned int) snprintf((char *) _image_build_id, SCRIPT_IMAGE_BUILD_ID,
+                                  "%s %s %s", OBELIX_VERSION, __DATE__, __TIME__);
+  }
+  _image_build_id_len = len;
+}
+
+static char * _image_path(char *source, char *dir, char *buf, size_t sz) {
+  snprintf(buf, sz, "%s/%08x.script", dir, strhash(source));
+  return buf;
+}
+
+static int _image_stat_source(char *source, struct stat *st) {
+  return !stat(source, st) && S_ISREG(st -> st_mode);
+}
+
+/* -- W R I T I N G ------------------------------------------------------- */
+
+static void _image_write(script_image_writer_t *writer, void *ptr, size_t sz) {
+  if (writer -> ok) {
+    writer -> ok = fwrite(ptr, 1, sz, writer -> f) == sz;
+  }
+}
+
+static void _image_write_int(script_image_writer_t *writer, int64_t value) {
+  _image_write(writer, &value, sizeof(int64_t));
+}
+
+static void _image_write_str(script_image_writer_t *writer, char *str) {
+  int64_t len = (str) ? (int64_t) strlen(str) : -1;
+
+  _image_write_int(writer, len);
+  if (str) {
+    _image_write(writer, str, (size_t) len);
+  }
+}
+
+static void _image_write_tag(script_image_writer_t *writer, char tag) {
+  _image_write(writer, &tag, 1);
+}
+
+static void _image_write_strings(script_image_writer_t *writer, array_t *strings) {
+  int ix;
+
+  _image_write_int(writer, (strings) ? array_size(strings) : -1);
+  for (ix = 0; strings && (ix < array_size(strings)); ix++) {
+    _image_write_str(writer, str_array_get(strings, ix));
+  }
+}
+
+/* Keyword argument names of calls are kept as data strings */
+static void _image_write_kwargs(script_image_writer_t *writer, array_t *kwargs) {
+  int ix;
+
+  _image_write_int(writer, (kwargs) ? array_size(kwargs) : -1);
+  for (ix = 0; kwargs && (ix < array_size(kwargs)); ix++) {
+    _image_write_str(writer, data_tostring(data_array_get(kwargs, ix)));
+  }
+}
+
+static void _image_write_value(script_image_writer_t *writer, data_t *value) {
+  exception_t *ex;
+  name_t      *name;
+  double       flt;
+  int          ix;
+
+  if (!value) {
+    _image_write_tag(writer, 'n');
+  } else if (value == data_null()) {
+    _image_write_tag(writer, 'N');
+  } else if (data_type(value) == Int) {
+    _image_write_tag(writer, 'i');
+    _image_write_int(writer, data_intval(value));
+  } else if (data_type(value) == Bool) {
+    _image_write_tag(writer, 'b');
+    _image_write_int(writer, data_intval(value));
+  } else if (data_type(value) == Float) {
+    flt = data_floatval(value);
+    _image_write_tag(writer, 'f');
+    _image_write(writer, &flt, sizeof(double));
+  } else if (data_type(value) == String) {
+    _image_write_tag(writer, 's');
+    _image_write_str(writer, data_tostring(value));
+  } else if ((name = data_as_name(value))) {
+    _image_write_tag(writer, 'm');
+    _image_write_int(writer, name_size(name));
+    for (ix = 0; ix < name_size(name); ix++) {
+      _image_write_str(writer, name_get(name, ix));
+    }
+  } else if ((ex = data_as_exception(value)) && !ex -> throwable) {
+    _image_write_tag(writer, 'x');
+    _image_write_int(writer, ex -> code);
+    _image_write_str(writer, ex -> msg);
+  } else if (data_is_script(value)) {
+    /* A lambda, which is stored with the functions of the enclosing script */
+    _image_write_tag(writer, 'l');
+    _image_write_str(writer, name_last(data_as_script(value) -> name));
+  } else {
+    debug(obelix, "Cannot store '%s' [%s] in a script image",
+          data_tostring(value), data_typename(value));
+    writer -> ok = FALSE;
+  }
+}
+
+static script_image_writer_t * _image_write_label(char *label, script_image_writer_t *writer) {
+  _image_write_str(writer, label);
+  return writer;
+}
+
+static void _image_write_instruction(script_image_writer_t *writer, instruction_t *instr) {
+  function_call_t *call;
+
+  _image_write_str(writer, data_typename(instr));
+  _image_write_str(writer, instr -> name);
+  _image_write_int(writer, instr -> line);
+  _image_write_int(writer, (instr -> labels) ? set_size(instr -> labels) : 0);
+  if (instr -> labels) {
+    set_reduce(instr -> labels, (reduce_t) _image_write_label, writer);
+  }
+  if (data_type(instr) == ITFunctionCall) {
+    call = (function_call_t *) instr -> value;
+    _image_write_tag(writer, 'c');
+    _image_write_int(writer, call -> flags);
+    _image_write_int(writer, call -> arg_count);
+    _image_write_kwargs(writer, call -> kwargs);
+  } else {
+    _image_write_value(writer, instr -> value);
+  }
+}
+
+static script_image_writer_t * _image_write_function(entry_t *entry, script_image_writer_t *writer) {
+  data_t     *value = (data_t *) entry -> value;
+  function_t *fnc;
+
+  _image_write_str(writer, (char *) entry -> key);
+  if (data_is_script(value)) {
+    _image_write_tag(writer, 'S');
+    _image_write_script(writer, data_as_script(value));
+  } else if ((fnc = data_as_function(value))) {
+    _image_write_tag(writer, 'F');
+    _image_write_str(writer, name_tostring_sep(fnc -> name, ":"));
+    _image_write_int(writer, fnc -> type);
+    _image_write_strings(writer, fnc -> params);
+  } else {
+    debug(obelix, "Cannot store function '%s' [%s] in a script image",
+          data_tostring(value), data_typename(value));
+    writer -> ok = FALSE;
+  }
+  return writer;
+}
+
+void _image_write_script(script_image_writer_t *writer, script_t *script) {
+  list_t *block = script -> bytecode -> main_block;
+
+  _image_write_int(writer, script -> type);
+  _image_write_strings(writer, script -> params);
+  _image_write_int(writer, dictionary_size(script -> functions));
+  dict_reduce(script -> functions -> attributes, (reduce_t) _image_write_function, writer);
+  _image_write_int(writer, list_size(block));
+  for (list_start(block); list_has_next(block); ) {
+    _image_write_instruction(writer, (instruction_t *) list_next(block));
+  }
+}
+
+/* -- R E A D I N G ------------------------------------------------------- */
+
+static void * _image_read(script_image_reader_t *reader, size_t sz) {
+  void *ret = reader -> ptr;
+
+  if (!reader -> ok || ((size_t) (reader -> end - reader -> ptr) < sz)) {
+    reader -> ok = FALSE;
+    return NULL;
+  }
+  reader -> ptr += sz;
+  return ret;
+}
+
+static int64_t _image_read_int(script_image_reader_t *reader) {
+  int64_t  ret = 0;
+  void    *ptr = _image_read(reader, sizeof(int64_t));
+
+  if (ptr) {
+    memcpy(&ret, ptr, sizeof(int64_t));
+  }
+  return ret;
+}
+
+/*
+ * Returns a string allocated with stralloc, or NULL if a NULL string was
+ * stored. Check reader -> ok to tell that apart from an error.
+ */
+static char * _image_read_str(script_image_reader_t *reader) {
+  int64_t  len = _image_read_int(reader);
+  char    *ptr;
+  char    *ret;
+
+  if (len < 0) {
+    return NULL;
+  }
+  if (!(ptr = (char *) _image_read(reader, (size_t) len))) {
+    return NULL;
+  }
+  ret = stralloc((size_t) len);
+  memcpy(ret, ptr, (size_t) len);
+  ret[len] = 0;
+  return ret;
+}
+
+static char _image_read_tag(script_image_reader_t *reader) {
+  char *ptr = (char *) _image_read(reader, 1);
+
+  return (ptr) ? *ptr : 0;
+}
+
+static array_t * _image_read_strings(script_image_reader_t *reader) {
+  int64_t  count = _image_read_int(reader);
+  array_t *ret;
+  int64_t  ix;
+  char    *str;
+
+  if (count < 0) {
+    return NULL;
+  }
+  ret = str_array_create((int) count);
+  for (ix = 0; reader -> ok && (ix < count); ix++) {
+    if ((str = _image_read_str(reader))) {
+      array_push(ret, str);
+    } else {
+      reader -> ok = FALSE;
+    }
+  }
+  return ret;
+}
+
+static array_t * _image_read_kwargs(script_image_reader_t *reader) {
+  int64_t  count = _image_read_int(reader);
+  array_t *ret;
+  int64_t  ix;
+  char    *str;
+
+  if (count < 0) {
+    return NULL;
+  }
+  ret = data_array_create((int) count);
+  for (ix = 0; reader -> ok && (ix < count); ix++) {
+    if ((str = _image_read_str(reader))) {
+      array_push(ret, str_to_data(str));
+      free(str);
+    } else {
+      reader -> ok = FALSE;
+    }
+  }
+  return ret;
+}
+
+static data_t * _image_read_value(script_image_reader_t *reader, script_t *script) {
+  data_t  *ret = NULL;
+  name_t  *name;
+  char    *str;
+  double  *flt;
+  int64_t  count;
+  int64_t  code;
+  int64_t  ix;
+
+  switch (_image_read_tag(reader)) {
+    case 'n':
+      break;
+    case 'N':
+      ret = data_null();
+      break;
+    case 'i':
+      ret = int_to_data(_image_read_int(reader));
+      break;
+    case 'b':
+      ret = int_as_bool(_image_read_int(reader));
+      break;
+    case 'f':
+      if ((flt = (double *) _image_read(reader, sizeof(double)))) {
+        ret = flt_to_data(*flt);
+      }
+      break;
+    case 's':
+      if ((str = _image_read_str(reader))) {
+        ret = str_to_data(str);
+        free(str);
+      }
+      break;
+    case 'm':
+      name = name_create(0);
+      count = _image_read_int(reader);
+      for (ix = 0; reader -> ok && (ix < count); ix++) {
+        if ((str = _image_read_str(reader))) {
+          name_extend(name, str);
+          free(str);
+        }
+      }
+      ret = (data_t *) name;
+      break;
+    case 'x':
+      code = _image_read_int(reader);
+      if ((str = _image_read_str(reader))) {
+        ret = data_exception((int) code, "%s", str);
+        free(str);
+      }
+      break;
+    case 'l':
+      if ((str = _image_read_str(reader))) {
+        ret = data_copy(dictionary_get(script -> functions, str));
+        reader -> ok = data_is_script(ret);
+        free(str);
+      }
+      break;
+  }
+  if (!reader -> ok) {
+    data_free(ret);
+    ret = NULL;
+  }
+  return ret;
+}
+
+static int _image_read_instruction(script_image_reader_t *reader, script_t *script) {
+  bytecode_t   *bytecode = script -> bytecode;
+  data_t       *instr = NULL;
+  data_t       *value;
+  name_t       *fname;
+  array_t      *kwargs;
+  char         *type;
+  char         *name;
+  char         *label;
+  int64_t       line;
+  int64_t       count;
+  int64_t       flags;
+  int64_t       arg_count;
+  int64_t       ix;
+
+  type = _image_read_str(reader);
+  name = _image_read_str(reader);
+  line = _image_read_int(reader);
+  count = _image_read_int(reader);
+  for (ix = 0; reader -> ok && (ix < count); ix++) {
+    if ((label = _image_read_str(reader))) {
+      datastack_push(bytecode -> pending_labels, str_to_data(label));
+      free(label);
+    }
+  }
+  if (!reader -> ok || !type) {
+    reader -> ok = FALSE;
+  } else if ((reader -> ptr < reader -> end) && (*reader -> ptr == 'c')) {
+    _image_read_tag(reader);
+    flags = _image_read_int(reader);
+    arg_count = _image_read_int(reader);
+    kwargs = _image_read_kwargs(reader);
+    if (reader -> ok) {
+      fname = (name) ? name_create(1, name) : NULL;
+      instr = instruction_create_function(fname, (callflag_t) flags, (long) arg_count, kwargs);
+      name_free(fname);
+    }
+    array_free(kwargs);
+  } else {
+    value = _image_read_value(reader, script);
+    if (reader -> ok) {
+      instr = (data_t *) instruction_create_byname(type, name, value);
+    }
+    data_free(value);
+  }
+  if (instr && data_is_instruction(instr)) {
+    bytecode_push_instruction(bytecode, instr);
+    data_as_instruction(instr) -> line = (int) line;
+  } else {
+    data_free(instr);
+    reader -> ok = FALSE;
+  }
+  datastack_clear(bytecode -> pending_labels);
+  free(type);
+  free(name);
+  return reader -> ok;
+}
+
+static int _image_read_function(script_image_reader_t *reader, script_t *script) {
+  script_t   *func;
+  function_t *fnc;
+  char       *key;
+  char       *name;
+
+  if (!(key = _image_read_str(reader))) {
+    reader -> ok = FALSE;
+    return FALSE;
+  }
+  switch (_image_read_tag(reader)) {
+    case 'S':
+      func = script_create((data_t *) script, key);
+      _image_read_script(reader, func);
+      break;
+    case 'F':
+      if ((name = _image_read_str(reader))) {
+        fnc = function_create(name, NULL);
+        fnc -> type = (int) _image_read_int(reader);
+        fnc -> params = _image_read_strings(reader);
+        dictionary_set(script -> functions, key, data_uncopy(fnc));
+        free(name);
+      } else {
+        reader -> ok = FALSE;
+      }
+      break;
+    default:
+      reader -> ok = FALSE;
+      break;
+  }
+  free(key);
+  return reader -> ok;
+}
+
+int _image_read_script(script_image_reader_t *reader, script_t *script) {
+  int64_t count;
+  int64_t ix;
+
+  script -> type = (script_type_t) _image_read_int(reader);
+  script -> params = _image_read_strings(reader);
+  count = _image_read_int(reader);
+  for (ix = 0; reader -> ok && (ix < count); ix++) {
+    _image_read_function(reader, script);
+  }
+  count = _image_read_int(reader);
+  for (ix = 0; reader -> ok && (ix < count); ix++) {
+    _image_read_instruction(reader, script);
+  }
+  return reader -> ok;
+}
+
+/* -- S C R I P T  I M A G E  P U B L I C  F U N C T I O N S -------------- */
+
+/*
+ * Recreates the script compiled from the source of the module from its
+ * image in dir. Returns NULL if there is no usable image.
+ */
+script_t * script_image_load(module_t *mod, char *name, char *dir) {
+  script_image_header_t *header;
+  script_image_reader_t  reader;
+  script_t              *script = NULL;
+  struct stat            st;
+  FILE                  *f;
+  char                  *image = NULL;
+  char                  *source;
+  char                  *reason = NULL;
+  char                   path[MAX_PATH];
+
+  if (!mod -> source || !_image_stat_source(data_tostring(mod -> source), &st)) {
+    return NULL;
+  }
+  pthread_once(&_image_build_id_once, _image_build_id_init);
+  source = data_tostring(mod -> source);
+  _image_path(source, dir, path, MAX_PATH);
+  if (!(f = fopen(path, "rb"))) {
+    debug(obelix, "No script image '%s' for '%s'", path, source);
+    return NULL;
+  }
+  image = (char *) new(sizeof(script_image_header_t));
+  header = (script_image_header_t *) image;
+  if (fread(header, sizeof(script_image_header_t), 1, f) != 1) {
+    reason = "truncated";
+  } else if (memcmp(header -> magic, SCRIPT_IMAGE_MAGIC, sizeof(header -> magic)) ||
+             (header -> version != SCRIPT_IMAGE_VERSION)) {
+    reason = "not an image";
+  } else if ((header -> build_id_len != _image_build_id_len) ||
+             memcmp(header -> build_id, _image_build_id, _image_build_id_len)) {
+    reason = "build id mismatch";
+  } else if ((header -> source_size != (int64_t) st.st_size) ||
+             (header -> source_mtime != (int64_t) st.st_mtim.tv_sec) ||
+             (header -> source_mtime_nsec != (int64_t) st.st_mtim.tv_nsec)) {
+    reason = "source changed";
+  } else if (header -> size <= sizeof(script_image_header_t)) {
+    reason = "corrupt";
+  } else {
+    image = resize_block(image, header -> size, sizeof(script_image_header_t));
+    header = (script_image_header_t *) image;
+    if (fread(image + sizeof(script_image_header_t),
+              header -> size - sizeof(script_image_header_t), 1, f) != 1) {
+      reason = "truncated";
+    }
+  }
+  fclose(f);
+
+  if (!reason) {
+    reader.ptr = image + sizeof(script_image_header_t);
+    reader.end = image + header -> size;
+    reader.ok = TRUE;
+    source = _image_read_str(&reader);
+    if (!source || strcmp(source, data_tostring(mod -> source))) {
+      reason = "different source";
+    } else {
+      script = script_create((data_t *) mod, name);
+      if (!_image_read_script(&reader, script) || (reader.ptr != reader.end)) {
+        reason = "corrupt";
+        script_free(script);
+        script = NULL;
+      }
+    }
+    free(source);
+  }
+  if (reason) {
+    debug(obelix, "Ignoring script image '%s': %s", path, reason);
+  } else {
+    debug(obelix, "Loaded script image '%s' for '%s'", path, data_tostring(mod -> source));
+  }
+  free(image);
+  return script;
+}
+
+/*
+ * Writes the image of a script compiled from a module source to dir. The
+ * image is written to a temporary file that is renamed into place, so that
+ * concurrent runs never see a partially written image.
+ */
+int script_image_save(script_t *script, char *dir) {
+  script_image_header_t header;
+  script_image_writer_t writer;
+  struct stat           st;
+  char                 *source;
+  char                 *tmp;
+  long                  size;
+  char                  path[MAX_PATH];
+
+  if (!script -> mod -> source ||
+      !_image_stat_source(data_tostring(script -> mod -> source), &st)) {
+    return FALSE;
+  }
+  pthread_once(&_image_build_id_once, _image_build_id_init);
+  if (mkdir(dir, 0755) && (errno != EEXIST)) {
+    debug(obelix, "Could not create image directory '%s': %s", dir, strerror(errno));
+    return FALSE;
+  }
+  source = data_tostring(script -> mod -> source);
+  _image_path(source, dir, path, MAX_PATH);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SCRIPT_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = SCRIPT_IMAGE_VERSION;
+  header.build_id_len = _image_build_id_len;
+  memcpy(header.build_id, _image_build_id, _image_build_id_len);
+  header.source_size = (int64_t) st.st_size;
+  header.source_mtime = (int64_t) st.st_mtim.tv_sec;
+  header.source_mtime_nsec = (int64_t) st.st_mtim.tv_nsec;
+
+  asprintf(&tmp, "%s.%d.%lx", path, getpid(), (unsigned long) pthread_self());
+  if (!(writer.f = fopen(tmp, "wb"))) {
+    debug(obelix, "Could not create script image '%s': %s", tmp, strerror(errno));
+    free(tmp);
+    return FALSE;
+  }
+  writer.ok = TRUE;
+  _image_write(&writer, &header, sizeof(header));
+  _image_write_str(&writer, source);
+  _image_write_script(&writer, script);
+
+  /* The header goes in last, now that the size is known: */
+  if (writer.ok && ((size = ftell(writer.f)) > 0)) {
+    header.size = (size_t) size;
+    writer.ok = !fseek(writer.f, 0, SEEK_SET);
+    _image_write(&writer, &header, sizeof(header));
+  }
+  writer.ok = !fclose(writer.f) && writer.ok;
+  if (writer.ok && !rename(tmp, path)) {
+    debug(obelix, "Wrote script image '%s' for '%s'", path, source);
+  } else {
+    debug(obelix, "Could not write script image '%s' for '%s'", path, source);
+    unlink(tmp);
+    writer.ok = FALSE;
+  }
+  free(tmp);
+  return writer.ok;
+}
@@ -34,6 +34,7 @@
 #endif /* SCRIPTPARSE_IMPEXP */
 
 #include <parser.h>
+#include <vm.h>
 
 SCRIPTPARSE_IMPEXP int obelix_debug;
 
@@ -100,4 +101,7 @@ __PLUGIN__ parser_t * script_parse_query(parser_t *parser);
 __PLUGIN__ parser_t * script_parse_qstring_disable_slash(parser_t *);
 __PLUGIN__ parser_t * script_parse_qstring_enable_slash(parser_t *);
 
+SCRIPTPARSE_IMPEXP script_t * script_image_load(module_t *, char *, char *);
+SCRIPTPARSE_IMPEXP int        script_image_save(script_t *, char *);
+
 #endif /* __SCRIPTPARSE_H__ */
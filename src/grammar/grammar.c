@@ -32,6 +32,17 @@ static grammar_t * _grammar_dump_pre(ge_dump_ctx_t *);
 static grammar_t * _grammar_dump_get_children(grammar_t *, list_t *);
 static grammar_t * _grammar_dump_post(ge_dump_ctx_t *);
 
+typedef struct _grammar_analysis grammar_analysis_t;
+
+static grammar_analysis_t * _grammar_analysis_create(grammar_t *);
+static void                 _grammar_analysis_free(grammar_analysis_t *);
+static int                  _grammar_analysis_index(grammar_analysis_t *, rule_entry_t *);
+static void                 _grammar_analysis_push(grammar_analysis_t *, int);
+static int                  _grammar_analysis_pop(grammar_analysis_t *);
+static void                 _grammar_analysis_reset(grammar_analysis_t *);
+static grammar_analysis_t * _grammar_build_firsts(grammar_analysis_t *);
+static grammar_analysis_t * _grammar_build_follows(grammar_analysis_t *);
+
 static vtable_t _vtable_Grammar[] = {
   { .id = FunctionNew,      .fnc = (void_t) _grammar_new },
   { .id = FunctionFree,     .fnc = (void_t) _grammar_free },
@@ -73,6 +84,7 @@ grammar_t * _grammar_new(grammar_t *grammar, va_list args) {
   grammar -> libs = NULL;
   grammar -> strategy = ParsingStrategyTopDown;
   grammar -> dryrun = FALSE;
+  grammar -> lr_table = NULL;
 
   grammar -> keywords = intdata_dict_create();
   grammar -> nonterminals = strdata_dict_create();
@@ -88,6 +100,7 @@ void _grammar_free(grammar_t *grammar) {
     lexer_config_free(grammar -> lexer);
     free(grammar -> prefix);
     free(grammar -> build_func);
+    lr_table_free(grammar -> lr_table);
   }
 }
 
@@ -126,7 +139,8 @@ grammar_t * _grammar_set(grammar_t *g, char *name, data_t *value) {
     if (val) {
       if (!strncmp(val, "topdown", 7)|| !strncmp(val, "ll(1)", 5)) {
         grammar_set_parsing_strategy(g, ParsingStrategyTopDown);
-      } else if (!strncmp(val, "bottomup", 8) || !strncmp(val, "lr(1)", 5)) {
+      } else if (!strncmp(val, "bottomup", 8) || !strncmp(val, "lr(1)", 5) ||
+                 !strncmp(val, "lalr(1)", 7)) {
         grammar_set_parsing_strategy(g, ParsingStrategyBottomUp);
       }
     }
@@ -185,6 +199,9 @@ grammar_t * _grammar_dump_pre(ge_dump_ctx_t *ctx) {
          "  grammar = grammar_create();\n",
          (grammar -> build_func) ? grammar -> build_func : "grammar_build");
 
+  if (grammar -> strategy == ParsingStrategyBottomUp) {
+    printf("  grammar_set_parsing_strategy(grammar, ParsingStrategyBottomUp);\n");
+  }
   if (grammar -> prefix && grammar -> prefix[0]) {
     /*
      * No need to escape - can't have quotes or backslashes in C function names
@@ -224,14 +241,143 @@ grammar_t * _grammar_dump_post(ge_dump_ctx_t *ctx) {
 
 /* ------------------------------------------------------------------------ */
 
-void _grammar_get_firsts_visitor(entry_t *entry) {
-  nonterminal_t *nonterminal;
+/*
+ * FIRST and FOLLOW sets are computed with a worklist: a non-terminal is
+ * only revisited when a set it depends on has grown.
+ */
 
-  nonterminal = (nonterminal_t *) entry -> value;
-//  if (grammar_debug) {
-//    debug("Building FIRST sets for rule %s", nonterminal -> name);
-//  }
-  _nonterminal_get_firsts(nonterminal);
+struct _grammar_analysis {
+  grammar_t      *grammar;
+  int             num_nonterminals;
+  nonterminal_t **nonterminals;
+  dict_t         *index;
+  list_t        **dependents;
+  int            *worklist;
+  int             len;
+  char           *queued;
+  bitset_t       *scratch;
+};
+
+static list_t * _grammar_collect_nonterminal(nonterminal_t *nonterminal, list_t *nonterminals) {
+  list_append(nonterminals, nonterminal);
+  return nonterminals;
+}
+
+grammar_analysis_t * _grammar_analysis_create(grammar_t *grammar) {
+  grammar_analysis_t *analysis = NEW(grammar_analysis_t);
+  list_t             *nonterminals;
+  int                 ix;
+
+  analysis -> grammar = grammar;
+  nonterminals = dict_reduce_values(grammar -> nonterminals,
+                                    (reduce_t) _grammar_collect_nonterminal,
+                                    list_create());
+  analysis -> num_nonterminals = list_size(nonterminals);
+  analysis -> nonterminals = NEWARR(analysis -> num_nonterminals, nonterminal_t *);
+  analysis -> dependents = NEWARR(analysis -> num_nonterminals, list_t *);
+  analysis -> worklist = NEWARR(analysis -> num_nonterminals, int);
+  analysis -> queued = NEWARR(analysis -> num_nonterminals, char);
+  analysis -> index = strint_dict_create();
+  for (ix = 0; ix < analysis -> num_nonterminals; ix++) {
+    analysis -> nonterminals[ix] = list_get(nonterminals, ix);
+    analysis -> dependents[ix] = list_create();
+    dict_put(analysis -> index, strdup(analysis -> nonterminals[ix] -> name),
+             (void *) ((intptr_t) (ix + 1)));
+  }
+  list_free(nonterminals);
+  analysis -> scratch = bitset_create(TokenCodeEOF + 1);
+  return analysis;
+}
+
+void _grammar_analysis_free(grammar_analysis_t *analysis) {
+  int ix;
+
+  if (analysis) {
+    for (ix = 0; ix < analysis -> num_nonterminals; ix++) {
+      list_free(analysis -> dependents[ix]);
+    }
+    free(analysis -> dependents);
+    free(analysis -> nonterminals);
+    free(analysis -> worklist);
+    free(analysis -> queued);
+    dict_free(analysis -> index);
+    bitset_free(analysis -> scratch);
+    free(analysis);
+  }
+}
+
+int _grammar_analysis_index(grammar_analysis_t *analysis, rule_entry_t *entry) {
+  intptr_t ix = (intptr_t) dict_get(analysis -> index, entry -> nonterminal);
+
+  oassert(ix, "Non-terminal '%s' not found", entry -> nonterminal);
+  return (int) ix - 1;
+}
+
+void _grammar_analysis_push(grammar_analysis_t *analysis, int ix) {
+  if (!analysis -> queued[ix]) {
+    analysis -> queued[ix] = TRUE;
+    analysis -> worklist[analysis -> len++] = ix;
+  }
+}
+
+int _grammar_analysis_pop(grammar_analysis_t *analysis) {
+  int ix = analysis -> worklist[--analysis -> len];
+
+  analysis -> queued[ix] = FALSE;
+  return ix;
+}
+
+void _grammar_analysis_reset(grammar_analysis_t *analysis) {
+  int ix;
+
+  for (ix = 0; ix < analysis -> num_nonterminals; ix++) {
+    list_clear(analysis -> dependents[ix]);
+  }
+  analysis -> len = 0;
+  memset(analysis -> queued, 0, analysis -> num_nonterminals);
+}
+
+grammar_analysis_t * _grammar_build_firsts(grammar_analysis_t *analysis) {
+  nonterminal_t *nonterminal;
+  rule_t        *rule;
+  rule_entry_t  *entry;
+  int            ix, i, j, dep;
+  long           visits = 0;
+
+  /*
+   * A change to FIRST(B) requires FIRST(A) to be recomputed for every A with
+   * a rule referencing B:
+   */
+  for (ix = 0; ix < analysis -> num_nonterminals; ix++) {
+    nonterminal = analysis -> nonterminals[ix];
+    _nonterminal_get_firsts(nonterminal);
+    for (i = 0; i < array_size(nonterminal -> rules); i++) {
+      rule = nonterminal_get_rule(nonterminal, i);
+      for (j = 0; j < array_size(rule -> entries); j++) {
+        entry = rule_get_entry(rule, j);
+        if (!entry -> terminal) {
+          list_append(analysis -> dependents[_grammar_analysis_index(analysis, entry)],
+                      (void *) ((intptr_t) ix));
+        }
+      }
+    }
+  }
+  for (ix = analysis -> num_nonterminals - 1; ix >= 0; ix--) {
+    _grammar_analysis_push(analysis, ix);
+  }
+  while (analysis -> len) {
+    ix = _grammar_analysis_pop(analysis);
+    visits++;
+    if (_nonterminal_update_firsts(analysis -> nonterminals[ix], analysis -> scratch)) {
+      for (list_start(analysis -> dependents[ix]); list_has_next(analysis -> dependents[ix]); ) {
+        dep = (int) (intptr_t) list_next(analysis -> dependents[ix]);
+        _grammar_analysis_push(analysis, dep);
+      }
+    }
+  }
+  debug(grammar, "FIRST sets built: %d non-terminals, %ld visits",
+        analysis -> num_nonterminals, visits);
+  return analysis;
 }
 
 /*
@@ -244,50 +390,65 @@ void _grammar_get_firsts_visitor(entry_t *entry) {
       then everything in FOLLOW(A) is in FOLLOW(B)
     If there is a production A → aBb, where FIRST(b) contains ε,
       then everything in FOLLOW(A) is in FOLLOW(B)
+
+    The FIRST(b) contributions are fixed once the FIRST sets are known and
+    are added in a single pass. The FOLLOW(A) contributions are recorded as
+    dependencies and propagated using the worklist.
 */
-void * _grammar_follows_reducer(entry_t *entry, int *current_sum) {
-  nonterminal_t *nonterminal, *nt;
-  int            i, j, k;
+grammar_analysis_t * _grammar_build_follows(grammar_analysis_t *analysis) {
+  nonterminal_t *nonterminal;
   rule_t        *rule;
-  rule_entry_t  *rule_entry, *it, *next;
-  set_t         *follows, *f, *next_firsts;
-
-  nonterminal = (nonterminal_t *) (entry -> value);
-
-  debug(grammar, "Building FOLLOW sets for rule %s", nonterminal -> name);
-  follows = _nonterminal_get_follows(nonterminal);
-  for (i = 0; i < array_size(nonterminal -> rules); i++) {
-    rule = nonterminal_get_rule(nonterminal, i);
-    for (j = 0; j < array_size(rule -> entries); j++) {
-      rule_entry = rule_get_entry(rule, j);
-      if (!rule_entry -> terminal) {
-        next_firsts = intset_create();
-        next = NULL;
-        for (k = j + 1; k < array_size(rule -> entries); k++) {
-          it = rule_get_entry(rule, k);
-          if (!next) {
-            next = it;
-          }
-          _rule_entry_get_firsts(it, next_firsts);
-          if (!set_has_int(next_firsts, TokenCodeEmpty)) {
-            break;
-          }
+  rule_entry_t  *rule_entry;
+  bitset_t      *next_firsts = analysis -> scratch;
+  bitset_t      *follows;
+  int            ix, i, j, k, nt, dep;
+  long           visits = 0;
+
+  _grammar_analysis_reset(analysis);
+  for (ix = 0; ix < analysis -> num_nonterminals; ix++) {
+    _nonterminal_get_follows(analysis -> nonterminals[ix]);
+  }
+  for (ix = 0; ix < analysis -> num_nonterminals; ix++) {
+    nonterminal = analysis -> nonterminals[ix];
+    for (i = 0; i < array_size(nonterminal -> rules); i++) {
+      rule = nonterminal_get_rule(nonterminal, i);
+      for (j = 0; j < array_size(rule -> entries); j++) {
+        rule_entry = rule_get_entry(rule, j);
+        if (rule_entry -> terminal) {
+          continue;
+        }
+        nt = _grammar_analysis_index(analysis, rule_entry);
+        bitset_clear(next_firsts);
+        bitset_add(next_firsts, TokenCodeEmpty);
+        for (k = j + 1; bitset_has(next_firsts, TokenCodeEmpty) && (k < array_size(rule -> entries)); k++) {
+          bitset_remove(next_firsts, TokenCodeEmpty);
+          _rule_entry_get_firsts(rule_get_entry(rule, k), next_firsts);
         }
-        nt = grammar_get_nonterminal(
-               nonterminal_get_grammar(rule_entry),
-               rule_entry -> nonterminal);
-        f = _nonterminal_get_follows(nt);
-        if ((next == NULL) || set_has_int(next_firsts, TokenCodeEmpty)) {
-          set_union(f, follows);
+        if (bitset_has(next_firsts, TokenCodeEmpty) && (nt != ix)) {
+          list_append(analysis -> dependents[ix], (void *) ((intptr_t) nt));
         }
-        set_remove_int(next_firsts, TokenCodeEmpty);
-        set_union(f, next_firsts);
-        set_free(next_firsts);
+        bitset_remove(next_firsts, TokenCodeEmpty);
+        bitset_union(_nonterminal_get_follows(analysis -> nonterminals[nt]), next_firsts);
       }
     }
   }
-  *current_sum += set_size(follows);
-  return current_sum;
+  for (ix = analysis -> num_nonterminals - 1; ix >= 0; ix--) {
+    _grammar_analysis_push(analysis, ix);
+  }
+  while (analysis -> len) {
+    ix = _grammar_analysis_pop(analysis);
+    visits++;
+    follows = analysis -> nonterminals[ix] -> follows;
+    for (list_start(analysis -> dependents[ix]); list_has_next(analysis -> dependents[ix]); ) {
+      dep = (int) (intptr_t) list_next(analysis -> dependents[ix]);
+      if (bitset_union(analysis -> nonterminals[dep] -> follows, follows)) {
+        _grammar_analysis_push(analysis, dep);
+      }
+    }
+  }
+  debug(grammar, "FOLLOW sets built: %d non-terminals, %ld visits",
+        analysis -> num_nonterminals, visits);
+  return analysis;
 }
 
 int * _grammar_check_LL1_reducer(entry_t *entry, int *ok) {
@@ -366,20 +527,24 @@ function_t * grammar_resolve_function(grammar_t *grammar, char *func_name) {
 }
 
 grammar_t * grammar_analyze(grammar_t *grammar) {
-  int sum, prev_sum, iter, ll_1;
-
-  debug(grammar, "Building FIRST sets");
-  dict_visit(grammar -> nonterminals, (visit_t) _grammar_get_firsts_visitor);
-
-  debug(grammar, "Building FOLLOW sets");
-  sum = 0;
-  iter = 1;
-  do {
-    prev_sum = sum;
-    sum = 0;
-    dict_reduce(grammar -> nonterminals, (reduce_t) _grammar_follows_reducer, &sum);
-    debug(grammar, "_grammar_analyze - build follows: iter: %d sum: %d", iter++, sum);
-  } while (sum != prev_sum);
+  grammar_analysis_t *analysis;
+  int                 ll_1;
+
+  if (grammar -> strategy == ParsingStrategyBottomUp) {
+    debug(grammar, "Building LALR(1) parse tables");
+    lr_table_free(grammar -> lr_table);
+    grammar -> lr_table = lr_table_create(grammar);
+    if (grammar -> lr_table && grammar_debug) {
+      info("Grammar is LALR(1)");
+    }
+    return (grammar -> lr_table) ? grammar : NULL;
+  }
+
+  debug(grammar, "Building FIRST and FOLLOW sets");
+  analysis = _grammar_analysis_create(grammar);
+  _grammar_build_firsts(analysis);
+  _grammar_build_follows(analysis);
+  _grammar_analysis_free(analysis);
 
   debug(grammar, "Checking grammar for LL(1)-ness");
   debug(grammar, "Keywords: %s", dict_tostring(grammar -> keywords));
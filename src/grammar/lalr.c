@@ -0,0 +1,831 @@
+/*
+ * /obelix/src/grammar/lalr.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "libgrammar.h"
+
+/*
+ * LALR(1) parse table generator.
+ *
+ * The grammar is first flattened into a list of productions over integer
+ * symbols: terminals are numbered 0 .. T-1 and nonterminals T .. T+N-1.
+ * Nonterminal 0 is the synthetic start symbol of the augmented production
+ * $accept := <entrypoint>.
+ *
+ * Grammar actions are executed in the same order as the top-down parser
+ * executes them. Actions that the top-down parser runs in the middle of a
+ * rule (nonterminal and rule actions, which run before the first entry,
+ * and actions attached to any entry but the last) are moved into synthetic
+ * empty 'marker' productions which are inserted into the rule at the
+ * position of the actions. The actions of the last entry of a rule are
+ * executed when the rule itself is reduced.
+ *
+ * The LALR(1) automaton is built by constructing the LR(0) item sets and
+ * merging the LR(1) lookaheads of states with identical kernels, reprocessing
+ * states whose lookaheads grew until nothing changes anymore.
+ *
+ * Conflicts are resolved the same way the LL(1) parse tables resolve
+ * overlapping FIRST and FOLLOW sets: a shift wins over a reduction (non-empty
+ * rules take precedence over empty ones), a reduction of a marker wins over
+ * the reduction of an empty rule for the same reason, and otherwise the
+ * reduction by the rule declared first wins.
+ */
+
+typedef struct _lr_state {
+  int            num_kernel;
+  int           *kernel;
+  bitset_word_t *lookaheads;
+  unsigned int   hash;
+  int            next;
+  int            queued;
+  int            num_transitions;
+  int           *transition_symbols;
+  int           *transition_targets;
+} lr_state_t;
+
+typedef struct _lr_builder {
+  grammar_t       *grammar;
+  lr_table_t      *table;
+  int              ok;
+  int              conflicts;
+
+  int              num_real;
+  nonterminal_t  **nonterminals;
+  int              productions_size;
+
+  int              words;
+  bitset_word_t   *firsts;
+  char            *nullable;
+  int             *nt_offsets;
+  int             *nt_productions;
+
+  int              num_items;
+  int             *item_base;
+  int             *item_production;
+
+  int              states_size;
+  lr_state_t      *states;
+  int             *buckets;
+  int              num_buckets;
+  int             *queue;
+  int              queue_len;
+  int              queue_size;
+
+  int              stamp;
+  int             *closure_mark;
+  int             *closure_items;
+  int              closure_len;
+  bitset_word_t   *closure_lookaheads;
+  int             *worklist;
+  char            *in_worklist;
+  int             *pairs;
+  bitset_word_t   *scratch;
+} lr_builder_t;
+
+static int               _lr_nonterminal_cmp(const void *, const void *);
+static int               _lr_nonterminal_index(lr_builder_t *, char *);
+static list_t *          _lr_collect_nonterminal(nonterminal_t *, list_t *);
+static lr_builder_t *    _lr_collect_terminals(lr_builder_t *);
+static lr_production_t * _lr_add_production(lr_builder_t *, int);
+static lr_production_t * _lr_production_push(lr_production_t *, int);
+static lr_production_t * _lr_production_add_actions(lr_production_t *, list_t *);
+static int               _lr_add_marker(lr_builder_t *, list_t *, int);
+static lr_builder_t *    _lr_flatten(lr_builder_t *);
+static lr_builder_t *    _lr_compute_firsts(lr_builder_t *);
+static lr_builder_t *    _lr_build_items(lr_builder_t *);
+static int               _lr_find_or_create_state(lr_builder_t *, int *, int, bitset_word_t *);
+static lr_builder_t *    _lr_closure(lr_builder_t *, int);
+static lr_builder_t *    _lr_process_state(lr_builder_t *, int);
+static lr_builder_t *    _lr_build_automaton(lr_builder_t *);
+static lr_builder_t *    _lr_build_tables(lr_builder_t *);
+static char *            _lr_symbol_name(lr_builder_t *, int, char *, size_t);
+static void              _lr_builder_free(lr_builder_t *);
+
+/* -- F L A T T E N I N G ------------------------------------------------- */
+
+int _lr_nonterminal_cmp(const void *nt1, const void *nt2) {
+  return strcmp((*((nonterminal_t **) nt1)) -> name,
+                (*((nonterminal_t **) nt2)) -> name);
+}
+
+int _lr_nonterminal_index(lr_builder_t *builder, char *name) {
+  nonterminal_t   key;
+  nonterminal_t  *keyptr = &key;
+  nonterminal_t **found;
+
+  key.name = name;
+  found = bsearch(&keyptr, builder -> nonterminals, builder -> num_real,
+                  sizeof(nonterminal_t *), _lr_nonterminal_cmp);
+  return (found) ? (int) (found - builder -> nonterminals) + 1 : -1;
+}
+
+list_t * _lr_collect_nonterminal(nonterminal_t *nonterminal, list_t *nonterminals) {
+  list_append(nonterminals, nonterminal);
+  return nonterminals;
+}
+
+lr_builder_t * _lr_collect_terminals(lr_builder_t *builder) {
+  lr_table_t    *table = builder -> table;
+  nonterminal_t *nonterminal;
+  rule_t        *rule;
+  rule_entry_t  *entry;
+  int            ix, jx, kx, code;
+
+  table -> max_code = TokenCodeEnd;
+  for (ix = 0; ix < builder -> num_real; ix++) {
+    nonterminal = builder -> nonterminals[ix];
+    for (jx = 0; jx < array_size(nonterminal -> rules); jx++) {
+      rule = nonterminal_get_rule(nonterminal, jx);
+      for (kx = 0; kx < array_size(rule -> entries); kx++) {
+        entry = rule_get_entry(rule, kx);
+        if (entry -> terminal && (token_code(entry -> token) > table -> max_code)) {
+          table -> max_code = token_code(entry -> token);
+        }
+      }
+    }
+  }
+  table -> terminals = NEWARR(table -> max_code + 1, int);
+  for (code = 0; code <= table -> max_code; code++) {
+    table -> terminals[code] = -1;
+  }
+  table -> terminals[TokenCodeEnd] = 0;
+  for (ix = 0; ix < builder -> num_real; ix++) {
+    nonterminal = builder -> nonterminals[ix];
+    for (jx = 0; jx < array_size(nonterminal -> rules); jx++) {
+      rule = nonterminal_get_rule(nonterminal, jx);
+      for (kx = 0; kx < array_size(rule -> entries); kx++) {
+        entry = rule_get_entry(rule, kx);
+        if (entry -> terminal && (token_code(entry -> token) != TokenCodeEmpty)) {
+          table -> terminals[token_code(entry -> token)] = 0;
+        }
+      }
+    }
+  }
+
+  /* Number the terminals in token code order: */
+  table -> num_terminals = 0;
+  for (code = 0; code <= table -> max_code; code++) {
+    if (!table -> terminals[code]) {
+      table -> terminals[code] = table -> num_terminals++;
+    }
+  }
+  return builder;
+}
+
+lr_production_t * _lr_add_production(lr_builder_t *builder, int lhs) {
+  lr_table_t      *table = builder -> table;
+  lr_production_t *production;
+
+  if (table -> num_productions >= builder -> productions_size) {
+    table -> productions = resize_block(
+      table -> productions,
+      2 * builder -> productions_size * sizeof(lr_production_t),
+      builder -> productions_size * sizeof(lr_production_t));
+    builder -> productions_size *= 2;
+  }
+  production = &table -> productions[table -> num_productions++];
+  production -> lhs = lhs;
+  production -> length = 0;
+  production -> rhs = NULL;
+  production -> num_actions = 0;
+  production -> actions = NULL;
+  production -> lookahead = FALSE;
+  production -> rule = NULL;
+  return production;
+}
+
+lr_production_t * _lr_production_push(lr_production_t *production, int symbol) {
+  production -> rhs = resize_block(production -> rhs,
+                                   (production -> length + 1) * sizeof(int),
+                                   production -> length * sizeof(int));
+  production -> rhs[production -> length++] = symbol;
+  return production;
+}
+
+lr_production_t * _lr_production_add_actions(lr_production_t *production, list_t *actions) {
+  int num = list_size(actions);
+  int ix;
+
+  if (num) {
+    production -> actions = resize_block(
+      production -> actions,
+      (production -> num_actions + num) * sizeof(grammar_action_t *),
+      production -> num_actions * sizeof(grammar_action_t *));
+    for (ix = 0; ix < num; ix++) {
+      production -> actions[production -> num_actions++] =
+        grammar_action_copy(list_get(actions, ix));
+    }
+  }
+  return production;
+}
+
+int _lr_add_marker(lr_builder_t *builder, list_t *actions, int lookahead) {
+  lr_production_t *marker;
+  int              lhs;
+
+  lhs = builder -> table -> num_nonterminals++;
+  marker = _lr_add_production(builder, lhs);
+  _lr_production_add_actions(marker, actions);
+  marker -> lookahead = lookahead;
+  return lhs;
+}
+
+lr_builder_t * _lr_flatten(lr_builder_t *builder) {
+  grammar_t       *grammar = builder -> grammar;
+  lr_table_t      *table = builder -> table;
+  list_t          *nonterminals;
+  nonterminal_t   *nonterminal;
+  rule_t          *rule;
+  rule_entry_t    *entry;
+  lr_production_t *production;
+  list_t          *pending;
+  int              pending_lookahead;
+  int              ix, jx, kx, symbol, nt, p;
+
+  nonterminals = dict_reduce_values(grammar -> nonterminals,
+                                    (reduce_t) _lr_collect_nonterminal,
+                                    list_create());
+  builder -> num_real = list_size(nonterminals);
+  builder -> nonterminals = NEWARR(builder -> num_real, nonterminal_t *);
+  for (ix = 0; ix < builder -> num_real; ix++) {
+    builder -> nonterminals[ix] = list_get(nonterminals, ix);
+  }
+  list_free(nonterminals);
+  qsort(builder -> nonterminals, builder -> num_real,
+        sizeof(nonterminal_t *), _lr_nonterminal_cmp);
+
+  _lr_collect_terminals(builder);
+  table -> num_nonterminals = builder -> num_real + 1;
+  builder -> productions_size = 16;
+  table -> productions = NEWARR(builder -> productions_size, lr_production_t);
+
+  production = _lr_add_production(builder, 0);
+  _lr_production_push(production,
+    table -> num_terminals + _lr_nonterminal_index(builder, grammar -> entrypoint -> name));
+
+  pending = list_create();
+  for (ix = 0; builder -> ok && (ix < builder -> num_real); ix++) {
+    nonterminal = builder -> nonterminals[ix];
+    for (jx = 0; builder -> ok && (jx < array_size(nonterminal -> rules)); jx++) {
+      rule = nonterminal_get_rule(nonterminal, jx);
+      p = _lr_add_production(builder, ix + 1) - table -> productions;
+
+      /*
+       * The top-down parser never executes the actions of the entrypoint
+       * nonterminal, only those of its rules:
+       */
+      list_clear(pending);
+      if (nonterminal != grammar -> entrypoint) {
+        list_add_all(pending, ((ge_t *) nonterminal) -> actions);
+      }
+      list_add_all(pending, ((ge_t *) rule) -> actions);
+      pending_lookahead = TRUE;
+
+      for (kx = 0; kx < array_size(rule -> entries); kx++) {
+        entry = rule_get_entry(rule, kx);
+        if (entry -> terminal && (token_code(entry -> token) == TokenCodeEmpty)) {
+          list_add_all(pending, ((ge_t *) entry) -> actions);
+          continue;
+        }
+        if (list_notempty(pending)) {
+          nt = _lr_add_marker(builder, pending, pending_lookahead);
+          _lr_production_push(&table -> productions[p], table -> num_terminals + nt);
+          list_clear(pending);
+        }
+        if (entry -> terminal) {
+          symbol = table -> terminals[token_code(entry -> token)];
+        } else {
+          symbol = _lr_nonterminal_index(builder, entry -> nonterminal);
+          if (symbol < 0) {
+            error("Non-terminal '%s' referenced in rule for '%s' not found",
+                  entry -> nonterminal, nonterminal -> name);
+            builder -> ok = FALSE;
+            break;
+          }
+          symbol += table -> num_terminals;
+        }
+        _lr_production_push(&table -> productions[p], symbol);
+        list_add_all(pending, ((ge_t *) entry) -> actions);
+        pending_lookahead = FALSE;
+      }
+      production = &table -> productions[p];
+      production -> rule = rule;
+      production -> lookahead = pending_lookahead;
+      _lr_production_add_actions(production, pending);
+    }
+  }
+  list_free(pending);
+  return builder;
+}
+
+/* -- F I R S T  S E T S -------------------------------------------------- */
+
+lr_builder_t * _lr_compute_firsts(lr_builder_t *builder) {
+  lr_table_t      *table = builder -> table;
+  lr_production_t *production;
+  int              T = table -> num_terminals;
+  int              words, changed, ix, jx, symbol, lhs;
+
+  words = builder -> words = bitset_words(T);
+  builder -> firsts = NEWARR(table -> num_nonterminals * words, bitset_word_t);
+  builder -> nullable = NEWARR(table -> num_nonterminals, char);
+
+  do {
+    changed = FALSE;
+    for (ix = 0; ix < table -> num_productions; ix++) {
+      production = &table -> productions[ix];
+      lhs = production -> lhs;
+      for (jx = 0; jx < production -> length; jx++) {
+        symbol = production -> rhs[jx];
+        if (symbol < T) {
+          if (!bitset_bits_has(builder -> firsts + lhs * words, symbol)) {
+            bitset_bits_set(builder -> firsts + lhs * words, symbol);
+            changed = TRUE;
+          }
+          break;
+        }
+        changed |= bitset_bits_union(builder -> firsts + lhs * words,
+                                  builder -> firsts + (symbol - T) * words,
+                                  words);
+        if (!builder -> nullable[symbol - T]) {
+          break;
+        }
+      }
+      if ((jx == production -> length) && !builder -> nullable[lhs]) {
+        builder -> nullable[lhs] = TRUE;
+        changed = TRUE;
+      }
+    }
+  } while (changed);
+
+  /* Index productions by their left hand side: */
+  builder -> nt_offsets = NEWARR(table -> num_nonterminals + 1, int);
+  builder -> nt_productions = NEWARR(table -> num_productions, int);
+  for (ix = 0; ix < table -> num_productions; ix++) {
+    builder -> nt_offsets[table -> productions[ix].lhs + 1]++;
+  }
+  for (ix = 0; ix < table -> num_nonterminals; ix++) {
+    builder -> nt_offsets[ix + 1] += builder -> nt_offsets[ix];
+  }
+  for (ix = table -> num_productions - 1; ix >= 0; ix--) {
+    lhs = table -> productions[ix].lhs;
+    builder -> nt_productions[builder -> nt_offsets[lhs + 1] - 1] = ix;
+    builder -> nt_offsets[lhs + 1]--;
+  }
+  /* nt_offsets[lhs + 1] now holds the start of the productions for lhs: */
+  for (ix = 0; ix < table -> num_nonterminals; ix++) {
+    builder -> nt_offsets[ix] = builder -> nt_offsets[ix + 1];
+  }
+  builder -> nt_offsets[table -> num_nonterminals] = table -> num_productions;
+  return builder;
+}
+
+lr_builder_t * _lr_build_items(lr_builder_t *builder) {
+  lr_table_t *table = builder -> table;
+  int         ix, jx;
+
+  builder -> item_base = NEWARR(table -> num_productions, int);
+  builder -> num_items = 0;
+  for (ix = 0; ix < table -> num_productions; ix++) {
+    builder -> item_base[ix] = builder -> num_items;
+    builder -> num_items += table -> productions[ix].length + 1;
+  }
+  builder -> item_production = NEWARR(builder -> num_items, int);
+  for (ix = 0; ix < table -> num_productions; ix++) {
+    for (jx = 0; jx <= table -> productions[ix].length; jx++) {
+      builder -> item_production[builder -> item_base[ix] + jx] = ix;
+    }
+  }
+  builder -> closure_mark = NEWARR(builder -> num_items, int);
+  builder -> closure_items = NEWARR(builder -> num_items, int);
+  builder -> closure_lookaheads = NEWARR(builder -> num_items * builder -> words, bitset_word_t);
+  builder -> worklist = NEWARR(builder -> num_items, int);
+  builder -> in_worklist = NEWARR(builder -> num_items, char);
+  builder -> pairs = NEWARR(2 * builder -> num_items, int);
+  builder -> scratch = NEWARR(builder -> words, bitset_word_t);
+  return builder;
+}
+
+/* -- A U T O M A T O N --------------------------------------------------- */
+
+int _lr_find_or_create_state(lr_builder_t *builder, int *kernel, int num, bitset_word_t *lookaheads) {
+  unsigned int  h = 0;
+  int           ix, s;
+  lr_state_t   *state;
+  int           words = builder -> words;
+
+  for (ix = 0; ix < num; ix++) {
+    h = hashblend(h, (unsigned int) kernel[ix]);
+  }
+  for (s = builder -> buckets[h % builder -> num_buckets]; s >= 0; s = state -> next) {
+    state = &builder -> states[s];
+    if ((state -> hash == h) && (state -> num_kernel == num) &&
+        !memcmp(state -> kernel, kernel, num * sizeof(int))) {
+      if (bitset_bits_union(state -> lookaheads, lookaheads, num * words) && !state -> queued) {
+        state -> queued = TRUE;
+        builder -> queue[builder -> queue_len++] = s;
+      }
+      return s;
+    }
+  }
+
+  s = builder -> table -> num_states++;
+  if (s >= builder -> states_size) {
+    builder -> states = resize_block(builder -> states,
+                                     2 * builder -> states_size * sizeof(lr_state_t),
+                                     builder -> states_size * sizeof(lr_state_t));
+    builder -> queue = resize_block(builder -> queue,
+                                    2 * builder -> states_size * sizeof(int),
+                                    builder -> states_size * sizeof(int));
+    builder -> states_size *= 2;
+  }
+  state = &builder -> states[s];
+  state -> num_kernel = num;
+  state -> kernel = NEWARR(num, int);
+  memcpy(state -> kernel, kernel, num * sizeof(int));
+  state -> lookaheads = NEWARR(num * words, bitset_word_t);
+  memcpy(state -> lookaheads, lookaheads, num * words * sizeof(bitset_word_t));
+  state -> hash = h;
+  state -> next = builder -> buckets[h % builder -> num_buckets];
+  builder -> buckets[h % builder -> num_buckets] = s;
+  state -> num_transitions = -1;
+  state -> queued = TRUE;
+  builder -> queue[builder -> queue_len++] = s;
+  return s;
+}
+
+static inline void _lr_closure_add(lr_builder_t *builder, int item, bitset_word_t *lookaheads, int *wl_len) {
+  int            words = builder -> words;
+  bitset_word_t *la = builder -> closure_lookaheads + item * words;
+
+  if (builder -> closure_mark[item] != builder -> stamp) {
+    builder -> closure_mark[item] = builder -> stamp;
+    memcpy(la, lookaheads, words * sizeof(bitset_word_t));
+    builder -> closure_items[builder -> closure_len++] = item;
+  } else if (!bitset_bits_union(la, lookaheads, words)) {
+    return;
+  }
+  if (!builder -> in_worklist[item]) {
+    builder -> in_worklist[item] = TRUE;
+    builder -> worklist[(*wl_len)++] = item;
+  }
+}
+
+lr_builder_t * _lr_closure(lr_builder_t *builder, int s) {
+  lr_table_t      *table = builder -> table;
+  lr_state_t      *state = &builder -> states[s];
+  lr_production_t *production;
+  int              T = table -> num_terminals;
+  int              words = builder -> words;
+  int              wl_len = 0;
+  int              ix, item, dot, symbol, nt, p;
+
+  builder -> stamp++;
+  builder -> closure_len = 0;
+  for (ix = 0; ix < state -> num_kernel; ix++) {
+    _lr_closure_add(builder, state -> kernel[ix],
+                    state -> lookaheads + ix * words, &wl_len);
+  }
+  while (wl_len) {
+    item = builder -> worklist[--wl_len];
+    builder -> in_worklist[item] = FALSE;
+    production = &table -> productions[builder -> item_production[item]];
+    dot = item - builder -> item_base[builder -> item_production[item]];
+    if ((dot >= production -> length) || (production -> rhs[dot] < T)) {
+      continue;
+    }
+    nt = production -> rhs[dot] - T;
+
+    /* scratch := FIRST(rest of the rule following the nonterminal, lookaheads) */
+    memset(builder -> scratch, 0, words * sizeof(bitset_word_t));
+    for (ix = dot + 1; ix < production -> length; ix++) {
+      symbol = production -> rhs[ix];
+      if (symbol < T) {
+        bitset_bits_set(builder -> scratch, symbol);
+        break;
+      }
+      bitset_bits_union(builder -> scratch, builder -> firsts + (symbol - T) * words, words);
+      if (!builder -> nullable[symbol - T]) {
+        break;
+      }
+    }
+    if (ix >= production -> length) {
+      bitset_bits_union(builder -> scratch,
+                     builder -> closure_lookaheads + item * words, words);
+    }
+    for (p = builder -> nt_offsets[nt]; p < builder -> nt_offsets[nt + 1]; p++) {
+      _lr_closure_add(builder, builder -> item_base[builder -> nt_productions[p]],
+                      builder -> scratch, &wl_len);
+    }
+  }
+  return builder;
+}
+
+static int _lr_pair_cmp(const void *p1, const void *p2) {
+  const int *pair1 = (const int *) p1;
+  const int *pair2 = (const int *) p2;
+
+  return (pair1[0] != pair2[0]) ? pair1[0] - pair2[0] : pair1[1] - pair2[1];
+}
+
+lr_builder_t * _lr_process_state(lr_builder_t *builder, int s) {
+  lr_table_t      *table = builder -> table;
+  lr_production_t *production;
+  int              words = builder -> words;
+  int              num_pairs = 0;
+  int              ix, jx, item, dot, symbol, target, record;
+  int             *kernel;
+  bitset_word_t   *lookaheads;
+
+  _lr_closure(builder, s);
+  for (ix = 0; ix < builder -> closure_len; ix++) {
+    item = builder -> closure_items[ix];
+    production = &table -> productions[builder -> item_production[item]];
+    dot = item - builder -> item_base[builder -> item_production[item]];
+    if (dot < production -> length) {
+      builder -> pairs[2 * num_pairs] = production -> rhs[dot];
+      builder -> pairs[2 * num_pairs + 1] = item;
+      num_pairs++;
+    }
+  }
+  qsort(builder -> pairs, num_pairs, 2 * sizeof(int), _lr_pair_cmp);
+
+  record = builder -> states[s].num_transitions < 0;
+  if (record) {
+    builder -> states[s].num_transitions = 0;
+    builder -> states[s].transition_symbols = NEWARR(num_pairs, int);
+    builder -> states[s].transition_targets = NEWARR(num_pairs, int);
+  }
+  kernel = NEWARR(num_pairs, int);
+  lookaheads = NEWARR(num_pairs * words, bitset_word_t);
+  for (ix = 0; ix < num_pairs; ix = jx) {
+    symbol = builder -> pairs[2 * ix];
+    for (jx = ix; (jx < num_pairs) && (builder -> pairs[2 * jx] == symbol); jx++) {
+      item = builder -> pairs[2 * jx + 1];
+      kernel[jx - ix] = item + 1;
+      memcpy(lookaheads + (jx - ix) * words,
+             builder -> closure_lookaheads + item * words,
+             words * sizeof(bitset_word_t));
+    }
+    /* _lr_find_or_create_state may move the states array: */
+    target = _lr_find_or_create_state(builder, kernel, jx - ix, lookaheads);
+    if (record) {
+      lr_state_t *state = &builder -> states[s];
+
+      state -> transition_symbols[state -> num_transitions] = symbol;
+      state -> transition_targets[state -> num_transitions++] = target;
+    }
+  }
+  free(kernel);
+  free(lookaheads);
+  return builder;
+}
+
+lr_builder_t * _lr_build_automaton(lr_builder_t *builder) {
+  int            kernel = 0;
+  bitset_word_t *lookaheads;
+  int            s;
+
+  builder -> states_size = 64;
+  builder -> states = NEWARR(builder -> states_size, lr_state_t);
+  builder -> queue = NEWARR(builder -> states_size, int);
+  builder -> num_buckets = 1021;
+  builder -> buckets = NEWARR(builder -> num_buckets, int);
+  memset(builder -> buckets, -1, builder -> num_buckets * sizeof(int));
+
+  /* $accept := . <entrypoint>, with lookahead End: */
+  lookaheads = NEWARR(builder -> words, bitset_word_t);
+  bitset_bits_set(lookaheads, builder -> table -> terminals[TokenCodeEnd]);
+  _lr_find_or_create_state(builder, &kernel, 1, lookaheads);
+  free(lookaheads);
+
+  while (builder -> queue_len) {
+    s = builder -> queue[--builder -> queue_len];
+    builder -> states[s].queued = FALSE;
+    _lr_process_state(builder, s);
+  }
+  debug(grammar, "LALR(1) automaton: %d states, %d productions, %d items",
+        builder -> table -> num_states, builder -> table -> num_productions,
+        builder -> num_items);
+  return builder;
+}
+
+/* -- T A B L E S --------------------------------------------------------- */
+
+char * _lr_symbol_name(lr_builder_t *builder, int symbol, char *buf, size_t sz) {
+  int      T = builder -> table -> num_terminals;
+  int      code;
+  token_t *kw;
+
+  if (symbol >= T) {
+    symbol -= T;
+    if (!symbol) {
+      snprintf(buf, sz, "$accept");
+    } else if (symbol <= builder -> num_real) {
+      snprintf(buf, sz, "%s", builder -> nonterminals[symbol - 1] -> name);
+    } else {
+      snprintf(buf, sz, "@%d", symbol - builder -> num_real);
+    }
+    return buf;
+  }
+  for (code = 0; code <= builder -> table -> max_code; code++) {
+    if (builder -> table -> terminals[code] == symbol) {
+      break;
+    }
+  }
+  kw = (token_t *) dict_get_int(builder -> grammar -> keywords, code);
+  if (kw) {
+    snprintf(buf, sz, "\"%s\"", token_token(kw));
+  } else if (code < 200) {
+    snprintf(buf, sz, "%s", token_code_name(code));
+  } else {
+    snprintf(buf, sz, "keyword %d", code);
+  }
+  return buf;
+}
+
+/*
+ * The reduction of a marker production means a non-empty rule is entered,
+ * which the top-down parser prefers over completing an empty rule.
+ */
+static int _lr_reduce_precedes(lr_table_t *table, int p1, int p2) {
+  int marker1 = table -> productions[p1].rule == NULL;
+  int marker2 = table -> productions[p2].rule == NULL;
+
+  return (marker1 != marker2) ? marker1 : (p1 < p2);
+}
+
+lr_builder_t * _lr_build_tables(lr_builder_t *builder) {
+  lr_table_t      *table = builder -> table;
+  lr_state_t      *state;
+  lr_production_t *production;
+  int              T = table -> num_terminals;
+  int              N = table -> num_nonterminals;
+  int              words = builder -> words;
+  int              s, ix, t, item, p, dot, reduction, shifts;
+  int             *entry;
+  char             buf1[64], buf2[64];
+
+  table -> action = NEWARR(table -> num_states * T, int);
+  table -> goto_table = NEWARR(table -> num_states * N, int);
+  table -> default_reduction = NEWARR(table -> num_states, int);
+
+  for (s = 0; s < table -> num_states; s++) {
+    state = &builder -> states[s];
+    shifts = 0;
+    for (ix = 0; ix < state -> num_transitions; ix++) {
+      if (state -> transition_symbols[ix] < T) {
+        table -> action[s * T + state -> transition_symbols[ix]] =
+          state -> transition_targets[ix] + 1;
+        shifts++;
+      } else {
+        table -> goto_table[s * N + state -> transition_symbols[ix] - T] =
+          state -> transition_targets[ix];
+      }
+    }
+
+    reduction = -1;
+    _lr_closure(builder, s);
+    for (ix = 0; ix < builder -> closure_len; ix++) {
+      item = builder -> closure_items[ix];
+      p = builder -> item_production[item];
+      production = &table -> productions[p];
+      dot = item - builder -> item_base[p];
+      if (dot < production -> length) {
+        continue;
+      }
+      reduction = (reduction == -1) ? p : -2;
+      for (t = 0; t < T; t++) {
+        if (!bitset_bits_has(builder -> closure_lookaheads + item * words, t)) {
+          continue;
+        }
+        entry = &table -> action[s * T + t];
+        if (*entry > 0) {
+          debug(grammar, "Shift/reduce conflict in state %d on %s (%s), shifting",
+                s, _lr_symbol_name(builder, t, buf1, 64),
+                _lr_symbol_name(builder, T + production -> lhs, buf2, 64));
+          builder -> conflicts++;
+        } else if (*entry && (*entry != -(p + 1))) {
+          if (_lr_reduce_precedes(table, p, -*entry - 1)) {
+            *entry = -(p + 1);
+          }
+          debug(grammar, "Reduce/reduce conflict in state %d on %s (%s), reducing by production %d",
+                s, _lr_symbol_name(builder, t, buf1, 64),
+                _lr_symbol_name(builder, T + production -> lhs, buf2, 64),
+                -*entry - 1);
+          builder -> conflicts++;
+        } else {
+          *entry = -(p + 1);
+        }
+      }
+    }
+    table -> default_reduction[s] = (!shifts && (reduction >= 0)) ? reduction : -1;
+  }
+  if (builder -> conflicts) {
+    debug(grammar, "%d LALR(1) conflicts resolved", builder -> conflicts);
+  }
+  return builder;
+}
+
+void _lr_builder_free(lr_builder_t *builder) {
+  int ix;
+
+  for (ix = 0; builder -> states && (ix < builder -> table -> num_states); ix++) {
+    free(builder -> states[ix].kernel);
+    free(builder -> states[ix].lookaheads);
+    free(builder -> states[ix].transition_symbols);
+    free(builder -> states[ix].transition_targets);
+  }
+  free(builder -> states);
+  free(builder -> buckets);
+  free(builder -> queue);
+  free(builder -> nonterminals);
+  free(builder -> firsts);
+  free(builder -> nullable);
+  free(builder -> nt_offsets);
+  free(builder -> nt_productions);
+  free(builder -> item_base);
+  free(builder -> item_production);
+  free(builder -> closure_mark);
+  free(builder -> closure_items);
+  free(builder -> closure_lookaheads);
+  free(builder -> worklist);
+  free(builder -> in_worklist);
+  free(builder -> pairs);
+  free(builder -> scratch);
+  free(builder);
+}
+
+/* -- L R _ T A B L E  P U B L I C  F U N C T I O N S --------------------- */
+
+lr_table_t * lr_table_create(grammar_t *grammar) {
+  lr_builder_t *builder;
+  lr_table_t   *ret;
+  char         *image;
+
+  builder = NEW(lr_builder_t);
+  builder -> grammar = grammar;
+  builder -> table = NEW(lr_table_t);
+  builder -> ok = TRUE;
+  image = lr_table_get_image_dir();
+  if (_lr_flatten(builder) -> ok) {
+    builder -> table -> fingerprint = _lr_table_fingerprint(builder -> table);
+    if (!image || !_lr_table_load_image(builder -> table, image)) {
+      _lr_compute_firsts(builder);
+      _lr_build_items(builder);
+      _lr_build_automaton(builder);
+      _lr_build_tables(builder);
+      if (image && builder -> ok) {
+        _lr_table_save_image(builder -> table, image);
+      }
+    }
+  }
+  ret = builder -> table;
+  if (!builder -> ok) {
+    lr_table_free(ret);
+    ret = NULL;
+  }
+  _lr_builder_free(builder);
+  return ret;
+}
+
+void lr_table_free(lr_table_t *table) {
+  int ix, jx;
+
+  if (table) {
+    for (ix = 0; ix < table -> num_productions; ix++) {
+      for (jx = 0; jx < table -> productions[ix].num_actions; jx++) {
+        grammar_action_free(table -> productions[ix].actions[jx]);
+      }
+      free(table -> productions[ix].actions);
+      free(table -> productions[ix].rhs);
+    }
+    free(table -> productions);
+    free(table -> terminals);
+    if (table -> image) {
+      _lr_table_unmap_image(table);
+    } else {
+      free(table -> action);
+      free(table -> goto_table);
+      free(table -> default_reduction);
+    }
+    free(table);
+  }
+}
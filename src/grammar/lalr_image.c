@@ -0,0 +1,296 @@
+/*
+ * /obelix/src/grammar/lalr_image.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "libgrammar.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#include <resolve.h>
+
+/*
+ * LALR(1) table images.
+ *
+ * Building the LALR(1) automaton is the most expensive step of bringing up
+ * a bottom-up grammar, and the result only depends on the shape of the
+ * grammar. An image file stores the action, goto and default reduction
+ * tables of a table built earlier. The image is mapped read-only into the
+ * address space of later runs, and its arrays are used in place. Images
+ * live in an image directory, one file per grammar, named after the
+ * fingerprint of the grammar.
+ *
+ * The productions of a table hold pointers to the rules and actions of the
+ * live grammar and are therefore not stored. They are rebuilt by flattening
+ * the grammar, which is cheap, and the image is only used if it was written
+ * by the same build of the library and executable (as identified by their
+ * GNU build ids) and for a grammar with the same flattened productions.
+ */
+
+#define LR_IMAGE_MAGIC       "OBLLALR1"
+#define LR_IMAGE_VERSION     1
+#define LR_IMAGE_BUILD_ID    64
+
+typedef struct _lr_image_header {
+  char          magic[8];
+  unsigned int  version;
+  unsigned int  build_id_len;
+  unsigned char build_id[LR_IMAGE_BUILD_ID];
+  unsigned int  fingerprint;
+  int           num_terminals;
+  int           num_nonterminals;
+  int           num_productions;
+  int           num_states;
+  int           max_code;
+  size_t        action_offset;
+  size_t        goto_offset;
+  size_t        default_offset;
+  size_t        size;
+} lr_image_header_t;
+
+typedef struct _lr_build_id {
+  unsigned char id[LR_IMAGE_BUILD_ID];
+  unsigned int  len;
+} lr_build_id_t;
+
+static char          *_lr_image_dir = NULL;
+static lr_build_id_t  _lr_build_id;
+static pthread_once_t _lr_build_id_once = PTHREAD_ONCE_INIT;
+
+/* ------------------------------------------------------------------------ */
+
+static inline unsigned int _lr_hash_int(unsigned int hash, int value) {
+  return (hash ^ (unsigned int) value) * 16777619u;
+}
+
+static void _lr_build_id_init(void) {
+  _lr_build_id.len = resolve_build_id(NULL, _lr_build_id.id, LR_IMAGE_BUILD_ID);
+  _lr_build_id.len += resolve_build_id((void *) lr_table_create,
+                                       _lr_build_id.id + _lr_build_id.len,
+                                       LR_IMAGE_BUILD_ID - _lr_build_id.len);
+  if (!_lr_build_id.len) {
+    /*
+     * No build id notes. Fall back to the version and the time this file
+     * was compiled, which will at least catch most rebuilds.
+     */
+    _lr_build_id.len = (unsigned int) snprintf((char *) _lr_build_id.id, LR_IMAGE_BUILD_ID,
+                                               "%s %s %s", OBELIX_VERSION, __DATE__, __TIME__);
+  }
+}
+
+/* ------------------------------------------------------------------------ */
+
+unsigned int _lr_table_fingerprint(lr_table_t *table) {
+  lr_production_t *production;
+  unsigned int     hash = 2166136261u;
+  int              ix, jx;
+
+  hash = _lr_hash_int(hash, table -> num_terminals);
+  hash = _lr_hash_int(hash, table -> num_nonterminals);
+  hash = _lr_hash_int(hash, table -> num_productions);
+  hash = _lr_hash_int(hash, table -> max_code);
+  for (ix = 0; ix <= table -> max_code; ix++) {
+    hash = _lr_hash_int(hash, table -> terminals[ix]);
+  }
+  for (ix = 0; ix < table -> num_productions; ix++) {
+    production = &table -> productions[ix];
+    hash = _lr_hash_int(hash, production -> lhs);
+    hash = _lr_hash_int(hash, production -> lookahead);
+    hash = _lr_hash_int(hash, production -> length);
+    for (jx = 0; jx < production -> length; jx++) {
+      hash = _lr_hash_int(hash, production -> rhs[jx]);
+    }
+  }
+  return hash;
+}
+
+#ifdef HAVE_SYS_MMAN_H
+
+static char * _lr_image_path(lr_table_t *table, char *dir, char *buf, size_t sz) {
+  snprintf(buf, sz, "%s/%08x.lalr", dir, table -> fingerprint);
+  return buf;
+}
+
+/*
+ * Maps the image for the given flattened table and points its state tables
+ * into it. Returns the table if the image was usable, NULL otherwise.
+ */
+lr_table_t * _lr_table_load_image(lr_table_t *table, char *dir) {
+  lr_image_header_t *header;
+  struct stat        st;
+  void              *image;
+  int                fh;
+  size_t             states;
+  char              *reason = NULL;
+  char               path[MAX_PATH];
+
+  pthread_once(&_lr_build_id_once, _lr_build_id_init);
+  _lr_image_path(table, dir, path, MAX_PATH);
+  if ((fh = open(path, O_RDONLY)) < 0) {
+    debug(grammar, "No LALR(1) image '%s'", path);
+    return NULL;
+  }
+  if (fstat(fh, &st) || (st.st_size < (off_t) sizeof(lr_image_header_t))) {
+    close(fh);
+    debug(grammar, "LALR(1) image '%s' is truncated", path);
+    return NULL;
+  }
+  image = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fh, 0);
+  close(fh);
+  if (image == MAP_FAILED) {
+    debug(grammar, "Could not map LALR(1) image '%s': %s", path, strerror(errno));
+    return NULL;
+  }
+
+  header = (lr_image_header_t *) image;
+  states = (size_t) header -> num_states;
+  if (memcmp(header -> magic, LR_IMAGE_MAGIC, sizeof(header -> magic)) ||
+      (header -> version != LR_IMAGE_VERSION)) {
+    reason = "not an image";
+  } else if ((header -> build_id_len != _lr_build_id.len) ||
+             memcmp(header -> build_id, _lr_build_id.id, _lr_build_id.len)) {
+    reason = "build id mismatch";
+  } else if ((header -> fingerprint != table -> fingerprint) ||
+             (header -> num_terminals != table -> num_terminals) ||
+             (header -> num_nonterminals != table -> num_nonterminals) ||
+             (header -> num_productions != table -> num_productions) ||
+             (header -> max_code != table -> max_code)) {
+    reason = "grammar mismatch";
+  } else if ((header -> size != (size_t) st.st_size) ||
+             (header -> num_states <= 0) ||
+             (header -> action_offset + states * table -> num_terminals * sizeof(int) > header -> size) ||
+             (header -> goto_offset + states * table -> num_nonterminals * sizeof(int) > header -> size) ||
+             (header -> default_offset + states * sizeof(int) > header -> size)) {
+    reason = "corrupt";
+  }
+  if (reason) {
+    debug(grammar, "Ignoring LALR(1) image '%s': %s", path, reason);
+    munmap(image, (size_t) st.st_size);
+    return NULL;
+  }
+
+  table -> num_states = header -> num_states;
+  table -> action = (int *) ((char *) image + header -> action_offset);
+  table -> goto_table = (int *) ((char *) image + header -> goto_offset);
+  table -> default_reduction = (int *) ((char *) image + header -> default_offset);
+  table -> image = image;
+  table -> image_size = (size_t) st.st_size;
+  debug(grammar, "Mapped LALR(1) image '%s': %d states", path, table -> num_states);
+  return table;
+}
+
+/*
+ * Writes the image to a temporary file next to the target and renames it
+ * into place, so concurrent runs never see a partially written image.
+ */
+lr_table_t * _lr_table_save_image(lr_table_t *table, char *dir) {
+  lr_image_header_t  header;
+  char              *tmp;
+  FILE              *f;
+  size_t             action_sz, goto_sz, default_sz;
+  int                ok;
+  char               path[MAX_PATH];
+
+  pthread_once(&_lr_build_id_once, _lr_build_id_init);
+  if (mkdir(dir, 0755) && (errno != EEXIST)) {
+    debug(grammar, "Could not create LALR(1) image directory '%s': %s", dir, strerror(errno));
+    return NULL;
+  }
+  _lr_image_path(table, dir, path, MAX_PATH);
+  action_sz = (size_t) table -> num_states * table -> num_terminals * sizeof(int);
+  goto_sz = (size_t) table -> num_states * table -> num_nonterminals * sizeof(int);
+  default_sz = (size_t) table -> num_states * sizeof(int);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LR_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = LR_IMAGE_VERSION;
+  header.build_id_len = _lr_build_id.len;
+  memcpy(header.build_id, _lr_build_id.id, _lr_build_id.len);
+  header.fingerprint = table -> fingerprint;
+  header.num_terminals = table -> num_terminals;
+  header.num_nonterminals = table -> num_nonterminals;
+  header.num_productions = table -> num_productions;
+  header.num_states = table -> num_states;
+  header.max_code = table -> max_code;
+  header.action_offset = sizeof(header);
+  header.goto_offset = header.action_offset + action_sz;
+  header.default_offset = header.goto_offset + goto_sz;
+  header.size = header.default_offset + default_sz;
+
+  asprintf(&tmp, "%s.%d", path, getpid());
+  if (!(f = fopen(tmp, "wb"))) {
+    debug(grammar, "Could not create LALR(1) image '%s': %s", tmp, strerror(errno));
+    free(tmp);
+    return NULL;
+  }
+  ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+       (fwrite(table -> action, 1, action_sz, f) == action_sz) &&
+       (fwrite(table -> goto_table, 1, goto_sz, f) == goto_sz) &&
+       (fwrite(table -> default_reduction, 1, default_sz, f) == default_sz);
+  ok = !fclose(f) && ok;
+  if (ok && !rename(tmp, path)) {
+    debug(grammar, "Wrote LALR(1) image '%s'", path);
+  } else {
+    debug(grammar, "Could not write LALR(1) image '%s': %s", path, strerror(errno));
+    unlink(tmp);
+    table = NULL;
+  }
+  free(tmp);
+  return table;
+}
+
+void _lr_table_unmap_image(lr_table_t *table) {
+  munmap(table -> image, table -> image_size);
+}
+
+#else /* !HAVE_SYS_MMAN_H */
+
+lr_table_t * _lr_table_load_image(_unused_ lr_table_t *table, _unused_ char *path) {
+  return NULL;
+}
+
+lr_table_t * _lr_table_save_image(_unused_ lr_table_t *table, _unused_ char *path) {
+  return NULL;
+}
+
+void _lr_table_unmap_image(_unused_ lr_table_t *table) {
+}
+
+#endif /* HAVE_SYS_MMAN_H */
+
+/* -- L R _ T A B L E  I M A G E  P U B L I C  F U N C T I O N S ---------- */
+
+/*
+ * Sets the directory LALR(1) tables are loaded from and saved to. Images are
+ * not used if no directory is set.
+ */
+void lr_table_set_image_dir(char *dir) {
+  free(_lr_image_dir);
+  _lr_image_dir = (dir && *dir) ? strdup(dir) : NULL;
+}
+
+char * lr_table_get_image_dir(void) {
+  return _lr_image_dir;
+}
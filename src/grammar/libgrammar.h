@@ -47,24 +47,30 @@ extern void        rule_entry_register(void);
 
 extern list_t *    ge_append_child(data_t *, list_t *);
 
-extern void         _grammar_get_firsts_visitor(entry_t *);
 extern int *        _grammar_check_LL1_reducer(entry_t *, int *);
 extern void         _grammar_build_parse_table_visitor(entry_t *);
 extern function_t * _grammar_resolve_function(grammar_t *, char *, char *);
 
-extern set_t *      _nonterminal_get_follows(nonterminal_t *);
-extern set_t *      _nonterminal_get_firsts(nonterminal_t *);
+extern bitset_t *   _nonterminal_get_follows(nonterminal_t *);
+extern bitset_t *   _nonterminal_get_firsts(nonterminal_t *);
+extern int          _nonterminal_update_firsts(nonterminal_t *, bitset_t *);
 extern int          _nonterminal_check_LL1(nonterminal_t *);
 extern void         _nonterminal_build_parse_table(nonterminal_t *);
 extern grammar_t *  _nonterminal_dump_terminal(token_code_t, grammar_t *);
 
-extern set_t *      _rule_get_firsts(rule_t *);
+extern bitset_t *   _rule_get_firsts(rule_t *);
+extern int          _rule_update_firsts(rule_t *, bitset_t *);
 extern void         _rule_build_parse_table(rule_t *);
-extern set_t *      _rule_get_follows(rule_t *);
+extern bitset_t *   _rule_get_follows(rule_t *);
 extern rule_t *     _rule_add_parse_table_entry(long, rule_t *);
 
-extern set_t *      _rule_entry_get_firsts(rule_entry_t *, set_t *);
-extern set_t *      _rule_entry_get_follows(rule_entry_t *, set_t *);
+extern unsigned int _lr_table_fingerprint(lr_table_t *);
+extern lr_table_t * _lr_table_load_image(lr_table_t *, char *);
+extern lr_table_t * _lr_table_save_image(lr_table_t *, char *);
+extern void         _lr_table_unmap_image(lr_table_t *);
+
+extern bitset_t *   _rule_entry_get_firsts(rule_entry_t *, bitset_t *);
+extern bitset_t *   _rule_entry_get_follows(rule_entry_t *, bitset_t *);
 
 extern int GrammarAction;
 extern int GrammarVariable;
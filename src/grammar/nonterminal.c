@@ -75,8 +75,8 @@ void _nonterminal_free(nonterminal_t *nonterminal) {
   if (nonterminal) {
     free(nonterminal -> name);
     array_free(nonterminal -> rules);
-    set_free(nonterminal -> firsts);
-    set_free(nonterminal -> follows);
+    bitset_free(nonterminal -> firsts);
+    bitset_free(nonterminal -> follows);
     dict_free(nonterminal -> parse_table);
   }
 }
@@ -111,23 +111,34 @@ nonterminal_t * _nonterminal_dump_get_children(nonterminal_t *nt, list_t *childr
           add ε to First(Y1Y2..Yk) as well.
 */
 
-set_t * _nonterminal_get_firsts(nonterminal_t *nonterminal) {
+bitset_t * _nonterminal_get_firsts(nonterminal_t *nonterminal) {
+  if (!nonterminal -> firsts) {
+    nonterminal -> firsts = bitset_create(TokenCodeEOF + 1);
+    if (!array_size(nonterminal -> rules)) {
+      bitset_add(nonterminal -> firsts, TokenCodeEmpty);
+    }
+  }
+  return nonterminal -> firsts;
+}
+
+/*
+ * Recomputes the FIRST sets of the rules of the non-terminal and merges
+ * them into the FIRST set of the non-terminal. Returns non-zero if the
+ * FIRST set of the non-terminal grew, in which case the non-terminals
+ * referencing this one need to be updated as well.
+ */
+int _nonterminal_update_firsts(nonterminal_t *nonterminal, bitset_t *scratch) {
   int     i;
+  int     changed = 0;
   rule_t *rule;
 
-  if (!nonterminal -> firsts) {
-    nonterminal -> firsts = intset_create();
-    if (nonterminal -> firsts) {
-      for (i = 0; i < array_size(nonterminal -> rules); i++) {
-        rule = nonterminal_get_rule(nonterminal, i);
-        set_union(nonterminal -> firsts, _rule_get_firsts(rule));
-      }
-      if (set_empty(nonterminal -> firsts)){
-        set_add_int(nonterminal -> firsts, TokenCodeEmpty);
-      }
+  for (i = 0; i < array_size(nonterminal -> rules); i++) {
+    rule = nonterminal_get_rule(nonterminal, i);
+    if (_rule_update_firsts(rule, scratch)) {
+      changed |= bitset_union(_nonterminal_get_firsts(nonterminal), rule -> firsts);
     }
   }
-  return nonterminal -> firsts;
+  return changed;
 }
 
 /*
@@ -142,20 +153,20 @@ set_t * _nonterminal_get_firsts(nonterminal_t *nonterminal) {
       then everything in FOLLOW(A) is in FOLLOW(B)
 */
 
-set_t * _nonterminal_get_follows(nonterminal_t *nonterminal) {
+bitset_t * _nonterminal_get_follows(nonterminal_t *nonterminal) {
   if (!nonterminal -> follows) {
-    nonterminal -> follows = intset_create();
+    nonterminal -> follows = bitset_create(TokenCodeEOF + 1);
     if (nonterminal == nonterminal_get_grammar(nonterminal) -> entrypoint) {
-      set_add_int(nonterminal -> follows, TokenCodeEnd);
+      bitset_add(nonterminal -> follows, TokenCodeEnd);
     }
   }
   return nonterminal -> follows;
 }
 
 int _nonterminal_check_LL1(nonterminal_t *nonterminal) {
-  int     i, j, ret, ok;
-  rule_t *r_i, *r_j;
-  set_t  *f_i, *f_j;
+  int       i, j, ret, ok;
+  rule_t   *r_i, *r_j;
+  bitset_t *f_i, *f_j;
 
   ret = 1;
   for (i = 0; i < array_size(nonterminal -> rules); i++) {
@@ -164,20 +175,20 @@ int _nonterminal_check_LL1(nonterminal_t *nonterminal) {
     for (j = i + 1; j < array_size(nonterminal -> rules); j++) {
       r_j = nonterminal_get_rule(nonterminal, j);
       f_j = _rule_get_firsts(r_j);
-      ok = set_disjoint(f_i, f_j);
+      ok = bitset_disjoint(f_i, f_j);
       if (!ok) {
         error("Grammar not LL(1): non-terminal %s - Firsts for rules %d and %d not disjoint", nonterminal -> name, i, j);
-        error("FIRSTS(%d): %s", i, set_tostring(f_i));
-        error("FIRSTS(%d): %s", j, set_tostring(f_j));
+        error("FIRSTS(%d): %s", i, bitset_tostring(f_i));
+        error("FIRSTS(%d): %s", j, bitset_tostring(f_j));
       }
       ret &= ok;
-      if (set_has_int(f_j, TokenCodeEnd)) {
-        ok = set_disjoint(f_i, _rule_get_follows(r_i));
+      if (bitset_has(f_j, TokenCodeEnd)) {
+        ok = bitset_disjoint(f_i, _rule_get_follows(r_i));
         if (!ok) {
           error("Grammar not LL(1): non-terminal %s - Firsts for rule %d follows not disjoint", nonterminal -> name, i);
         }
         ret &= ok;
-        ret = ret && set_disjoint(f_i, nonterminal -> follows);
+        ret = ret && bitset_disjoint(f_i, nonterminal -> follows);
       }
     }
   }
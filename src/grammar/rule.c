@@ -61,8 +61,8 @@ rule_t * _rule_new(rule_t *rule, va_list args) {
 void _rule_free(rule_t *rule) {
   if (rule) {
     array_free(rule -> entries);
-    set_free(rule -> firsts);
-    set_free(rule -> follows);
+    bitset_free(rule -> firsts);
+    bitset_free(rule -> follows);
   }
 }
 
@@ -96,25 +96,31 @@ list_t * _rule_dump_get_children(rule_t *rule, list_t *children) {
         If First(Y1) First(Y2)..First(Yk) all contain ε
           add ε to First(Y1Y2..Yk) as well.
 */
-set_t * _rule_get_firsts(rule_t *rule) {
-  rule_entry_t *e;
-  int           j;
-
+bitset_t * _rule_get_firsts(rule_t *rule) {
   if (!rule -> firsts) {
-    rule -> firsts = intset_create();
-    if (rule -> firsts) {
-      set_add_int(rule -> firsts, TokenCodeEmpty);
-      for (j = 0; set_has_int(rule -> firsts, TokenCodeEmpty) && (j < array_size(rule -> entries)); j++) {
-        set_remove_int(rule -> firsts, TokenCodeEmpty);
-        e = rule_get_entry(rule, j);
-        _rule_entry_get_firsts(e, rule -> firsts);
-      }
-    }
+    rule -> firsts = bitset_create(TokenCodeEOF + 1);
   }
   return rule -> firsts;
 }
 
-set_t * _rule_get_follows(rule_t *rule) {
+/*
+ * Recomputes FIRST(rule) from the current FIRST sets of the non-terminals
+ * referenced by the rule, using scratch as work space. Returns non-zero if
+ * the FIRST set of the rule grew.
+ */
+int _rule_update_firsts(rule_t *rule, bitset_t *scratch) {
+  int j;
+
+  bitset_clear(scratch);
+  bitset_add(scratch, TokenCodeEmpty);
+  for (j = 0; bitset_has(scratch, TokenCodeEmpty) && (j < array_size(rule -> entries)); j++) {
+    bitset_remove(scratch, TokenCodeEmpty);
+    _rule_entry_get_firsts(rule_get_entry(rule, j), scratch);
+  }
+  return bitset_union(_rule_get_firsts(rule), scratch);
+}
+
+bitset_t * _rule_get_follows(rule_t *rule) {
   return rule -> follows;
 }
 
@@ -127,15 +133,15 @@ rule_t * _rule_add_parse_table_entry(long tokencode, rule_t *rule) {
       dict_put_int(nonterminal -> parse_table, (int) tokencode, rule_copy(rule));
     }
   } else {
-    set_reduce(nonterminal -> follows,
-               (reduce_t) _rule_add_parse_table_entry, rule);
+    bitset_reduce(nonterminal -> follows,
+                  (reduce_t) _rule_add_parse_table_entry, rule);
   }
   return rule;
 }
 
 void _rule_build_parse_table(rule_t *rule) {
   if (rule -> firsts) {
-    set_reduce(rule -> firsts, (reduce_t) _rule_add_parse_table_entry, rule);
+    bitset_reduce(rule -> firsts, (reduce_t) _rule_add_parse_table_entry, rule);
   }
 }
 
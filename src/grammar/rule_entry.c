@@ -104,21 +104,21 @@ rule_entry_t * _rule_entry_dump_pre(ge_dump_ctx_t *ctx) {
 
 /* ----------------------------------------------------------------------- */
 
-set_t * _rule_entry_get_firsts(rule_entry_t *entry, set_t *firsts) {
+bitset_t * _rule_entry_get_firsts(rule_entry_t *entry, bitset_t *firsts) {
   nonterminal_t *nonterminal;
 
   if (entry -> terminal) {
-    set_add_int(firsts, token_code(entry -> token));
+    bitset_add(firsts, token_code(entry -> token));
   } else {
     nonterminal = grammar_get_nonterminal(rule_entry_get_grammar(entry),
                                           entry -> nonterminal);
     oassert(nonterminal, "Non-terminal '%s' not found", entry -> nonterminal);
-    set_union(firsts, _nonterminal_get_firsts(nonterminal));
+    bitset_union(firsts, _nonterminal_get_firsts(nonterminal));
   }
   return firsts;
 }
 
-set_t * _rule_entry_get_follows(rule_entry_t *entry, set_t *follows) {
+bitset_t * _rule_entry_get_follows(rule_entry_t *entry, bitset_t *follows) {
   return follows;
 }
 
@@ -27,6 +27,16 @@ static data_t * _client_new(client_t *, va_list);
 static void     _client_free(client_t *);
 static char   * _client_tostring(client_t *);
 static data_t * _client_resolve(client_t *, char *);
+static void *   _client_fail_pending(future_t *, client_t *);
+static void *   _client_reader(client_t *);
+static void     _client_cancel(future_t *, client_t *);
+
+typedef struct _client_lookup {
+  future_t *future;
+  void     *id;
+} client_lookup_t;
+
+static client_lookup_t * _client_find_pending(entry_t *, client_lookup_t *);
 
 static vtable_t _vtable_Client[] = {
   {.id = FunctionNew,         .fnc = (void_t) _client_new},
@@ -52,7 +62,9 @@ data_t * _client_new(client_t *client, va_list args) {
   mountpoint_t *mountpoint = va_arg(args, mountpoint_t *);
   socket_t     *socket;
   data_t       *ret = NULL;
-  data_t       *version;
+  data_t       *welcome;
+  data_t       *protocols;
+  int           ix;
 
   socket = socket_open(mountpoint->remote);
   if (socket_error(socket)) {
@@ -62,15 +74,35 @@ data_t * _client_new(client_t *client, va_list args) {
   }
   client->socket = (stream_t *) socket;
   client->mountpoint = mountpoint;
-  version = protocol_send_handshake(client->socket, mountpoint);
-  if (!data_is_exception(version)) {
+  client->binary = FALSE;
+  client->next_id = 1;
+  client->send_lock = mutex_create();
+  client->lock = condition_create();
+  client->pending = intdict_create();
+  client->reader = NULL;
+  client->dead = FALSE;
+  welcome = protocol_send_handshake(client->socket, mountpoint);
+  if (!data_is_exception(welcome)) {
     if (!mountpoint->version) {
-      mountpoint->version = strdup(data_tostring(version));
+      mountpoint->version = strdup(data_tostring(
+          data_uncopy(dictionary_get(data_as_dictionary(welcome), "engine"))));
+    }
+    protocols = dictionary_get(data_as_dictionary(welcome), "protocols");
+    for (ix = 0; mountpoint->binary && data_is_list(protocols) &&
+                 (ix < datalist_size((datalist_t *) protocols)); ix++) {
+      if (!strcmp(data_tostring(datalist_get((datalist_t *) protocols, ix)),
+                  OBLSERVER_PROTOCOL_BINARY)) {
+        client->binary = TRUE;
+      }
     }
+    data_free(protocols);
+    data_free(welcome);
     ret = (data_t *) client;
   } else {
+    /* data_create frees the half-built client, which must not free the socket */
+    client->socket = NULL;
     socket_free(socket);
-    ret = version;
+    ret = welcome;
   }
   return ret;
 }
@@ -85,7 +117,23 @@ char * _client_tostring(client_t *client) {
 
 void _client_free(client_t *client) {
   if (client) {
+    if (client->reader) {
+      /*
+       * Wake the reader up by shutting the socket down, and wait for it to
+       * fail the futures that are still pending.
+       */
+      socket_shutdown((socket_t *) client->socket);
+      condition_acquire(client->lock);
+      while (!client->dead) {
+        condition_sleep(client->lock);
+      }
+      condition_release(client->lock);
+      thread_free(client->reader);
+    }
     stream_free(client->socket);
+    dict_free(client->pending);
+    condition_free(client->lock);
+    mutex_free(client->send_lock);
   }
 }
 
@@ -101,38 +149,103 @@ data_t * _client_resolve(client_t *client, char *name) {
 
 /* ------------------------------------------------------------------------ */
 
-data_t * client_run(client_t *client, remote_t *remote, arguments_t *args) {
-  data_t          *ret = NULL;
-  data_t          *err;
-  char            *path;
-  char            *mp_path = uri_path(client->mountpoint->remote);
-  char            *remote_path = name_tostring_sep(remote->name, "/");
-  servermessage_t *msg;
+void * _client_fail_pending(future_t *future, client_t *client) {
+  future_complete(future,
+      data_exception(ErrorIOError, "Connection to '%s' lost",
+          uri_tostring(client->mountpoint->remote)));
+  return client;
+}
 
-  if (!mp_path || !*mp_path) {
-    path = strdup(remote_path);
-  } else {
-    path = stralloc(strlen(mp_path) + strlen(remote_path) + 1);
-    strcpy(path, mp_path);
-    strcat(path, "/");
-    strcat(path, remote_path);
-  }
-  msg = servermessage_create(OBLSERVER_CODE_CALL, 2,
-      data_tostring(client->mountpoint), path);
-  servermessage_set_payload(msg, (data_t *) args);
-  ret = protocol_send_message(client->socket, msg);
-  servermessage_free(msg);
+void * _client_reader(client_t *client) {
+  data_t          *ret;
+  servermessage_t *msg;
+  future_t        *future;
+  int              done = FALSE;
 
-  if (!ret) {
-    ret = protocol_expect(client->socket, OBLSERVER_CODE_DATA, 1, Int);
+  debug(ipc, "Reader for '%s' started", uri_tostring(client->mountpoint->remote));
+  do {
+    ret = client_receive(client);
+    condition_acquire(client->lock);
     if (data_is_servermessage(ret)) {
       msg = data_as_servermessage(ret);
-      ret = data_copy(msg->payload);
+      future = (future_t *) dict_pop(client->pending,
+                                     (void *) ((intptr_t) msg->id));
+      if (future) {
+        future_complete(future, client_result(msg));
+      } else {
+        debug(ipc, "Discarding reply to request %u", msg->id);
+      }
       servermessage_free(msg);
+      condition_release(client->lock);
+    } else {
+      debug(ipc, "Reader for '%s' stopping: %s",
+          uri_tostring(client->mountpoint->remote), data_tostring(ret));
+      data_free(ret);
+      done = TRUE;
+      client->dead = TRUE;
+      dict_reduce_values(client->pending,
+                         (reduce_t) _client_fail_pending, client);
+      dict_clear(client->pending);
+      condition_broadcast(client->lock);
     }
+  } while (!done);
+  return NULL;
+}
+
+client_lookup_t * _client_find_pending(entry_t *entry, client_lookup_t *lookup) {
+  if (entry->value == lookup->future) {
+    lookup->id = entry->key;
   }
-  if (!data_is_exception(ret) || data_as_exception(ret)->handled) {
-    if ((err = protocol_expect(client->socket, OBLSERVER_CODE_READY, 0))) {
+  return lookup;
+}
+
+void _client_cancel(future_t *future, client_t *client) {
+  client_lookup_t lookup = { .future = future, .id = NULL };
+
+  condition_acquire(client->lock);
+  dict_reduce(client->pending, (reduce_t) _client_find_pending, &lookup);
+  if (lookup.id) {
+    dict_remove(client->pending, lookup.id);
+  }
+  condition_release(client->lock);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Sends a CALL for <code>remote</code> without waiting for the reply. On
+ * a binary connection several calls can be outstanding at the same time.
+ * Returns the id of the request, which the reply will carry, or an
+ * exception if the request could not be sent.
+ */
+data_t * client_submit(client_t *client, remote_t *remote, arguments_t *args) {
+  data_t          *ret;
+  servermessage_t *msg;
+
+  msg = servermessage_create(OBLSERVER_CODE_CALL, 1, name_tostring(remote->name));
+  msg->binary = client->binary;
+  msg->id = client->next_id++;
+  servermessage_set_payload(msg, (data_t *) args);
+  ret = protocol_send_message(client->socket, msg);
+  if (!ret) {
+    ret = int_to_data(msg->id);
+  }
+  servermessage_free(msg);
+  return ret;
+}
+
+/**
+ * Reads the next reply from the server. Replies arrive in the order the
+ * requests were submitted. On a text connection the READY message that
+ * follows each reply is consumed as well.
+ */
+data_t * client_receive(client_t *client) {
+  data_t *ret;
+  data_t *err;
+
+  ret = protocol_read_message(client->socket);
+  if (data_is_servermessage(ret) && !data_as_servermessage(ret)->binary) {
+    if (!data_is_servermessage(err = protocol_expect(client->socket, OBLSERVER_CODE_READY, 0))) {
       data_free(ret);
       ret = err;
     } else {
@@ -142,6 +255,118 @@ data_t * client_run(client_t *client, remote_t *remote, arguments_t *args) {
   return ret;
 }
 
+/**
+ * Converts a reply into the return value of the remote call. Errors the
+ * server reports are returned as exceptions.
+ */
+data_t * client_result(servermessage_t *msg) {
+  switch (msg->code) {
+    case OBLSERVER_CODE_DATA:
+      return data_copy(msg->payload);
+    case OBLSERVER_CODE_ERROR_RUNTIME:
+    case OBLSERVER_CODE_ERROR_SYNTAX:
+    case OBLSERVER_CODE_ERROR_PROTOCOL:
+    case OBLSERVER_CODE_ERROR_INTERNAL:
+      if (data_is_exception(msg->payload)) {
+        return data_copy(msg->payload);
+      }
+      return data_exception(
+          (msg->code == OBLSERVER_CODE_ERROR_PROTOCOL) ? ErrorProtocol : ErrorInternalError,
+          "Remote call failed: %s %s", msg->tag, data_tostring(msg->payload));
+    default:
+      return data_exception(ErrorProtocol,
+          "Expected IPC reply but got %s", servermessage_tostring(msg));
+  }
+}
+
+/**
+ * Sends a CALL for <code>remote</code> and returns a future for its
+ * result. Only binary connections can have several calls outstanding, and
+ * the replies are picked up by a reader thread that is started with the
+ * first call. The reply to a request whose future is freed before it is
+ * completed is discarded.
+ */
+data_t * client_call_async(client_t *client, remote_t *remote, arguments_t *args) {
+  future_t     *future = NULL;
+  data_t       *ret = NULL;
+  unsigned int  id;
+
+  if (!client->binary) {
+    return data_exception(ErrorProtocol,
+        "Connection to '%s' does not support concurrent calls",
+        uri_tostring(client->mountpoint->remote));
+  }
+
+  /*
+   * Replies are read without holding the send lock, so a writer blocked on
+   * a full socket never keeps the reader from draining it.
+   */
+  mutex_lock(client->send_lock);
+  condition_acquire(client->lock);
+  if (client->dead) {
+    ret = data_exception(ErrorIOError, "Connection to '%s' lost",
+        uri_tostring(client->mountpoint->remote));
+  } else if (!client->reader) {
+    client->reader = thread_new("IPC Client Reader",
+                                (threadproc_t) _client_reader, client);
+    if (!client->reader) {
+      ret = data_exception_from_errno();
+    }
+  }
+  if (!ret) {
+    id = client->next_id;
+    future = future_create((future_cancel_t) _client_cancel, client);
+    dict_put_int(client->pending, id, future);
+  }
+  condition_release(client->lock);
+
+  if (!ret) {
+    ret = client_submit(client, remote, args);
+    if (data_is_int(ret)) {
+      data_free(ret);
+      ret = (data_t *) future;
+    } else {
+      condition_acquire(client->lock);
+      dict_remove_int(client->pending, id);
+      condition_release(client->lock);
+      future->cancel = NULL;
+      future_free(future);
+    }
+  }
+  mutex_unlock(client->send_lock);
+  return ret;
+}
+
+/**
+ * Returns the number of calls on this connection that are waiting for their
+ * reply, or -1 if the connection is lost.
+ */
+int client_inflight(client_t *client) {
+  int ret;
+
+  condition_acquire(client->lock);
+  ret = (client->dead) ? -1 : dict_size(client->pending);
+  condition_release(client->lock);
+  return ret;
+}
+
+data_t * client_run(client_t *client, remote_t *remote, arguments_t *args) {
+  data_t          *ret;
+  servermessage_t *msg;
+
+  ret = client_submit(client, remote, args);
+  if (data_is_int(ret)) {
+    data_free(ret);
+    ret = client_receive(client);
+  }
+  if (data_is_servermessage(ret)) {
+    msg = data_as_servermessage(ret);
+    ret = client_result(msg);
+    servermessage_free(msg);
+  }
+  return ret;
+}
+
 /* ------------------------------------------------------------------------ */
 
 data_t *client_create(mountpoint_t *mountpoint) {
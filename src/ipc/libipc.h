@@ -59,6 +59,27 @@
 #define OBLSERVER_TAG_CALL            "CALL"
 #define OBLSERVER_TAG_QUIT            "QUIT"
 
+/*
+ * A binary frame starts with a byte that cannot start a text message, so
+ * both kinds can be told apart on the same connection. The header is
+ * followed by the packed argument list and, if the flag is set, the packed
+ * payload:
+ *
+ *   magic (1) | flags (1) | code (2) | request id (4) | body length (4)
+ *
+ * Multi-byte fields are in network byte order.
+ */
+#define OBLSERVER_FRAME_MAGIC         0xB1
+#define OBLSERVER_FRAME_HEADER_SIZE   12
+#define OBLSERVER_FRAME_MAX_SIZE      (64 * 1024 * 1024)
+#define OBLSERVER_FRAME_PAYLOAD       0x01
+
+#define OBLSERVER_PROTOCOL_TEXT       "text"
+#define OBLSERVER_PROTOCOL_BINARY     "binary"
+
+/* Calls in flight on a shared connection before another one is opened */
+#define OBLIPC_SHARED_INFLIGHT        8
+
 #define STRINGIFY(code)               #code
 
 #define OBLSERVER_MESSAGE(code, tag)  STRINGIFY(code) " " tag
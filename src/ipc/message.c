@@ -53,6 +53,9 @@ code_label_t message_codes[] = {
   { .code = OBLSERVER_CODE_ERROR_INTERNAL, .label = OBLSERVER_TAG_ERROR_INTERNAL },
   { .code = OBLSERVER_CODE_COOKIE,         .label = OBLSERVER_TAG_COOKIE },
   { .code = OBLSERVER_CODE_BYE,            .label = OBLSERVER_TAG_BYE },
+  { .code = OBLSERVER_CODE_HELLO,          .label = OBLSERVER_TAG_HELLO },
+  { .code = OBLSERVER_CODE_CALL,           .label = OBLSERVER_TAG_CALL },
+  { .code = OBLSERVER_CODE_QUIT,           .label = OBLSERVER_TAG_QUIT },
   { .code = 0,                             .label = NULL }
 };
 
@@ -68,13 +71,14 @@ void servermessage_init(void) {
 /* ------------------------------------------------------------------------ */
 
 servermessage_t * _servermessage_new(servermessage_t *msg, va_list args) {
-  msg -> args = datalist_create(NULL);
   msg -> code = va_arg(args, int);
   msg -> tag = label_for_code(message_codes, msg -> code);
   if (!msg -> tag) {
     msg -> code = 0;
   }
   msg -> args = datalist_create(NULL);
+  msg -> id = 0;
+  msg -> binary = FALSE;
   msg -> payload = NULL;
   msg -> encoded = NULL;
   msg -> payload_size = 0;
@@ -86,9 +90,11 @@ data_t * _servermessage_parse(char *str) {
   array_t         *words;
   int              sz;
   int              numargs;
+  int              tagwords = 1;
   long             l;
   data_t          *ret = NULL;
   int              ix;
+  char            *ptr;
 
   words = array_split(str, " ");
   if (!words || ((sz = array_size(words)) < 2)) {
@@ -102,16 +108,30 @@ data_t * _servermessage_parse(char *str) {
         str_array_get(words, 0));
   }
   msg = servermessage_create(0, 0);
-  msg -> code = (int) l;
-  msg -> tag = label_for_code(message_codes, (int) l);
-  if (!ret && strcmp(msg -> tag, str_array_get(words, 1))) {
-    ret = data_exception(ErrorProtocol,
-        "IPC message tag '%s' does not match code '%d'",
-        str_array_get(words, 1), l);
+  if (!ret) {
+    msg -> code = (int) l;
+    msg -> tag = label_for_code(message_codes, (int) l);
+    if (!msg -> tag) {
+      ret = data_exception(ErrorProtocol,
+          "Unknown IPC message code '%d'", l);
+    }
+  }
+  if (!ret) {
+    /* Tags like 'ERROR RUNTIME' span more than one word */
+    for (ptr = strchr(msg -> tag, ' '); ptr; ptr = strchr(ptr + 1, ' ')) {
+      tagwords++;
+    }
+    ptr = strchr(str, ' ') + 1;
+    if (strncmp(ptr, msg -> tag, strlen(msg -> tag)) ||
+        (ptr[strlen(msg -> tag)] && (ptr[strlen(msg -> tag)] != ' '))) {
+      ret = data_exception(ErrorProtocol,
+          "IPC message tag '%s' does not match code '%d'",
+          str_array_get(words, 1), l);
+    }
   }
   if (!ret) {
-    if (sz > 2) {
-      if ((sz >= 4) &&
+    if (sz > tagwords + 1) {
+      if ((sz >= tagwords + 3) &&
           !strcmp(str_array_get(words, sz - 2), "--") &&
           !strtoint(str_array_get(words, sz - 1), &l)) {
         numargs = array_size(words) - 2;
@@ -119,7 +139,7 @@ data_t * _servermessage_parse(char *str) {
       } else {
         numargs = sz;
       }
-      for (ix = 2; ix < numargs; ix++) {
+      for (ix = tagwords + 1; ix < numargs; ix++) {
         if (!strtoint(str_array_get(words, ix), &l)) {
           datalist_push(msg->args, int_to_data(l));
         } else {
@@ -128,6 +148,7 @@ data_t * _servermessage_parse(char *str) {
       }
     }
   }
+  array_free(words);
   if (ret) {
     servermessage_free(msg);
   }
@@ -151,9 +172,8 @@ char * _servermessage_tostring(servermessage_t *msg) {
     str_append_char(str, ' ');
     str_append_chars(str, data_tostring(datalist_get(msg -> args, ix)));
   }
-  if (msg -> payload) {
-    str_append_chars(str, " -- ");
-    str_append_chars(str, data_tostring(int_to_data(msg -> payload_size)));
+  if (msg -> payload && msg -> encoded) {
+    str_append_printf(str, " -- %d", msg -> payload_size);
   }
   return str_reassign(str);
 }
@@ -161,6 +181,8 @@ char * _servermessage_tostring(servermessage_t *msg) {
 data_t * _servermessage_resolve(servermessage_t *msg, char *name) {
   if (!strcmp(name, "code")) {
     return int_to_data(msg -> code);
+  } else if (!strcmp(name, "id")) {
+    return int_to_data(msg -> id);
   } else if (!strcmp(name, "tag")) {
     return (msg -> tag) ? str_to_data(msg -> tag) : data_null();
   } else if (!strcmp(name, "args")) {
@@ -263,10 +285,21 @@ servermessage_t * servermessage_set_payload(servermessage_t *msg, data_t *payloa
   msg -> payload = NULL;
   free(msg -> encoded);
   msg -> encoded = NULL;
+  msg -> payload_size = 0;
   if (payload) {
-    msg->payload = data_copy(payload);
-    msg->encoded = json_encode(payload);
-    msg->payload_size = (int) strlen(msg->encoded) + 2;
+    msg -> payload = data_copy(payload);
+  }
+  return msg;
+}
+
+/**
+ * Encodes the payload as JSON for the text protocol. Binary frames pack the
+ * payload themselves, so this only happens when a message is sent as text.
+ */
+servermessage_t * servermessage_encode_payload(servermessage_t *msg) {
+  if (msg -> payload && !msg -> encoded) {
+    msg -> encoded = json_encode(msg -> payload);
+    msg -> payload_size = (msg -> encoded) ? (int) strlen(msg -> encoded) + 2 : 0;
   }
   return msg;
 }
\ No newline at end of file
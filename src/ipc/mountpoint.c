@@ -67,16 +67,19 @@ data_t * _mountpoint_new(mountpoint_t *mp, va_list args) {
   uri_t  *remote = va_arg(args, uri_t *);
   char   *cookie = va_arg(args, char *);
   char   *max;
+  char   *prefix;
   long    l;
 
   if (remote -> error) {
     return remote -> error;
   }
   mp -> remote = uri_copy(remote);
-  if (!mp -> remote -> port) {
+  if (!mp -> remote -> port &&
+      (!mp -> remote -> scheme || strcmp(mp -> remote -> scheme, "unix"))) {
     mp -> remote -> port = OBELIX_DEFAULT_PORT;
   }
   mp -> version = NULL;
+  mp -> binary = TRUE;
   mp -> wait = condition_create();
   mp -> maxclients = 5;
   mp -> current = 0;
@@ -91,7 +94,28 @@ data_t * _mountpoint_new(mountpoint_t *mp, va_list args) {
       error("Server URI '%s' has non-integer maxclients value", uri_tostring(remote));
     }
   }
+  if (mp -> remote -> query &&
+      dict_has_key(mp -> remote -> query, "protocol")) {
+    mp -> binary = strcmp((char *) dict_get(remote -> query, "protocol"),
+                          OBLSERVER_PROTOCOL_TEXT) != 0;
+  }
+
+  /*
+   * The path of a unix: URI names the socket, so the server side path is
+   * passed as a query parameter there. The URI parser does not take a '/'
+   * in a query value, so it is given without the leading slash, as in
+   * unix:/tmp/obelix.sock?path=remote.
+   */
+  if (mp -> remote -> scheme && !strcmp(mp -> remote -> scheme, "unix")) {
+    prefix = (mp -> remote -> query)
+             ? (char *) dict_get(mp -> remote -> query, "path")
+             : NULL;
+  } else {
+    prefix = uri_path(mp -> remote);
+  }
+  mp -> prefix = strdup((prefix && *prefix) ? prefix : "/");
   mp -> clients = data_list_create();
+  mp -> shared = data_list_create();
   return (data_t *) mp;
 }
 
@@ -100,6 +124,7 @@ void _mountpoint_free(mountpoint_t *mp) {
     uri_free(mp -> remote);
     condition_free(mp -> wait);
     list_free(mp -> clients);
+    list_free(mp -> shared);
     free(mp -> prefix);
     free(mp -> version);
     free(mp -> _d.str);
@@ -125,22 +150,26 @@ data_t * mountpoint_create(uri_t *remote, char *cookie) {
 }
 
 data_t * mountpoint_checkout_client(mountpoint_t *mp) {
-  data_t *ret = NULL;
+  data_t *ret;
+
+  condition_acquire(mp -> wait);
+  while (!(ret = (data_t *) list_shift(mp -> clients)) &&
+         (mp -> current >= mp -> maxclients)) {
+    condition_sleep(mp -> wait);
+  }
+  if (ret) {
+    condition_release(mp -> wait);
+    return ret;
+  }
 
-  while (!ret) {
+  /* Claim the slot, but connect without holding the lock */
+  mp -> current++;
+  condition_release(mp -> wait);
+  ret = client_create(mp);
+  if (!data_is_client(ret)) {
     condition_acquire(mp -> wait);
-    ret = (data_t *) list_shift(mp -> clients);
-    if (!ret && (mp -> current < mp -> maxclients)) {
-      ret = client_create(mp);
-      if (data_is_client(ret)) {
-        mp -> current++;
-      }
-    }
-    if (!ret) {
-      condition_sleep(mp -> wait);
-    } else {
-      condition_release(mp -> wait);
-    }
+    mp -> current--;
+    condition_wakeup(mp -> wait);
   }
   return ret;
 }
@@ -152,3 +181,106 @@ mountpoint_t * mountpoint_return_client(mountpoint_t *mp, client_t *client) {
   return mp;
 }
 
+/*
+ * Returns the shared client with the fewest calls in flight, dropping the
+ * clients whose connection was lost along the way.
+ */
+static client_t * _mountpoint_least_busy(mountpoint_t *mp, int *inflight) {
+  listiterator_t *iter;
+  client_t       *client;
+  client_t       *ret = NULL;
+  int             n;
+
+  for (iter = li_create(mp -> shared); li_has_next(iter); ) {
+    client = (client_t *) li_next(iter);
+    n = client_inflight(client);
+    if (n < 0) {
+      li_remove(iter);
+      mp -> current--;
+    } else if (!ret || (n < *inflight)) {
+      ret = client;
+      *inflight = n;
+    }
+  }
+  li_free(iter);
+  return ret;
+}
+
+/**
+ * Calls <code>remote</code> and returns a future for the result. On binary
+ * connections calls from all threads are multiplexed over a few shared
+ * connections. Another connection is opened when every shared one has
+ * OBLIPC_SHARED_INFLIGHT calls outstanding, up to the mountpoint's
+ * maxclients. If the server only speaks the text protocol, the call runs
+ * on an exclusive connection and the future is completed on return.
+ */
+data_t * mountpoint_call_async(mountpoint_t *mp, remote_t *remote, arguments_t *args) {
+  client_t *client = NULL;
+  client_t *exclusive = NULL;
+  data_t   *ret = NULL;
+  int       inflight = 0;
+  int       connect = FALSE;
+
+  /* The lock is only held to pick a client, not to connect or to send */
+  condition_acquire(mp -> wait);
+  while (mp -> binary && !client && !connect) {
+    client = _mountpoint_least_busy(mp, &inflight);
+    if ((!client || (inflight >= OBLIPC_SHARED_INFLIGHT)) &&
+        (mp -> current < mp -> maxclients)) {
+      mp -> current++;
+      connect = TRUE;
+    } else if (!client) {
+      /* Other threads are still connecting all the clients there can be */
+      condition_sleep(mp -> wait);
+    }
+  }
+  if (client) {
+    data_copy((data_t *) client);
+  }
+  condition_release(mp -> wait);
+
+  if (connect) {
+    ret = client_create(mp);
+    condition_acquire(mp -> wait);
+    if (!data_is_client(ret)) {
+      mp -> current--;
+    } else if (data_as_client(ret) -> binary) {
+      data_free((data_t *) client);
+      client = data_as_client(ret);
+      list_append(mp -> shared, data_copy(ret));
+      ret = NULL;
+    } else {
+      debug(ipc, "'%s' does not speak the binary protocol",
+            uri_tostring(mp -> remote));
+      mp -> binary = FALSE;
+      data_free((data_t *) client);
+      client = NULL;
+      exclusive = data_as_client(ret);
+      ret = NULL;
+    }
+    condition_broadcast(mp -> wait);
+    if (ret && client) {
+      data_free(ret);
+      ret = NULL;
+    }
+  }
+  if (client) {
+    ret = client_call_async(client, remote, args);
+    data_free((data_t *) client);
+  }
+  if (ret) {
+    return ret;
+  }
+
+  if (!exclusive) {
+    ret = mountpoint_checkout_client(mp);
+    if (!data_is_client(ret)) {
+      return ret;
+    }
+    exclusive = data_as_client(ret);
+  }
+  ret = client_run(exclusive, remote, args);
+  mountpoint_return_client(mp, exclusive);
+  return (data_t *) future_completed(ret);
+}
+
@@ -21,8 +21,11 @@
 
 #include <exception.h>
 #include <json.h>
+#include <pack.h>
 
 static data_t *    _protocol_read_payload(stream_t *, servermessage_t *);
+static data_t *    _protocol_send_frame(stream_t *, servermessage_t *);
+static data_t *    _protocol_read_frame(stream_t *);
 
 /* ------------------------------------------------------------------------ */
 
@@ -54,12 +57,130 @@ data_t * _protocol_read_payload(stream_t *stream, servermessage_t *msg) {
   return ret;
 }
 
+static inline void _protocol_put(unsigned char *buf, uint32_t value, int len) {
+  for (len--; len >= 0; len--) {
+    buf[len] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+static inline uint32_t _protocol_get(unsigned char *buf, int len) {
+  uint32_t ret = 0;
+  int      ix;
+
+  for (ix = 0; ix < len; ix++) {
+    ret = (ret << 8) | buf[ix];
+  }
+  return ret;
+}
+
+data_t * _protocol_send_frame(stream_t *stream, servermessage_t *msg) {
+  packer_t       packer;
+  unsigned char  header[OBLSERVER_FRAME_HEADER_SIZE];
+  data_t        *ret = NULL;
+
+  packer_init(&packer);
+  packer_pack(&packer, (data_t *) msg -> args);
+  if (msg -> payload) {
+    packer_pack(&packer, msg -> payload);
+  }
+  if (packer.error) {
+    ret = data_exception(ErrorProtocol,
+        "Could not pack IPC message '%s'", msg -> tag);
+  } else if (packer.len > OBLSERVER_FRAME_MAX_SIZE) {
+    ret = data_exception(ErrorProtocol,
+        "IPC message '%s' is %d bytes, which exceeds the maximum of %d",
+        msg -> tag, (int) packer.len, OBLSERVER_FRAME_MAX_SIZE);
+  }
+  if (!ret) {
+    debug(ipc, "Sending frame %d %s #%u, %d bytes",
+        msg -> code, msg -> tag, msg -> id, (int) packer.len);
+    header[0] = OBLSERVER_FRAME_MAGIC;
+    header[1] = (msg -> payload) ? OBLSERVER_FRAME_PAYLOAD : 0;
+    _protocol_put(header + 2, (uint32_t) msg -> code, 2);
+    _protocol_put(header + 4, msg -> id, 4);
+    _protocol_put(header + 8, (uint32_t) packer.len, 4);
+    ret = protocol_write(stream, (char *) header, OBLSERVER_FRAME_HEADER_SIZE);
+    if (!ret) {
+      ret = protocol_write(stream, (char *) packer.buffer, (int) packer.len);
+    }
+  }
+  packer_release(&packer);
+  return ret;
+}
+
+data_t * _protocol_read_frame(stream_t *stream) {
+  unsigned char    header[OBLSERVER_FRAME_HEADER_SIZE];
+  char            *body = NULL;
+  size_t           len;
+  size_t           consumed = 0;
+  size_t           used = 0;
+  servermessage_t *msg = NULL;
+  data_t          *args = NULL;
+  data_t          *ret = NULL;
+  int              r;
+
+  r = stream_read(stream, (char *) header, OBLSERVER_FRAME_HEADER_SIZE);
+  if (r != OBLSERVER_FRAME_HEADER_SIZE) {
+    return (stream -> error)
+           ? data_copy(stream -> error)
+           : data_exception(ErrorIOError, "Could not read from IPC channel");
+  }
+  len = _protocol_get(header + 8, 4);
+  if (len > OBLSERVER_FRAME_MAX_SIZE) {
+    return data_exception(ErrorProtocol,
+        "IPC frame of %d bytes exceeds the maximum of %d",
+        (int) len, OBLSERVER_FRAME_MAX_SIZE);
+  }
+  body = stralloc(len);
+  if (stream_read(stream, body, (int) len) != (int) len) {
+    ret = data_exception(ErrorProtocol,
+        "Protocol error reading IPC frame. Expected %d bytes", (int) len);
+  }
+  if (!ret) {
+    msg = servermessage_create((int) _protocol_get(header + 2, 2), 0);
+    msg -> id = _protocol_get(header + 4, 4);
+    msg -> binary = TRUE;
+    if (!msg -> code) {
+      ret = data_exception(ErrorProtocol, "Unknown IPC message code '%d'",
+          (int) _protocol_get(header + 2, 2));
+    }
+  }
+  if (!ret) {
+    args = data_unpack(body, len, &consumed);
+    if (data_is_list(args)) {
+      datalist_free(msg -> args);
+      msg -> args = (datalist_t *) args;
+    } else {
+      ret = data_exception(ErrorProtocol,
+          "Malformed argument list in IPC frame: %s", data_tostring(args));
+      data_free(args);
+    }
+  }
+  if (!ret && (header[1] & OBLSERVER_FRAME_PAYLOAD)) {
+    msg -> payload = data_unpack(body + consumed, len - consumed, &used);
+    if (!used) {
+      ret = data_exception(ErrorProtocol,
+          "Malformed payload in IPC frame: %s", data_tostring(msg -> payload));
+    } else if (data_is_exception(msg -> payload)) {
+      data_as_exception(msg -> payload) -> handled = TRUE;
+    }
+  }
+  free(body);
+  if (ret) {
+    servermessage_free(msg);
+    return ret;
+  }
+  debug(ipc, "Received frame %s #%u", servermessage_tostring(msg), msg -> id);
+  return (data_t *) msg;
+}
+
 /* ------------------------------------------------------------------------ */
 
 data_t * protocol_write(stream_t *stream, char *buf, int len) {
   data_t *ret = NULL;
 
-  if (stream_write(stream, buf, len) <= 0) {
+  if (stream_write(stream, buf, len) < 0) {
     ret = (stream -> error)
           ? data_copy(stream -> error)
           : data_exception(ErrorIOError, "Could not write to IPC channel");
@@ -130,36 +251,42 @@ data_t * protocol_expect(stream_t *stream, int expected, int numargs, ...) {
   return (ret) ? ret : (data_t *) msg;
 }
 
+/*
+ * The handshake is always done in text, since the client does not know yet
+ * whether the server understands binary frames. Returns the dictionary the
+ * server sent with its WELCOME message. Its 'protocols' entry lists the
+ * encodings the server accepts.
+ */
 data_t * protocol_send_handshake(stream_t *stream, mountpoint_t *mountpoint) {
   servermessage_t *msg;
-  data_t *version = NULL;
-  data_t *ret;
+  data_t          *welcome = NULL;
+  data_t          *ret;
   servermessage_t *hello;
 
-  hello = servermessage_create(OBLSERVER_CODE_HELLO,
-      1, uri_path(mountpoint->remote));
+  hello = servermessage_create(OBLSERVER_CODE_HELLO, 1, mountpoint -> prefix);
   ret = protocol_send_message(stream, hello);
   servermessage_free(hello);
   if (!ret) {
-    ret = protocol_expect(stream, OBLSERVER_CODE_WELCOME, 3, String, String, String);
+    ret = protocol_expect(stream, OBLSERVER_CODE_WELCOME, 0);
   }
   if (data_is_servermessage(ret)) {
     msg = data_as_servermessage(ret);
-    ret = NULL;
-    debug(ipc, "Connected to server %s %s on %s",
-        data_tostring(data_uncopy(datalist_get(msg -> args, 0))),
-        data_tostring(data_uncopy(datalist_get(msg -> args, 1))),
-        data_tostring(data_uncopy(datalist_get(msg -> args, 2))));
-    version = datalist_get(msg -> args, 1);
+    ret = servermessage_match_payload(msg, Dictionary);
+    if (!ret) {
+      welcome = data_copy(msg -> payload);
+      debug(ipc, "Connected to server %s", data_tostring(welcome));
+    }
+    servermessage_free(msg);
   }
   if (!ret) {
     ret = protocol_expect(stream, OBLSERVER_CODE_READY, 0);
   }
   if (!data_is_servermessage(ret)) {
     error("Handshake with server failed: %s", data_tostring(ret));
+    data_free(welcome);
   } else {
     data_free(ret);
-    ret = version;
+    ret = welcome;
   }
   return ret;
 }
@@ -168,14 +295,18 @@ data_t * protocol_send_data(stream_t *stream, int code, data_t *data) {
   servermessage_t *msg = servermessage_create(code, 0);
   data_t          *ret;
 
-  error("Sending data with code %s", code);
+  debug(ipc, "Sending data with code %d", code);
   servermessage_set_payload(msg, data);
   ret = protocol_send_message(stream, msg);
   servermessage_free(msg);
   return ret;
 }
 
-data_t * protocol_return_result(stream_t *stream, data_t *result) {
+/*
+ * Sends the result of the request <code>request</code>. The reply uses the
+ * request's encoding and carries its id.
+ */
+data_t * protocol_return_result(stream_t *stream, servermessage_t *request, data_t *result) {
   exception_t     *ex;
   data_t          *ret = NULL;
   servermessage_t *msg;
@@ -186,36 +317,54 @@ data_t * protocol_return_result(stream_t *stream, data_t *result) {
     ex = data_as_exception(result);
     switch (ex -> code) {
       case ErrorExit:
-        result = data_copy(ex -> throwable);
-        exception_free(ex);
+        result = ex -> throwable;
         break;
       case ErrorSyntax:
         code = OBLSERVER_CODE_ERROR_SYNTAX;
         break;
       default:
-        code = OBLSERVER_CODE_ERROR_RUNTIME;
+        code = (ex -> code == ErrorProtocol)
+               ? OBLSERVER_CODE_ERROR_PROTOCOL
+               : OBLSERVER_CODE_ERROR_RUNTIME;
         break;
     }
   }
 
-  if (result) {
-    msg = servermessage_create(code, 0);
-    servermessage_set_payload(msg, result);
-    ret = protocol_send_message(stream, msg);
-    data_free(result);
+  msg = servermessage_create(code, 0);
+  if (request) {
+    msg -> id = request -> id;
+    msg -> binary = request -> binary;
   }
+  servermessage_set_payload(msg, (result) ? result : data_null());
+  ret = protocol_send_message(stream, msg);
+  servermessage_free(msg);
   return ret;
 }
 
 data_t * protocol_send_message(stream_t *stream, servermessage_t *msg) {
-  data_t * ret;
+  data_t *ret;
+  char   *line;
 
-  ret = protocol_printf(stream, servermessage_tostring(msg));
-  if (!ret && msg->payload) {
-    ret = protocol_write(stream, msg->encoded, msg->payload_size - 2);
+  if (msg -> binary) {
+    ret = _protocol_send_frame(stream, msg);
+  } else {
+    servermessage_encode_payload(msg);
+    line = servermessage_tostring(msg);
+    ret = protocol_write(stream, line, strlen(line));
     if (!ret) {
       ret = protocol_newline(stream);
     }
+    if (!ret && msg -> encoded) {
+      ret = protocol_write(stream, msg -> encoded, msg -> payload_size - 2);
+      if (!ret) {
+        ret = protocol_newline(stream);
+      }
+    }
+  }
+  if (!ret && stream_flush(stream)) {
+    ret = (stream -> error)
+          ? data_copy(stream -> error)
+          : data_exception(ErrorIOError, "Could not write to IPC channel");
   }
   return ret;
 }
@@ -223,8 +372,12 @@ data_t * protocol_send_message(stream_t *stream, servermessage_t *msg) {
 data_t * protocol_read_message(stream_t *stream) {
   str_t           *line = NULL;
   data_t          *ret;
+  data_t          *err;
   servermessage_t *msg;
 
+  if (stream_peek(stream) == OBLSERVER_FRAME_MAGIC) {
+    return _protocol_read_frame(stream);
+  }
   ret = protocol_readline(stream);
   if (data_is_string(ret)) {
     line = (str_t *) ret;
@@ -232,16 +385,52 @@ data_t * protocol_read_message(stream_t *stream) {
   }
   if (!ret) {
     ret = data_parse(ServerMessage, str_chars(line));
+    str_free(line);
   }
   if (data_is_servermessage(ret)) {
     msg = data_as_servermessage(ret);
-    if (msg -> payload_size > 0) {
-      ret = _protocol_read_payload(stream, msg);
+    if ((msg -> payload_size > 0) && (err = _protocol_read_payload(stream, msg))) {
+      servermessage_free(msg);
+      ret = err;
     }
   }
   return ret;
 }
 
+/*
+ * Returns TRUE if the stream buffer holds a complete message, so that
+ * protocol_read_message will not have to wait for the peer. A text message
+ * announces its payload with "-- <size>" at the end of its line.
+ */
+int protocol_message_buffered(stream_t *stream) {
+  char   *buf = stream -> buffer + stream -> pos;
+  int     avail = stream -> len - stream -> pos;
+  char   *eol;
+  char   *word;
+  size_t  len;
+
+  if (!stream -> buffer || (avail <= 0)) {
+    return FALSE;
+  }
+  if ((unsigned char) *buf == OBLSERVER_FRAME_MAGIC) {
+    if (avail < OBLSERVER_FRAME_HEADER_SIZE) {
+      return FALSE;
+    }
+    len = _protocol_get((unsigned char *) buf + 8, 4);
+    /* Oversized frames are rejected by protocol_read_message */
+    return (len > OBLSERVER_FRAME_MAX_SIZE) ||
+           ((size_t) avail >= OBLSERVER_FRAME_HEADER_SIZE + len);
+  }
+  if (!(eol = memchr(buf, '\n', avail))) {
+    return FALSE;
+  }
+  for (word = eol; (word > buf) && (word[-1] != ' '); word--);
+  if ((word - buf >= 4) && !strncmp(word - 4, " -- ", 4)) {
+    return avail - (eol + 1 - buf) >= strtol(word, NULL, 10);
+  }
+  return TRUE;
+}
+
 name_t * protocol_build_name(char *scriptname) {
   char   *buf;
   char   *ptr;
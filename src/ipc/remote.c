@@ -27,7 +27,7 @@ static data_t * _remote_new(remote_t *, va_list);
 static void     _remote_free(remote_t *);
 static char *   _remote_tostring(remote_t *);
 static data_t * _remote_resolve(remote_t *, char *);
-static data_t * _remote_call(remote_t *, array_t *, dict_t *);
+static data_t * _remote_call(remote_t *, arguments_t *);
 
 static vtable_t _vtable_Remote[] = {
   { .id = FunctionNew,         .fnc = (void_t) _remote_new },
@@ -79,22 +79,30 @@ data_t * _remote_resolve(remote_t *remote, char *name) {
   return data_create(Remote, remote -> mountpoint, n);
 }
 
-data_t * _remote_call(remote_t *remote, array_t *args, dict_t *kwargs) {
-  client_t    *client;
-  data_t      *ret;
-  arguments_t *a;
+data_t * _remote_call(remote_t *remote, arguments_t *args) {
+  data_t   *ret;
+  future_t *future;
 
+  ret = remote_call_async(remote, args);
+  if (data_is_future(ret)) {
+    future = data_as_future(ret);
+    ret = future_result(future);
+    future_free(future);
+  }
+  return ret;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Calls <code>remote</code> without waiting for the result. Returns a
+ * future that completes with the result, or an exception if the call could
+ * not be made.
+ */
+data_t * remote_call_async(remote_t *remote, arguments_t *args) {
   debug(ipc, "Running '%s' on mountpoint %s",
       name_tostring(remote->name),
       data_tostring((data_t *) remote->mountpoint));
-  ret = mountpoint_checkout_client(remote->mountpoint);
-  if (data_is_client(ret)) {
-    client = (client_t *) ret;
-    a = arguments_create(args, kwargs);
-    ret = client_run(client, remote, a);
-    arguments_free(a);
-    mountpoint_return_client(remote->mountpoint, client);
-  }
-  return ret;
+  return mountpoint_call_async(remote->mountpoint, remote, args);
 }
 
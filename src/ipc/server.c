@@ -20,12 +20,23 @@
 #include "libipc.h"
 
 #include <exception.h>
+#include <threadpool.h>
 
 typedef struct _server_cmd_handler {
   int        code;
   data_t * (*handler)(server_t *, servermessage_t *);
 } server_cmd_handler_t;
 
+typedef struct _server_config {
+  data_t *engine;
+  int     maxinflight;
+} server_config_t;
+
+typedef struct _server_job {
+  server_t        *server;
+  servermessage_t *msg;
+} server_job_t;
+
 extern void       server_init(void);
 
 static server_t * _server_new(server_t *, va_list);
@@ -33,9 +44,15 @@ static void       _server_free(server_t *);
 static char *     _server_tostring(server_t *);
 static data_t *   _server_resolve(server_t *, char *);
 
+static data_t *   _server_send(server_t *, servermessage_t *);
+static data_t *   _server_return(server_t *, servermessage_t *, data_t *);
 static data_t *   _server_welcome(server_t *, servermessage_t *);
 static data_t *   _server_call(server_t *, servermessage_t *);
 static data_t *   _server_quit(server_t *, servermessage_t *);
+static data_t *   _server_job(server_job_t *);
+static void       _server_dispatch(server_t *, servermessage_t *);
+static void       _server_drain(server_t *, int);
+static int        _server_handle(server_t *);
 
 static vtable_t _vtable_Server[] = {
   { .id = FunctionNew,          .fnc = (void_t) _server_new },
@@ -54,8 +71,6 @@ static server_cmd_handler_t _cmd_handlers[] = {
   { .code = 0,                       .handler = NULL }
 };
 
-static servermessage_t * _bye = NULL;
-static servermessage_t * _hello = NULL;
 static servermessage_t * _ready = NULL;
 
 /* ------------------------------------------------------------------------ */
@@ -63,10 +78,6 @@ static servermessage_t * _ready = NULL;
 void server_init(void) {
   if (Server < 1) {
     typedescr_register(Server, server_t);
-    _bye = servermessage_create(OBLSERVER_CODE_BYE, 0);
-    _bye -> _d.free_me = Constant;
-    _hello = servermessage_create(OBLSERVER_CODE_HELLO, 0);
-    _hello -> _d.free_me = Constant;
     _ready = servermessage_create(OBLSERVER_CODE_READY, 0);
     _ready -> _d.free_me = Constant;
   }
@@ -93,6 +104,12 @@ static inline data_t * _server_engine_call(server_t *server, vtable_id_t func,
 server_t * _server_new(server_t *server, va_list args) {
   server -> engine = data_copy(va_arg(args, data_t *));
   server -> stream = stream_copy(va_arg(args, stream_t *));
+  server -> maxinflight = 0;
+  server -> inflight = 0;
+  server -> paused = FALSE;
+  server -> connection = NULL;
+  server -> lock = condition_create();
+  server -> send_lock = mutex_create();
   return server;
 }
 
@@ -102,8 +119,13 @@ char * _server_tostring(server_t * _unused_ server) {
 
 void _server_free(server_t *server) {
   if (server) {
+    /* The calls still running are using the stream */
+    _server_drain(server, 0);
     _server_engine_call(server, FunctionUnregisterServer, NULL);
     data_free(server -> engine);
+    stream_free(server -> stream);
+    condition_free(server -> lock);
+    mutex_free(server -> send_lock);
   }
 }
 
@@ -116,6 +138,29 @@ data_t * _server_resolve(server_t *server, char *name) {
 }
 
 /* ------------------------------------------------------------------------ */
+
+/*
+ * Replies can be sent by worker threads as well as by the connection
+ * thread, so every write goes through the send lock.
+ */
+data_t * _server_send(server_t *server, servermessage_t *msg) {
+  data_t *ret;
+
+  mutex_lock(server -> send_lock);
+  ret = protocol_send_message(server -> stream, msg);
+  mutex_unlock(server -> send_lock);
+  return ret;
+}
+
+data_t * _server_return(server_t *server, servermessage_t *msg, data_t *result) {
+  data_t *ret;
+
+  mutex_lock(server -> send_lock);
+  ret = protocol_return_result(server -> stream, msg, result);
+  mutex_unlock(server -> send_lock);
+  return ret;
+}
+
 /* ------------------------------------------------------------------------ */
 
 data_t * _server_call(server_t *server, servermessage_t *msg) {
@@ -123,7 +168,7 @@ data_t * _server_call(server_t *server, servermessage_t *msg) {
   data_t *ret = NULL;
 
   retval = _server_engine_call(server, FunctionRemoteCall, msg);
-  ret = protocol_return_result(server->stream, retval);
+  ret = _server_return(server, msg, retval);
   data_free(retval);
   return ret;
 }
@@ -131,7 +176,9 @@ data_t * _server_call(server_t *server, servermessage_t *msg) {
 data_t * _server_welcome(server_t *server, servermessage_t *hello) {
   servermessage_t *welcome;
   data_t          *ret;
+  data_t          *err;
   dictionary_t    *welcome_data;
+  datalist_t      *protocols;
 
   ret = servermessage_match(hello, OBLSERVER_CODE_HELLO, 1, String);
   if (ret) {
@@ -147,93 +194,256 @@ data_t * _server_welcome(server_t *server, servermessage_t *hello) {
         str_to_data(data_tostring(server -> engine)));
     dictionary_set(welcome_data, "host",
         str_to_data("localhost")); // FIXME
+    protocols = datalist_create(NULL);
+    datalist_push(protocols, str_to_data(OBLSERVER_PROTOCOL_TEXT));
+    datalist_push(protocols, str_to_data(OBLSERVER_PROTOCOL_BINARY));
+    dictionary_set(welcome_data, "protocols", (data_t *) protocols);
     servermessage_set_payload(welcome, (data_t *) welcome_data);
-    ret = protocol_send_message(server -> stream, welcome);
+    ret = _server_send(server, welcome);
     servermessage_free(welcome);
     dictionary_free(welcome_data);
+  } else {
+    err = _server_return(server, hello, ret);
+    data_free(ret);
+    ret = err;
   }
   return ret;
 }
 
-data_t * _server_quit(server_t *server, servermessage_t *ignore) {
-  (void) ignore;
+data_t * _server_quit(server_t *server, servermessage_t *quit) {
+  servermessage_t *bye;
+
+  /* Calls that are still running get to send their replies before BYE */
+  _server_drain(server, 0);
+  bye = servermessage_create(OBLSERVER_CODE_BYE, 0);
+  bye -> id = quit -> id;
+  bye -> binary = quit -> binary;
   /* Ignore return value of protocol_send_message since we're quitting anyway */
-  protocol_send_message(server -> stream, _bye);
+  _server_send(server, bye);
+  servermessage_free(bye);
   return data_exception(ErrorQuit, "Quit");
 }
 
-void * _server_connection_handler(connection_t *connection) {
-  data_t   *engine = data_as_data(connection -> context);
-  server_t *server = server_create(engine, data_as_stream(connection -> client));
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Runs a dispatched CALL on a thread pool worker. If the connection was
+ * paused because too many calls were in flight, this makes room and
+ * resumes it. That happens under the server lock, so a server that is
+ * being closed waits for it and the connection is still there.
+ */
+data_t * _server_job(server_job_t *job) {
+  server_t        *server = job -> server;
+  servermessage_t *msg = job -> msg;
+  data_t          *ret;
 
-  server_free(server_run(server));
-  return connection;
+  debug(ipc, "Worker executing '%s' #%u", servermessage_tostring(msg), msg -> id);
+  if ((ret = _server_call(server, msg))) {
+    /* The connection will notice the broken stream when it reads */
+    debug(ipc, "Could not return result of #%u: %s", msg -> id, data_tostring(ret));
+    data_free(ret);
+  }
+  servermessage_free(msg);
+  condition_acquire(server -> lock);
+  server -> inflight--;
+  if (server -> paused && (server -> inflight < server -> maxinflight)) {
+    server -> paused = FALSE;
+    connection_resume(server -> connection);
+  }
+  condition_broadcast(server -> lock);
+  return NULL;
 }
 
-/* ------------------------------------------------------------------------ */
+/*
+ * Hands a CALL to the thread pool. The job owns the message.
+ */
+void _server_dispatch(server_t *server, servermessage_t *msg) {
+  server_job_t *job = NEW(server_job_t);
+
+  job -> server = server;
+  job -> msg = msg;
+  condition_acquire(server -> lock);
+  server -> inflight++;
+  condition_release(server -> lock);
+  future_free(threadpool_submit("IPC call", (pooljob_t) _server_job, job, free));
+}
 
-server_t * server_create(data_t *engine, stream_t *stream) {
-  ipc_init();
-  debug(ipc, "Creating IPC server for engine '%s' using stream '%s'",
-      data_tostring(engine), stream_tostring(stream));
-  return data_as_server(data_create(Server, engine, stream));
+/*
+ * Waits until at most max calls are in flight.
+ */
+void _server_drain(server_t *server, int max) {
+  condition_acquire(server -> lock);
+  while (server -> inflight > max) {
+    condition_sleep(server -> lock);
+  }
+  condition_release(server -> lock);
 }
 
-server_t * server_run(server_t *server) {
-  servermessage_t      *msg = _hello;
+/*
+ * Reads and handles one message. Returns TRUE when the client quit or the
+ * connection failed.
+ */
+int _server_handle(server_t *server) {
+  servermessage_t      *msg = NULL;
   server_cmd_handler_t *handler;
-  data_t               *ret = 0;
-  exception_t          *ex;
-
-  while (msg) {
-    debug(ipc, "Message: '%s'", servermessage_tostring(msg));
+  data_t               *ret;
+  data_t               *err;
+  int                   done = FALSE;
+
+  ret = protocol_read_message(server -> stream);
+  if (data_is_servermessage(ret)) {
+    msg = data_as_servermessage(ret);
+    debug(ipc, "Message: '%s' #%u", servermessage_tostring(msg), msg -> id);
+    server -> binary |= msg -> binary;
+    if (msg -> binary && server -> maxinflight &&
+        (msg -> code == OBLSERVER_CODE_CALL)) {
+      _server_dispatch(server, msg);
+      return FALSE;
+    }
+    ret = data_exception(ErrorProtocol,
+        "Unexpected IPC message '%s'", servermessage_tostring(msg));
     for (handler = _cmd_handlers; handler -> code; handler++) {
       if (msg -> code == handler -> code) {
+        data_free(ret);
         ret = (handler -> handler)(server, msg);
+        break;
       }
     }
-    servermessage_free(msg);
-    if (data_is_exception(ret)) {
-      ex = data_as_exception(ret);
-      if (ex -> code == ErrorProtocol) {
-        ret = protocol_send_data(server -> stream,
-            OBLSERVER_CODE_ERROR_PROTOCOL, (data_t *) ex);
-        exception_free(ex);
-      }
-    }
-    if (!ret) {
-      ret = protocol_send_message(server -> stream, _ready);
+  }
+  if (data_is_exception(ret) && (data_as_exception(ret) -> code == ErrorProtocol)) {
+    if (!msg) {
+      /* A frame that could not be read may have left the stream out of sync */
+      msg = servermessage_create(0, 0);
+      msg -> binary = server -> binary;
+      done = server -> binary;
     }
-    for (msg = NULL; !msg; ) {
-      ret = protocol_read_message(server -> stream);
-      if (data_is_servermessage(ret)) {
-        msg = data_as_servermessage(ret);
-        ret = NULL;
-      } else if (data_is_exception(ret)) {
-        ex = data_as_exception(ret);
-        if (ex -> code == ErrorProtocol) {
-          ret = protocol_send_data(server -> stream,
-              OBLSERVER_CODE_ERROR_PROTOCOL, (data_t *) ex);
-          exception_free(ex);
-        }
-      }
+    err = _server_return(server, msg, ret);
+    data_free(ret);
+    ret = err;
+  }
+  if (!ret && !server -> binary) {
+    ret = _server_send(server, _ready);
+  }
+  servermessage_free(msg);
+  if (ret) {
+    debug(ipc, "Closing IPC connection: %s", data_tostring(ret));
+    data_free(ret);
+    done = TRUE;
+  }
+  return done;
+}
+
+/*
+ * Called by the event loop every time the client sent something. The
+ * server is kept with the connection in between, so an idle connection
+ * does not tie up a thread. Neither does a client that sent half a message:
+ * the socket has data, so one fill does not block, and the message is only
+ * read once all of it arrived.
+ */
+void * _server_connection_handler(connection_t *connection) {
+  server_config_t *config = (server_config_t *) connection -> context;
+  server_t        *server = (server_t *) connection -> state;
+
+  if (!server) {
+    server = server_create(config -> engine, data_as_stream(connection -> client));
+    server_set_maxinflight(server, config -> maxinflight);
+    server -> connection = connection;
+    connection -> state = (data_t *) server;
+  }
+  if (server -> maxinflight) {
+    condition_acquire(server -> lock);
+    if (server -> inflight >= server -> maxinflight) {
+      /* Not reading any further is what pushes back on the client */
+      debug(ipc, "Pausing IPC connection: %d calls in flight", server -> inflight);
+      server -> paused = TRUE;
+      condition_release(server -> lock);
+      return SERVICE_PAUSE;
     }
+    condition_release(server -> lock);
+  }
+  if (!protocol_message_buffered(server -> stream) &&
+      (stream_fill(server -> stream) > 0) &&
+      !protocol_message_buffered(server -> stream)) {
+    return SERVICE_INCOMPLETE;
   }
+  return (_server_handle(server)) ? NULL : SERVICE_KEEPALIVE;
+}
+
+/* ------------------------------------------------------------------------ */
+
+server_t * server_create(data_t *engine, stream_t *stream) {
+  ipc_init();
+  debug(ipc, "Creating IPC server for engine '%s' using stream '%s'",
+      data_tostring(engine), stream_tostring(stream));
+  return data_as_server(data_create(Server, engine, stream));
+}
+
+/**
+ * Allows up to <code>maxinflight</code> CALLs on a binary connection to
+ * execute concurrently. 0 executes them one at a time on the connection
+ * thread, which is the default.
+ */
+server_t * server_set_maxinflight(server_t *server, int maxinflight) {
+  server -> maxinflight = (maxinflight > 0) ? maxinflight : 0;
+  return server;
+}
+
+/*
+ * Reads and handles messages until the client quits or the connection
+ * fails. A connection switches to binary mode when the client sends its
+ * first binary frame. Binary clients match replies to requests by id and
+ * may send requests without waiting for earlier ones to complete, so they
+ * are not sent READY after every reply.
+ */
+server_t * server_run(server_t *server) {
+  do {
+    if (server -> maxinflight) {
+      _server_drain(server, server -> maxinflight - 1);
+    }
+  } while (!_server_handle(server));
+  _server_drain(server, 0);
   return server;
 }
 
 /* ------------------------------------------------------------------------ */
 
-int server_start(data_t *engine, int port) {
-  socket_t *server;
+int server_start(data_t *engine, int port, int maxinflight) {
+  char service[32];
 
   if (port <= 0) {
     port = OBELIX_DEFAULT_PORT;
   }
-  server = serversocket_create(port);
-  debug(ipc, "Establishing IPC server on port %d", port);
-  socket_listen(server,
-                _server_connection_handler,
-                engine);
-  return 0;
+  snprintf(service, 32, "%d", port);
+  return server_serve(engine, service, maxinflight);
+}
+
+/*
+ * Serves IPC clients on the given service, either a TCP port or a
+ * "unix:/path" Unix domain socket.
+ */
+int server_start_byservice(data_t *engine, char *service) {
+  return server_serve(engine, service, 0);
+}
+
+/*
+ * Like server_start_byservice, but allows up to maxinflight calls per
+ * connection to execute concurrently. See server_set_maxinflight.
+ * Connections are served by the socket_serve() event loop.
+ */
+int server_serve(data_t *engine, char *service, int maxinflight) {
+  server_config_t  config;
+  socket_t        *server;
+
+  server = serversocket_create_byservice(service);
+  if (socket_error(server)) {
+    error("Could not establish IPC server on '%s': %s",
+          service, data_tostring(socket_error(server)));
+    socket_free(server);
+    return -1;
+  }
+  debug(ipc, "Establishing IPC server on '%s' allowing %d calls in flight",
+        service, maxinflight);
+  config.engine = engine;
+  config.maxinflight = maxinflight;
+  return socket_serve(server, _server_connection_handler, &config, NULL);
 }
@@ -17,69 +17,877 @@
  * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "libjson.h"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 
+#include "libjson.h"
 #ifdef HAVE_PTHREAD_H
 #include <pthread.h>
 #endif
 
-#include <grammar.h>
-#include <nvp.h>
-#include <parser.h>
+#include <dictionary.h>
+#include <exception.h>
+#include <file.h>
+#include <str.h>
 
-/* ------------------------------------------------------------------------ */
+/*
+ * Values nested deeper than this are rejected by both the encoder and the
+ * decoder. This protects the recursive descent against stack exhaustion and
+ * the encoder against cyclic structures.
+ */
+#define JSON_MAX_DEPTH    512
+
+/*
+ * Object keys are unescaped into a buffer that is reused for all keys at the
+ * same nesting level. Objects nested deeper than this allocate their own.
+ */
+#define JSON_KEY_BUFFERS  32
+
+typedef struct _json_reader {
+  const char *start;
+  const char *ptr;
+  const char *end;
+  int         depth;
+  int         typed;
+  data_t     *error;
+  str_t      *keys[JSON_KEY_BUFFERS];
+} json_reader_t;
+
+typedef struct _json_writer {
+  str_t      *out;
+  int         depth;
+  int         first;
+  int         serialized;
+  int         error;
+} json_writer_t;
 
-static void        _json_init(void);
-extern grammar_t * json_grammar_build(void);
+static void            _json_init(void);
+
+static json_writer_t * _json_write_value(json_writer_t *, data_t *);
+static json_writer_t * _json_write_entry(entry_t *, json_writer_t *);
+static void            _json_write_string(str_t *, const char *, size_t);
+static void            _json_write_int(str_t *, long);
+static void            _json_write_float(str_t *, double);
+
+static data_t *        _json_read_value(json_reader_t *);
+static data_t *        _json_read_array(json_reader_t *);
+static data_t *        _json_read_object(json_reader_t *);
+static int             _json_read_string(json_reader_t *, str_t *);
+static data_t *        _json_read_number(json_reader_t *);
+static data_t *        _json_read_literal(json_reader_t *, const char *, data_t *);
+static data_t *        _json_error(json_reader_t *, char *);
+static data_t *        _json_deserialize(data_t *);
+static dictionary_t *  _json_deserialize_entry(entry_t *, dictionary_t *);
 
 int json_debug = -1;
 
-static grammar_t       *_json_grammar = NULL;
 static pthread_once_t   _json_once = PTHREAD_ONCE_INIT;
 
 #define json_init()     pthread_once(&_json_once, _json_init)
 
 /* ------------------------------------------------------------------------ */
 
+/*
+ * Strings are scanned eight bytes at a time. A word is only inspected byte
+ * by byte if it contains a byte that needs attention, so runs of plain text
+ * are copied in bulk. The tests are the usual SWAR tricks; they can report
+ * false positives for bytes following a match, but never miss one, which is
+ * all the bytewise loop behind them needs.
+ */
+typedef uint64_t json_word_t;
+
+#define JSON_ONES         ((json_word_t) 0x0101010101010101ULL)
+#define JSON_HIGHS        ((json_word_t) 0x8080808080808080ULL)
+
+static inline json_word_t _json_word_has_zero(json_word_t w) {
+  return (w - JSON_ONES) & ~w & JSON_HIGHS;
+}
+
+static inline json_word_t _json_word_has_byte(json_word_t w, unsigned char c) {
+  return _json_word_has_zero(w ^ (JSON_ONES * c));
+}
+
+static inline json_word_t _json_word_has_less(json_word_t w, unsigned char n) {
+  return (w - JSON_ONES * n) & ~w & JSON_HIGHS;
+}
+
+static inline json_word_t _json_load_word(const char *ptr) {
+  json_word_t w;
+
+  memcpy(&w, ptr, sizeof(json_word_t));
+  return w;
+}
+
+static inline int _json_must_escape(unsigned char c) {
+  return (c == '"') || (c == '\\') || (c < 0x20);
+}
+
+/*
+ * Returns a pointer to the first character in [ptr, end) that can not be
+ * copied verbatim into an encoded string.
+ */
+static inline const char * _json_scan_plain(const char *ptr, const char *end) {
+  json_word_t w;
+
+  for (; end - ptr >= (long) sizeof(json_word_t); ptr += sizeof(json_word_t)) {
+    w = _json_load_word(ptr);
+    if (_json_word_has_byte(w, '"') | _json_word_has_byte(w, '\\') | _json_word_has_less(w, 0x20)) {
+      break;
+    }
+  }
+  for (; (ptr < end) && !_json_must_escape((unsigned char) *ptr); ptr++);
+  return ptr;
+}
+
+/*
+ * Returns a pointer to the first quote or backslash in [ptr, end).
+ */
+static inline const char * _json_scan_string(const char *ptr, const char *end) {
+  json_word_t w;
+
+  for (; end - ptr >= (long) sizeof(json_word_t); ptr += sizeof(json_word_t)) {
+    w = _json_load_word(ptr);
+    if (_json_word_has_byte(w, '"') | _json_word_has_byte(w, '\\')) {
+      break;
+    }
+  }
+  for (; (ptr < end) && (*ptr != '"') && (*ptr != '\\'); ptr++);
+  return ptr;
+}
+
+static inline const char * _json_skip_whitespace(const char *ptr, const char *end) {
+  for (; (ptr < end) && ((*ptr == ' ') || (*ptr == '\n') || (*ptr == '\r') || (*ptr == '\t')); ptr++);
+  return ptr;
+}
+
+/* ------------------------------------------------------------------------ */
+
 void _json_init(void) {
   logging_register_module(json);
-  _json_grammar = json_grammar_build();
+}
+
+/* -- E N C O D E R ------------------------------------------------------- */
+
+void _json_write_string(str_t *out, const char *str, size_t len) {
+  static const char  hex[] = "0123456789abcdef";
+  const char        *end = str + len;
+  const char        *run;
+  char               esc[7];
+  unsigned char      c;
+
+  str_append_char(out, '"');
+  while (str < end) {
+    run = str;
+    str = _json_scan_plain(str, end);
+    if (str > run) {
+      str_append_nchars(out, run, str - run);
+    }
+    if (str < end) {
+      c = (unsigned char) *str++;
+      esc[0] = '\\';
+      esc[2] = 0;
+      switch (c) {
+        case '"':  esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+          esc[1] = 'u';
+          esc[2] = '0';
+          esc[3] = '0';
+          esc[4] = hex[c >> 4];
+          esc[5] = hex[c & 0x0F];
+          esc[6] = 0;
+          break;
+      }
+      str_append_chars(out, esc);
+    }
+  }
+  str_append_char(out, '"');
+}
+
+void _json_write_int(str_t *out, long value) {
+  char          buf[24];
+  char         *ptr = buf + sizeof(buf);
+  unsigned long u = (value < 0) ? -((unsigned long) value) : (unsigned long) value;
+
+  do {
+    *(--ptr) = (char) ('0' + (u % 10));
+    u /= 10;
+  } while (u);
+  if (value < 0) {
+    *(--ptr) = '-';
+  }
+  str_append_nchars(out, ptr, buf + sizeof(buf) - ptr);
+}
+
+/*
+ * Writes the shortest representation of value that reads back as the same
+ * double. JSON has no representation for NaN and infinities, so those are
+ * written as null.
+ */
+void _json_write_float(str_t *out, double value) {
+  char buf[32];
+  int  prec;
+
+  if (!isfinite(value)) {
+    str_append_chars(out, "null");
+    return;
+  }
+  for (prec = 15; prec < 17; prec++) {
+    snprintf(buf, sizeof(buf), "%.*g", prec, value);
+    if (strtod(buf, NULL) == value) {
+      break;
+    }
+  }
+  if (prec == 17) {
+    snprintf(buf, sizeof(buf), "%.17g", value);
+  }
+  str_append_chars(out, buf);
+  if (!strpbrk(buf, ".eE")) {
+    str_append_chars(out, ".0");
+  }
+}
+
+json_writer_t * _json_write_entry(entry_t *entry, json_writer_t *writer) {
+  if (!writer -> error) {
+    if (!writer -> first) {
+      str_append_char(writer -> out, ',');
+    }
+    writer -> first = 0;
+    _json_write_string(writer -> out, (char *) entry -> key, strlen((char *) entry -> key));
+    str_append_char(writer -> out, ':');
+    _json_write_value(writer, (data_t *) entry -> value);
+  }
+  return writer;
+}
+
+json_writer_t * _json_write_value(json_writer_t *writer, data_t *value) {
+  array_t *array;
+  data_t  *serialized;
+  char    *str;
+  size_t   len;
+  int      ix;
+  int      first;
+
+  if (writer -> error) {
+    return writer;
+  }
+  if (++writer -> depth > JSON_MAX_DEPTH) {
+    debug(json, "Value nested more than %d levels deep", JSON_MAX_DEPTH);
+    writer -> error = 1;
+    return writer;
+  }
+  if (data_isnull(value)) {
+    str_append_chars(writer -> out, "null");
+  } else if (data_type(value) == Bool) {
+    str_append_chars(writer -> out, (((int_t *) value) -> i) ? "true" : "false");
+  } else if (data_type(value) == Int) {
+    _json_write_int(writer -> out, ((int_t *) value) -> i);
+  } else if (data_type(value) == Float) {
+    _json_write_float(writer -> out, ((flt_t *) value) -> dbl);
+  } else if (data_type(value) == String) {
+    str = str_chars((str_t *) value);
+    len = str_len((str_t *) value);
+    if (writer -> serialized && (len >= 2) && (str[0] == '"') && (str[len - 1] == '"')) {
+      /* Serialized strings are wrapped in quotes by _str_serialize */
+      str++;
+      len -= 2;
+    }
+    _json_write_string(writer -> out, str, len);
+  } else if (data_type(value) == List) {
+    array = data_as_array(value);
+    str_append_char(writer -> out, '[');
+    for (ix = 0; ix < array_size(array); ix++) {
+      if (ix) {
+        str_append_char(writer -> out, ',');
+      }
+      _json_write_value(writer, data_array_get(array, ix));
+    }
+    str_append_char(writer -> out, ']');
+  } else if (data_type(value) == Dictionary) {
+    /* A dictionary can be nested in one of the entries being written */
+    first = writer -> first;
+    str_append_char(writer -> out, '{');
+    writer -> first = 1;
+    dict_reduce(((dictionary_t *) value) -> attributes,
+                (reduce_t) _json_write_entry, writer);
+    str_append_char(writer -> out, '}');
+    writer -> first = first;
+  } else {
+    /*
+     * Everything else goes through the type's serializer. Serialized
+     * dictionaries carry an __obl_type__ entry which json_decode uses to
+     * rebuild the original value.
+     */
+    serialized = data_serialize(value);
+    if (data_type(serialized) == data_type(value)) {
+      _json_write_string(writer -> out, data_tostring(value), strlen(data_tostring(value)));
+    } else {
+      writer -> serialized++;
+      _json_write_value(writer, serialized);
+      writer -> serialized--;
+    }
+    data_free(serialized);
+  }
+  writer -> depth--;
+  return writer;
+}
+
+/* -- D E C O D E R ------------------------------------------------------- */
+
+data_t * _json_error(json_reader_t *reader, char *msg) {
+  if (!reader -> error) {
+    reader -> error = data_exception(ErrorSyntax, "JSON: %s at offset %d",
+                                     msg, (int) (reader -> ptr - reader -> start));
+  }
+  return NULL;
+}
+
+static inline int _json_hex(char c) {
+  if ((c >= '0') && (c <= '9')) {
+    return c - '0';
+  } else if ((c >= 'a') && (c <= 'f')) {
+    return c - 'a' + 10;
+  } else if ((c >= 'A') && (c <= 'F')) {
+    return c - 'A' + 10;
+  } else {
+    return -1;
+  }
+}
+
+static inline long _json_read_hex4(const char *ptr, const char *end) {
+  long ret = 0;
+  int  ix;
+  int  h;
+
+  if (end - ptr < 4) {
+    return -1;
+  }
+  for (ix = 0; ix < 4; ix++) {
+    if ((h = _json_hex(ptr[ix])) < 0) {
+      return -1;
+    }
+    ret = (ret << 4) | h;
+  }
+  return ret;
+}
+
+static inline void _json_append_utf8(str_t *str, long cp) {
+  char buf[5];
+  int  len;
+
+  if (cp < 0x80) {
+    buf[0] = (char) cp;
+    len = 1;
+  } else if (cp < 0x800) {
+    buf[0] = (char) (0xC0 | (cp >> 6));
+    buf[1] = (char) (0x80 | (cp & 0x3F));
+    len = 2;
+  } else if (cp < 0x10000) {
+    buf[0] = (char) (0xE0 | (cp >> 12));
+    buf[1] = (char) (0x80 | ((cp >> 6) & 0x3F));
+    buf[2] = (char) (0x80 | (cp & 0x3F));
+    len = 3;
+  } else {
+    buf[0] = (char) (0xF0 | (cp >> 18));
+    buf[1] = (char) (0x80 | ((cp >> 12) & 0x3F));
+    buf[2] = (char) (0x80 | ((cp >> 6) & 0x3F));
+    buf[3] = (char) (0x80 | (cp & 0x3F));
+    len = 4;
+  }
+  buf[len] = 0;
+  str_append_nchars(str, buf, len);
+}
+
+/*
+ * Reads the string starting at the opening quote under the read pointer and
+ * appends its unescaped contents to into. Returns 0 on success.
+ */
+int _json_read_string(json_reader_t *reader, str_t *into) {
+  const char *ptr = reader -> ptr + 1;
+  const char *end = reader -> end;
+  const char *run;
+  long        cp;
+  long        low;
+  char        c;
+
+  for (;;) {
+    run = ptr;
+    ptr = _json_scan_string(ptr, end);
+    if (ptr > run) {
+      str_append_nchars(into, run, ptr - run);
+    }
+    if (ptr >= end) {
+      reader -> ptr = ptr;
+      _json_error(reader, "Unterminated string");
+      return -1;
+    }
+    if (*ptr == '"') {
+      reader -> ptr = ptr + 1;
+      return 0;
+    }
+    if (++ptr >= end) {
+      continue;
+    }
+    switch (c = *ptr++) {
+      case '"':
+      case '\\':
+      case '/':
+        str_append_char(into, c);
+        break;
+      case 'b': str_append_char(into, '\b'); break;
+      case 'f': str_append_char(into, '\f'); break;
+      case 'n': str_append_char(into, '\n'); break;
+      case 'r': str_append_char(into, '\r'); break;
+      case 't': str_append_char(into, '\t'); break;
+      case 'u':
+        if ((cp = _json_read_hex4(ptr, end)) < 0) {
+          reader -> ptr = ptr;
+          _json_error(reader, "Invalid \\u escape");
+          return -1;
+        }
+        ptr += 4;
+        if ((cp >= 0xD800) && (cp < 0xDC00) &&
+            (end - ptr >= 6) && (ptr[0] == '\\') && (ptr[1] == 'u') &&
+            ((low = _json_read_hex4(ptr + 2, end)) >= 0xDC00) && (low < 0xE000)) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          ptr += 6;
+        }
+        if (!cp) {
+          /* Strings end at the first NUL, which would cut this one short */
+          reader -> ptr = ptr - 6;
+          _json_error(reader, "Unsupported \\u0000 escape");
+          return -1;
+        }
+        _json_append_utf8(into, cp);
+        break;
+      default:
+        reader -> ptr = ptr - 1;
+        _json_error(reader, "Invalid escape sequence");
+        return -1;
+    }
+  }
+}
+
+/*
+ * Numbers with at most 19 significant digits are accumulated into an
+ * integer. Integers that fit a long are returned as int. Floats whose
+ * mantissa and decimal exponent are small enough to be represented exactly
+ * are computed with a single multiplication or division, which is correctly
+ * rounded; everything else is left to strtod.
+ */
+data_t * _json_read_number(json_reader_t *reader) {
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char *ptr = reader -> ptr;
+  const char *end = reader -> end;
+  uint64_t    mantissa = 0;
+  int         digits = 0;
+  int         truncated = 0;
+  int         exp10 = 0;
+  int         exp = 0;
+  int         expneg = 0;
+  int         neg = 0;
+  int         isfloat = 0;
+  double      dbl;
+  char        numbuf[64];
+  char       *buf;
+  int         numlen;
+
+  if (*ptr == '-') {
+    neg = 1;
+    ptr++;
+  }
+  if ((ptr >= end) || (*ptr < '0') || (*ptr > '9')) {
+    reader -> ptr = ptr;
+    return _json_error(reader, "Invalid number");
+  }
+  if (*ptr == '0') {
+    ptr++;
+  } else {
+    for (; (ptr < end) && (*ptr >= '0') && (*ptr <= '9'); ptr++) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*ptr - '0');
+        digits++;
+      } else {
+        exp10++;
+        truncated = 1;
+      }
+    }
+  }
+  if ((ptr < end) && (*ptr == '.')) {
+    isfloat = 1;
+    if ((++ptr >= end) || (*ptr < '0') || (*ptr > '9')) {
+      reader -> ptr = ptr;
+      return _json_error(reader, "Invalid number");
+    }
+    for (; (ptr < end) && (*ptr >= '0') && (*ptr <= '9'); ptr++) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*ptr - '0');
+        if (mantissa) {
+          digits++;
+        }
+        exp10--;
+      } else {
+        truncated = 1;
+      }
+    }
+  }
+  if ((ptr < end) && ((*ptr == 'e') || (*ptr == 'E'))) {
+    isfloat = 1;
+    ptr++;
+    if ((ptr < end) && ((*ptr == '+') || (*ptr == '-'))) {
+      expneg = (*ptr++ == '-');
+    }
+    if ((ptr >= end) || (*ptr < '0') || (*ptr > '9')) {
+      reader -> ptr = ptr;
+      return _json_error(reader, "Invalid number");
+    }
+    for (; (ptr < end) && (*ptr >= '0') && (*ptr <= '9'); ptr++) {
+      if (exp < 100000) {
+        exp = exp * 10 + (*ptr - '0');
+      }
+    }
+    exp10 += (expneg) ? -exp : exp;
+  }
+
+  if (!isfloat && !truncated &&
+      (mantissa <= ((neg) ? ((uint64_t) LONG_MAX) + 1 : (uint64_t) LONG_MAX))) {
+    reader -> ptr = ptr;
+    return int_to_data((neg) ? (long) (0 - mantissa) : (long) mantissa);
+  }
+  if (!truncated && (mantissa <= ((uint64_t) 1 << 53)) && (exp10 >= -22) && (exp10 <= 22)) {
+    dbl = (double) mantissa;
+    dbl = (exp10 < 0) ? dbl / pow10[-exp10] : dbl * pow10[exp10];
+    if (neg) {
+      dbl = -dbl;
+    }
+  } else {
+    /*
+     * The input is not necessarily NUL-terminated, e.g. when decoding
+     * straight out of a memory mapped file, so strtod gets a copy.
+     */
+    numlen = ptr - reader -> ptr;
+    buf = (numlen < (int) sizeof(numbuf)) ? numbuf : stralloc(numlen);
+    memcpy(buf, reader -> ptr, numlen);
+    buf[numlen] = 0;
+    dbl = strtod(buf, NULL);
+    if (buf != numbuf) {
+      free(buf);
+    }
+  }
+  reader -> ptr = ptr;
+  return flt_to_data(dbl);
+}
+
+data_t * _json_read_literal(json_reader_t *reader, const char *literal, data_t *value) {
+  size_t len = strlen(literal);
+
+  if (((size_t) (reader -> end - reader -> ptr) < len) || strncmp(reader -> ptr, literal, len)) {
+    return _json_error(reader, "Invalid literal");
+  }
+  reader -> ptr += len;
+  return value;
+}
+
+data_t * _json_read_array(json_reader_t *reader) {
+  datalist_t *ret = datalist_create(NULL);
+  data_t     *elem;
+
+  reader -> ptr = _json_skip_whitespace(reader -> ptr + 1, reader -> end);
+  if ((reader -> ptr < reader -> end) && (*reader -> ptr == ']')) {
+    reader -> ptr++;
+    return (data_t *) ret;
+  }
+  for (;;) {
+    if (!(elem = _json_read_value(reader))) {
+      break;
+    }
+    datalist_push(ret, elem);
+    data_free(elem);
+    reader -> ptr = _json_skip_whitespace(reader -> ptr, reader -> end);
+    if (reader -> ptr >= reader -> end) {
+      _json_error(reader, "Unterminated array");
+      break;
+    } else if (*reader -> ptr == ']') {
+      reader -> ptr++;
+      return (data_t *) ret;
+    } else if (*reader -> ptr != ',') {
+      _json_error(reader, "Expected ',' or ']'");
+      break;
+    }
+    reader -> ptr++;
+  }
+  datalist_free(ret);
+  return NULL;
+}
+
+data_t * _json_read_object(json_reader_t *reader) {
+  dictionary_t *ret = dictionary_create(NULL);
+  str_t        *key;
+  data_t       *value;
+
+  if (reader -> depth < JSON_KEY_BUFFERS) {
+    if (!reader -> keys[reader -> depth]) {
+      reader -> keys[reader -> depth] = str_create(0);
+    }
+    key = reader -> keys[reader -> depth];
+  } else {
+    key = str_create(0);
+  }
+
+  reader -> ptr = _json_skip_whitespace(reader -> ptr + 1, reader -> end);
+  if ((reader -> ptr < reader -> end) && (*reader -> ptr == '}')) {
+    reader -> ptr++;
+    if (reader -> depth >= JSON_KEY_BUFFERS) {
+      str_free(key);
+    }
+    return (data_t *) ret;
+  }
+  for (;;) {
+    if ((reader -> ptr >= reader -> end) || (*reader -> ptr != '"')) {
+      _json_error(reader, "Expected string key");
+      break;
+    }
+    str_erase(key);
+    if (_json_read_string(reader, key)) {
+      break;
+    }
+    reader -> ptr = _json_skip_whitespace(reader -> ptr, reader -> end);
+    if ((reader -> ptr >= reader -> end) || (*reader -> ptr != ':')) {
+      _json_error(reader, "Expected ':'");
+      break;
+    }
+    reader -> ptr++;
+    if (!(value = _json_read_value(reader))) {
+      break;
+    }
+    dictionary_set(ret, str_chars(key), value);
+    data_free(value);
+    reader -> ptr = _json_skip_whitespace(reader -> ptr, reader -> end);
+    if (reader -> ptr >= reader -> end) {
+      _json_error(reader, "Unterminated object");
+      break;
+    } else if (*reader -> ptr == '}') {
+      reader -> ptr++;
+      reader -> typed |= dictionary_has(ret, "__obl_type__");
+      if (reader -> depth >= JSON_KEY_BUFFERS) {
+        str_free(key);
+      }
+      return (data_t *) ret;
+    } else if (*reader -> ptr != ',') {
+      _json_error(reader, "Expected ',' or '}'");
+      break;
+    }
+    reader -> ptr = _json_skip_whitespace(reader -> ptr + 1, reader -> end);
+  }
+  if (reader -> depth >= JSON_KEY_BUFFERS) {
+    str_free(key);
+  }
+  dictionary_free(ret);
+  return NULL;
+}
+
+data_t * _json_read_value(json_reader_t *reader) {
+  data_t     *ret = NULL;
+  str_t      *str;
+  const char *end;
+
+  reader -> ptr = _json_skip_whitespace(reader -> ptr, reader -> end);
+  if (reader -> ptr >= reader -> end) {
+    return _json_error(reader, "Unexpected end of input");
+  }
+  if (++reader -> depth > JSON_MAX_DEPTH) {
+    return _json_error(reader, "Value nested too deeply");
+  }
+  switch (*reader -> ptr) {
+    case '{':
+      ret = _json_read_object(reader);
+      break;
+    case '[':
+      ret = _json_read_array(reader);
+      break;
+    case '"':
+      end = _json_scan_string(reader -> ptr + 1, reader -> end);
+      if ((end < reader -> end) && (*end == '"')) {
+        /* No escapes: copy the string in one go */
+        ret = (data_t *) str_copy_nchars(reader -> ptr + 1, end - reader -> ptr - 1);
+        reader -> ptr = end + 1;
+        break;
+      }
+      str = str_create(end - reader -> ptr);
+      if (!_json_read_string(reader, str)) {
+        ret = (data_t *) str;
+      } else {
+        str_free(str);
+      }
+      break;
+    case 't':
+      ret = _json_read_literal(reader, "true", data_true());
+      break;
+    case 'f':
+      ret = _json_read_literal(reader, "false", data_false());
+      break;
+    case 'n':
+      ret = _json_read_literal(reader, "null", data_null());
+      break;
+    default:
+      if ((*reader -> ptr == '-') || ((*reader -> ptr >= '0') && (*reader -> ptr <= '9'))) {
+        ret = _json_read_number(reader);
+      } else {
+        _json_error(reader, "Unexpected character");
+      }
+      break;
+  }
+  reader -> depth--;
+  return ret;
+}
+
+/*
+ * Objects carrying an __obl_type__ entry were written by the encoder for
+ * values that are not plain JSON. They are handed to data_deserialize,
+ * which rebuilds the original value from the object as data_serialize
+ * produced it. This is done top-down, because a type's deserializer expects
+ * its own members in serialized form.
+ */
+dictionary_t * _json_deserialize_entry(entry_t *entry, dictionary_t *dict) {
+  data_t *value = _json_deserialize((data_t *) entry -> value);
+
+  dictionary_set(dict, (char *) entry -> key, value);
+  data_free(value);
+  return dict;
+}
+
+data_t * _json_deserialize(data_t *value) {
+  datalist_t *list;
+  data_t     *elem;
+  array_t    *array;
+  int         ix;
+
+  if (data_is_dictionary(value)) {
+    if (dictionary_has((dictionary_t *) value, "__obl_type__")) {
+      return data_deserialize(value);
+    }
+    return (data_t *) dict_reduce(((dictionary_t *) value) -> attributes,
+                                  (reduce_t) _json_deserialize_entry,
+                                  dictionary_create(NULL));
+  } else if (data_is_list(value)) {
+    array = data_as_array(value);
+    list = datalist_create(NULL);
+    for (ix = 0; ix < array_size(array); ix++) {
+      elem = _json_deserialize(data_array_get(array, ix));
+      datalist_push(list, elem);
+      data_free(elem);
+    }
+    return (data_t *) list;
+  } else {
+    return data_copy(value);
+  }
 }
 
 /* ------------------------------------------------------------------------ */
 
 char * json_encode(data_t *value) {
-  data_t *serialized;
-  char   *ret;
+  json_writer_t writer;
 
   json_init();
   if (!value) {
     return NULL;
   }
-  serialized = data_serialize(value);
-  if (data_is_exception(serialized)) {
+  writer.out = str_create(0);
+  writer.depth = 0;
+  writer.first = 1;
+  writer.serialized = 0;
+  writer.error = 0;
+  _json_write_value(&writer, value);
+  if (writer.error) {
+    str_free(writer.out);
     return NULL;
   }
-  ret = data_encode(serialized);
-  data_free(serialized);
-  return ret;
+  return str_reassign(writer.out);
 }
 
 data_t * json_decode(data_t *jsontext) {
-  parser_t *parser;
-  data_t   *ret;
+  json_reader_t  reader;
+  str_t         *text;
+  str_t         *buffer = NULL;
+  data_t        *ret;
+  data_t        *deserialized;
+  int            ix;
+  read_t         rdr;
+  char           chunk[4096];
+  int            r;
+  char          *slice = NULL;
 
   json_init();
-  if (!data_hastype(jsontext, InputStream)) {
+  if (data_is_string(jsontext)) {
+    text = (str_t *) jsontext;
+  } else if (data_hastype(jsontext, Stream)) {
+    slice = stream_readall((stream_t *) jsontext, &r);
+    if (!slice) {
+      return (stream_error((stream_t *) jsontext))
+             ? data_copy(stream_error((stream_t *) jsontext))
+             : data_exception(ErrorIOError, "Could not read JSON text");
+    }
+  } else if (data_hastype(jsontext, InputStream)) {
+    rdr = (read_t) typedescr_get_function(data_typedescr(jsontext), FunctionRead);
+    buffer = str_create(sizeof(chunk));
+    while (rdr && ((r = rdr(jsontext, chunk, sizeof(chunk))) > 0)) {
+      str_append_nchars(buffer, chunk, r);
+    }
+    text = buffer;
+  } else {
     return data_exception(ErrorType, "Cannot decode type '%s'",
         data_typename(jsontext));
   }
-  parser = parser_create(_json_grammar);
-  parser -> data = NULL;
-  if (!(ret = parser_parse(parser, jsontext))) {
-    ret = parser -> data;
+  if (slice) {
+    reader.start = reader.ptr = slice;
+    reader.end = slice + r;
+  } else {
+    reader.start = str_chars(text);
+    reader.ptr = reader.start + text -> pos;
+    reader.end = reader.start + str_len(text);
+  }
+  reader.depth = 0;
+  reader.typed = 0;
+  reader.error = NULL;
+  memset(reader.keys, 0, sizeof(reader.keys));
+
+  if ((ret = _json_read_value(&reader))) {
+    reader.ptr = _json_skip_whitespace(reader.ptr, reader.end);
+    if (reader.ptr < reader.end) {
+      data_free(ret);
+      ret = _json_error(&reader, "Unexpected data after value");
+    }
+  }
+  for (ix = 0; ix < JSON_KEY_BUFFERS; ix++) {
+    if (reader.keys[ix]) {
+      str_free(reader.keys[ix]);
+    }
+  }
+  if (!ret) {
+    ret = reader.error;
+  } else {
+    if (!slice) {
+      text -> pos = reader.ptr - reader.start;
+    }
+    if (reader.typed) {
+      deserialized = _json_deserialize(ret);
+      data_free(ret);
+      ret = deserialized;
+    }
+  }
+  if (buffer) {
+    str_free(buffer);
   }
-  parser_free(parser);
   return ret;
 }
 
@@ -106,28 +914,3 @@ __PLUGIN__ data_t * _function_decode(char *func_name, arguments_t *args) {
   }
   return json_decode(encoded);
 }
-
-/* ------------------------------------------------------------------------ */
-
-__PLUGIN__ parser_t * json_parse_get_value(parser_t *parser) {
-  data_t *obj = datastack_pop(parser -> stack);
-
-  parser -> data = data_deserialize(obj);
-  data_free(obj);
-  return parser;
-}
-
-__PLUGIN__ parser_t * json_parse_to_dictionary(parser_t *parser) {
-  datalist_t   *list = (datalist_t *) datastack_pop(parser -> stack);
-  int           ix;
-  nvp_t        *nvp;
-  dictionary_t *dict = dictionary_create(NULL);
-
-  for (ix = 0; ix < datalist_size(list); ix++) {
-    nvp = (nvp_t *) datalist_get(list, ix);
-    dictionary_set(dict, data_tostring(nvp -> name), nvp -> value);
-  }
-  datalist_free(list);
-  datastack_push(parser -> stack, dict);
-  return parser;
-}
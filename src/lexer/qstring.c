@@ -36,7 +36,7 @@ typedef struct _qstr_config {
 typedef struct _qstr_scanner {
   char   *quotechars;
   int     quote;
-  data_t *quotechars_data;
+  str_t  *quotechars_str;
 } qstr_scanner_t;
 
 static qstr_config_t *  _qstr_config_create(qstr_config_t *config, va_list args);
@@ -114,10 +114,10 @@ qstr_scanner_t * _qstr_scanner_create(qstr_config_t *config) {
 
   qstr_scanner = NEW(qstr_scanner_t);
   if (config -> quotechars && str_len(config -> quotechars)) {
-    qstr_scanner -> quotechars_data = data_copy((data_t *) config -> quotechars);
-    qstr_scanner -> quotechars = data_tostring(qstr_scanner -> quotechars_data);
+    qstr_scanner -> quotechars_str = str_copy(config -> quotechars);
+    qstr_scanner -> quotechars = str_chars(qstr_scanner -> quotechars_str);
   } else {
-    qstr_scanner -> quotechars_data = NULL;
+    qstr_scanner -> quotechars_str = NULL;
     qstr_scanner -> quotechars = NULL;
   }
   qstr_scanner -> quote = 0;
@@ -126,7 +126,7 @@ qstr_scanner_t * _qstr_scanner_create(qstr_config_t *config) {
 
 void _qstr_scanner_free(qstr_scanner_t *qstr_scanner) {
   if (qstr_scanner) {
-    data_free(qstr_scanner -> quotechars_data);
+    str_free(qstr_scanner -> quotechars_str);
     free(qstr_scanner);
   }
 }
@@ -140,9 +140,14 @@ scanner_t * _qstr_scanner_config(scanner_t *scanner, char *param, data_t *value)
     scanner -> data = qstr_scanner;
   }
   if (!strcmp(param, PARAM_QUOTES) && data_notnull(value)) {
-    data_free(qstr_scanner -> quotechars_data);
-    qstr_scanner -> quotechars_data = data_copy(value);
-    qstr_scanner -> quotechars = data_tostring(qstr_scanner -> quotechars_data);
+    /*
+     * The quote strings are shared by all parsers of a grammar, possibly
+     * in other threads, so use the str buffer directly. data_tostring would
+     * replace the cached string of the shared value under the other lexers.
+     */
+    str_free(qstr_scanner -> quotechars_str);
+    qstr_scanner -> quotechars_str = str_from_data(value);
+    qstr_scanner -> quotechars = str_chars(qstr_scanner -> quotechars_str);
     debug(lexer, "Reconfig: Setting quotes to '%s'", qstr_scanner -> quotechars);
   }
   return scanner;
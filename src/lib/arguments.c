@@ -21,7 +21,6 @@
 
 #include <data.h>
 
-static void            _arguments_init(void);
 static arguments_t *   _arguments_new(arguments_t *, va_list);
 static void            _arguments_free(arguments_t *);
 static char *          _arguments_tostring(arguments_t *);
@@ -30,6 +29,8 @@ static data_t *        _arguments_resolve(arguments_t *, char *);
 static arguments_t *   _arguments_set(arguments_t *, char *, data_t *);
 static dictionary_t *  _arguments_serialize(arguments_t *);
 static arguments_t *   _arguments_deserialize(dictionary_t *);
+static datalist_t *    _arguments_pack(arguments_t *);
+static arguments_t *   _arguments_unpack(int, datalist_t *);
 
 /* ----------------------------------------------------------------------- */
 
@@ -43,6 +44,8 @@ _unused_ static vtable_t _vtable_Arguments[] = {
   { .id = FunctionLen,          .fnc = (void_t) arguments_args_size },
   { .id = FunctionSerialize,    .fnc = (void_t) _arguments_serialize },
   { .id = FunctionDeserialize,  .fnc = (void_t) _arguments_deserialize },
+  { .id = FunctionPack,         .fnc = (void_t) _arguments_pack },
+  { .id = FunctionUnpack,       .fnc = (void_t) _arguments_unpack },
   { .id = FunctionNone,         .fnc = NULL }
 };
 
@@ -54,7 +57,7 @@ int Arguments = -1;
 
 /* ----------------------------------------------------------------------- */
 
-void _arguments_init(void) {
+void arguments_init(void) {
   if (Arguments < 1) {
     typedescr_register(Arguments, arguments_t);
   }
@@ -133,8 +136,8 @@ arguments_t * _arguments_set(arguments_t *arguments, char *name, data_t *value)
 arguments_t * _arguments_deserialize(dictionary_t *dict) {
   arguments_t *args = data_new(Arguments, arguments_t);
 
-  args -> args = (datalist_t *) dictionary_get(dict, "args");
-  args -> kwargs = (dictionary_t *) dictionary_get(dict, "kwargs");
+  args -> args = (datalist_t *) data_deserialize(data_uncopy(dictionary_get(dict, "args")));
+  args -> kwargs = (dictionary_t *) data_deserialize(data_uncopy(dictionary_get(dict, "kwargs")));
   return args;
 }
 
@@ -146,10 +149,37 @@ dictionary_t * _arguments_serialize(arguments_t *arguments) {
   return ret;
 }
 
+datalist_t * _arguments_pack(arguments_t *arguments) {
+  datalist_t *ret = datalist_create(NULL);
+
+  datalist_push(ret, (data_t *) arguments -> args);
+  datalist_push(ret, (data_t *) arguments -> kwargs);
+  return ret;
+}
+
+arguments_t * _arguments_unpack(int type, datalist_t *packed) {
+  arguments_t *args;
+  data_t      *a;
+  data_t      *kw;
+
+  if (!data_is_list(packed) || (datalist_size(packed) != 2)) {
+    return NULL;
+  }
+  a = datalist_get(packed, 0);
+  kw = datalist_get(packed, 1);
+  if (!data_is_list(a) || !data_is_dictionary(kw)) {
+    return NULL;
+  }
+  args = data_new(Arguments, arguments_t);
+  args -> args = (datalist_t *) data_copy(a);
+  args -> kwargs = (dictionary_t *) data_copy(kw);
+  return args;
+}
+
 /* ----------------------------------------------------------------------- */
 
 arguments_t * arguments_create(array_t *args, dict_t *kwargs) {
-  _arguments_init();
+  arguments_init();
   return (arguments_t *) data_create(Arguments, args, kwargs);
 }
 
@@ -0,0 +1,163 @@
+/*
+ * bitset.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libcore.h"
+#include <bitset.h>
+#include <str.h>
+
+static inline int _bitset_word_count(bitset_word_t word) {
+  int ret;
+
+  for (ret = 0; word; ret++) {
+    word &= word - 1;
+  }
+  return ret;
+}
+
+// -----------------------
+// bitset_t public methods
+
+bitset_t * bitset_create(int size) {
+  bitset_t *ret = NEW(bitset_t);
+
+  ret -> words = (size > 0) ? bitset_words(size) : 1;
+  ret -> bits = NEWARR(ret -> words, bitset_word_t);
+  ret -> str = NULL;
+  return ret;
+}
+
+void bitset_free(bitset_t *set) {
+  if (set) {
+    free(set -> bits);
+    free(set -> str);
+    free(set);
+  }
+}
+
+bitset_t * bitset_copy(bitset_t *set) {
+  bitset_t *ret;
+
+  if (!set) {
+    return NULL;
+  }
+  ret = bitset_create(set -> words * BITSET_WORD_BITS);
+  memcpy(ret -> bits, set -> bits, set -> words * sizeof(bitset_word_t));
+  return ret;
+}
+
+bitset_t * bitset_resize(bitset_t *set, int size) {
+  int words = bitset_words(size);
+
+  if (words > set -> words) {
+    set -> bits = resize_block(set -> bits,
+                               words * sizeof(bitset_word_t),
+                               set -> words * sizeof(bitset_word_t));
+    set -> words = words;
+  }
+  return set;
+}
+
+bitset_t * bitset_clear(bitset_t *set) {
+  memset(set -> bits, 0, set -> words * sizeof(bitset_word_t));
+  return set;
+}
+
+/*
+ * Adds all elements of src to dest. Returns non-zero if dest changed.
+ */
+int bitset_union(bitset_t *dest, bitset_t *src) {
+  if (!src) {
+    return 0;
+  }
+  if (src -> words > dest -> words) {
+    bitset_resize(dest, src -> words * BITSET_WORD_BITS);
+  }
+  return bitset_bits_union(dest -> bits, src -> bits, src -> words);
+}
+
+int bitset_disjoint(bitset_t *s1, bitset_t *s2) {
+  int ix;
+  int words;
+
+  if (!s1 || !s2) {
+    return 1;
+  }
+  words = (s1 -> words < s2 -> words) ? s1 -> words : s2 -> words;
+  for (ix = 0; ix < words; ix++) {
+    if (s1 -> bits[ix] & s2 -> bits[ix]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int bitset_size(bitset_t *set) {
+  int ix;
+  int ret = 0;
+
+  for (ix = 0; set && (ix < set -> words); ix++) {
+    ret += _bitset_word_count(set -> bits[ix]);
+  }
+  return ret;
+}
+
+/*
+ * Calls the reducer for every element of the set in ascending order. The
+ * element is passed as an intptr_t cast to a void pointer, like set_reduce
+ * does for sets of ints.
+ */
+void * bitset_reduce(bitset_t *set, reduce_t reducer, void *data) {
+  int           ix;
+  int           bit;
+  bitset_word_t word;
+
+  for (ix = 0; ix < set -> words; ix++) {
+    for (word = set -> bits[ix], bit = 0; word; word >>= 1, bit++) {
+      if (word & 1) {
+        data = reducer((void *) ((intptr_t) (ix * BITSET_WORD_BITS + bit)), data);
+      }
+    }
+  }
+  return data;
+}
+
+char * bitset_tostring(bitset_t *set) {
+  str_t *s;
+  int    ix;
+  int    first = 1;
+
+  if (!set) {
+    return NULL;
+  }
+  s = str_copy_chars("{");
+  for (ix = 0; ix < set -> words * (int) BITSET_WORD_BITS; ix++) {
+    if (bitset_has(set, ix)) {
+      str_append_printf(s, (first) ? "%d" : ", %d", ix);
+      first = 0;
+    }
+  }
+  str_append_chars(s, "}");
+  free(set -> str);
+  set -> str = strdup(str_chars(s));
+  str_free(s);
+  return set -> str;
+}
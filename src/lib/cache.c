@@ -0,0 +1,201 @@
+/*
+ * /obelix/src/lib/cache.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libcore.h"
+#include <cache.h>
+
+#define CACHE_INIT_CAPACITY   16
+
+static cachetable_t * _cache_table_create(size_t);
+static size_t         _cache_slot(cachetable_t *, const char *, unsigned int);
+static cachetable_t * _cache_grow(cache_t *);
+static void           _cache_acquire(cache_t *);
+static void           _cache_release(cache_t *);
+
+/* ------------------------------------------------------------------------ */
+
+cachetable_t * _cache_table_create(size_t capacity) {
+  cachetable_t *table;
+
+  table = (cachetable_t *) _new(sizeof(cachetable_t) + capacity * sizeof(cacheentry_t *));
+  table -> capacity = capacity;
+  table -> prev = NULL;
+  return table;
+}
+
+/*
+ * Returns the slot holding key, or the empty slot where it would go. There
+ * always is one since the table is never more than half full.
+ */
+size_t _cache_slot(cachetable_t *table, const char *key, unsigned int hash) {
+  size_t        mask = table -> capacity - 1;
+  size_t        ix;
+  cacheentry_t *entry;
+
+  for (ix = hash & mask; (entry = table -> slots[ix]); ix = (ix + 1) & mask) {
+    if ((entry -> hash == hash) && !strcmp(entry -> key, key)) {
+      break;
+    }
+  }
+  return ix;
+}
+
+/*
+ * The new table is filled completely before it is published, and the old
+ * one stays valid, so a reader never sees a partial table.
+ */
+cachetable_t * _cache_grow(cache_t *cache) {
+  cachetable_t *old = cache -> table;
+  cachetable_t *table;
+  cacheentry_t *entry;
+  size_t        ix;
+
+  table = _cache_table_create(old -> capacity * 2);
+  table -> prev = old;
+  for (ix = 0; ix < old -> capacity; ix++) {
+    if ((entry = old -> slots[ix])) {
+      table -> slots[_cache_slot(table, entry -> key, entry -> hash)] = entry;
+    }
+  }
+  __sync_synchronize();
+  cache -> table = table;
+  return table;
+}
+
+void _cache_acquire(cache_t *cache) {
+  while (__sync_lock_test_and_set(&cache -> busy, 1)) {
+    while (cache -> busy);
+  }
+}
+
+void _cache_release(cache_t *cache) {
+  __sync_lock_release(&cache -> busy);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Creates an empty cache. If <code>free_value</code> is not NULL the cache
+ * owns its values and frees them with it.
+ */
+cache_t * cache_create(free_t free_value) {
+  cache_t *cache = NEW(cache_t);
+
+  cache -> table = _cache_table_create(CACHE_INIT_CAPACITY);
+  cache -> free_value = free_value;
+  return cache;
+}
+
+void cache_free(cache_t *cache) {
+  cachetable_t *table;
+  cacheentry_t *entry;
+  size_t        ix;
+
+  if (cache) {
+    table = cache -> table;
+    for (ix = 0; ix < table -> capacity; ix++) {
+      if ((entry = table -> slots[ix])) {
+        if (cache -> free_value) {
+          cache -> free_value(entry -> value);
+        }
+        free(entry -> key);
+        free(entry);
+      }
+    }
+    while (table) {
+      cache -> table = table -> prev;
+      free(table);
+      table = cache -> table;
+    }
+    free(cache);
+  }
+}
+
+/**
+ * Returns the value for <code>key</code>, or NULL if it is not in the
+ * cache. Never blocks.
+ */
+void * cache_get(cache_t *cache, const char *key) {
+  cachetable_t *table = cache -> table;
+  cacheentry_t *entry;
+
+  entry = table -> slots[_cache_slot(table, key, strhash(key))];
+  return (entry) ? entry -> value : NULL;
+}
+
+/**
+ * Adds <code>value</code> under <code>key</code> unless another thread
+ * got there first, and returns the value that is in the cache afterwards.
+ * If that is not <code>value</code> and the cache owns its values,
+ * <code>value</code> is freed.
+ */
+void * cache_put(cache_t *cache, const char *key, void *value) {
+  cachetable_t *table;
+  cacheentry_t *entry;
+  unsigned int  hash = strhash(key);
+  size_t        ix;
+
+  _cache_acquire(cache);
+  table = cache -> table;
+  ix = _cache_slot(table, key, hash);
+  if ((entry = table -> slots[ix])) {
+    _cache_release(cache);
+    if (cache -> free_value && (entry -> value != value)) {
+      cache -> free_value(value);
+    }
+    return entry -> value;
+  }
+  if ((size_t) (cache -> size + 1) * 2 > table -> capacity) {
+    table = _cache_grow(cache);
+    ix = _cache_slot(table, key, hash);
+  }
+  entry = NEW(cacheentry_t);
+  entry -> key = strdup(key);
+  entry -> hash = hash;
+  entry -> value = value;
+  __sync_synchronize();
+  table -> slots[ix] = entry;
+  cache -> size++;
+  _cache_release(cache);
+  return value;
+}
+
+/**
+ * Calls <code>reducer</code> for every value in the cache, in no
+ * particular order. Values added while this runs may or may not be seen.
+ */
+void * cache_reduce(cache_t *cache, reduce_t reducer, void *ctx) {
+  cachetable_t *table = cache -> table;
+  cacheentry_t *entry;
+  size_t        ix;
+
+  for (ix = 0; ix < table -> capacity; ix++) {
+    if ((entry = table -> slots[ix])) {
+      ctx = reducer(entry -> value, ctx);
+    }
+  }
+  return ctx;
+}
+
+int cache_size(cache_t *cache) {
+  return cache -> size;
+}
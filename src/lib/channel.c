@@ -0,0 +1,815 @@
+/*
+ * /obelix/src/lib/channel.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libcore.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#include <arguments.h>
+#include <channel.h>
+#include <coroutine.h>
+#include <exception.h>
+
+/*
+ * A thread blocked in channel_select, or a green thread blocked on a
+ * single channel. It is linked into the waiter list of every channel it
+ * waits for, and all of them wake it when their state changes. OS threads
+ * sleep on a condition, green threads wait for a pipe to become readable
+ * so that they only suspend the coroutine and not the carrier.
+ */
+typedef struct _chanwaiter {
+  condition_t      *condition;
+  int               fds[2];
+  volatile int      ready;
+} chanwaiter_t;
+
+typedef struct _chanlink {
+  chanwaiter_t     *waiter;
+  struct _chanlink *next;
+  struct _chanlink *prev;
+} chanlink_t;
+
+typedef struct _channeliter {
+  data_t            _d;
+  channel_t        *channel;
+  data_t           *next;
+} channeliter_t;
+
+static channel_t *     _channel_new(channel_t *, va_list);
+static void            _channel_free(channel_t *);
+static char *          _channel_allocstring(channel_t *);
+static data_t *        _channel_resolve(channel_t *, char *);
+static int             _channel_len(channel_t *);
+static data_t *        _channel_iter(channel_t *);
+
+static data_t *        _channel_send(channel_t *, char *, arguments_t *);
+static data_t *        _channel_recv(channel_t *, char *, arguments_t *);
+static data_t *        _channel_close(channel_t *, char *, arguments_t *);
+
+extern data_t *        _channel_create(char *, arguments_t *);
+extern data_t *        _channel_select(char *, arguments_t *);
+
+static channeliter_t * _channeliter_new(channeliter_t *, va_list);
+static void            _channeliter_free(channeliter_t *);
+static char *          _channeliter_allocstring(channeliter_t *);
+static data_t *        _channeliter_has_next(channeliter_t *);
+static data_t *        _channeliter_next(channeliter_t *);
+
+static long            _channel_now(void);
+static long            _channel_remaining(long, long);
+static int             _channel_full(channel_t *);
+static int             _channel_empty(channel_t *);
+static int             _channel_enqueue(channel_t *, data_t *);
+static int             _channel_dequeue(channel_t *, data_t **);
+static int             _channel_try_send(channel_t *, data_t *);
+static int             _channel_try_recv(channel_t *, data_t **);
+static int             _channel_poll(channel_t **, int, data_t **);
+static void            _channel_notify(condition_t *, chanlink_t *, volatile int *, int);
+static void            _channel_link(channel_t *, chanlink_t *, int);
+static void            _channel_unlink(channel_t *, chanlink_t *, int);
+static int             _channel_wait(channel_t **, int, data_t *, data_t **, long);
+static void            _chanwaiter_wake(chanwaiter_t *);
+
+/* ------------------------------------------------------------------------ */
+
+static vtable_t _vtable_Channel[] = {
+  { .id = FunctionNew,         .fnc = (void_t) _channel_new },
+  { .id = FunctionFree,        .fnc = (void_t) _channel_free },
+  { .id = FunctionAllocString, .fnc = (void_t) _channel_allocstring },
+  { .id = FunctionResolve,     .fnc = (void_t) _channel_resolve },
+  { .id = FunctionLen,         .fnc = (void_t) _channel_len },
+  { .id = FunctionIter,        .fnc = (void_t) _channel_iter },
+  { .id = FunctionNone,        .fnc = NULL }
+};
+
+static methoddescr_t _methods_Channel[] = {
+  { .type = -1,     .name = "send",  .method = (method_t) _channel_send,  .argtypes = { Any, Int, NoType },       .minargs = 1, .varargs = 1, .maxargs = 2 },
+  { .type = -1,     .name = "recv",  .method = (method_t) _channel_recv,  .argtypes = { Int, NoType, NoType },    .minargs = 0, .varargs = 1, .maxargs = 1 },
+  { .type = -1,     .name = "close", .method = (method_t) _channel_close, .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 0 },
+  { .type = NoType, .name = NULL,    .method = NULL,                      .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
+};
+
+static vtable_t _vtable_ChannelIterator[] = {
+  { .id = FunctionNew,         .fnc = (void_t) _channeliter_new },
+  { .id = FunctionFree,        .fnc = (void_t) _channeliter_free },
+  { .id = FunctionAllocString, .fnc = (void_t) _channeliter_allocstring },
+  { .id = FunctionHasNext,     .fnc = (void_t) _channeliter_has_next },
+  { .id = FunctionNext,        .fnc = (void_t) _channeliter_next },
+  { .id = FunctionNone,        .fnc = NULL }
+};
+
+int Channel = -1;
+int ChannelIterator = -1;
+int channel_debug = 0;
+
+static volatile unsigned int _select_offset = 0;
+
+/* ------------------------------------------------------------------------ */
+
+void channel_init(void) {
+  logging_register_category("channel", &channel_debug);
+  typedescr_register_with_name_and_methods(Channel, "channel", channel_t);
+  typedescr_register(ChannelIterator, channeliter_t);
+}
+
+channel_t * _channel_new(channel_t *channel, va_list args) {
+  size_t ix;
+
+  channel -> capacity = (size_t) va_arg(args, int);
+  channel -> slots = NEWARR(channel -> capacity, chanslot_t);
+  for (ix = 0; ix < channel -> capacity; ix++) {
+    channel -> slots[ix].sequence = 2 * ix;
+  }
+  channel -> enqueue_pos = 0;
+  channel -> dequeue_pos = 0;
+  channel -> not_full = condition_create();
+  channel -> not_empty = condition_create();
+  return channel;
+}
+
+void _channel_free(channel_t *channel) {
+  data_t *value;
+
+  if (channel) {
+    while (_channel_dequeue(channel, &value)) {
+      data_free(value);
+    }
+    condition_free(channel -> not_full);
+    condition_free(channel -> not_empty);
+    free(channel -> slots);
+  }
+}
+
+char * _channel_allocstring(channel_t *channel) {
+  char *buf;
+
+  asprintf(&buf, "<channel %d/%d%s>",
+           channel_size(channel), (int) channel -> capacity,
+           (channel -> closed) ? " closed" : "");
+  return buf;
+}
+
+data_t * _channel_resolve(channel_t *channel, char *name) {
+  if (!strcmp(name, "capacity")) {
+    return int_to_data((intptr_t) channel -> capacity);
+  } else if (!strcmp(name, "closed")) {
+    return int_as_bool(channel -> closed);
+  } else {
+    return NULL;
+  }
+}
+
+int _channel_len(channel_t *channel) {
+  return channel_size(channel);
+}
+
+data_t * _channel_iter(channel_t *channel) {
+  return data_create(ChannelIterator, channel);
+}
+
+/* ------------------------------------------------------------------------ */
+
+long _channel_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/*
+ * Returns the number of milliseconds left until deadline, 0 if it has
+ * passed, or -1 if there is no deadline.
+ */
+long _channel_remaining(long timeout, long deadline) {
+  long ret;
+
+  if (timeout < 0) {
+    return -1;
+  }
+  ret = deadline - _channel_now();
+  return (ret > 0) ? ret : 0;
+}
+
+/*
+ * The ring buffer. A slot can be written by the sender claiming position
+ * pos when its sequence number is 2 * pos, and read by the receiver
+ * claiming position pos when it is 2 * pos + 1. After reading, the sequence
+ * is set to 2 * (pos + capacity) so the slot is free for the next lap.
+ * Doubling keeps a full slot apart from a free one even if the capacity
+ * is 1. The enqueue and dequeue functions are the only ones writing the
+ * slots.
+ */
+int _channel_full(channel_t *channel) {
+  size_t pos = channel -> enqueue_pos;
+
+  return (long) (channel -> slots[pos % channel -> capacity].sequence - 2 * pos) < 0;
+}
+
+int _channel_empty(channel_t *channel) {
+  size_t pos = channel -> dequeue_pos;
+
+  return (long) (channel -> slots[pos % channel -> capacity].sequence - (2 * pos + 1)) < 0;
+}
+
+int _channel_enqueue(channel_t *channel, data_t *value) {
+  chanslot_t *slot;
+  size_t      pos = channel -> enqueue_pos;
+  size_t      claimed;
+  long        diff;
+
+  while (TRUE) {
+    slot = &channel -> slots[pos % channel -> capacity];
+    diff = (long) (slot -> sequence - 2 * pos);
+    __sync_synchronize();
+    if (!diff) {
+      claimed = __sync_val_compare_and_swap(&channel -> enqueue_pos, pos, pos + 1);
+      if (claimed == pos) {
+        break;
+      }
+      pos = claimed;
+    } else if (diff < 0) {
+      return FALSE;
+    } else {
+      pos = channel -> enqueue_pos;
+    }
+  }
+  slot -> value = data_copy(value);
+  __sync_synchronize();
+  slot -> sequence = 2 * pos + 1;
+  return TRUE;
+}
+
+int _channel_dequeue(channel_t *channel, data_t **value) {
+  chanslot_t *slot;
+  size_t      pos = channel -> dequeue_pos;
+  size_t      claimed;
+  long        diff;
+
+  while (TRUE) {
+    slot = &channel -> slots[pos % channel -> capacity];
+    diff = (long) (slot -> sequence - (2 * pos + 1));
+    __sync_synchronize();
+    if (!diff) {
+      claimed = __sync_val_compare_and_swap(&channel -> dequeue_pos, pos, pos + 1);
+      if (claimed == pos) {
+        break;
+      }
+      pos = claimed;
+    } else if (diff < 0) {
+      return FALSE;
+    } else {
+      pos = channel -> dequeue_pos;
+    }
+  }
+  *value = slot -> value;
+  slot -> value = NULL;
+  __sync_synchronize();
+  slot -> sequence = 2 * (pos + channel -> capacity);
+  return TRUE;
+}
+
+/*
+ * A sender announces itself in senders before it looks at closed. So once
+ * a receiver has seen the channel closed and no senders in flight, no value
+ * can arrive anymore, and an empty channel is drained for good.
+ *
+ * Both return 1 on success, 0 if the channel is full (empty), and -1 if it
+ * is closed (closed and drained).
+ */
+int _channel_try_send(channel_t *channel, data_t *value) {
+  int ret;
+
+  __sync_add_and_fetch(&channel -> senders, 1);
+  ret = (channel -> closed) ? -1 : _channel_enqueue(channel, value);
+  __sync_sub_and_fetch(&channel -> senders, 1);
+  if (ret) {
+    _channel_notify(channel -> not_empty, channel -> recv_waiters,
+                    &channel -> waiting_receivers, ret < 0);
+  }
+  return ret;
+}
+
+int _channel_try_recv(channel_t *channel, data_t **value) {
+  int ret = 0;
+
+  if (_channel_dequeue(channel, value)) {
+    ret = 1;
+  } else if (channel -> closed) {
+    __sync_synchronize();
+    if (!channel -> senders) {
+      ret = (_channel_dequeue(channel, value)) ? 1 : -1;
+    }
+  }
+  if (ret > 0) {
+    _channel_notify(channel -> not_full, channel -> send_waiters,
+                    &channel -> waiting_senders, FALSE);
+  }
+  return ret;
+}
+
+/*
+ * Tries to receive from any of the channels, starting at a different one
+ * every time so that a busy channel does not starve the others. Returns the
+ * index of the channel, -1 if all of them are closed and drained, or -2 if
+ * none of them has a value.
+ */
+int _channel_poll(channel_t **channels, int num, data_t **value) {
+  unsigned int offset = __sync_fetch_and_add(&_select_offset, 1);
+  int          open = 0;
+  int          ix;
+  int          jx;
+
+  for (jx = 0; jx < num; jx++) {
+    ix = (int) ((offset + jx) % num);
+    switch (_channel_try_recv(channels[ix], value)) {
+      case 1:
+        return ix;
+      case 0:
+        open++;
+        break;
+      default:
+        break;
+    }
+  }
+  return (open) ? -2 : -1;
+}
+
+/*
+ * Wakes up threads waiting for the other side of the channel. The caller
+ * changed the state of the ring before, and the barrier makes sure that
+ * either we see the waiter or the waiter sees the change. Since waiters in
+ * the list may give up or pick another channel, they are all woken.
+ */
+void _channel_notify(condition_t *condition, chanlink_t *waiters, volatile int *waiting, int all) {
+  chanlink_t *link;
+
+  __sync_synchronize();
+  if (!*waiting) {
+    return;
+  }
+  condition_acquire(condition);
+  for (link = waiters; link; link = link -> next) {
+    _chanwaiter_wake(link -> waiter);
+  }
+  if (all) {
+    condition_broadcast(condition);
+  } else {
+    condition_wakeup(condition);
+  }
+}
+
+void _chanwaiter_wake(chanwaiter_t *waiter) {
+  if (waiter -> condition) {
+    condition_acquire(waiter -> condition);
+    waiter -> ready = TRUE;
+    condition_wakeup(waiter -> condition);
+  } else if (__sync_bool_compare_and_swap(&waiter -> ready, FALSE, TRUE)) {
+    if (write(waiter -> fds[1], "x", 1) < 0) {
+      error("Could not wake channel waiter: %s", strerror(errno));
+    }
+  }
+}
+
+void _channel_link(channel_t *channel, chanlink_t *link, int sending) {
+  condition_t  *condition = (sending) ? channel -> not_full : channel -> not_empty;
+  chanlink_t  **list = (sending) ? &channel -> send_waiters : &channel -> recv_waiters;
+
+  condition_acquire(condition);
+  link -> prev = NULL;
+  link -> next = *list;
+  if (*list) {
+    (*list) -> prev = link;
+  }
+  *list = link;
+  __sync_add_and_fetch((sending) ? &channel -> waiting_senders : &channel -> waiting_receivers, 1);
+  condition_release(condition);
+}
+
+void _channel_unlink(channel_t *channel, chanlink_t *link, int sending) {
+  condition_t  *condition = (sending) ? channel -> not_full : channel -> not_empty;
+  chanlink_t  **list = (sending) ? &channel -> send_waiters : &channel -> recv_waiters;
+
+  condition_acquire(condition);
+  if (link -> prev) {
+    link -> prev -> next = link -> next;
+  } else {
+    *list = link -> next;
+  }
+  if (link -> next) {
+    link -> next -> prev = link -> prev;
+  }
+  __sync_sub_and_fetch((sending) ? &channel -> waiting_senders : &channel -> waiting_receivers, 1);
+  condition_release(condition);
+}
+
+/*
+ * Waits until value can be sent to the first channel or, if value is NULL,
+ * until one of the channels has a value to receive. Used by channel_select,
+ * and by green threads for which sleeping on the channel conditions would
+ * block the carrier.
+ */
+int _channel_wait(channel_t **channels, int num, data_t *value, data_t **received, long timeout) {
+  chanwaiter_t  waiter;
+  chanlink_t   *links;
+  long          deadline = _channel_now() + timeout;
+  long          remaining;
+  char          buf[16];
+  int           sending = (value != NULL);
+  int           ret;
+  int           ix;
+
+  memset(&waiter, 0, sizeof(chanwaiter_t));
+  if (coroutine_current()) {
+    if (pipe(waiter.fds)) {
+      return -1;
+    }
+    fcntl(waiter.fds[0], F_SETFL, O_NONBLOCK);
+  } else {
+    waiter.condition = condition_create();
+  }
+  links = NEWARR(num, chanlink_t);
+  for (ix = 0; ix < num; ix++) {
+    links[ix].waiter = &waiter;
+    _channel_link(channels[ix], &links[ix], sending);
+  }
+
+  while (TRUE) {
+    if (waiter.condition) {
+      condition_acquire(waiter.condition);
+    }
+    waiter.ready = FALSE;
+    if (sending) {
+      ret = _channel_try_send(channels[0], value);
+      ret = (ret > 0) ? 0 : ((ret < 0) ? -1 : -2);
+    } else {
+      ret = _channel_poll(channels, num, received);
+    }
+    remaining = _channel_remaining(timeout, deadline);
+    if ((ret == -2) && !remaining) {
+      ret = -3;
+    } else if ((ret == -2) && !waiter.ready) {
+      if (waiter.condition) {
+        condition_sleep_timeout(waiter.condition, remaining);
+      } else if (!coroutine_wait_fd(waiter.fds[0], CoroutineRead, remaining)) {
+        while (read(waiter.fds[0], buf, sizeof(buf)) > 0);
+      } else if (errno == EINTR) {
+        ret = -4;
+      }
+    }
+    if (waiter.condition) {
+      condition_release(waiter.condition);
+    }
+    if (ret != -2) {
+      break;
+    }
+  }
+
+  for (ix = 0; ix < num; ix++) {
+    _channel_unlink(channels[ix], &links[ix], sending);
+  }
+  free(links);
+  if (waiter.condition) {
+    condition_free(waiter.condition);
+  } else {
+    close(waiter.fds[0]);
+    close(waiter.fds[1]);
+  }
+  switch (ret) {
+    case -1:
+      errno = EPIPE;
+      return -1;
+    case -3:
+      errno = ETIMEDOUT;
+      return -1;
+    case -4:
+      errno = EINTR;
+      return -1;
+    default:
+      return ret;
+  }
+}
+
+/* ------------------------------------------------------------------------ */
+
+data_t * _channel_send(channel_t *channel, char _unused_ *name, arguments_t *args) {
+  long timeout = -1;
+
+  if (arguments_args_size(args) > 1) {
+    timeout = data_intval(data_uncopy(arguments_get_arg(args, 1)));
+  }
+  if (!channel_send(channel, data_uncopy(arguments_get_arg(args, 0)), timeout)) {
+    return data_true();
+  } else if (errno == ETIMEDOUT) {
+    return data_false();
+  } else if (errno == EPIPE) {
+    return data_exception(ErrorIOError, "Cannot send to closed channel");
+  } else {
+    return data_exception_from_errno();
+  }
+}
+
+data_t * _channel_recv(channel_t *channel, char _unused_ *name, arguments_t *args) {
+  data_t *ret;
+  long    timeout = -1;
+
+  if (arguments_args_size(args)) {
+    timeout = data_intval(data_uncopy(arguments_get_arg(args, 0)));
+  }
+  if (!channel_recv(channel, &ret, timeout)) {
+    return ret;
+  } else if (errno == EPIPE) {
+    return data_exception(ErrorExhausted, "Channel closed");
+  } else {
+    return data_exception_from_errno();
+  }
+}
+
+data_t * _channel_close(channel_t *channel, char _unused_ *name, arguments_t _unused_ *args) {
+  channel_close(channel);
+  return data_copy((data_t *) channel);
+}
+
+/* ------------------------------------------------------------------------ */
+
+channeliter_t * _channeliter_new(channeliter_t *iter, va_list args) {
+  iter -> channel = channel_copy(va_arg(args, channel_t *));
+  iter -> next = NULL;
+  return iter;
+}
+
+void _channeliter_free(channeliter_t *iter) {
+  if (iter) {
+    data_free(iter -> next);
+    channel_free(iter -> channel);
+  }
+}
+
+char * _channeliter_allocstring(channeliter_t *iter) {
+  char *buf;
+
+  asprintf(&buf, "iter(%s)", channel_tostring(iter -> channel));
+  return buf;
+}
+
+/*
+ * Blocks until the channel has a value, which is kept until it is picked
+ * up by _channeliter_next, or until the channel is closed and drained.
+ */
+data_t * _channeliter_has_next(channeliter_t *iter) {
+  if (iter -> next) {
+    return data_true();
+  } else if (!channel_recv(iter -> channel, &iter -> next, -1)) {
+    return data_true();
+  } else if (errno == EPIPE) {
+    return data_false();
+  } else {
+    return data_exception_from_errno();
+  }
+}
+
+data_t * _channeliter_next(channeliter_t *iter) {
+  data_t *ret = iter -> next;
+
+  iter -> next = NULL;
+  return ret;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Creates a channel that holds up to <code>capacity</code> values.
+ */
+channel_t * channel_create(int capacity) {
+  typedescr_init();
+  if (capacity < 1) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return (channel_t *) data_create(Channel, capacity);
+}
+
+/**
+ * Sends <code>value</code>, waiting at most <code>timeout</code> ms for
+ * room in the channel. The channel takes its own reference to the value.
+ */
+int channel_send(channel_t *channel, data_t *value, long timeout) {
+  long deadline = _channel_now() + timeout;
+  long remaining;
+  int  ret;
+
+  while (!(ret = _channel_try_send(channel, value))) {
+    if (!timeout) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    if (coroutine_current()) {
+      return _channel_wait(&channel, 1, value, NULL, timeout);
+    }
+    condition_acquire(channel -> not_full);
+    __sync_add_and_fetch(&channel -> waiting_senders, 1);
+    ret = 0;
+    while (!channel -> closed && !ret && _channel_full(channel)) {
+      remaining = _channel_remaining(timeout, deadline);
+      ret = (remaining) ? condition_sleep_timeout(channel -> not_full, remaining) : 1;
+    }
+    __sync_sub_and_fetch(&channel -> waiting_senders, 1);
+    condition_release(channel -> not_full);
+    if (ret) {
+      /* Timed out. Perhaps the wakeup came just too late, so one more try. */
+      timeout = 0;
+    }
+  }
+  if (ret < 0) {
+    errno = EPIPE;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Receives a value, waiting at most <code>timeout</code> ms for one to
+ * arrive. The caller owns the returned value.
+ */
+int channel_recv(channel_t *channel, data_t **value, long timeout) {
+  long deadline = _channel_now() + timeout;
+  long remaining;
+  int  ret;
+
+  while (!(ret = _channel_try_recv(channel, value))) {
+    if (!timeout) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    if (coroutine_current()) {
+      return (_channel_wait(&channel, 1, NULL, value, timeout) < 0) ? -1 : 0;
+    }
+    condition_acquire(channel -> not_empty);
+    __sync_add_and_fetch(&channel -> waiting_receivers, 1);
+    ret = 0;
+    while (!(channel -> closed && !channel -> senders) && !ret && _channel_empty(channel)) {
+      remaining = _channel_remaining(timeout, deadline);
+      ret = (remaining) ? condition_sleep_timeout(channel -> not_empty, remaining) : 1;
+    }
+    __sync_sub_and_fetch(&channel -> waiting_receivers, 1);
+    condition_release(channel -> not_empty);
+    if (ret) {
+      timeout = 0;
+    }
+  }
+  if (ret < 0) {
+    errno = EPIPE;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Closes the channel. Waiting senders fail, and waiting receivers fail
+ * once the values still in the channel are received. Closing a closed
+ * channel does nothing.
+ */
+int channel_close(channel_t *channel) {
+  if (__sync_bool_compare_and_swap(&channel -> closed, FALSE, TRUE)) {
+    debug(channel, "Closing %s", channel_tostring(channel));
+    _channel_notify(channel -> not_full, channel -> send_waiters,
+                    &channel -> waiting_senders, TRUE);
+    _channel_notify(channel -> not_empty, channel -> recv_waiters,
+                    &channel -> waiting_receivers, TRUE);
+  }
+  return 0;
+}
+
+int channel_closed(channel_t *channel) {
+  return channel -> closed;
+}
+
+/**
+ * Returns the number of values in the channel. Only a snapshot if other
+ * threads are using the channel at the same time.
+ */
+int channel_size(channel_t *channel) {
+  size_t dequeued = channel -> dequeue_pos;
+  size_t enqueued = channel -> enqueue_pos;
+  long   ret = (long) (enqueued - dequeued);
+
+  if (ret < 0) {
+    return 0;
+  }
+  return (ret > (long) channel -> capacity) ? (int) channel -> capacity : (int) ret;
+}
+
+/**
+ * Receives a value from whichever of the <code>num</code> channels has one
+ * first, and returns the index of that channel. Channels that are closed
+ * and drained are skipped. Fails with EPIPE if that leaves none.
+ */
+int channel_select(channel_t **channels, int num, data_t **value, long timeout) {
+  int ret;
+
+  if (num < 1) {
+    errno = EINVAL;
+    return -1;
+  }
+  ret = _channel_poll(channels, num, value);
+  if (ret >= 0) {
+    return ret;
+  } else if (ret == -1) {
+    errno = EPIPE;
+    return -1;
+  } else if (!timeout) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  return _channel_wait(channels, num, NULL, value, timeout);
+}
+
+/* ------------------------------------------------------------------------ */
+
+data_t * _channel_create(char _unused_ *name, arguments_t *args) {
+  channel_t *ret;
+  int        capacity = 1;
+
+  if (arguments_args_size(args)) {
+    capacity = (int) data_intval(data_uncopy(arguments_get_arg(args, 0)));
+  }
+  if (!(ret = channel_create(capacity))) {
+    return data_exception(ErrorParameterValue,
+                          "Channel capacity must be at least 1, not %d", capacity);
+  }
+  return (data_t *) ret;
+}
+
+/*
+ * select(channels [, timeout]) returns a list holding the index of the
+ * channel a value was received from and the value. If the timeout expires
+ * the index is -1 and the value null. Once all channels are closed and
+ * drained it returns null, so that it can drive a while loop.
+ */
+data_t * _channel_select(char _unused_ *name, arguments_t *args) {
+  datalist_t  *list;
+  datalist_t  *ret;
+  channel_t  **channels;
+  data_t      *value;
+  data_t      *index;
+  long         timeout = -1;
+  int          num;
+  int          ix;
+
+  list = (datalist_t *) data_uncopy(arguments_get_arg(args, 0));
+  if (!data_is_list(list)) {
+    return data_exception(ErrorType, "select() expects a list of channels");
+  }
+  if (arguments_args_size(args) > 1) {
+    timeout = data_intval(data_uncopy(arguments_get_arg(args, 1)));
+  }
+  num = datalist_size(list);
+  channels = NEWARR(num, channel_t *);
+  for (ix = 0; ix < num; ix++) {
+    channels[ix] = data_as_channel(data_array_get(data_as_array(list), ix));
+    if (!channels[ix]) {
+      free(channels);
+      return data_exception(ErrorType, "select() expects a list of channels, not '%s'",
+                            data_tostring(list));
+    }
+  }
+  ix = channel_select(channels, num, &value, timeout);
+  free(channels);
+  if ((ix < 0) && (errno == ETIMEDOUT)) {
+    value = data_null();
+  }
+  if ((ix >= 0) || (errno == ETIMEDOUT)) {
+    ret = datalist_create(NULL);
+    index = int_to_data(ix);
+    datalist_push(ret, index);
+    datalist_push(ret, value);
+    data_free(index);
+    data_free(value);
+    return (data_t *) ret;
+  } else if (errno == EPIPE) {
+    return data_null();
+  } else {
+    return data_exception_from_errno();
+  }
+}
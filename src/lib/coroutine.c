@@ -0,0 +1,860 @@
+/*
+ * /obelix/src/lib/coroutine.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libcore.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#if defined(HAVE_UCONTEXT_H) && defined(HAVE_SYS_EPOLL_H) && defined(HAVE_PTHREAD_H)
+#define HAVE_COROUTINES 1
+#include <time.h>
+#include <ucontext.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+#endif
+#include <arguments.h>
+#include <coroutine.h>
+#include <exception.h>
+#include <mutex.h>
+#include <threadonce.h>
+
+static void *        _coroutine_call(arguments_t *);
+
+extern data_t *      _coroutine_spawn(char *, arguments_t *);
+
+int coroutine_debug = 0;
+
+#ifdef HAVE_COROUTINES
+
+#define COROUTINE_MAX_EVENTS     64
+#define COROUTINE_STACK_CACHE    64
+
+typedef enum _coroutine_state {
+  CoroutineReady = 0,
+  CoroutineRunning,
+  CoroutineParked,
+  CoroutineDone
+} coroutine_state_t;
+
+typedef void (*park_t)(coroutine_t *);
+
+/*
+ * waiting, result, fd, deadline and timer_ix are protected by the reactor
+ * mutex, next by the run queue condition. The other fields are only
+ * touched by the coroutine itself or by the carrier running it. locks
+ * counts the mutexes and rwlocks the coroutine holds. Those are owned by
+ * the carrier, so a coroutine holding one must not be parked.
+ */
+struct _coroutine {
+  thread_t          *thread;
+  threadproc_t       proc;
+  void              *arg;
+  ucontext_t         context;
+  ucontext_t        *carrier;
+  void              *stack;
+  coroutine_state_t  state;
+  park_t             park;
+  int                interrupted;
+  int                waiting;
+  int                result;
+  int                fd;
+  int                events;
+  long               deadline;
+  int                timer_ix;
+  int                locks;
+  coroutine_t       *next;
+};
+
+typedef struct _scheduler {
+  condition_t       *queue;
+  coroutine_t       *head;
+  coroutine_t       *tail;
+  int                carriers;
+  int                size;
+  int                idle;
+  void              *stacks[COROUTINE_STACK_CACHE];
+  int                num_stacks;
+  size_t             pagesize;
+
+  mutex_t           *reactor;
+  int                epfd;
+  int                wakefd;
+  coroutine_t      **waiters;
+  int                num_waiters;
+  coroutine_t      **timers;
+  int                num_timers;
+  int                timer_cap;
+} scheduler_t;
+
+static void          _coroutine_init(void);
+static long          _coroutine_now(void);
+static void *        _coroutine_stack_alloc(void);
+static void          _coroutine_stack_release(void *);
+static void          _coroutine_entry(unsigned int, unsigned int);
+static void          _coroutine_schedule(coroutine_t *);
+static int           _coroutine_start_carrier(void);
+static void *        _coroutine_carrier(void *);
+static void          _coroutine_switch_out(coroutine_t *, park_t);
+static void          _coroutine_park(coroutine_t *);
+static void          _coroutine_wake(coroutine_t *, int);
+static void *        _coroutine_reactor(void *);
+static void          _coroutine_timer_swap(int, int);
+static void          _coroutine_timer_up(int);
+static void          _coroutine_timer_down(int);
+static void          _coroutine_timer_add(coroutine_t *);
+static void          _coroutine_timer_remove(coroutine_t *);
+static coroutine_t * _coroutine_running(void);
+static int           _coroutine_block(int, int, long);
+
+static scheduler_t   _scheduler;
+static pthread_key_t _coroutine_key;
+THREAD_ONCE(_coroutine_once);
+
+/* ------------------------------------------------------------------------ */
+
+void _coroutine_init(void) {
+  struct epoll_event ev;
+  thread_t          *reactor;
+  long               cpus = 1;
+
+  logging_register_category("coroutine", &coroutine_debug);
+#ifdef HAVE_SYSCONF
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  _scheduler.pagesize = (size_t) sysconf(_SC_PAGESIZE);
+#else /* !HAVE_SYSCONF */
+  _scheduler.pagesize = 4096;
+#endif /* HAVE_SYSCONF */
+  _scheduler.size = (cpus > 1) ? (int) cpus : 1;
+  pthread_key_create(&_coroutine_key, NULL);
+  _scheduler.queue = condition_create();
+  _scheduler.reactor = mutex_create();
+  _scheduler.wakefd = -1;
+  _scheduler.epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (_scheduler.epfd < 0) {
+    error("Green threads disabled: epoll_create1() failed: %s", strerror(errno));
+    return;
+  }
+  _scheduler.wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ev.events = EPOLLIN;
+  ev.data.fd = _scheduler.wakefd;
+  if ((_scheduler.wakefd < 0) ||
+      epoll_ctl(_scheduler.epfd, EPOLL_CTL_ADD, _scheduler.wakefd, &ev) ||
+      !(reactor = thread_new("Green Thread Reactor", _coroutine_reactor, NULL))) {
+    error("Green threads disabled: could not start reactor: %s", strerror(errno));
+    close(_scheduler.epfd);
+    _scheduler.epfd = -1;
+    return;
+  }
+  thread_free(reactor);
+}
+
+long _coroutine_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long) ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/*
+ * Stacks are mapped lazily by the kernel, so only the pages a coroutine
+ * actually touches cost memory. The lowest page is a guard page. Stacks of
+ * finished coroutines are kept for reuse.
+ */
+void * _coroutine_stack_alloc(void) {
+  void *ret = NULL;
+
+  condition_acquire(_scheduler.queue);
+  if (_scheduler.num_stacks) {
+    ret = _scheduler.stacks[--_scheduler.num_stacks];
+  }
+  condition_release(_scheduler.queue);
+  if (ret) {
+    return ret;
+  }
+#ifdef HAVE_SYS_MMAN_H
+  ret = mmap(NULL, COROUTINE_STACK_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (ret == MAP_FAILED) {
+    return NULL;
+  }
+  mprotect(ret, _scheduler.pagesize, PROT_NONE);
+#else /* !HAVE_SYS_MMAN_H */
+  ret = _new(COROUTINE_STACK_SIZE);
+#endif /* HAVE_SYS_MMAN_H */
+  return ret;
+}
+
+void _coroutine_stack_release(void *stack) {
+  condition_acquire(_scheduler.queue);
+  if (_scheduler.num_stacks < COROUTINE_STACK_CACHE) {
+    _scheduler.stacks[_scheduler.num_stacks++] = stack;
+    stack = NULL;
+  }
+  condition_release(_scheduler.queue);
+  if (stack) {
+#ifdef HAVE_SYS_MMAN_H
+    munmap(stack, COROUTINE_STACK_SIZE);
+#else /* !HAVE_SYS_MMAN_H */
+    free(stack);
+#endif /* HAVE_SYS_MMAN_H */
+  }
+}
+
+/*
+ * makecontext only passes int arguments, so the coroutine pointer is split
+ * in two halves.
+ */
+void _coroutine_entry(unsigned int hi, unsigned int lo) {
+  coroutine_t *co = (coroutine_t *) (((uintptr_t) hi << 16 << 16) | (uintptr_t) lo);
+
+  debug(coroutine, "Green thread '%s' started", co -> thread -> name);
+  co -> proc(co -> arg);
+  debug(coroutine, "Green thread '%s' finished", co -> thread -> name);
+  co -> state = CoroutineDone;
+  setcontext(co -> carrier);
+}
+
+/* -- S C H E D U L E R --------------------------------------------------- */
+
+void _coroutine_schedule(coroutine_t *co) {
+  condition_acquire(_scheduler.queue);
+  co -> state = CoroutineReady;
+  co -> next = NULL;
+  if (_scheduler.tail) {
+    _scheduler.tail -> next = co;
+  } else {
+    _scheduler.head = co;
+  }
+  _scheduler.tail = co;
+  if (!_scheduler.idle && (_scheduler.carriers < _scheduler.size)) {
+    _coroutine_start_carrier();
+  }
+  if (_scheduler.idle) {
+    condition_wakeup(_scheduler.queue);
+  } else {
+    condition_release(_scheduler.queue);
+  }
+}
+
+/*
+ * Must be called with the run queue condition acquired.
+ */
+int _coroutine_start_carrier(void) {
+  thread_t *thread;
+  char      name[32];
+
+  snprintf(name, sizeof(name), "carrier-%d", _scheduler.carriers);
+  if (!(thread = thread_new(name, _coroutine_carrier, NULL))) {
+    error("Could not start green thread carrier: %s", strerror(errno));
+    return -1;
+  }
+  _scheduler.carriers++;
+  debug(coroutine, "Started %s", name);
+  thread_free(thread);
+  return 0;
+}
+
+void * _coroutine_carrier(void *arg) {
+  ucontext_t   context;
+  coroutine_t *co;
+  thread_t    *self;
+  park_t       park;
+
+  (void) arg;
+  while (TRUE) {
+    condition_acquire(_scheduler.queue);
+    while (!_scheduler.head) {
+      if (_scheduler.carriers > _scheduler.size) {
+        _scheduler.carriers--;
+        condition_release(_scheduler.queue);
+        return NULL;
+      }
+      _scheduler.idle++;
+      condition_sleep(_scheduler.queue);
+      _scheduler.idle--;
+    }
+    co = _scheduler.head;
+    _scheduler.head = co -> next;
+    if (!_scheduler.head) {
+      _scheduler.tail = NULL;
+    }
+    co -> next = NULL;
+    condition_release(_scheduler.queue);
+
+    co -> carrier = &context;
+    co -> state = CoroutineRunning;
+    self = thread_switch(co -> thread);
+    pthread_setspecific(_coroutine_key, co);
+    swapcontext(&context, &co -> context);
+    pthread_setspecific(_coroutine_key, NULL);
+    thread_switch(self);
+
+    if (co -> state == CoroutineDone) {
+      _coroutine_stack_release(co -> stack);
+      co -> stack = NULL;
+      thread_free(co -> thread);
+    } else if (co -> park) {
+      /*
+       * Only now that the coroutine is off its stack can it be handed to
+       * the reactor or the run queue, where another carrier may pick it up.
+       */
+      park = co -> park;
+      co -> park = NULL;
+      park(co);
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Cheaper than coroutine_current() and safe to call from the lock
+ * functions, which thread_self() itself uses. No coroutine can be running
+ * before the first carrier started.
+ */
+coroutine_t * _coroutine_running(void) {
+  return (_scheduler.carriers)
+    ? (coroutine_t *) pthread_getspecific(_coroutine_key)
+    : NULL;
+}
+
+void _coroutine_switch_out(coroutine_t *co, park_t park) {
+  co -> park = park;
+  co -> state = CoroutineParked;
+  swapcontext(&co -> context, co -> carrier);
+}
+
+/* -- R E A C T O R ------------------------------------------------------- */
+
+void _coroutine_park(coroutine_t *co) {
+  struct epoll_event  ev;
+  int                 cap;
+  int                 wakeup = FALSE;
+  uint64_t            one = 1;
+
+  mutex_lock(_scheduler.reactor);
+  co -> result = 0;
+  if (co -> interrupted) {
+    co -> interrupted = FALSE;
+    co -> result = EINTR;
+  } else if (co -> fd >= 0) {
+    if (co -> fd >= _scheduler.num_waiters) {
+      for (cap = (_scheduler.num_waiters) ? _scheduler.num_waiters : 64; cap <= co -> fd; cap *= 2);
+      _scheduler.waiters = resize_ptrarray(_scheduler.waiters, cap, _scheduler.num_waiters);
+      _scheduler.num_waiters = cap;
+    }
+    ev.events = EPOLLONESHOT;
+    ev.events |= (co -> events & CoroutineRead) ? (EPOLLIN | EPOLLRDHUP) : 0;
+    ev.events |= (co -> events & CoroutineWrite) ? EPOLLOUT : 0;
+    ev.data.fd = co -> fd;
+    if (_scheduler.waiters[co -> fd]) {
+      co -> result = EBUSY;
+    } else if (epoll_ctl(_scheduler.epfd, EPOLL_CTL_MOD, co -> fd, &ev) &&
+               epoll_ctl(_scheduler.epfd, EPOLL_CTL_ADD, co -> fd, &ev)) {
+      /* Regular files cannot be polled and are always ready. */
+      co -> result = (errno == EPERM) ? 0 : errno;
+      co -> fd = -1;
+      co -> deadline = -1;
+    } else {
+      _scheduler.waiters[co -> fd] = co;
+    }
+  } else if (co -> deadline < 0) {
+    co -> result = EINVAL;
+  }
+  if (co -> result || ((co -> fd < 0) && (co -> deadline < 0))) {
+    mutex_unlock(_scheduler.reactor);
+    _coroutine_schedule(co);
+    return;
+  }
+  if (co -> deadline >= 0) {
+    _coroutine_timer_add(co);
+    wakeup = !co -> timer_ix;
+  }
+  co -> waiting = TRUE;
+  mutex_unlock(_scheduler.reactor);
+  if (wakeup && (write(_scheduler.wakefd, &one, sizeof(one)) < 0)) {
+    debug(coroutine, "Could not wake up reactor: %s", strerror(errno));
+  }
+}
+
+/*
+ * Must be called with the reactor mutex locked.
+ */
+void _coroutine_wake(coroutine_t *co, int result) {
+  if (!co -> waiting) {
+    return;
+  }
+  co -> waiting = FALSE;
+  co -> result = result;
+  if (co -> fd >= 0) {
+    _scheduler.waiters[co -> fd] = NULL;
+  }
+  if (co -> timer_ix >= 0) {
+    _coroutine_timer_remove(co);
+  }
+  _coroutine_schedule(co);
+}
+
+void * _coroutine_reactor(void *arg) {
+  struct epoll_event  events[COROUTINE_MAX_EVENTS];
+  int                 num;
+  int                 ix;
+  int                 fd;
+  long                timeout;
+  long                now;
+  uint64_t            count;
+
+  (void) arg;
+  while (TRUE) {
+    mutex_lock(_scheduler.reactor);
+    timeout = -1;
+    if (_scheduler.num_timers) {
+      timeout = _scheduler.timers[0] -> deadline - _coroutine_now();
+      timeout = (timeout > 0) ? timeout : 0;
+    }
+    mutex_unlock(_scheduler.reactor);
+
+    num = epoll_wait(_scheduler.epfd, events, COROUTINE_MAX_EVENTS, (int) timeout);
+    if ((num < 0) && (errno != EINTR)) {
+      error("Green thread reactor: epoll_wait() failed: %s", strerror(errno));
+      break;
+    }
+
+    mutex_lock(_scheduler.reactor);
+    for (ix = 0; ix < num; ix++) {
+      fd = events[ix].data.fd;
+      if (fd == _scheduler.wakefd) {
+        while (read(fd, &count, sizeof(count)) > 0);
+      } else if ((fd < _scheduler.num_waiters) && _scheduler.waiters[fd]) {
+        _coroutine_wake(_scheduler.waiters[fd], 0);
+      }
+    }
+    now = _coroutine_now();
+    while (_scheduler.num_timers && (_scheduler.timers[0] -> deadline <= now)) {
+      _coroutine_wake(_scheduler.timers[0], ETIMEDOUT);
+    }
+    mutex_unlock(_scheduler.reactor);
+  }
+  return NULL;
+}
+
+/*
+ * Binary heap of the waiting coroutines with a deadline, earliest first.
+ * All timer functions must be called with the reactor mutex locked.
+ */
+void _coroutine_timer_swap(int i, int j) {
+  coroutine_t *tmp = _scheduler.timers[i];
+
+  _scheduler.timers[i] = _scheduler.timers[j];
+  _scheduler.timers[j] = tmp;
+  _scheduler.timers[i] -> timer_ix = i;
+  _scheduler.timers[j] -> timer_ix = j;
+}
+
+void _coroutine_timer_up(int ix) {
+  while (ix && (_scheduler.timers[(ix - 1) / 2] -> deadline > _scheduler.timers[ix] -> deadline)) {
+    _coroutine_timer_swap(ix, (ix - 1) / 2);
+    ix = (ix - 1) / 2;
+  }
+}
+
+void _coroutine_timer_down(int ix) {
+  int child;
+
+  while ((child = 2 * ix + 1) < _scheduler.num_timers) {
+    if ((child + 1 < _scheduler.num_timers) &&
+        (_scheduler.timers[child + 1] -> deadline < _scheduler.timers[child] -> deadline)) {
+      child++;
+    }
+    if (_scheduler.timers[ix] -> deadline <= _scheduler.timers[child] -> deadline) {
+      break;
+    }
+    _coroutine_timer_swap(ix, child);
+    ix = child;
+  }
+}
+
+void _coroutine_timer_add(coroutine_t *co) {
+  int cap;
+
+  if (_scheduler.num_timers >= _scheduler.timer_cap) {
+    cap = (_scheduler.timer_cap) ? 2 * _scheduler.timer_cap : 64;
+    _scheduler.timers = resize_ptrarray(_scheduler.timers, cap, _scheduler.timer_cap);
+    _scheduler.timer_cap = cap;
+  }
+  co -> timer_ix = _scheduler.num_timers++;
+  _scheduler.timers[co -> timer_ix] = co;
+  _coroutine_timer_up(co -> timer_ix);
+}
+
+void _coroutine_timer_remove(coroutine_t *co) {
+  int ix = co -> timer_ix;
+  int last = --_scheduler.num_timers;
+
+  co -> timer_ix = -1;
+  if (ix != last) {
+    _scheduler.timers[ix] = _scheduler.timers[last];
+    _scheduler.timers[ix] -> timer_ix = ix;
+    _coroutine_timer_down(ix);
+    _coroutine_timer_up(ix);
+  }
+  _scheduler.timers[last] = NULL;
+}
+
+/*
+ * Waits for fd, or sleeps if fd is negative, without leaving the carrier.
+ * Used when the coroutine holds a lock and cannot be parked.
+ */
+int _coroutine_block(int fd, int events, long timeout) {
+  struct pollfd pfd;
+  int           ret;
+
+  if (fd < 0) {
+    if (timeout < 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    usleep((useconds_t) (timeout * 1000));
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  pfd.fd = fd;
+  pfd.events = (events & CoroutineRead) ? POLLIN : 0;
+  pfd.events |= (events & CoroutineWrite) ? POLLOUT : 0;
+  pfd.revents = 0;
+  ret = poll(&pfd, 1, (int) timeout);
+  if (!ret) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  return (ret > 0) ? 0 : -1;
+}
+
+/* -- P U B L I C  F U N C T I O N S -------------------------------------- */
+
+/**
+ * Starts a green thread running <code>proc</code> with <code>arg</code>
+ * and returns its thread object. Returns NULL if green threads are not
+ * available, in which case the caller should start an OS thread instead.
+ */
+thread_t * coroutine_spawn(char *name, threadproc_t proc, void *arg) {
+  coroutine_t *co;
+  uintptr_t    ptr;
+  thread_t    *ret;
+
+  ONCE(_coroutine_once, _coroutine_init);
+  if (_scheduler.epfd < 0) {
+    return NULL;
+  }
+  co = NEW(coroutine_t);
+  if (!(co -> stack = _coroutine_stack_alloc())) {
+    error("Could not allocate green thread stack: %s", strerror(errno));
+    free(co);
+    return NULL;
+  }
+  co -> thread = thread_create_green(co, name);
+  co -> thread -> parent = thread_copy(thread_self());
+  co -> proc = proc;
+  co -> arg = arg;
+  co -> fd = -1;
+  co -> deadline = -1;
+  co -> timer_ix = -1;
+  getcontext(&co -> context);
+  co -> context.uc_stack.ss_sp = co -> stack;
+  co -> context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+  co -> context.uc_link = NULL;
+  ptr = (uintptr_t) co;
+  makecontext(&co -> context, (void (*)(void)) _coroutine_entry, 2,
+              (unsigned int) (ptr >> 16 >> 16), (unsigned int) (ptr & 0xFFFFFFFFUL));
+  ret = thread_copy(co -> thread);
+  debug(coroutine, "Spawning green thread '%s'", co -> thread -> name);
+  _coroutine_schedule(co);
+  return ret;
+}
+
+/**
+ * Returns the coroutine running in the calling thread, or NULL if it is
+ * not a green thread.
+ */
+coroutine_t * coroutine_current(void) {
+  return thread_self() -> coroutine;
+}
+
+/**
+ * Lets the other runnable green threads run before continuing. Outside a
+ * green thread this yields the OS thread.
+ */
+int coroutine_yield(void) {
+  coroutine_t *co = coroutine_current();
+
+  if (!co || co -> locks) {
+    return thread_yield();
+  }
+  _coroutine_switch_out(co, _coroutine_schedule);
+  return 0;
+}
+
+/**
+ * Suspends the calling green thread for <code>ms</code> milliseconds.
+ * Returns -1 with errno EINTR if it was interrupted. Outside a green thread,
+ * or in one that holds a lock, this blocks the OS thread.
+ */
+int coroutine_sleep(long ms) {
+  if (!coroutine_current()) {
+    return usleep((useconds_t) (ms * 1000));
+  }
+  if (coroutine_wait_fd(-1, 0, ms) && (errno != ETIMEDOUT)) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Suspends the calling green thread until <code>fd</code> is ready for the
+ * coroutine_event_t flags in <code>events</code>, or until
+ * <code>timeout</code> milliseconds have passed. A negative timeout waits
+ * indefinitely. Returns 0 when the descriptor is ready, and -1 with errno
+ * set to ETIMEDOUT, EINTR or the epoll error otherwise. Returns -1 with
+ * errno EINVAL when not called from a green thread.
+ *
+ * A green thread holding a mutex or rwlock waits on its carrier instead,
+ * since the lock belongs to the carrier thread and another green thread
+ * scheduled there would hold it as well.
+ *
+ * errno is per carrier, and a green thread may be resumed on another
+ * carrier than the one it was suspended on. Code around a wait should not
+ * hold on to errno values across the call.
+ */
+int coroutine_wait_fd(int fd, int events, long timeout) {
+  coroutine_t *co = coroutine_current();
+  int          ret;
+
+  if (!co) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (co -> locks) {
+    mutex_lock(_scheduler.reactor);
+    ret = co -> interrupted;
+    co -> interrupted = FALSE;
+    mutex_unlock(_scheduler.reactor);
+    if (ret) {
+      errno = EINTR;
+      return -1;
+    }
+    return _coroutine_block(fd, events, timeout);
+  }
+  co -> fd = fd;
+  co -> events = events;
+  co -> deadline = (timeout >= 0) ? _coroutine_now() + timeout : -1;
+  _coroutine_switch_out(co, _coroutine_park);
+  co -> fd = -1;
+  co -> deadline = -1;
+  if (co -> result) {
+    errno = co -> result;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Interrupts a green thread. If it is waiting in coroutine_wait_fd or
+ * coroutine_sleep the wait fails with EINTR, otherwise its next wait does.
+ */
+int coroutine_interrupt(coroutine_t *co) {
+  mutex_lock(_scheduler.reactor);
+  if (co -> state != CoroutineDone) {
+    if (co -> waiting) {
+      _coroutine_wake(co, EINTR);
+    } else {
+      co -> interrupted = TRUE;
+    }
+  }
+  mutex_unlock(_scheduler.reactor);
+  return 0;
+}
+
+/**
+ * Called by the lock functions after taking and before releasing a mutex or
+ * rwlock, so that a green thread holding one stays on its carrier.
+ */
+void coroutine_lock_acquired(void) {
+  coroutine_t *co = _coroutine_running();
+
+  if (co) {
+    co -> locks++;
+  }
+}
+
+void coroutine_lock_released(void) {
+  coroutine_t *co = _coroutine_running();
+
+  if (co && co -> locks) {
+    co -> locks--;
+  }
+}
+
+/**
+ * Frees the coroutine. Called when the last reference to its thread object
+ * goes away, which is never before the coroutine finished.
+ */
+void coroutine_free(coroutine_t *co) {
+  if (co) {
+    free(co);
+  }
+}
+
+int coroutine_carriers(void) {
+  int ret;
+
+  ONCE(_coroutine_once, _coroutine_init);
+  condition_acquire(_scheduler.queue);
+  ret = _scheduler.size;
+  condition_release(_scheduler.queue);
+  return ret;
+}
+
+/**
+ * Sets the number of carrier threads running green threads. Returns -1 if
+ * <code>carriers</code> is out of range or green threads are not available.
+ */
+int coroutine_set_carriers(int carriers) {
+  ONCE(_coroutine_once, _coroutine_init);
+  if ((carriers < 1) || (carriers > COROUTINE_MAX_CARRIERS) || (_scheduler.epfd < 0)) {
+    return -1;
+  }
+  condition_acquire(_scheduler.queue);
+  _scheduler.size = carriers;
+  debug(coroutine, "Number of carriers set to %d", carriers);
+  condition_broadcast(_scheduler.queue);
+  return 0;
+}
+
+#else /* !HAVE_COROUTINES */
+
+thread_t * coroutine_spawn(char *name, threadproc_t proc, void *arg) {
+  (void) name;
+  (void) proc;
+  (void) arg;
+  return NULL;
+}
+
+coroutine_t * coroutine_current(void) {
+  return NULL;
+}
+
+int coroutine_yield(void) {
+  return thread_yield();
+}
+
+int coroutine_sleep(long ms) {
+#ifdef HAVE_UNISTD_H
+  return usleep((useconds_t) (ms * 1000));
+#else /* !HAVE_UNISTD_H */
+  Sleep((DWORD) ms);
+  return 0;
+#endif /* HAVE_UNISTD_H */
+}
+
+int coroutine_wait_fd(int fd, int events, long timeout) {
+  (void) fd;
+  (void) events;
+  (void) timeout;
+  errno = EINVAL;
+  return -1;
+}
+
+int coroutine_interrupt(coroutine_t *co) {
+  (void) co;
+  errno = ENOSYS;
+  return -1;
+}
+
+void coroutine_lock_acquired(void) {
+}
+
+void coroutine_lock_released(void) {
+}
+
+void coroutine_free(coroutine_t *co) {
+  (void) co;
+}
+
+int coroutine_carriers(void) {
+  return 0;
+}
+
+int coroutine_set_carriers(int carriers) {
+  (void) carriers;
+  return -1;
+}
+
+#endif /* HAVE_COROUTINES */
+
+/* ------------------------------------------------------------------------ */
+
+void * _coroutine_call(arguments_t *args) {
+  data_t      *fnc = NULL;
+  arguments_t *shifted;
+  data_t      *ret;
+
+  shifted = arguments_shift(args, &fnc);
+  ret = data_call(fnc, shifted);
+  if (data_is_exception(ret)) {
+    debug(coroutine, "Green thread '%s' returned %s",
+          thread_self() -> name, data_tostring(ret));
+  }
+  data_free(ret);
+  arguments_free(shifted);
+  arguments_free(args);
+  data_free(fnc);
+  return NULL;
+}
+
+/*
+ * thread.spawn(fnc, ...) calls fnc with the remaining arguments in a new
+ * green thread, or in a new OS thread if green threads are not available.
+ */
+data_t * _coroutine_spawn(char _unused_ *name, arguments_t *args) {
+  data_t   *fnc = arguments_get_arg(args, 0);
+  thread_t *ret;
+
+  if (!data_is_callable(fnc)) {
+    return data_exception(ErrorType, "spawn() expects a callable, not '%s'",
+                          data_typename(fnc));
+  }
+  args = arguments_copy(args);
+  ret = coroutine_spawn(data_tostring(fnc), (threadproc_t) _coroutine_call, args);
+  if (!ret) {
+    ret = thread_new(data_tostring(fnc), (threadproc_t) _coroutine_call, args);
+  }
+  if (!ret) {
+    arguments_free(args);
+    return data_exception_from_errno();
+  }
+  return (data_t *) ret;
+}
@@ -368,7 +368,7 @@ void data_free(data_t *data) {
   free_semantics_t  free_me;
   free_semantics_t  free_str;
 
-  if (data && (data -> free_me != Constant) && (--data -> refs <= 0)) {
+  if (data && (data -> free_me != Constant) && (__sync_sub_and_fetch(&data -> refs, 1) <= 0)) {
     free_me = data -> free_me;
     free_str = data -> free_str;
     type = data_typedescr(data);
@@ -617,6 +617,8 @@ int data_has_callable(data_t *self, name_t *name) {
 
 char * _data_tostring(data_t *data) {
   char        *ret;
+  char        *old;
+  char        *str = NULL;
   typedescr_t *type;
   tostring_t   tostring;
 
@@ -624,34 +626,52 @@ char * _data_tostring(data_t *data) {
     return "null";
   } else if (data -> str && (data -> free_str == DontFreeData)) {
     return data -> str;
+  } else if (data_is_string(data)) {
+    return str_chars((str_t *) data);
   } else {
-    free(data -> str);
-    data -> str = NULL;
+    /*
+     * The new representation is built before the cached one is let go, and
+     * if nothing changed the cached one is kept. Values that never change,
+     * like the constants shared by parsers running in different threads,
+     * therefore never have their string freed under a reader.
+     */
+    old = data -> str;
     type = data_typedescr(data);
     tostring = (tostring_t) typedescr_get_function(type, FunctionAllocString);
     if (tostring) {
-      data -> str = tostring(data);
+      str = tostring(data);
     }
-    if (!data -> str) {
+    if (!str) {
       tostring = (tostring_t) typedescr_get_function(type, FunctionToString);
       if (tostring) {
         ret = tostring(data);
-        if (ret && !data -> str) {
-          data -> str = strdup(ret);
+        if (ret) {
+          str = strdup(ret);
+        } else if (data -> str) {
+          /* The type maintains data -> str itself */
+          return data -> str;
         }
       }
     }
-    if (!data -> str) {
+    if (!str) {
       tostring = (tostring_t) typedescr_get_function(type, FunctionStaticString);
-      if (tostring) {
-        data -> str = tostring(data);
+      if (tostring && (str = tostring(data))) {
+        data -> str = str;
         data -> free_str = DontFreeData;
+        free(old);
+        return str;
       }
     }
-    if (!data -> str) {
-      asprintf(&(data -> str), "%s:%p", data_typename(data), data);
+    if (!str) {
+      asprintf(&str, "%s:%p", data_typename(data), data);
     }
-    return data -> str;
+    if (old && !strcmp(old, str)) {
+      free(str);
+      return old;
+    }
+    data -> str = str;
+    free(old);
+    return str;
   }
 }
 
@@ -73,6 +73,8 @@ static data_t *       _exception_call(data_t *, arguments_t *);
 static data_t *       _exception_cast(data_t *, int);
 static dictionary_t * _exception_serialize(exception_t *);
 static exception_t *  _exception_deserialize(dictionary_t *);
+static datalist_t *   _exception_pack(exception_t *);
+static exception_t *  _exception_unpack(int, datalist_t *);
 
 static data_t *       _data_exception_from_exception(exception_t *);
 
@@ -87,6 +89,8 @@ static vtable_t _vtable_Exception[] = {
   { .id = FunctionCast,        .fnc = (void_t) _exception_cast },
   { .id = FunctionSerialize,   .fnc = (void_t) _exception_serialize },
   { .id = FunctionDeserialize, .fnc = (void_t) _exception_deserialize },
+  { .id = FunctionPack,        .fnc = (void_t) _exception_pack },
+  { .id = FunctionUnpack,      .fnc = (void_t) _exception_unpack },
   { .id = FunctionNone,        .fnc = NULL }
 };
 
@@ -292,6 +296,36 @@ static exception_t * _exception_deserialize(dictionary_t *d) {
   return ret;
 }
 
+datalist_t * _exception_pack(exception_t *e) {
+  datalist_t *ret = datalist_create(NULL);
+  data_t     *msg = str_to_data(e -> msg);
+
+  datalist_push(ret, int_to_data(e -> code));
+  datalist_push(ret, msg);
+  data_free(msg);
+  datalist_push(ret, (e -> throwable) ? e -> throwable : data_null());
+  datalist_push(ret, (e -> trace) ? e -> trace : data_null());
+  return ret;
+}
+
+exception_t * _exception_unpack(int type, datalist_t *packed) {
+  exception_t *ret;
+  data_t      *throwable;
+  data_t      *trace;
+
+  if (!data_is_list(packed) || (datalist_size(packed) != 4) ||
+      !data_is_int(datalist_get(packed, 0))) {
+    return NULL;
+  }
+  ret = exception_create((int) data_intval(datalist_get(packed, 0)), "%s",
+                         data_tostring(datalist_get(packed, 1)));
+  throwable = datalist_get(packed, 2);
+  trace = datalist_get(packed, 3);
+  ret -> throwable = (data_notnull(throwable)) ? data_copy(throwable) : NULL;
+  ret -> trace = (data_notnull(trace)) ? data_copy(trace) : NULL;
+  return ret;
+}
+
 
 /* -- E X C E P T I O N  F A C T O R Y  F U N C T I O N S ----------------- */
 
@@ -21,6 +21,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
@@ -32,6 +33,9 @@
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif /* HAVE_STRINGS_H */
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif /* HAVE_UNISTD_H */
@@ -44,8 +48,10 @@
 #include <exception.h>
 #include <file.h>
 #include <logging.h>
+#include <mutex.h>
 #include <re.h>
 #include <str.h>
+#include <threadonce.h>
 
 int file_debug = 0;
 
@@ -72,8 +78,11 @@ static data_t *      _stream_query(stream_t *, data_t *, array_t *);
 static data_t *      _stream_iter(stream_t *);
 static data_t *      _stream_readline(stream_t *, char *, arguments_t *);
 static data_t *      _stream_print(stream_t *, char *, arguments_t *);
+static data_t *      _stream_flush(stream_t *, char *, arguments_t *);
 
 static _oshandle_t   _file_oshandle(file_t *);
+static int           _file_map_window(file_t *, off_t);
+static int           _file_map_next(file_t *);
 
 static file_t *      _file_new(file_t *, va_list);
 static void          _file_free(file_t *);
@@ -107,6 +116,7 @@ static vtable_t _vtable_Stream[] = {
 static methoddescr_t _methods_Stream[] = {
   { .type = -1,     .name = "readline", .method = (method_t) _stream_readline, .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
   { .type = -1,     .name = "print",    .method = (method_t) _stream_print,    .argtypes = { String, Any,    NoType }, .minargs = 1, .varargs = 1 },
+  { .type = -1,     .name = "flush",    .method = (method_t) _stream_flush,    .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
   { .type = NoType, .name = NULL,       .method = NULL,                        .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 }
 };
 
@@ -164,10 +174,37 @@ int Stream = -1;
 int File = -1;
 int StreamIter = -1;
 
+static mutex_t  *_stream_mutex = NULL;
+static stream_t *_stream_writers = NULL;
+
+THREAD_ONCE(_stream_writers_once);
+
 type_skel(streamiter, StreamIter, streamiter_t);
 
 /* ------------------------------------------------------------------------ */
 
+/**
+ * Flushes the output buffers of all streams. This runs at exit, but a
+ * process leaving with _exit() has to call it itself.
+ */
+void stream_flush_all(void) {
+  stream_t *stream;
+
+  if (!_stream_mutex) {
+    return;
+  }
+  mutex_lock(_stream_mutex);
+  for (stream = _stream_writers; stream; stream = stream -> wnext) {
+    stream_flush(stream);
+  }
+  mutex_unlock(_stream_mutex);
+}
+
+static void _stream_writers_init(void) {
+  _stream_mutex = mutex_create();
+  atexit(stream_flush_all);
+}
+
 void file_init(void) {
   if (File < 1) {
     logging_register_module(file);
@@ -193,7 +230,23 @@ stream_t * _stream_new(stream_t *stream, va_list args) {
 
 void _stream_free(stream_t *stream) {
   if (stream) {
-    str_free(stream -> buffer);
+    stream_flush(stream);
+    if (stream -> wbuffer) {
+      mutex_lock(_stream_mutex);
+      if (stream -> wprev) {
+        stream -> wprev -> wnext = stream -> wnext;
+      } else {
+        _stream_writers = stream -> wnext;
+      }
+      if (stream -> wnext) {
+        stream -> wnext -> wprev = stream -> wprev;
+      }
+      mutex_unlock(_stream_mutex);
+    }
+    if (!stream -> mapped) {
+      free(stream -> buffer);
+    }
+    free(stream -> wbuffer);
     data_free(stream -> error);
   }
 }
@@ -212,6 +265,8 @@ data_t * _stream_resolve(stream_t *stream, char *name) {
     return (stream_error(stream)) ? data_copy(stream_error(stream)) : data_null();
   } else if (!strcmp(name, "eof")) {
     return int_as_bool(stream_eof(stream));
+  } else if (!strcmp(name, "bufsize")) {
+    return int_to_data(stream -> bufsize);
   } else {
     return NULL;
   }
@@ -241,12 +296,12 @@ data_t * _stream_query(stream_t *stream, data_t *selector, array_t *params) {
 
 data_t * _stream_readline(stream_t *stream, char _unused_ *name, arguments_t _unused_ *args) {
   char   *line;
+  int     len;
   data_t *ret;
 
-  line = stream_readline(stream);
+  line = stream_readslice(stream, &len);
   if (line) {
-    ret = str_to_data(line);
-    free(line);
+    ret = (data_t *) str_copy_nchars(line, len);
   } else if (stream -> _errno) {
     ret = data_exception_from_errno();
   } else {
@@ -271,11 +326,22 @@ data_t * _stream_print(stream_t *self, char _unused_ *name, arguments_t *args) {
   return retval;
 }
 
+data_t * _stream_flush(stream_t *stream, char _unused_ *name, arguments_t _unused_ *args) {
+  if (stream_flush(stream)) {
+    return data_exception_from_my_errno(stream -> _errno);
+  } else {
+    return data_true();
+  }
+}
+
 /* ------------------------------------------------------------------------ */
 
 stream_t * stream_init(stream_t *stream, read_t reader, write_t writer) {
   stream -> reader = reader;
   stream -> writer = writer;
+  if (stream -> bufsize <= 0) {
+    stream -> bufsize = STREAM_BUFSZ;
+  }
   return stream;
 }
 
@@ -287,137 +353,397 @@ data_t * stream_error(stream_t *stream) {
   return stream -> error;
 }
 
-int stream_getchar(stream_t *stream) {
-  int ch;
+/*
+ * Moves the unconsumed part of the buffer to the front, growing the buffer
+ * if it is full, and appends as much as the reader is willing to give in
+ * one call. Returns the number of bytes added, 0 at end of file and -1 on
+ * error.
+ */
+static int _stream_fill(stream_t *stream) {
   int ret;
 
+  if (stream -> mapped) {
+    return _file_map_next((file_t *) stream);
+  }
+  if (stream -> wlen && stream_flush(stream)) {
+    return -1;
+  }
   if (!stream -> buffer) {
-    stream -> buffer = str_create(STREAM_BUFSZ);
-    if (!stream -> buffer) {
-      errno = 1;
-      stream -> _errno = 1;
-      return -1;
-    }
-    ret = str_read_from_stream(stream -> buffer, stream, stream -> reader);
-    if (ret < 0) {
-      stream -> _errno = errno;
-      return ret;
-    } else if (!ret) {
-      stream -> _eof = 1;
+    stream -> buffer = (char *) _new(stream -> bufsize);
+    stream -> pos = stream -> len = 0;
+  } else if (stream -> pos > 0) {
+    stream -> len -= stream -> pos;
+    memmove(stream -> buffer, stream -> buffer + stream -> pos, stream -> len);
+    stream -> pos = 0;
+  }
+  if (stream -> len >= stream -> bufsize) {
+    stream -> buffer = resize_block(stream -> buffer, 2 * stream -> bufsize,
+                                    stream -> bufsize);
+    stream -> bufsize *= 2;
+  }
+  ret = (stream -> reader)(stream, stream -> buffer + stream -> len,
+                           stream -> bufsize - stream -> len);
+  if (ret < 0) {
+    stream -> _errno = errno;
+  } else if (!ret) {
+    stream -> _eof = 1;
+  } else {
+    stream -> len += ret;
+  }
+  return ret;
+}
+
+int stream_getchar(stream_t *stream) {
+  int ret;
+
+  if (stream -> pos >= stream -> len) {
+    ret = _stream_fill(stream);
+    if (ret <= 0) {
       return ret;
     }
   }
-  ch = str_readchar(stream -> buffer);
-  if (!ch) {
-    ret = str_read_from_stream(stream -> buffer, stream, stream -> reader);
-    if (ret < 0) {
-      stream -> _errno = errno;
+  return (unsigned char) stream -> buffer[stream -> pos++];
+}
+
+/*
+ * Returns the next character like stream_getchar does, but leaves it in the
+ * buffer so that the next read returns it again.
+ */
+int stream_peek(stream_t *stream) {
+  int ret;
+
+  if (stream -> pos >= stream -> len) {
+    ret = _stream_fill(stream);
+    if (ret <= 0) {
       return ret;
-    } else if (!ret) {
-      stream -> _eof = 1;
-      return 0;
-    } else {
-      ch = str_readchar(stream -> buffer);
     }
   }
-  if (ch < 0) {
-    stream -> _errno = errno;
-    return -1;
-  }
-  return ch;
+  return (unsigned char) stream -> buffer[stream -> pos];
+}
+
+/*
+ * Appends what the reader gives in one call to the buffer without consuming
+ * anything. A caller that knows the device has data can use this to check
+ * whether a complete record arrived, since parsing a partial one blocks.
+ */
+int stream_fill(stream_t *stream) {
+  return _stream_fill(stream);
 }
 
 int stream_eof(stream_t *stream) {
-  return stream -> _eof;
+  return stream -> _eof && (stream -> pos >= stream -> len);
 }
 
+/*
+ * Reads until num bytes are copied or the reader reports end of file.
+ * Buffered data is handed out first; whatever is left is read straight into
+ * the caller's buffer when it is at least as large as the stream buffer.
+ */
 int stream_read(stream_t *stream, char *buf, int num) {
-  int     ix;
-  char   *ptr;
-  int     ch;
+  int ret = 0;
+  int n;
 
   debug(file, "%s.read(%d)", data_tostring((data_t *) stream), num);
-  ptr = buf;
-  for (ix = 0; ix < num; ix++) {
-    ch = stream_getchar(stream);
-    if (ch > 0) {
-      *ptr++ = ch;
-    } else if (ch == 0) {
-      break;
+  while (ret < num) {
+    n = stream -> len - stream -> pos;
+    if (n > 0) {
+      if (n > num - ret) {
+        n = num - ret;
+      }
+      memcpy(buf + ret, stream -> buffer + stream -> pos, n);
+      stream -> pos += n;
+      ret += n;
+      continue;
+    }
+    if (!stream -> mapped && (num - ret >= stream -> bufsize)) {
+      n = (stream -> wlen && stream_flush(stream))
+            ? -1
+            : (stream -> reader)(stream, buf + ret, num - ret);
+      if (n < 0) {
+        stream -> _errno = errno;
+      } else if (!n) {
+        stream -> _eof = 1;
+      } else {
+        ret += n;
+      }
     } else {
+      n = _stream_fill(stream);
+    }
+    if (n < 0) {
       return -1;
+    } else if (!n) {
+      break;
     }
   }
-  return ix;
+  return ret;
 }
 
-static inline int _stream_write_buffer(stream_t *stream, char *buf, int num, int retval) {
-  if (!retval) {
-    int _len = (num > 0) ? num : strlen(buf);
-    if (_len > 0) {
-      debug(file, "Writing %d bytes to %s", _len, stream_tostring(stream));
-      retval = (stream->writer)(stream, buf, _len);
-      if (retval > 0) {
-        debug(file, "Wrote %d bytes", retval);
-        retval = (retval == _len) ? 0 : -1;
-      } else {
+/*
+ * Reads at most num bytes. Buffered data is returned first; only when the
+ * buffer is empty is the underlying device read, once. Unlike stream_read,
+ * which keeps reading until num bytes arrived or the stream ends, this
+ * returns after a short read.
+ */
+int stream_readsome(stream_t *stream, char *buf, int num) {
+  int n = stream -> len - stream -> pos;
+
+  if (n <= 0) {
+    if ((n = _stream_fill(stream)) <= 0) {
+      return n;
+    }
+    n = stream -> len - stream -> pos;
+  }
+  if (n > num) {
+    n = num;
+  }
+  memcpy(buf, stream -> buffer + stream -> pos, n);
+  stream -> pos += n;
+  return n;
+}
+
+/*
+ * Sets the size used for the next buffer refill. Data already buffered is
+ * kept, so the buffer never shrinks below what it currently holds.
+ */
+stream_t * stream_set_bufsize(stream_t *stream, int bufsize) {
+  int   len;
+  char *buffer;
+
+  if (bufsize <= 0) {
+    bufsize = STREAM_BUFSZ;
+  }
+  if (stream -> buffer && !stream -> mapped) {
+    len = stream -> len - stream -> pos;
+    if (bufsize < len) {
+      bufsize = len;
+    }
+    buffer = (char *) _new(bufsize);
+    memcpy(buffer, stream -> buffer + stream -> pos, len);
+    free(stream -> buffer);
+    stream -> buffer = buffer;
+    stream -> pos = 0;
+    stream -> len = len;
+  }
+  stream -> bufsize = bufsize;
+  return stream;
+}
+
+stream_t * stream_set_bufmode(stream_t *stream, stream_bufmode_t bufmode) {
+  stream -> bufmode = bufmode;
+  if (bufmode == StreamUnbuffered) {
+    stream_flush(stream);
+  }
+  return stream;
+}
+
+/*
+ * Drops all buffered input, for example after the underlying handle was
+ * repositioned. Pending output is not affected.
+ */
+stream_t * stream_discard(stream_t *stream) {
+  stream -> pos = stream -> len = 0;
+  stream -> _eof = 0;
+  return stream;
+}
+
+static int _stream_write_all(stream_t *stream, char *buf, int num) {
+  int ret;
+
+  while (num > 0) {
+    debug(file, "Writing %d bytes to %s", num, stream_tostring(stream));
+    ret = (stream -> writer)(stream, buf, num);
+    if (ret <= 0) {
+      debug(file, "error: %s (%d)", strerror(errno), errno);
+      stream -> _errno = errno;
+      return -1;
+    }
+    debug(file, "Wrote %d bytes", ret);
+    buf += ret;
+    num -= ret;
+  }
+  return 0;
+}
+
+/*
+ * Writes the pending output followed by buf. With a vectored writer this
+ * takes a single system call in the common case.
+ */
+static int _stream_write_through(stream_t *stream, char *buf, int num) {
+#ifdef HAVE_SYS_UIO_H
+  struct iovec iov[2];
+  int          ix = 0;
+  int          ret;
+
+  if (stream -> vwriter) {
+    iov[0].iov_base = stream -> wbuffer;
+    iov[0].iov_len = stream -> wlen;
+    iov[1].iov_base = buf;
+    iov[1].iov_len = num;
+    while (ix < 2) {
+      debug(file, "Writing %d+%d bytes to %s",
+            (int) iov[ix].iov_len, (ix) ? 0 : (int) iov[1].iov_len,
+            stream_tostring(stream));
+      ret = (stream -> vwriter)(stream, iov + ix, 2 - ix);
+      if (ret <= 0) {
         debug(file, "error: %s (%d)", strerror(errno), errno);
-        retval = -1;
+        stream -> _errno = errno;
+        return -1;
+      }
+      for (; (ix < 2) && ((size_t) ret >= iov[ix].iov_len); ix++) {
+        ret -= iov[ix].iov_len;
+      }
+      if (ix < 2) {
+        iov[ix].iov_base = (char *) iov[ix].iov_base + ret;
+        iov[ix].iov_len -= ret;
       }
     }
+    stream -> wlen = 0;
+    return 0;
   }
-  return retval;
+#endif /* HAVE_SYS_UIO_H */
+  if (stream_flush(stream)) {
+    return -1;
+  }
+  return _stream_write_all(stream, buf, num);
+}
+
+static inline int _stream_write_buffer(stream_t *stream, char *buf, int num, int retval) {
+  int len;
+
+  if (retval) {
+    return retval;
+  }
+  len = (num > 0) ? num : strlen(buf);
+  if (len <= 0) {
+    return 0;
+  }
+  if (stream -> bufmode == StreamUnbuffered) {
+    return _stream_write_through(stream, buf, len);
+  }
+  if (!stream -> wbuffer) {
+    stream -> wsize = stream -> bufsize;
+    stream -> wbuffer = (char *) _new(stream -> wsize);
+    stream -> wlen = 0;
+    ONCE(_stream_writers_once, _stream_writers_init);
+    mutex_lock(_stream_mutex);
+    stream -> wnext = _stream_writers;
+    if (_stream_writers) {
+      _stream_writers -> wprev = stream;
+    }
+    _stream_writers = stream;
+    mutex_unlock(_stream_mutex);
+  }
+  if (stream -> wlen + len > stream -> wsize) {
+    if (len >= stream -> wsize) {
+      return _stream_write_through(stream, buf, len);
+    }
+    if (stream_flush(stream)) {
+      return -1;
+    }
+  }
+  memcpy(stream -> wbuffer + stream -> wlen, buf, len);
+  stream -> wlen += len;
+  if ((stream -> bufmode == StreamLineBuffered) && memchr(buf, '\n', len)) {
+    return stream_flush(stream);
+  }
+  return 0;
+}
+
+int stream_flush(stream_t *stream) {
+  int ret = 0;
+
+  if (stream -> wlen > 0) {
+    ret = _stream_write_all(stream, stream -> wbuffer, stream -> wlen);
+    stream -> wlen = 0;
+  }
+  return ret;
 }
 
 int stream_write(stream_t *stream, char *buf, int num) {
   return _stream_write_buffer(stream, buf, num, 0);
 }
 
-char * stream_readline(stream_t *stream) {
-  char   *buf;
-  size_t  num = 0;
-  int     ch;
-  size_t  cursz = 40;
-  size_t  newsz;
-  char   *ptr;
-
-  buf = stralloc(cursz);
-  do {
-    ch = stream_getchar(stream);
-    if ((!ch && !num) || (ch < 0)) {
-      free(buf);
-      return NULL;
-    } else if (!ch || (ch == '\n')) {
+/*
+ * Returns the next line as a pointer into the stream buffer and stores its
+ * length in len. The newline and any trailing control characters are not
+ * part of the line. The slice is only valid until the next read from the
+ * stream. Returns NULL at end of file or on error.
+ */
+char * stream_readslice(stream_t *stream, int *len) {
+  int   scanned = 0;
+  int   ret;
+  char *line;
+  char *nl;
+  int   n;
+
+  for (;;) {
+    line = stream -> buffer + stream -> pos;
+    n = stream -> len - stream -> pos;
+    nl = (n > scanned) ? memchr(line + scanned, '\n', n - scanned) : NULL;
+    if (nl) {
+      n = nl - line;
+      stream -> pos += n + 1;
       break;
-    } else {
-      buf[num++] = ch;
-      if (num >= cursz) {
-        newsz = (size_t)(cursz * 1.6);
-        buf = resize_block(buf, newsz, cursz);
-        cursz = newsz;
+    }
+    scanned = n;
+    ret = _stream_fill(stream);
+    if (ret < 0) {
+      return NULL;
+    } else if (!ret) {
+      if (!scanned) {
+        return NULL;
       }
+      line = stream -> buffer + stream -> pos;
+      stream -> pos = stream -> len;
+      break;
     }
-  } while (ch > 0);
-  ptr = buf + (strlen(buf) - 1);
-  while (*buf && iscntrl(*ptr)) {
-    *ptr-- = 0;
   }
-  return buf;
+  while ((n > 0) && iscntrl((unsigned char) line[n - 1])) {
+    n--;
+  }
+  *len = n;
+  return line;
+}
+
+/*
+ * Returns everything up to the end of the stream as one slice of the
+ * stream buffer and stores its length in len. For a mapped file this is
+ * a view of the mapping. Like stream_readslice the slice is only valid
+ * until the next read. Returns NULL on error.
+ */
+char * stream_readall(stream_t *stream, int *len) {
+  int   ret;
+  char *ptr;
+
+  while ((ret = _stream_fill(stream)) > 0);
+  if (ret < 0) {
+    return NULL;
+  }
+  ptr = (stream -> buffer) ? stream -> buffer + stream -> pos : "";
+  *len = stream -> len - stream -> pos;
+  stream -> pos = stream -> len;
+  return ptr;
+}
+
+char * stream_readline(stream_t *stream) {
+  char *line;
+  char *ret;
+  int   len;
+
+  line = stream_readslice(stream, &len);
+  if (!line) {
+    return NULL;
+  }
+  ret = stralloc(len);
+  memcpy(ret, line, len);
+  return ret;
 }
 
 int _stream_print_data(stream_t *stream, data_t *s) {
-  int     retval = 0;
-  data_t *r = NULL;
+  int retval = 0;
 
   retval = _stream_write_buffer(stream, data_tostring(s), 0, 0);
   retval = _stream_write_buffer(stream, "\r\n", 2, retval);
-  if (!retval && data_hasmethod((data_t *) stream, "flush")) {
-    r = data_execute((data_t *) stream, "flush", NULL);
-    if ((data_type(r) != Bool) || !data_intval(r)) {
-      retval = -1;
-    }
-    data_free(r);
-  }
   return retval;
 }
 
@@ -595,6 +921,14 @@ file_t * _file_new(file_t *file, va_list args) {
   file -> fh = va_arg(args, int);
   file -> fname = NULL;
   stream_init((stream_t *) file, (read_t) file_read, (write_t) file_write);
+#ifdef HAVE_SYS_UIO_H
+  file -> _stream.vwriter = (writev_t) file_writev;
+#endif /* HAVE_SYS_UIO_H */
+  if (file -> fh == 2) {
+    file -> _stream.bufmode = StreamUnbuffered;
+  } else if ((file -> fh >= 0) && isatty(file -> fh)) {
+    file -> _stream.bufmode = StreamLineBuffered;
+  }
   return file;
 }
 
@@ -645,6 +979,82 @@ data_t * _file_resolve(file_t *file, char *name) {
   }
 }
 
+/*
+ * Maps the window of the file that starts at the page holding offset and
+ * positions the stream at offset. The window is bufsize bytes long, or up
+ * to the end of the file if that comes first.
+ */
+int _file_map_window(file_t *file, off_t offset) {
+#ifdef HAVE_SYS_MMAN_H
+  stream_t *stream = (stream_t *) file;
+  off_t     start;
+  off_t     size;
+  void     *map;
+
+  if (offset > file -> mapsize) {
+    offset = file -> mapsize;
+  }
+  start = offset - (offset % sysconf(_SC_PAGESIZE));
+  size = file -> mapsize - start;
+  if (size > stream -> bufsize) {
+    size = stream -> bufsize;
+  }
+  if (stream -> buffer) {
+    munmap(stream -> buffer, stream -> len);
+  }
+  stream -> buffer = NULL;
+  stream -> pos = stream -> len = 0;
+  if (size > 0) {
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file -> fh, start);
+    if (map == MAP_FAILED) {
+      file_set_errno(file);
+      return -1;
+    }
+    posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+    stream -> buffer = (char *) map;
+  }
+  file -> mapoff = start;
+  stream -> len = size;
+  stream -> pos = offset - start;
+  stream -> _eof = 0;
+  return 0;
+#else /* !HAVE_SYS_MMAN_H */
+  errno = ENOSYS;
+  file_set_errno(file);
+  return -1;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+/*
+ * Slides the window forward so it starts at the current position, doubling
+ * it when that would not expose any new data because a single line is
+ * larger than the window. Returns the number of bytes that became
+ * available, 0 at end of file and -1 on error.
+ */
+int _file_map_next(file_t *file) {
+  stream_t *stream = (stream_t *) file;
+  off_t     offset = file -> mapoff + stream -> pos;
+  off_t     end = file -> mapoff + stream -> len;
+  off_t     page = sysconf(_SC_PAGESIZE);
+
+  if (end >= file -> mapsize) {
+    stream -> _eof = 1;
+    return 0;
+  }
+  while (offset - (offset % page) + stream -> bufsize <= end) {
+    if (stream -> bufsize > INT_MAX / 2) {
+      errno = EFBIG;
+      file_set_errno(file);
+      return -1;
+    }
+    stream -> bufsize *= 2;
+  }
+  if (_file_map_window(file, offset)) {
+    return -1;
+  }
+  return (int) (file -> mapoff + stream -> len - end);
+}
+
 /* -- F I L E _ T  P U B L I C  F U N C T I O N S ------------------------- */
 
 file_t * file_create(int fh) {
@@ -667,6 +1077,8 @@ int file_flags(char *flags) {
     ret = O_WRONLY | O_APPEND | O_CREAT;
   } else if (!strcasecmp(flags, "a+")) {
     ret = O_RDWR | O_APPEND | O_CREAT;
+  } else if (!strcasecmp(flags, "m")) {
+    ret = O_RDONLY;
   } else {
     ret = -1;
   }
@@ -751,7 +1163,7 @@ file_t * file_open_ext(char *fname, ...) {
   int      fh = -1;
   va_list  args;
   char    *flags;
-  char    *mode;
+  char    *mode = NULL;
   int      open_flags = 0;
   int      open_mode = 0;
 
@@ -790,6 +1202,9 @@ file_t * file_open_ext(char *fname, ...) {
   }
   if (fh >= 0) {
     ret = file_create(fh);
+    if ((open_flags == O_RDONLY) && flags && !strcasecmp(flags, "m")) {
+      file_map(ret);
+    }
   } else {
     if (file_debug) {
       _debug("File open(%s)", n);
@@ -810,8 +1225,21 @@ file_t * file_open(char *fname) {
 int file_close(file_t *file) {
   int ret = 0;
 
+  if (file_ismapped(file)) {
+#ifdef HAVE_SYS_MMAN_H
+    if (file -> _stream.buffer) {
+      munmap(file -> _stream.buffer, file -> _stream.len);
+    }
+#endif /* HAVE_SYS_MMAN_H */
+    file -> _stream.buffer = NULL;
+    file -> _stream.pos = file -> _stream.len = 0;
+    file -> _stream.mapped = 0;
+  }
   if (file -> fh >= 0) {
-    ret = close(file -> fh);
+    ret = stream_flush((stream_t *) file);
+    if (close(file -> fh)) {
+      ret = -1;
+    }
     if (ret) {
       if (errno) {
         file_set_errno(file);
@@ -839,14 +1267,81 @@ int file_cmp(file_t *f1, file_t *f2) {
 int file_seek(file_t *file, int offset) {
   int   whence = (offset >= 0) ? SEEK_SET : SEEK_END;
   off_t o = (whence == SEEK_SET) ? offset : -offset;
-  int   ret = lseek(file -> fh, o, whence);
+  int   ret;
 
+  /* Pending output belongs at the old position */
+  if (stream_flush((stream_t *) file)) {
+    return -1;
+  }
+  ret = lseek(file -> fh, o, whence);
   if (ret < 0) {
     file_set_errno(file);
+  } else if (file_ismapped(file)) {
+    if (_file_map_window(file, ret)) {
+      ret = -1;
+    }
+  } else {
+    stream_discard((stream_t *) file);
   }
   return ret;
 }
 
+/*
+ * Switches an open file to mapped reads, starting at the current read
+ * position. Only regular files can be mapped. On failure the file keeps
+ * reading through read(2).
+ *
+ * Mapping is only done when asked for, with mode "m" or this function,
+ * because a mapped file must not change while it is read. The size is
+ * taken when the file is mapped, so data appended after that is never
+ * seen. If the file is truncated, touching the pages past its new end
+ * raises SIGBUS.
+ */
+int file_map(file_t *file) {
+#ifdef HAVE_SYS_MMAN_H
+  stream_t    *stream = (stream_t *) file;
+  struct stat  st;
+  off_t        offset;
+
+  if (file_ismapped(file)) {
+    return 0;
+  }
+  if (fstat(file -> fh, &st)) {
+    file_set_errno(file);
+    return -1;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    errno = ENODEV;
+    file_set_errno(file);
+    return -1;
+  }
+  offset = lseek(file -> fh, 0, SEEK_CUR);
+  if (offset < 0) {
+    file_set_errno(file);
+    return -1;
+  }
+  offset -= stream -> len - stream -> pos;
+  free(stream -> buffer);
+  stream -> buffer = NULL;
+  stream -> pos = stream -> len = 0;
+  stream -> mapped = 1;
+  stream -> bufsize = FILE_MMAP_WINDOW;
+  file -> mapsize = st.st_size;
+  if (_file_map_window(file, offset)) {
+    stream -> mapped = 0;
+    stream -> bufsize = STREAM_BUFSZ;
+    lseek(file -> fh, offset, SEEK_SET);
+    return -1;
+  }
+  debug(file, "%s mapped, %ld bytes", file_tostring(file), (long) st.st_size);
+  return 0;
+#else /* !HAVE_SYS_MMAN_H */
+  errno = ENOSYS;
+  file_set_errno(file);
+  return -1;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
 int file_read(file_t *file, char *target, int num) {
   int ret = read(file -> fh, target, num);
 
@@ -865,10 +1360,24 @@ int file_write(file_t *file, char *buf, int num) {
   return ret;
 }
 
+#ifdef HAVE_SYS_UIO_H
+int file_writev(file_t *file, struct iovec *iov, int iovcnt) {
+  int ret = writev(file -> fh, iov, iovcnt);
+
+  if (ret < 0) {
+    file_set_errno(file);
+  }
+  return ret;
+}
+#endif /* HAVE_SYS_UIO_H */
+
 int file_flush(file_t *file) {
   int   ret = 0;
 
   debug(file, "%s.file_flush", file_tostring(file));
+  if (stream_flush((stream_t *) file)) {
+    return -1;
+  }
   if (file -> fh <= 2) {
     return 0;
   }
@@ -926,13 +1435,15 @@ data_t * _file_open(char _unused_ *name, arguments_t *args) {
   char   *n;
   data_t *file;
 
+  if (datalist_size(args -> args) > 2) {
+    return data_exception(ErrorArgCount, "open() takes at most two arguments");
+  }
+  n = arguments_arg_tostring(args, 0);
   if (datalist_size(args -> args) > 1) {
-    // FIXME open mode!
-    return data_exception(ErrorArgCount, "open() takes exactly one argument");
+    file = (data_t *) file_open_ext(n, arguments_arg_tostring(args, 1), NULL);
   } else {
-    n = arguments_arg_tostring(args, 0);
+    file = (data_t *) file_open(n);
   }
-  file = (data_t *) file_open(n);
   if (!file) {
     file = data_false();
   }
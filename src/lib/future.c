@@ -0,0 +1,241 @@
+/*
+ * /obelix/src/lib/future.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libcore.h"
+#include <arguments.h>
+#include <data.h>
+#include <exception.h>
+#include <future.h>
+#include <threadpool.h>
+
+/* ------------------------------------------------------------------------ */
+
+static future_t *   _future_new(future_t *, va_list);
+static void         _future_free(future_t *);
+static char *       _future_allocstring(future_t *);
+static data_t *     _future_resolve(future_t *, char *);
+
+static data_t *     _future_wait(future_t *, char *, arguments_t *);
+static data_t *     _future_result(future_t *, char *, arguments_t *);
+static data_t *     _future_done(future_t *, char *, arguments_t *);
+
+extern data_t *     _future_wait_all(char *, arguments_t *);
+
+/* ------------------------------------------------------------------------ */
+
+static vtable_t _vtable_Future[] = {
+  { .id = FunctionNew,         .fnc = (void_t) _future_new },
+  { .id = FunctionFree,        .fnc = (void_t) _future_free },
+  { .id = FunctionAllocString, .fnc = (void_t) _future_allocstring },
+  { .id = FunctionResolve,     .fnc = (void_t) _future_resolve },
+  { .id = FunctionNone,        .fnc = NULL }
+};
+
+static methoddescr_t _methods_Future[] = {
+  { .type = -1,     .name = "wait",    .method = (method_t) _future_wait,   .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 0 },
+  { .type = -1,     .name = "result",  .method = (method_t) _future_result, .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 0 },
+  { .type = -1,     .name = "done",    .method = (method_t) _future_done,   .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 0 },
+  { .type = NoType, .name = NULL,      .method = NULL,                      .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
+};
+
+int Future = -1;
+
+/* ------------------------------------------------------------------------ */
+
+void future_init(void) {
+  if (Future < 1) {
+    typedescr_register_with_methods(Future, future_t);
+  }
+}
+
+future_t * _future_new(future_t *future, va_list args) {
+  future -> cancel = va_arg(args, future_cancel_t);
+  future -> context = va_arg(args, void *);
+  future -> condition = condition_create();
+  future -> result = NULL;
+  future -> done = FALSE;
+  return future;
+}
+
+void _future_free(future_t *future) {
+  if (future) {
+    if (future -> cancel && !future_done(future)) {
+      future -> cancel(future, future -> context);
+    }
+    data_free(future -> result);
+    condition_free(future -> condition);
+  }
+}
+
+char * _future_allocstring(future_t *future) {
+  char *buf;
+
+  if (future_done(future)) {
+    asprintf(&buf, "<future: %s>", data_tostring(future -> result));
+  } else {
+    asprintf(&buf, "<future: pending>");
+  }
+  return buf;
+}
+
+data_t * _future_resolve(future_t *future, char *name) {
+  if (!strcmp(name, "done")) {
+    return int_as_bool(future_done(future));
+  } else {
+    return NULL;
+  }
+}
+
+/* ------------------------------------------------------------------------ */
+
+data_t * _future_wait(future_t *future, char _unused_ *name, arguments_t _unused_ *args) {
+  future_wait(future);
+  return data_copy((data_t *) future);
+}
+
+data_t * _future_result(future_t *future, char _unused_ *name, arguments_t _unused_ *args) {
+  return future_result(future);
+}
+
+data_t * _future_done(future_t *future, char _unused_ *name, arguments_t _unused_ *args) {
+  return int_as_bool(future_done(future));
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Creates a pending future. <code>cancel</code> is called with
+ * <code>context</code> if the future is freed before it is completed.
+ */
+future_t * future_create(future_cancel_t cancel, void *context) {
+  future_init();
+  return (future_t *) data_create(Future, cancel, context);
+}
+
+/**
+ * Creates a future that is already completed with <code>result</code>.
+ * Takes ownership of the result.
+ */
+future_t * future_completed(data_t *result) {
+  future_t *ret = future_create(NULL, NULL);
+
+  future_complete(ret, result);
+  return ret;
+}
+
+/**
+ * Completes the future and wakes up everybody waiting for it. Takes
+ * ownership of <code>result</code>. A future can only be completed once;
+ * later attempts return -1 and free the result.
+ */
+int future_complete(future_t *future, data_t *result) {
+  condition_acquire(future -> condition);
+  if (future -> done) {
+    condition_release(future -> condition);
+    data_free(result);
+    return -1;
+  }
+  future -> result = result;
+  future -> done = TRUE;
+  return condition_broadcast(future -> condition);
+}
+
+int future_done(future_t *future) {
+  int ret;
+
+  condition_acquire(future -> condition);
+  ret = future -> done;
+  condition_release(future -> condition);
+  return ret;
+}
+
+/**
+ * Blocks until the future is completed and returns its result. The result
+ * is owned by the future.
+ */
+data_t * future_wait(future_t *future) {
+  int pooled = FALSE;
+
+  if (!future_done(future)) {
+    pooled = threadpool_enter_blocking();
+  }
+  condition_acquire(future -> condition);
+  while (!future -> done) {
+    condition_sleep(future -> condition);
+  }
+  condition_release(future -> condition);
+  if (pooled) {
+    threadpool_leave_blocking();
+  }
+  return future -> result;
+}
+
+/**
+ * Blocks until the future is completed and returns a new reference to its
+ * result.
+ */
+data_t * future_result(future_t *future) {
+  return data_copy(future_wait(future));
+}
+
+/**
+ * Waits for all futures in <code>futures</code> and returns a list with
+ * their results, in the same order. Values that are not futures are taken
+ * as their own result. If any of the results is an exception, the first
+ * one is returned instead of the list.
+ */
+data_t * future_wait_all(datalist_t *futures) {
+  datalist_t *ret = datalist_create(NULL);
+  data_t     *error = NULL;
+  data_t     *value;
+  int         ix;
+
+  for (ix = 0; ix < datalist_size(futures); ix++) {
+    value = datalist_get(futures, ix);
+    if (data_is_future(value)) {
+      value = future_wait(data_as_future(value));
+    }
+    if (!error && data_is_exception(value)) {
+      error = data_copy(value);
+    }
+    datalist_push(ret, value);
+  }
+  if (error) {
+    datalist_free(ret);
+    return error;
+  }
+  return (data_t *) ret;
+}
+
+/* ------------------------------------------------------------------------ */
+
+data_t * _future_wait_all(char _unused_ *name, arguments_t *args) {
+  data_t *first;
+
+  if (arguments_args_size(args) == 1) {
+    first = arguments_get_arg(args, 0);
+    if (data_is_list(first)) {
+      return future_wait_all((datalist_t *) first);
+    }
+  }
+  return future_wait_all(args -> args);
+}
@@ -23,6 +23,7 @@
 #include <stdio.h>
 
 #include <data.h>
+#include <mutex.h>
 #include <threadonce.h>
 
 extern void          int_init(void);
@@ -322,6 +323,7 @@ static int_t *                 _zero;
 static int_t *                 _one;
 static int_t *                 _minusone;
 static int_t *                 _two;
+static mutex_t *               _integer_cache_mutex;
 THREAD_ONCE(_integer_cache_once);
 
 static int_t * _int_make(intptr_t i) {
@@ -338,6 +340,7 @@ static void _integer_cache_init(void) {
     _integer_cache[ix] = NULL;
   }
   _ints = intdata_dict_create();
+  _integer_cache_mutex = mutex_create();
   _zero = _int_make(0);
   _one = _int_make(1);
   _minusone = _int_make(-1);
@@ -356,16 +359,23 @@ int_t * int_create(intptr_t val) {
     ret = _minusone;
   } else if (val == 2) {
     ret = _two;
-  } else if (val < INTEGER_CACHE_SIZE) {
+  } else if ((val > 0) && (val < INTEGER_CACHE_SIZE)) {
     if (!(ret = _integer_cache[val])) {
-      ret = _int_make(val);
-      _integer_cache[val] = ret;
+      mutex_lock(_integer_cache_mutex);
+      if (!(ret = _integer_cache[val])) {
+        ret = _int_make(val);
+        _integer_cache[val] = ret;
+      }
+      mutex_unlock(_integer_cache_mutex);
     }
   } else {
+    /* The dictionary can be resized by a put, so lookups take the lock too */
+    mutex_lock(_integer_cache_mutex);
     if (!(ret = (int_t *) data_dict_get(_ints, (void *) val))) {
       ret = _int_make(val);
       dict_put(_ints, (void *) val, ret);
     }
+    mutex_unlock(_integer_cache_mutex);
   }
   return ret;
 }
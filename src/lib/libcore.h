@@ -40,9 +40,12 @@ extern void     ptr_init(void);
 extern void     file_init(void);
 extern void     mutex_init(void);
 extern void     thread_init(void);
+extern void     channel_init(void);
 extern void     name_init(void);
 extern void     hierarchy_init(void);
 extern void     nvp_init(void);
+extern void     arguments_init(void);
+extern void     future_init(void);
 
 extern int  data_debug;
 extern int  name_debug;
@@ -18,16 +18,45 @@
  */
 
 #include <errno.h>
+#include <stdio.h>
+#include <time.h>
 
 #include "libcore.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#include <coroutine.h>
 #include <mutex.h>
 #include <exception.h>
+#include <str.h>
+
+#define MUTEX_MAX_SPIN       100
+
+#if defined(__x86_64__) || defined(__i386__)
+#define _lock_relax()        __builtin_ia32_pause()
+#else
+#define _lock_relax()        __sync_synchronize()
+#endif
+
+static unsigned long long _lock_now(void);
+static int           _lock_max_spin(void);
+static void          _lock_register(lockstats_t *, data_t *);
+static void          _lock_unregister(lockstats_t *);
+static void          _lock_hold(lockstats_t *, unsigned long long);
+static data_t *      _lock_resolve(lockstats_t *, char *);
+static int           _lock_cmp(lockstats_t *, lockstats_t *);
 
 static void          _mutex_free(mutex_t *);
+static data_t *      _mutex_resolve(mutex_t *, char *);
 static data_t *      _mutex_enter(mutex_t *);
 static data_t *      _mutex_leave(mutex_t *, data_t *);
+static void          _mutex_acquired(mutex_t *, unsigned long long, int);
+static void          _mutex_releasing(mutex_t *);
+static int           _mutex_suspend(mutex_t *);
+static void          _mutex_resume(mutex_t *, int);
 
 extern data_t *      _mutex_create(data_t *, char *, arguments_t *);
+extern data_t *      _mutex_report(char *, arguments_t *);
 
 static data_t *      _mutex_lock(mutex_t *, char *, arguments_t *);
 static data_t *      _mutex_unlock(mutex_t *, char *, arguments_t *);
@@ -36,13 +65,14 @@ static vtable_t _vtable_Mutex[] = {
   { .id = FunctionCmp,      .fnc = (void_t) mutex_cmp },
   { .id = FunctionFree,     .fnc = (void_t) _mutex_free },
   { .id = FunctionHash,     .fnc = (void_t) mutex_hash },
+  { .id = FunctionResolve,  .fnc = (void_t) _mutex_resolve },
   { .id = FunctionEnter,    .fnc = (void_t) _mutex_enter },
   { .id = FunctionLeave,    .fnc = (void_t) _mutex_leave },
   { .id = FunctionNone,     .fnc = NULL }
 };
 
 static methoddescr_t _methods_Mutex[] = {
-  { .type = -1,     .name = "lock",    .method = (method_t) _mutex_lock,    .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 0 },
+  { .type = -1,     .name = "lock",    .method = (method_t) _mutex_lock,    .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 1, .maxargs = 1 },
   { .type = -1,     .name = "unlock",  .method = (method_t) _mutex_unlock,  .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 0 },
   { .type = NoType, .name = NULL,      .method = NULL,                      .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
 };
@@ -79,19 +109,203 @@ static methoddescr_t _methods_Condition[] = {
   { .type = NoType, .name = NULL,        .method = NULL,                          .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
 };
 
+static void          _rwlock_free(rwlock_t *);
+static data_t *      _rwlock_resolve(rwlock_t *, char *);
+static void          _rwlock_acquired(rwlock_t *, unsigned long long, int, int);
+
+extern data_t *      _rwlock_create(char *, arguments_t *);
+
+static data_t *      _rwlock_read(rwlock_t *, char *, arguments_t *);
+static data_t *      _rwlock_write(rwlock_t *, char *, arguments_t *);
+static data_t *      _rwlock_unlock(rwlock_t *, char *, arguments_t *);
+
+static vtable_t _vtable_RWLock[] = {
+  { .id = FunctionFree,     .fnc = (void_t) _rwlock_free },
+  { .id = FunctionResolve,  .fnc = (void_t) _rwlock_resolve },
+  { .id = FunctionNone,     .fnc = NULL }
+};
+
+static methoddescr_t _methods_RWLock[] = {
+  { .type = -1,     .name = "read",    .method = (method_t) _rwlock_read,   .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 1, .maxargs = 1 },
+  { .type = -1,     .name = "write",   .method = (method_t) _rwlock_write,  .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 1, .maxargs = 1 },
+  { .type = -1,     .name = "unlock",  .method = (method_t) _rwlock_unlock, .argtypes = { Any, Any, Any },          .minargs = 0, .varargs = 0 },
+  { .type = NoType, .name = NULL,      .method = NULL,                      .argtypes = { NoType, NoType, NoType }, .minargs = 0, .varargs = 0 },
+};
+
 int mutex_debug = -1;
+int mutex_profile = 0;
+int RWLock = -1;
+
+static lockstats_t  *_locks = NULL;
+static volatile int  _locks_busy = 0;
+static int           _lock_spin = -1;
 
 /* ------------------------------------------------------------------------ */
 
 void mutex_init(void) {
   builtin_typedescr_register(Mutex, "mutex", mutex_t);
   builtin_typedescr_register(Condition, "condition", condition_t);
+  typedescr_register_with_name_and_methods(RWLock, "rwlock", rwlock_t);
+  logging_register_category("lockprofile", &mutex_profile);
+}
+
+/* -- L O C K  S T A T I S T I C S ---------------------------------------- */
+
+unsigned long long _lock_now(void) {
+#ifdef HAVE_PTHREAD_H
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else /* !HAVE_PTHREAD_H */
+  return (unsigned long long) GetTickCount64() * 1000000ULL;
+#endif /* HAVE_PTHREAD_H */
+}
+
+/*
+ * Spinning only makes sense if the holder of the lock can run on another
+ * CPU at the same time.
+ */
+int _lock_max_spin(void) {
+  if (_lock_spin < 0) {
+#ifdef HAVE_UNISTD_H
+    _lock_spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? MUTEX_MAX_SPIN : 0;
+#else /* !HAVE_UNISTD_H */
+    _lock_spin = MUTEX_MAX_SPIN;
+#endif /* HAVE_UNISTD_H */
+  }
+  return _lock_spin;
+}
+
+/*
+ * The list of locks is protected by a spinlock rather than a mutex since
+ * it is maintained while mutexes are created and freed.
+ */
+void _lock_register(lockstats_t *stats, data_t *lock) {
+  stats -> lock = lock;
+  stats -> prev = NULL;
+  while (__sync_lock_test_and_set(&_locks_busy, 1)) {
+    _lock_relax();
+  }
+  stats -> next = _locks;
+  if (_locks) {
+    _locks -> prev = stats;
+  }
+  _locks = stats;
+  __sync_lock_release(&_locks_busy);
+}
+
+void _lock_unregister(lockstats_t *stats) {
+  while (__sync_lock_test_and_set(&_locks_busy, 1)) {
+    _lock_relax();
+  }
+  if (stats -> prev) {
+    stats -> prev -> next = stats -> next;
+  } else if (_locks == stats) {
+    _locks = stats -> next;
+  }
+  if (stats -> next) {
+    stats -> next -> prev = stats -> prev;
+  }
+  stats -> prev = stats -> next = NULL;
+  __sync_lock_release(&_locks_busy);
+}
+
+void _lock_hold(lockstats_t *stats, unsigned long long since) {
+  unsigned long long hold;
+
+  if (since) {
+    hold = _lock_now() - since;
+    if (hold > stats -> max_hold) {
+      stats -> max_hold = hold;
+    }
+  }
+}
+
+data_t * _lock_resolve(lockstats_t *stats, char *name) {
+  if (!strcmp(name, "acquisitions")) {
+    return int_to_data((intptr_t) stats -> acquisitions);
+  } else if (!strcmp(name, "contended")) {
+    return int_to_data((intptr_t) stats -> contended);
+  } else if (!strcmp(name, "waittime")) {
+    return int_to_data((intptr_t) (stats -> wait_time / 1000));
+  } else if (!strcmp(name, "maxhold")) {
+    return int_to_data((intptr_t) (stats -> max_hold / 1000));
+  }
+  return NULL;
+}
+
+int _lock_cmp(lockstats_t *s1, lockstats_t *s2) {
+  if (s1 -> contended != s2 -> contended) {
+    return (s1 -> contended < s2 -> contended) ? 1 : -1;
+  } else if (s1 -> wait_time != s2 -> wait_time) {
+    return (s1 -> wait_time < s2 -> wait_time) ? 1 : -1;
+  }
+  return 0;
+}
+
+/**
+ * Returns a report of the <code>count</code> locks that were contended
+ * most often, or of all locks that were ever contended if count is 0.
+ * Waiting and hold times are reported in microseconds. The caller owns the
+ * returned string.
+ */
+char * mutex_report(int count) {
+  lockstats_t *stats;
+  lockstats_t *copies;
+  char       **names;
+  str_t       *report;
+  char        *ret;
+  int          num = 0;
+  int          ix;
+
+  while (__sync_lock_test_and_set(&_locks_busy, 1)) {
+    _lock_relax();
+  }
+  for (stats = _locks; stats; stats = stats -> next) {
+    num += (stats -> contended) ? 1 : 0;
+  }
+  copies = NEWARR(num + 1, lockstats_t);
+  names = NEWARR(num + 1, char *);
+  for (ix = 0, stats = _locks; stats && (ix < num); stats = stats -> next) {
+    if (stats -> contended) {
+      copies[ix] = *stats;
+      names[ix] = strdup((stats -> lock -> str) ? stats -> lock -> str : "lock");
+      copies[ix].lock = (data_t *) names[ix];
+      ix++;
+    }
+  }
+  __sync_lock_release(&_locks_busy);
+
+  qsort(copies, num, sizeof(lockstats_t), (int (*)(const void *, const void *)) _lock_cmp);
+  if (!count || (count > num)) {
+    count = num;
+  }
+  report = str_printf("%-24.24s %12s %12s %14s %14s\n",
+                      "Lock", "Acquired", "Contended", "Wait (us)", "Max hold (us)");
+  for (ix = 0; ix < count; ix++) {
+    str_append_printf(report, "%-24.24s %12lu %12lu %14llu %14llu\n",
+                      (char *) copies[ix].lock,
+                      copies[ix].acquisitions,
+                      copies[ix].contended,
+                      copies[ix].wait_time / 1000,
+                      copies[ix].max_hold / 1000);
+  }
+  ret = strdup(str_chars(report));
+  str_free(report);
+  for (ix = 0; ix < num; ix++) {
+    free(names[ix]);
+  }
+  free(names);
+  free(copies);
+  return ret;
 }
 
 /* ------------------------------------------------------------------------ */
 
 void _mutex_free(mutex_t *mutex) {
   if (mutex) {
+    _lock_unregister(&mutex -> stats);
 #ifdef HAVE_PTHREAD_H
     pthread_mutex_destroy(&mutex -> mutex);
 #elif defined(HAVE_INITIALIZECRITICALSECTION)
@@ -100,6 +314,61 @@ void _mutex_free(mutex_t *mutex) {
   }
 }
 
+data_t * _mutex_resolve(mutex_t *mutex, char *name) {
+  if (!strcmp(name, "recursive")) {
+    return int_as_bool(mutex -> flags & MutexRecursive);
+  }
+  return _lock_resolve(&mutex -> stats, name);
+}
+
+/*
+ * Called with the mutex held. <code>since</code> is the time the thread
+ * started waiting if the mutex was contended, and 0 otherwise. Only the
+ * outermost acquisition of a recursive mutex is counted.
+ */
+void _mutex_acquired(mutex_t *mutex, unsigned long long since, int spins) {
+  unsigned long long now = 0;
+
+  if (mutex -> depth++) {
+    return;
+  }
+  mutex -> stats.acquisitions++;
+  if (since) {
+    now = _lock_now();
+    mutex -> stats.contended++;
+    mutex -> stats.wait_time += now - since;
+    mutex -> spin += (spins - mutex -> spin) / 8;
+  }
+  if (mutex_profile) {
+    mutex -> held_since = (now) ? now : _lock_now();
+  }
+}
+
+void _mutex_releasing(mutex_t *mutex) {
+  if (mutex -> depth && !--mutex -> depth) {
+    _lock_hold(&mutex -> stats, mutex -> held_since);
+    mutex -> held_since = 0;
+  }
+}
+
+/*
+ * A thread sleeping on a condition does not hold its mutex.
+ */
+int _mutex_suspend(mutex_t *mutex) {
+  int depth = mutex -> depth;
+
+  mutex -> depth = 1;
+  _mutex_releasing(mutex);
+  return depth;
+}
+
+void _mutex_resume(mutex_t *mutex, int depth) {
+  mutex -> depth = depth;
+  if (mutex_profile) {
+    mutex -> held_since = _lock_now();
+  }
+}
+
 data_t * _mutex_enter(mutex_t *mutex) {
   return mutex_lock(mutex) ? data_exception_from_errno() :  data_true();
 }
@@ -115,15 +384,25 @@ mutex_t * mutex_create(void) {
 }
 
 mutex_t * mutex_create_withname(char *name) {
+  return mutex_create_with_flags(name, MutexRecursive);
+}
+
+/**
+ * Creates a mutex. Unless <code>flags</code> has MutexRecursive set, a
+ * thread that locks the mutex while already holding it deadlocks.
+ */
+mutex_t * mutex_create_with_flags(char *name, int flags) {
   mutex_t *mutex;
 #ifdef HAVE_PTHREAD_H
   pthread_mutexattr_t  attr;
 #endif /* HAVE_PTHREAD_H */
 
  mutex = data_new(Mutex, mutex_t);
+ mutex -> flags = flags;
 #ifdef HAVE_PTHREAD_H
   pthread_mutexattr_init(&attr);
-  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutexattr_settype(&attr,
+    (flags & MutexRecursive) ? PTHREAD_MUTEX_RECURSIVE : PTHREAD_MUTEX_NORMAL);
   if ((errno = pthread_mutex_init(&mutex -> mutex, &attr))) {
     error("Error creating mutex: %s", strerror(errno));
     free(mutex);
@@ -141,6 +420,7 @@ mutex_t * mutex_create_withname(char *name) {
     mutex->_d.str = "mutex";
     mutex->_d.free_str = Constant;
   }
+  _lock_register(&mutex -> stats, (data_t *) mutex);
   return mutex;
 }
 
@@ -157,20 +437,43 @@ unsigned int mutex_hash(mutex_t *mutex) {
 }
 
 int mutex_lock(mutex_t *mutex) {
-  int retval = 0;
+  int                retval = 0;
+  int                spins = 0;
+  int                max;
+  unsigned long long since = 0;
 
   mdebug(mutex, "Locking mutex");
 #ifdef HAVE_PTHREAD_H
-  errno = pthread_mutex_lock(&mutex -> mutex);
+  errno = pthread_mutex_trylock(&mutex -> mutex);
+  if (errno == EBUSY) {
+    since = _lock_now();
+    max = mutex -> spin * 2 + 10;
+    if (max > _lock_max_spin()) {
+      max = _lock_max_spin();
+    }
+    for (; (errno == EBUSY) && (spins < max); spins++) {
+      _lock_relax();
+      errno = pthread_mutex_trylock(&mutex -> mutex);
+    }
+    if (errno == EBUSY) {
+      errno = pthread_mutex_lock(&mutex -> mutex);
+    }
+  }
   if (errno) {
     retval = -1;
   }
 #elif defined(HAVE_INITIALIZECRITICALSECTION)
-  EnterCriticalSection(&(mutex -> cs));
+  (void) max;
+  if (!TryEnterCriticalSection(&(mutex -> cs))) {
+    since = _lock_now();
+    EnterCriticalSection(&(mutex -> cs));
+  }
 #endif /* HAVE_PTHREAD_H */
   if (retval) {
     error("Error locking mutex: %d", errno);
   } else {
+    coroutine_lock_acquired();
+    _mutex_acquired(mutex, since, spins);
     mdebug(mutex, "Mutex locked");
   }
   return retval;
@@ -199,8 +502,12 @@ int mutex_trylock(mutex_t *mutex) {
       break;
   }
 #elif defined(HAVE_INITIALIZECRITICALSECTION)
-  retval = (!TryEnterCriticalSection(&mutex -> cs)) ? 0 : 1;
+  retval = (TryEnterCriticalSection(&mutex -> cs)) ? 0 : 1;
 #endif /* HAVE_PTHREAD_H */
+  if (!retval) {
+    coroutine_lock_acquired();
+    _mutex_acquired(mutex, 0, 0);
+  }
   mdebug(mutex, "Trylock mutex: %s", (retval) ? "Fail" : "Success");
   return retval;
 }
@@ -209,13 +516,15 @@ int mutex_unlock(mutex_t *mutex) {
   int retval = 0;
 
   mdebug(mutex, "Unlocking mutex");
+  _mutex_releasing(mutex);
+  coroutine_lock_released();
 #ifdef HAVE_PTHREAD_H
   errno = pthread_mutex_unlock(&mutex -> mutex);
   if (errno) {
     retval = -1;
   }
 #elif defined(HAVE_INITIALIZECRITICALSECTION)
-  EnterCriticalSection(&mutex -> cs);
+  LeaveCriticalSection(&mutex -> cs);
 #endif /* HAVE_PTHREAD_H */
   if (retval) {
     error("Error unlocking mutex: %d", errno);
@@ -233,14 +542,28 @@ data_t * _mutex_create(data_t *self, char *name, arguments_t *args) {
   (void) name;
   (void) args;
 
-  mutex_init();
+  typedescr_init();
   if (arguments_args_size(args)) {
-    return data_create(Mutex, arguments_arg_tostring(args, 0));
+    return (data_t *) mutex_create_withname(arguments_arg_tostring(args, 0));
   } else {
-    return data_create(Mutex, NULL);
+    return (data_t *) mutex_create();
   }
 }
 
+data_t * _mutex_report(char _unused_ *name, arguments_t *args) {
+  int     count = 0;
+  char   *report;
+  data_t *ret;
+
+  if (arguments_args_size(args)) {
+    count = data_intval(data_uncopy(arguments_get_arg(args, 0)));
+  }
+  report = mutex_report(count);
+  ret = str_to_data(report);
+  free(report);
+  return ret;
+}
+
 data_t * _mutex_lock(mutex_t *mutex, char *name, arguments_t *args) {
 	int wait = TRUE;
 
@@ -314,7 +637,7 @@ data_t * _condition_leave(condition_t *condition, data_t *param) {
 /* ------------------------------------------------------------------------ */
 
 condition_t * condition_create() {
-  mutex_init();
+  typedescr_init();
   return (condition_t *) data_create(Condition, NULL);
 }
 
@@ -371,10 +694,37 @@ int condition_wakeup(condition_t *condition) {
   return retval;
 }
 
+/*
+ * Like condition_wakeup, but wakes up all threads sleeping on the
+ * condition instead of just one.
+ */
+int condition_broadcast(condition_t *condition) {
+  int retval = 0;
+
+  mdebug(mutex, "Broadcasting condition");
+#ifdef HAVE_PTHREAD_H
+  errno = pthread_cond_broadcast(&condition -> condition);
+  if (errno) {
+    retval = -1;
+  }
+#elif defined(HAVE_INITIALIZECRITICALSECTION)
+  WakeAllConditionVariable(&condition -> condition);
+#endif /* HAVE_PTHREAD_H */
+  mutex_unlock(condition -> mutex);
+  if (retval) {
+    error("Error broadcasting condition: %d", errno);
+  } else {
+    mdebug(mutex, "Condition broadcast");
+  }
+  return retval;
+}
+
 int condition_sleep(condition_t *condition) {
   int retval = 0;
+  int depth;
 
   mdebug(mutex, "Going to sleep on condition");
+  depth = _mutex_suspend(condition -> mutex);
 #ifdef HAVE_PTHREAD_H
   errno = pthread_cond_wait(&condition -> condition, &condition -> mutex -> mutex);
   if (errno) {
@@ -383,6 +733,7 @@ int condition_sleep(condition_t *condition) {
 #elif defined(HAVE_INITIALIZECRITICALSECTION)
   SleepConditionVariableCS(&condition -> condition, &condition -> mutex -> cs, INFINITE);
 #endif /* HAVE_PTHREAD_H */
+  _mutex_resume(condition -> mutex, depth);
 if (retval) {
   error("Error sleeping on condition: %d", errno);
 } else {
@@ -391,13 +742,59 @@ if (retval) {
   return retval;
 }
 
+/*
+ * Like condition_sleep, but gives up after <code>timeout</code>
+ * milliseconds. A negative timeout waits forever. Returns 0 when woken up,
+ * 1 when the timeout expired and -1 on error. The condition is acquired
+ * again in all cases.
+ */
+int condition_sleep_timeout(condition_t *condition, long timeout) {
+  int             retval = 0;
+  int             depth;
+#ifdef HAVE_PTHREAD_H
+  struct timespec ts;
+#endif /* HAVE_PTHREAD_H */
+
+  if (timeout < 0) {
+    return condition_sleep(condition);
+  }
+  mdebug(mutex, "Going to sleep on condition for %ld ms", timeout);
+  depth = _mutex_suspend(condition -> mutex);
+#ifdef HAVE_PTHREAD_H
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += timeout / 1000;
+  ts.tv_nsec += (timeout % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  errno = pthread_cond_timedwait(&condition -> condition, &condition -> mutex -> mutex, &ts);
+  if (errno == ETIMEDOUT) {
+    retval = 1;
+  } else if (errno) {
+    retval = -1;
+  }
+#elif defined(HAVE_INITIALIZECRITICALSECTION)
+  if (!SleepConditionVariableCS(&condition -> condition, &condition -> mutex -> cs, (DWORD) timeout)) {
+    retval = (GetLastError() == ERROR_TIMEOUT) ? 1 : -1;
+  }
+#endif /* HAVE_PTHREAD_H */
+  _mutex_resume(condition -> mutex, depth);
+  if (retval < 0) {
+    error("Error sleeping on condition: %d", errno);
+  } else {
+    mdebug(mutex, "%s condition", (retval) ? "Timed out on" : "Woke up from");
+  }
+  return retval;
+}
+
 /* ------------------------------------------------------------------------ */
 
 data_t * _condition_create(char *name, arguments_t *args) {
   (void) name;
   (void) args;
 
-  mutex_init();
+  typedescr_init();
   return data_create(Condition, NULL);
 }
 
@@ -447,3 +844,228 @@ data_t * _condition_sleep(condition_t *condition, char *name, arguments_t *args)
 
   return condition_sleep(condition) ? data_exception_from_errno() : data_true();
 }
+
+/* ------------------------------------------------------------------------ */
+/* -- R W L O C K _ T ----------------------------------------------------- */
+/* ------------------------------------------------------------------------ */
+
+void _rwlock_free(rwlock_t *rwlock) {
+  if (rwlock) {
+    _lock_unregister(&rwlock -> stats);
+#ifdef HAVE_PTHREAD_H
+    pthread_rwlock_destroy(&rwlock -> rwlock);
+#endif /* HAVE_PTHREAD_H */
+  }
+}
+
+data_t * _rwlock_resolve(rwlock_t *rwlock, char *name) {
+  return _lock_resolve(&rwlock -> stats, name);
+}
+
+/*
+ * Any number of readers can hold the lock at the same time, so the
+ * counters are updated atomically. Hold times are only kept for writers.
+ */
+void _rwlock_acquired(rwlock_t *rwlock, unsigned long long since, int spins, int write) {
+  __sync_add_and_fetch(&rwlock -> stats.acquisitions, 1);
+  if (since) {
+    __sync_add_and_fetch(&rwlock -> stats.contended, 1);
+    __sync_add_and_fetch(&rwlock -> stats.wait_time, _lock_now() - since);
+    rwlock -> spin += (spins - rwlock -> spin) / 8;
+  }
+  if (write) {
+    rwlock -> writer = TRUE;
+    rwlock -> held_since = (mutex_profile) ? _lock_now() : 0;
+  }
+}
+
+static int _rwlock_lock(rwlock_t *rwlock, int write) {
+  int                spins = 0;
+  int                max;
+  unsigned long long since = 0;
+
+  mdebug(mutex, "Locking rwlock for %s", (write) ? "writing" : "reading");
+#ifdef HAVE_PTHREAD_H
+  errno = (write)
+    ? pthread_rwlock_trywrlock(&rwlock -> rwlock)
+    : pthread_rwlock_tryrdlock(&rwlock -> rwlock);
+  if (errno == EBUSY) {
+    since = _lock_now();
+    max = rwlock -> spin * 2 + 10;
+    if (max > _lock_max_spin()) {
+      max = _lock_max_spin();
+    }
+    for (; (errno == EBUSY) && (spins < max); spins++) {
+      _lock_relax();
+      errno = (write)
+        ? pthread_rwlock_trywrlock(&rwlock -> rwlock)
+        : pthread_rwlock_tryrdlock(&rwlock -> rwlock);
+    }
+    if (errno == EBUSY) {
+      errno = (write)
+        ? pthread_rwlock_wrlock(&rwlock -> rwlock)
+        : pthread_rwlock_rdlock(&rwlock -> rwlock);
+    }
+  }
+  if (errno) {
+    error("Error locking rwlock: %d", errno);
+    return -1;
+  }
+#elif defined(HAVE_INITIALIZECRITICALSECTION)
+  (void) max;
+  if (write && !TryAcquireSRWLockExclusive(&rwlock -> rwlock)) {
+    since = _lock_now();
+    AcquireSRWLockExclusive(&rwlock -> rwlock);
+  } else if (!write && !TryAcquireSRWLockShared(&rwlock -> rwlock)) {
+    since = _lock_now();
+    AcquireSRWLockShared(&rwlock -> rwlock);
+  }
+#endif /* HAVE_PTHREAD_H */
+  coroutine_lock_acquired();
+  _rwlock_acquired(rwlock, since, spins, write);
+  return 0;
+}
+
+static int _rwlock_trylock(rwlock_t *rwlock, int write) {
+  int retval = 0;
+
+#ifdef HAVE_PTHREAD_H
+  errno = (write)
+    ? pthread_rwlock_trywrlock(&rwlock -> rwlock)
+    : pthread_rwlock_tryrdlock(&rwlock -> rwlock);
+  switch (errno) {
+    case 0:
+      retval = 0;
+      break;
+    case EBUSY:
+      retval = 1;
+      break;
+    default:
+      retval = -1;
+      break;
+  }
+#elif defined(HAVE_INITIALIZECRITICALSECTION)
+  retval = ((write)
+    ? TryAcquireSRWLockExclusive(&rwlock -> rwlock)
+    : TryAcquireSRWLockShared(&rwlock -> rwlock)) ? 0 : 1;
+#endif /* HAVE_PTHREAD_H */
+  if (!retval) {
+    coroutine_lock_acquired();
+    _rwlock_acquired(rwlock, 0, 0, write);
+  }
+  return retval;
+}
+
+/* ------------------------------------------------------------------------ */
+
+rwlock_t * rwlock_create(char *name) {
+  rwlock_t *rwlock;
+
+  typedescr_init();
+  rwlock = data_new(RWLock, rwlock_t);
+#ifdef HAVE_PTHREAD_H
+  if ((errno = pthread_rwlock_init(&rwlock -> rwlock, NULL))) {
+    error("Error creating rwlock: %s", strerror(errno));
+    free(rwlock);
+    return NULL;
+  }
+#elif defined(HAVE_INITIALIZECRITICALSECTION)
+  InitializeSRWLock(&rwlock -> rwlock);
+#endif /* HAVE_PTHREAD_H */
+  rwlock -> _d.str = strdup((name) ? name : "rwlock");
+  _lock_register(&rwlock -> stats, (data_t *) rwlock);
+  return rwlock;
+}
+
+int rwlock_rdlock(rwlock_t *rwlock) {
+  return _rwlock_lock(rwlock, FALSE);
+}
+
+int rwlock_wrlock(rwlock_t *rwlock) {
+  return _rwlock_lock(rwlock, TRUE);
+}
+
+/**
+ * @return 0 if the rwlock was successfully locked for reading
+ *         1 if a writer holds the lock
+ *         -1 If an error occurred.
+ */
+int rwlock_tryrdlock(rwlock_t *rwlock) {
+  return _rwlock_trylock(rwlock, FALSE);
+}
+
+/**
+ * @return 0 if the rwlock was successfully locked for writing
+ *         1 if the lock is held by readers or another writer
+ *         -1 If an error occurred.
+ */
+int rwlock_trywrlock(rwlock_t *rwlock) {
+  return _rwlock_trylock(rwlock, TRUE);
+}
+
+int rwlock_unlock(rwlock_t *rwlock) {
+  int write = rwlock -> writer;
+
+  mdebug(mutex, "Unlocking rwlock");
+  if (write) {
+    _lock_hold(&rwlock -> stats, rwlock -> held_since);
+    rwlock -> held_since = 0;
+    rwlock -> writer = FALSE;
+  }
+  coroutine_lock_released();
+#ifdef HAVE_PTHREAD_H
+  if ((errno = pthread_rwlock_unlock(&rwlock -> rwlock))) {
+    error("Error unlocking rwlock: %d", errno);
+    return -1;
+  }
+#elif defined(HAVE_INITIALIZECRITICALSECTION)
+  if (write) {
+    ReleaseSRWLockExclusive(&rwlock -> rwlock);
+  } else {
+    ReleaseSRWLockShared(&rwlock -> rwlock);
+  }
+#endif /* HAVE_PTHREAD_H */
+  return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+data_t * _rwlock_create(char _unused_ *name, arguments_t *args) {
+  return (data_t *) rwlock_create((arguments_args_size(args))
+                                  ? arguments_arg_tostring(args, 0)
+                                  : NULL);
+}
+
+static data_t * _rwlock_acquire(rwlock_t *rwlock, arguments_t *args, int write) {
+  int wait = TRUE;
+
+  if (args && arguments_args_size(args)) {
+    wait = data_intval(data_uncopy(arguments_get_arg(args, 0)));
+  }
+  if (wait) {
+    return _rwlock_lock(rwlock, write) ? data_exception_from_errno() : data_true();
+  } else {
+    switch (_rwlock_trylock(rwlock, write)) {
+      case 1:
+        return data_false();
+      case -1:
+        return data_exception_from_errno();
+      default:
+        return data_true();
+    }
+  }
+}
+
+data_t * _rwlock_read(rwlock_t *rwlock, char _unused_ *name, arguments_t *args) {
+  return _rwlock_acquire(rwlock, args, FALSE);
+}
+
+data_t * _rwlock_write(rwlock_t *rwlock, char _unused_ *name, arguments_t *args) {
+  return _rwlock_acquire(rwlock, args, TRUE);
+}
+
+data_t * _rwlock_unlock(rwlock_t *rwlock, char _unused_ *name, arguments_t *args) {
+  (void) args;
+
+  return rwlock_unlock(rwlock) ? data_exception_from_errno() : data_true();
+}
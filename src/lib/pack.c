@@ -0,0 +1,564 @@
+/*
+ * /obelix/src/lib/pack.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "libcore.h"
+#include <data.h>
+#include <exception.h>
+#include <mutex.h>
+#include <pack.h>
+#include <threadonce.h>
+
+/*
+ * Values nested deeper than this are rejected by both the packer and the
+ * unpacker, for the same reasons JSON_MAX_DEPTH exists in the JSON codec.
+ */
+#define PACK_MAX_DEPTH    512
+
+typedef struct _unpacker {
+  const unsigned char *start;
+  const unsigned char *ptr;
+  const unsigned char *end;
+  int                  depth;
+  data_t              *error;
+} unpacker_t;
+
+static data_t * _unpack_value(unpacker_t *);
+
+/*
+ * The libcore types have fixed ids, so they can be looked up before the
+ * type itself has been registered. Other types are added to the registry
+ * by pack_register_type.
+ */
+typedef struct _pack_coretype {
+  packtypeid_t   id;
+  int            builtin;
+  int           *type;
+  void         (*init)(void);
+} pack_coretype_t;
+
+static pack_coretype_t _pack_coretypes[] = {
+  { .id = PackTypeArguments, .builtin = NoType,    .type = &Arguments, .init = arguments_init },
+  { .id = PackTypeException, .builtin = Exception, .type = NULL,       .init = NULL },
+  { .id = PackTypeNone,      .builtin = NoType,    .type = NULL,       .init = NULL }
+};
+
+static inline int _pack_coretype_type(pack_coretype_t *core) {
+  return (core -> type) ? *(core -> type) : core -> builtin;
+}
+
+static void     _pack_init(void);
+
+static mutex_t *_pack_mutex = NULL;
+static dict_t  *_pack_types = NULL;
+static dict_t  *_pack_ids = NULL;
+
+THREAD_ONCE(_pack_once);
+
+/* -- T Y P E  R E G I S T R Y --------------------------------------------- */
+
+void _pack_init(void) {
+  _pack_mutex = mutex_create();
+  _pack_types = intint_dict_create();
+  _pack_ids = intint_dict_create();
+}
+
+/**
+ * Assigns wire id <code>id</code> to <code>type</code>. Returns -1 if the
+ * id is reserved for libcore or already taken by another type.
+ */
+int pack_register_type(int type, unsigned int id) {
+  int ret = 0;
+  int current;
+
+  ONCE(_pack_once, _pack_init);
+  if (id < PackTypeUser) {
+    return -1;
+  }
+  mutex_lock(_pack_mutex);
+  current = (int) (intptr_t) dict_get_int(_pack_types, id);
+  if (current && (current != type)) {
+    ret = -1;
+  } else {
+    dict_put_int(_pack_types, id, (void *) (intptr_t) type);
+    dict_put_int(_pack_ids, type, (void *) (intptr_t) id);
+  }
+  mutex_unlock(_pack_mutex);
+  return ret;
+}
+
+static unsigned int _pack_type_id(int type) {
+  pack_coretype_t *core;
+  unsigned int     ret;
+
+  for (core = _pack_coretypes; core -> id; core++) {
+    if (_pack_coretype_type(core) == type) {
+      return core -> id;
+    }
+  }
+  ONCE(_pack_once, _pack_init);
+  mutex_lock(_pack_mutex);
+  ret = (unsigned int) (intptr_t) dict_get_int(_pack_ids, type);
+  mutex_unlock(_pack_mutex);
+  return ret;
+}
+
+static int _pack_type_for_id(unsigned int id) {
+  pack_coretype_t *core;
+  int              ret;
+
+  for (core = _pack_coretypes; core -> id; core++) {
+    if (core -> id == id) {
+      if (core -> init && (_pack_coretype_type(core) < 1)) {
+        core -> init();
+      }
+      return _pack_coretype_type(core);
+    }
+  }
+  ONCE(_pack_once, _pack_init);
+  mutex_lock(_pack_mutex);
+  ret = (int) (intptr_t) dict_get_int(_pack_types, id);
+  mutex_unlock(_pack_mutex);
+  return ret;
+}
+
+/* -- P A C K E R --------------------------------------------------------- */
+
+packer_t * packer_init(packer_t *packer) {
+  memset(packer, 0, sizeof(packer_t));
+  return packer;
+}
+
+void packer_release(packer_t *packer) {
+  if (packer) {
+    free(packer -> buffer);
+    packer_init(packer);
+  }
+}
+
+packer_t * packer_reset(packer_t *packer) {
+  packer -> len = 0;
+  packer -> depth = 0;
+  packer -> serialized = 0;
+  packer -> error = 0;
+  return packer;
+}
+
+packer_t * packer_write(packer_t *packer, const void *data, size_t len) {
+  size_t size;
+
+  if (packer -> len + len > packer -> size) {
+    for (size = (packer -> size) ? packer -> size : 64; size < packer -> len + len; size *= 2);
+    packer -> buffer = resize_block(packer -> buffer, size, packer -> size);
+    packer -> size = size;
+  }
+  memcpy(packer -> buffer + packer -> len, data, len);
+  packer -> len += len;
+  return packer;
+}
+
+packer_t * packer_write_varint(packer_t *packer, uint64_t value) {
+  unsigned char buf[10];
+  int           len = 0;
+
+  do {
+    buf[len] = value & 0x7F;
+    value >>= 7;
+    if (value) {
+      buf[len] |= 0x80;
+    }
+    len++;
+  } while (value);
+  return packer_write(packer, buf, len);
+}
+
+static packer_t * _packer_write_tag(packer_t *packer, packtag_t tag) {
+  unsigned char t = (unsigned char) tag;
+
+  return packer_write(packer, &t, 1);
+}
+
+static packer_t * _packer_write_string(packer_t *packer, char *str, size_t len) {
+  _packer_write_tag(packer, PackString);
+  packer_write_varint(packer, len);
+  return packer_write(packer, str, len);
+}
+
+static packer_t * _packer_write_entry(entry_t *entry, packer_t *packer) {
+  char *key = (char *) entry -> key;
+
+  if (!packer -> error) {
+    packer_write_varint(packer, strlen(key));
+    packer_write(packer, key, strlen(key));
+    packer_pack(packer, (data_t *) entry -> value);
+  }
+  return packer;
+}
+
+packer_t * packer_pack(packer_t *packer, data_t *value) {
+  array_t       *array;
+  data_t        *serialized;
+  data_t        *packed;
+  pack_t         pack;
+  unsigned int   id;
+  char          *str;
+  size_t         len;
+  int64_t        i;
+  uint64_t       bits;
+  unsigned char  flt[8];
+  int            ix;
+
+  if (packer -> error) {
+    return packer;
+  }
+  if (++packer -> depth > PACK_MAX_DEPTH) {
+    packer -> error = 1;
+    return packer;
+  }
+  if (data_isnull(value)) {
+    _packer_write_tag(packer, PackNull);
+  } else if (data_type(value) == Bool) {
+    _packer_write_tag(packer, (((int_t *) value) -> i) ? PackTrue : PackFalse);
+  } else if (data_type(value) == Int) {
+    /* Zigzag encoding keeps small negative numbers short */
+    i = ((int_t *) value) -> i;
+    _packer_write_tag(packer, PackInt);
+    packer_write_varint(packer, ((uint64_t) i << 1) ^ (uint64_t) (i >> 63));
+  } else if (data_type(value) == Float) {
+    memcpy(&bits, &((flt_t *) value) -> dbl, sizeof(bits));
+    for (ix = 7; ix >= 0; ix--) {
+      flt[ix] = bits & 0xFF;
+      bits >>= 8;
+    }
+    _packer_write_tag(packer, PackFloat);
+    packer_write(packer, flt, sizeof(flt));
+  } else if (data_type(value) == String) {
+    str = str_chars((str_t *) value);
+    len = str_len((str_t *) value);
+    if (packer -> serialized && (len >= 2) && (str[0] == '"') && (str[len - 1] == '"')) {
+      /* Serialized strings are wrapped in quotes by _str_serialize */
+      str++;
+      len -= 2;
+    }
+    _packer_write_string(packer, str, len);
+  } else if (data_type(value) == List) {
+    array = data_as_array(value);
+    _packer_write_tag(packer, PackList);
+    packer_write_varint(packer, array_size(array));
+    for (ix = 0; ix < array_size(array); ix++) {
+      packer_pack(packer, data_array_get(array, ix));
+    }
+  } else if (data_type(value) == Dictionary) {
+    _packer_write_tag(packer, PackDictionary);
+    packer_write_varint(packer, dict_size(((dictionary_t *) value) -> attributes));
+    dict_reduce(((dictionary_t *) value) -> attributes,
+                (reduce_t) _packer_write_entry, packer);
+  } else if ((pack = (pack_t) data_get_function(value, FunctionPack))) {
+    if ((id = _pack_type_id(data_type(value)))) {
+      _packer_write_tag(packer, PackTyped);
+      packer_write_varint(packer, id);
+    } else {
+      _packer_write_tag(packer, PackNamed);
+      str = data_typename(value);
+      packer_write_varint(packer, strlen(str));
+      packer_write(packer, str, strlen(str));
+    }
+    packed = pack(value);
+    packer_pack(packer, packed);
+    data_free(packed);
+  } else {
+    serialized = data_serialize(value);
+    if (data_type(serialized) == data_type(value)) {
+      str = data_tostring(value);
+      _packer_write_string(packer, str, strlen(str));
+    } else {
+      _packer_write_tag(packer, PackSerialized);
+      packer -> serialized++;
+      packer_pack(packer, serialized);
+      packer -> serialized--;
+    }
+    data_free(serialized);
+  }
+  packer -> depth--;
+  return packer;
+}
+
+/* -- U N P A C K E R ----------------------------------------------------- */
+
+size_t pack_read_varint(const unsigned char *buf, size_t len, uint64_t *value) {
+  size_t ix;
+  int    shift;
+
+  *value = 0;
+  for (ix = 0, shift = 0; (ix < len) && (shift < 64); ix++, shift += 7) {
+    *value |= ((uint64_t) (buf[ix] & 0x7F)) << shift;
+    if (!(buf[ix] & 0x80)) {
+      return ix + 1;
+    }
+  }
+  return 0;
+}
+
+static data_t * _unpack_error(unpacker_t *unpacker, char *msg) {
+  if (!unpacker -> error) {
+    unpacker -> error = data_exception(ErrorParameterValue,
+        "Packed data: %s at offset %d",
+        msg, (int) (unpacker -> ptr - unpacker -> start));
+  }
+  return NULL;
+}
+
+static int _unpack_varint(unpacker_t *unpacker, uint64_t *value) {
+  size_t len = pack_read_varint(unpacker -> ptr, unpacker -> end - unpacker -> ptr, value);
+
+  if (!len) {
+    _unpack_error(unpacker, "Malformed varint");
+    return -1;
+  }
+  unpacker -> ptr += len;
+  return 0;
+}
+
+static int _unpack_length(unpacker_t *unpacker, size_t *len) {
+  uint64_t value;
+
+  if (_unpack_varint(unpacker, &value)) {
+    return -1;
+  }
+  if (value > (uint64_t) (unpacker -> end - unpacker -> ptr)) {
+    /* Every element takes at least one byte, so this also bounds counts */
+    _unpack_error(unpacker, "Length exceeds available data");
+    return -1;
+  }
+  *len = (size_t) value;
+  return 0;
+}
+
+static data_t * _unpack_list(unpacker_t *unpacker) {
+  datalist_t *ret;
+  data_t     *elem;
+  size_t      count;
+  size_t      ix;
+
+  if (_unpack_length(unpacker, &count)) {
+    return NULL;
+  }
+  ret = datalist_create(NULL);
+  for (ix = 0; ix < count; ix++) {
+    if (!(elem = _unpack_value(unpacker))) {
+      datalist_free(ret);
+      return NULL;
+    }
+    datalist_push(ret, elem);
+    data_free(elem);
+  }
+  return (data_t *) ret;
+}
+
+static data_t * _unpack_dictionary(unpacker_t *unpacker) {
+  dictionary_t *ret;
+  data_t       *value;
+  char         *key;
+  size_t        count;
+  size_t        len;
+  size_t        ix;
+
+  if (_unpack_length(unpacker, &count)) {
+    return NULL;
+  }
+  ret = dictionary_create(NULL);
+  for (ix = 0; ix < count; ix++) {
+    if (_unpack_length(unpacker, &len)) {
+      break;
+    }
+    key = strndup((char *) unpacker -> ptr, len);
+    unpacker -> ptr += len;
+    value = _unpack_value(unpacker);
+    if (value) {
+      dictionary_set(ret, key, value);
+      data_free(value);
+    }
+    free(key);
+    if (!value) {
+      break;
+    }
+  }
+  if (ix < count) {
+    dictionary_free(ret);
+    return NULL;
+  }
+  return (data_t *) ret;
+}
+
+static data_t * _unpack_typed(unpacker_t *unpacker, int type) {
+  typedescr_t *descr = typedescr_get(type);
+  unpack_t     unpack;
+  data_t      *packed;
+  data_t      *ret;
+
+  unpack = (descr) ? (unpack_t) typedescr_get_function(descr, FunctionUnpack) : NULL;
+  if (!unpack) {
+    return _unpack_error(unpacker, "Type cannot be unpacked");
+  }
+  if (!(packed = _unpack_value(unpacker))) {
+    return NULL;
+  }
+  ret = unpack(type, packed);
+  data_free(packed);
+  if (!ret) {
+    _unpack_error(unpacker, "Invalid packed value");
+  }
+  return ret;
+}
+
+data_t * _unpack_value(unpacker_t *unpacker) {
+  data_t        *ret = NULL;
+  data_t        *serialized;
+  typedescr_t   *descr;
+  char          *name;
+  uint64_t       u;
+  size_t         len;
+  int            ix;
+
+  if (unpacker -> ptr >= unpacker -> end) {
+    return _unpack_error(unpacker, "Unexpected end of data");
+  }
+  if (++unpacker -> depth > PACK_MAX_DEPTH) {
+    return _unpack_error(unpacker, "Value nested too deeply");
+  }
+  switch ((packtag_t) *unpacker -> ptr++) {
+    case PackNull:
+      ret = data_null();
+      break;
+    case PackFalse:
+      ret = data_false();
+      break;
+    case PackTrue:
+      ret = data_true();
+      break;
+    case PackInt:
+      if (!_unpack_varint(unpacker, &u)) {
+        ret = int_to_data((intptr_t) ((int64_t) (u >> 1) ^ -((int64_t) (u & 1))));
+      }
+      break;
+    case PackFloat:
+      if (unpacker -> end - unpacker -> ptr < 8) {
+        return _unpack_error(unpacker, "Truncated float");
+      }
+      for (u = 0, ix = 0; ix < 8; ix++) {
+        u = (u << 8) | *unpacker -> ptr++;
+      }
+      ret = flt_to_data(0.0);
+      memcpy(&((flt_t *) ret) -> dbl, &u, sizeof(u));
+      break;
+    case PackString:
+      if (!_unpack_length(unpacker, &len)) {
+        ret = (data_t *) str_copy_nchars((char *) unpacker -> ptr, len);
+        unpacker -> ptr += len;
+      }
+      break;
+    case PackList:
+      ret = _unpack_list(unpacker);
+      break;
+    case PackDictionary:
+      ret = _unpack_dictionary(unpacker);
+      break;
+    case PackSerialized:
+      if ((serialized = _unpack_value(unpacker))) {
+        ret = data_deserialize(serialized);
+        data_free(serialized);
+      }
+      break;
+    case PackTyped:
+      if (!_unpack_varint(unpacker, &u)) {
+        if (!(ix = _pack_type_for_id((unsigned int) u))) {
+          return _unpack_error(unpacker, "Unknown type id");
+        }
+        ret = _unpack_typed(unpacker, ix);
+      }
+      break;
+    case PackNamed:
+      if (!_unpack_length(unpacker, &len)) {
+        name = strndup((char *) unpacker -> ptr, len);
+        unpacker -> ptr += len;
+        descr = typedescr_get_byname(name);
+        free(name);
+        if (!descr) {
+          return _unpack_error(unpacker, "Unknown type name");
+        }
+        ret = _unpack_typed(unpacker, typetype(descr));
+      }
+      break;
+    default:
+      unpacker -> ptr--;
+      return _unpack_error(unpacker, "Unknown tag");
+  }
+  unpacker -> depth--;
+  return ret;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Packs a value into a newly allocated buffer. The length of the buffer is
+ * returned through <code>len</code>. Returns NULL if the value cannot be
+ * packed because it is nested too deeply.
+ */
+char * data_pack(data_t *value, size_t *len) {
+  packer_t packer;
+
+  packer_init(&packer);
+  packer_pack(&packer, value);
+  if (packer.error) {
+    packer_release(&packer);
+    return NULL;
+  }
+  *len = packer.len;
+  return (char *) packer.buffer;
+}
+
+/**
+ * Unpacks one value from <code>buf</code>. If <code>consumed</code> is not
+ * NULL the number of bytes used is returned through it, and trailing data is
+ * allowed. Otherwise the value must span the whole buffer. Malformed data
+ * results in an exception, and <code>consumed</code> is set to zero so it
+ * can be told apart from a packed exception value.
+ */
+data_t * data_unpack(const void *buf, size_t len, size_t *consumed) {
+  unpacker_t  unpacker;
+  data_t     *ret;
+
+  unpacker.start = unpacker.ptr = (const unsigned char *) buf;
+  unpacker.end = unpacker.start + len;
+  unpacker.depth = 0;
+  unpacker.error = NULL;
+  if (consumed) {
+    *consumed = 0;
+  }
+  if ((ret = _unpack_value(&unpacker))) {
+    if (consumed) {
+      *consumed = unpacker.ptr - unpacker.start;
+    } else if (unpacker.ptr < unpacker.end) {
+      data_free(ret);
+      ret = _unpack_error(&unpacker, "Unexpected data after value");
+    }
+  }
+  return (ret) ? ret : unpacker.error;
+}
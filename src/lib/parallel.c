@@ -0,0 +1,307 @@
+/*
+ * /obelix/src/lib/parallel.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libcore.h"
+#include <data.h>
+#include <exception.h>
+#include <threadpool.h>
+
+typedef enum _parallelop {
+  ParallelMap,
+  ParallelFilter,
+  ParallelReduce
+} parallelop_t;
+
+/*
+ * A chunk is the range [from, to) of the inputs. Map and filter chunks
+ * write one result per input into their own slots of results; a reduce
+ * chunk returns its partial result as the result of the job.
+ */
+typedef struct _parchunk {
+  parallelop_t  op;
+  data_t       *fnc;
+  datalist_t   *inputs;
+  data_t      **results;
+  int           from;
+  int           to;
+} parchunk_t;
+
+extern data_t *     _parallel_map(char *, arguments_t *);
+extern data_t *     _parallel_filter(char *, arguments_t *);
+extern data_t *     _parallel_reduce(char *, arguments_t *);
+
+static data_t *     _parallel_inputs(data_t *);
+static data_t *     _parallel_call(data_t *, data_t *, data_t *);
+static data_t *     _parallel_chunk(parchunk_t *);
+static data_t *     _parallel_run(parallelop_t, data_t *, data_t *, data_t *, int);
+
+static char * _parallel_opnames[] = { "pmap", "pfilter", "preduce" };
+
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Collects the values of an iterable in a list before any of the work is
+ * handed out, so the workers only ever read the inputs.
+ */
+data_t * _parallel_inputs(data_t *values) {
+  datalist_t *ret;
+  data_t     *iterator;
+  data_t     *has_next;
+  data_t     *value = NULL;
+
+  if (data_is_list(values)) {
+    return data_copy(values);
+  }
+  iterator = data_iter(values);
+  if (data_is_exception(iterator)) {
+    return iterator;
+  }
+  ret = datalist_create(NULL);
+  while (!value) {
+    has_next = data_has_next(iterator);
+    if (data_is_exception(has_next)) {
+      value = has_next;
+      break;
+    }
+    if (!data_intval(has_next)) {
+      data_free(has_next);
+      break;
+    }
+    data_free(has_next);
+    value = data_next(iterator);
+    if (!data_is_exception(value)) {
+      datalist_push(ret, value);
+      data_free(value);
+      value = NULL;
+    }
+  }
+  data_free(iterator);
+  if (value) {
+    datalist_free(ret);
+    return value;
+  }
+  return (data_t *) ret;
+}
+
+data_t * _parallel_call(data_t *fnc, data_t *arg1, data_t *arg2) {
+  arguments_t *args;
+  data_t      *ret;
+
+  args = (arg2)
+    ? arguments_create_args(2, arg1, arg2)
+    : arguments_create_args(1, arg1);
+  ret = data_call(fnc, args);
+  arguments_free(args);
+  return ret;
+}
+
+data_t * _parallel_chunk(parchunk_t *chunk) {
+  data_t *accum = NULL;
+  data_t *value;
+  int     ix;
+
+  for (ix = chunk -> from; ix < chunk -> to; ix++) {
+    value = datalist_get(chunk -> inputs, ix);
+    if (chunk -> op == ParallelReduce) {
+      value = (accum) ? _parallel_call(chunk -> fnc, accum, value) : data_copy(value);
+      data_free(accum);
+      accum = value;
+    } else {
+      value = _parallel_call(chunk -> fnc, value, NULL);
+      if (!data_is_exception(value)) {
+        chunk -> results[ix] = value;
+      }
+    }
+    if (data_is_exception(value)) {
+      return value;
+    }
+  }
+  return (accum) ? accum : data_null();
+}
+
+data_t * _parallel_run(parallelop_t op, data_t *fnc, data_t *values,
+                       data_t *initial, int chunksize) {
+  data_t      *inputs;
+  datalist_t  *list;
+  parchunk_t  *chunks;
+  future_t   **futures;
+  data_t     **results;
+  data_t      *error = NULL;
+  data_t      *accum = NULL;
+  data_t      *partial;
+  data_t      *value;
+  int          size;
+  int          count;
+  int          ix;
+
+  if (!data_is_callable(fnc)) {
+    return data_exception(ErrorType, "%s: '%s' is not callable",
+                          _parallel_opnames[op], data_tostring(fnc));
+  }
+  inputs = _parallel_inputs(values);
+  if (data_is_exception(inputs)) {
+    return inputs;
+  }
+  list = (datalist_t *) inputs;
+  size = datalist_size(list);
+  if (chunksize < 1) {
+    chunksize = size / (4 * threadpool_size());
+    if (chunksize < 1) {
+      chunksize = 1;
+    }
+  }
+  count = (size + chunksize - 1) / chunksize;
+  chunks = (parchunk_t *) _new((count + 1) * sizeof(parchunk_t));
+  futures = (future_t **) _new((count + 1) * sizeof(future_t *));
+  results = (data_t **) _new((size + 1) * sizeof(data_t *));
+  debug(threadpool, "%s: %d values in %d chunks of %d",
+        _parallel_opnames[op], size, count, chunksize);
+  for (ix = 0; ix < count; ix++) {
+    chunks[ix].op = op;
+    chunks[ix].fnc = fnc;
+    chunks[ix].inputs = list;
+    chunks[ix].results = results;
+    chunks[ix].from = ix * chunksize;
+    chunks[ix].to = (ix + 1 < count) ? (ix + 1) * chunksize : size;
+    futures[ix] = threadpool_submit(_parallel_opnames[op],
+                                    (pooljob_t) _parallel_chunk,
+                                    &chunks[ix], NULL);
+  }
+
+  /*
+   * Wait for all chunks, even after an error, since they all refer to the
+   * inputs and the results array. The first error in input order wins.
+   */
+  accum = (initial && (initial != data_null())) ? data_copy(initial) : NULL;
+  for (ix = 0; ix < count; ix++) {
+    partial = future_wait(futures[ix]);
+    if (!error && data_is_exception(partial)) {
+      error = data_copy(partial);
+    } else if (!error && (op == ParallelReduce)) {
+      value = (accum) ? _parallel_call(fnc, accum, partial) : data_copy(partial);
+      data_free(accum);
+      accum = value;
+      if (data_is_exception(accum)) {
+        error = accum;
+        accum = NULL;
+      }
+    }
+    future_free(futures[ix]);
+  }
+
+  if (!error) {
+    switch (op) {
+      case ParallelMap:
+        accum = (data_t *) datalist_create(NULL);
+        for (ix = 0; ix < size; ix++) {
+          datalist_push((datalist_t *) accum, results[ix]);
+        }
+        break;
+      case ParallelFilter:
+        accum = (data_t *) datalist_create(NULL);
+        for (ix = 0; ix < size; ix++) {
+          if (data_intval(results[ix])) {
+            datalist_push((datalist_t *) accum, datalist_get(list, ix));
+          }
+        }
+        break;
+      case ParallelReduce:
+        if (!accum) {
+          accum = data_null();
+        }
+        break;
+    }
+  } else {
+    data_free(accum);
+    accum = error;
+  }
+  for (ix = 0; ix < size; ix++) {
+    data_free(results[ix]);
+  }
+  free(results);
+  free(futures);
+  free(chunks);
+  datalist_free(list);
+  return accum;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Calls <code>fnc</code> for every value of <code>values</code> on the
+ * thread pool and returns the list of results, in the order of the values.
+ * The values are handed out in chunks of <code>chunksize</code>; if it is
+ * 0 the chunk size is derived from the pool size.
+ */
+data_t * threadpool_map(data_t *fnc, data_t *values, int chunksize) {
+  return _parallel_run(ParallelMap, fnc, values, NULL, chunksize);
+}
+
+/**
+ * Returns the list of those values for which <code>fnc</code>, called on
+ * the thread pool, returns a true value. The order of the values is kept.
+ */
+data_t * threadpool_filter(data_t *fnc, data_t *values, int chunksize) {
+  return _parallel_run(ParallelFilter, fnc, values, NULL, chunksize);
+}
+
+/**
+ * Reduces every chunk of <code>values</code> on the thread pool, and then
+ * reduces <code>initial</code> and the partial results of the chunks, in
+ * order, on the calling thread. <code>fnc</code> must therefore be
+ * associative. If <code>initial</code> is NULL the first partial result is
+ * used instead, and an empty set of values reduces to null.
+ */
+data_t * threadpool_reduce(data_t *fnc, data_t *values, data_t *initial, int chunksize) {
+  return _parallel_run(ParallelReduce, fnc, values, initial, chunksize);
+}
+
+/* ------------------------------------------------------------------------ */
+
+data_t * _parallel_map(char _unused_ *name, arguments_t *args) {
+  int chunksize = (arguments_args_size(args) > 2)
+    ? data_intval(data_uncopy(arguments_get_arg(args, 2))) : 0;
+
+  return threadpool_map(data_uncopy(arguments_get_arg(args, 0)),
+                        data_uncopy(arguments_get_arg(args, 1)),
+                        chunksize);
+}
+
+data_t * _parallel_filter(char _unused_ *name, arguments_t *args) {
+  int chunksize = (arguments_args_size(args) > 2)
+    ? data_intval(data_uncopy(arguments_get_arg(args, 2))) : 0;
+
+  return threadpool_filter(data_uncopy(arguments_get_arg(args, 0)),
+                           data_uncopy(arguments_get_arg(args, 1)),
+                           chunksize);
+}
+
+data_t * _parallel_reduce(char _unused_ *name, arguments_t *args) {
+  data_t *initial = (arguments_args_size(args) > 2)
+    ? data_uncopy(arguments_get_arg(args, 2)) : NULL;
+  int     chunksize = (arguments_args_size(args) > 3)
+    ? data_intval(data_uncopy(arguments_get_arg(args, 3))) : 0;
+
+  return threadpool_reduce(data_uncopy(arguments_get_arg(args, 0)),
+                           data_uncopy(arguments_get_arg(args, 1)),
+                           initial, chunksize);
+}
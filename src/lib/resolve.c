@@ -24,6 +24,9 @@
 #ifdef HAVE_DLFCN_H
 #include <dlfcn.h>
 #endif /* HAVE_DLFCN_H */
+#ifdef HAVE_LINK_H
+#include <link.h>
+#endif /* HAVE_LINK_H */
 #include <string.h>
 #ifdef HAVE_WINDOWS_H
 #include <windows.h>
@@ -41,6 +44,21 @@ typedef struct _resolve_result {
   char     *error;
 } resolve_result_t;
 
+typedef struct _resolve_registry {
+  resolve_static_t          *functions;
+  int                        size;
+  resolve_handle_t          *owner;
+  struct _resolve_registry  *next;
+} resolve_registry_t;
+
+typedef struct _resolve_build_id {
+  void          *base;
+  int            first;
+  unsigned char *buf;
+  unsigned int   sz;
+  unsigned int   len;
+} resolve_build_id_t;
+
        int                resolve_debug = 0;
 
 static resolve_result_t * _resolve_result_create(void *);
@@ -49,10 +67,16 @@ static void               _resolve_result_free(resolve_result_t *);
 static resolve_handle_t * _resolve_handle_create(char *);
 static void               _resolve_handle_free(resolve_handle_t *);
 static char *             _resolve_handle_tostring(resolve_handle_t *);
+static int                _resolve_handle_is(resolve_handle_t *, resolve_handle_t *);
 static char *             _resolve_handle_get_platform_image(resolve_handle_t *);
 static resolve_handle_t * _resolve_handle_open(resolve_handle_t *);
 static resolve_result_t * _resolve_handle_get_function(resolve_handle_t *, char *);
 
+static int                _resolve_static_cmp(const void *, const void *);
+static int                _resolve_registry_owned_by(resolve_registry_t *, resolve_handle_t *);
+static void_t             _resolve_registry_lookup(resolve_handle_t *, char *);
+static void               _resolve_registry_remove(resolve_handle_t *);
+
 static inline void        __resolve_init(void);
 static resolve_t *        _resolve_open(resolve_t *, char *);
 
@@ -62,6 +86,8 @@ THREAD_ONCE(_resolve_once);
 #define _resolve_init() ONCE(_resolve_once, __resolve_init)
 
 static mutex_t *_resolve_mutex;
+static resolve_registry_t * volatile _resolve_registries = NULL;
+static resolve_handle_t   *          _resolve_opening = NULL;
 
 
 /* ------------------------------------------------------------------------ */
@@ -122,22 +148,35 @@ resolve_handle_t * _resolve_handle_create(char *image) {
 
   ret -> image = image ? strdup(image) : NULL;
   ret -> platform_image = NULL;
+  ret -> handle = NULL;
   ret -> next = NULL;
-  return _resolve_handle_open(ret);
+  _resolve_handle_get_platform_image(ret);
+  return ret;
 }
 
 void _resolve_handle_free(resolve_handle_t *handle) {
   if (handle) {
+    if (handle -> handle) {
+      _resolve_registry_remove(handle);
 #ifdef HAVE_DLFCN_H
-    dlclose(handle -> handle);
+      dlclose(handle -> handle);
 #elif defined(HAVE_WINDOWS_H)
-    FreeLibrary(handle -> handle);
+      FreeLibrary(handle -> handle);
 #endif /* HAVE_DLFCN_H */
+    }
     free(handle -> image);
     free(handle -> platform_image);
+    free(handle);
   }
 }
 
+int _resolve_handle_is(resolve_handle_t *handle, resolve_handle_t *other) {
+  if (!handle -> platform_image || !other -> platform_image) {
+    return !handle -> platform_image && !other -> platform_image;
+  }
+  return !strcmp(handle -> platform_image, other -> platform_image);
+}
+
 char * _resolve_handle_tostring(resolve_handle_t *handle) {
   return handle -> image ? handle -> image : "Main Program Image";
 }
@@ -212,6 +251,7 @@ resolve_handle_t * _resolve_handle_try_open(resolve_handle_t *handle, char *dir)
   } else {
     debug(resolve, "Attempting to open main program module");
   }
+  _resolve_opening = handle;
 #ifdef HAVE_DLFCN_H
   dlerror();
   libhandle = dlopen(image ? path : NULL, RTLD_NOW | RTLD_GLOBAL);
@@ -219,6 +259,7 @@ resolve_handle_t * _resolve_handle_try_open(resolve_handle_t *handle, char *dir)
   SetLastError(0);
   libhandle = (image) ? LoadLibrary(TEXT(path)) : GetModuleHandle(NULL);
 #endif /* HAVE_DLFCN_H */
+  _resolve_opening = NULL;
   res = _resolve_result_create((void *) libhandle);
   handle -> handle = (lib_handle_t) res -> result;
   if (handle -> handle) {
@@ -319,13 +360,68 @@ resolve_result_t * _resolve_handle_get_function(resolve_handle_t *handle, char *
 
 /* ------------------------------------------------------------------------ */
 
+int _resolve_static_cmp(const void *s1, const void *s2) {
+  return strcmp(((resolve_static_t *) s1) -> name, ((resolve_static_t *) s2) -> name);
+}
+
+/*
+ * Tables registered while no library was being opened belong to libraries
+ * linked into the executable, and are searched with the main program image.
+ */
+int _resolve_registry_owned_by(resolve_registry_t *registry, resolve_handle_t *handle) {
+  return (registry -> owner)
+    ? registry -> owner == handle
+    : !handle -> image;
+}
+
+void_t _resolve_registry_lookup(resolve_handle_t *handle, char *func_name) {
+  resolve_registry_t *registry;
+  resolve_static_t    key;
+  resolve_static_t   *found;
+
+  key.name = func_name;
+  for (registry = _resolve_registries; registry; registry = registry -> next) {
+    if (!_resolve_registry_owned_by(registry, handle)) {
+      continue;
+    }
+    found = bsearch(&key, registry -> functions, registry -> size,
+                    sizeof(resolve_static_t), _resolve_static_cmp);
+    if (found) {
+      return found -> fnc;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Drops the tables of a library that is about to be closed. Tables are only
+ * removed with the resolve mutex held or from resolve_free, and lookups hold
+ * the mutex as well.
+ */
+void _resolve_registry_remove(resolve_handle_t *handle) {
+  resolve_registry_t * volatile *prev;
+  resolve_registry_t            *registry;
+
+  for (prev = &_resolve_registries; (registry = *prev); ) {
+    if (_resolve_registry_owned_by(registry, handle)) {
+      debug(resolve, "Removing static function table of '%s'", _resolve_handle_tostring(handle));
+      *prev = registry -> next;
+      free(registry);
+    } else {
+      prev = &registry -> next;
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------ */
+
 void __resolve_init(void) {
   logging_register_category("resolve", &resolve_debug);
   assert(!_singleton);
   _singleton = NEW(resolve_t);
 
   _singleton -> images = NULL;
-  _singleton -> functions = strvoid_dict_create();
+  _singleton -> functions = cache_create(NULL);
   _resolve_mutex = mutex_create();
   if (!_resolve_open(_singleton, NULL)) {
     error("Could not load main program image");
@@ -347,7 +443,7 @@ OBLCORE_IMPEXP void resolve_free(void) {
       _singleton -> images = image -> next;
       _resolve_handle_free(image);
     }
-    dict_free(_singleton -> functions);
+    cache_free(_singleton -> functions);
     free(_singleton);
     _singleton = NULL;
   }
@@ -356,12 +452,25 @@ OBLCORE_IMPEXP void resolve_free(void) {
 resolve_t * _resolve_open(resolve_t *resolve, char *image) {
   resolve_t        *ret = NULL;
   resolve_handle_t *handle;
+  resolve_handle_t *open;
 
   mutex_lock(_resolve_mutex);
-  if ((handle = _resolve_handle_create(image))) {
+  handle = _resolve_handle_create(image);
+  for (open = resolve -> images; open; open = open -> next) {
+    if (_resolve_handle_is(open, handle)) {
+      break;
+    }
+  }
+  if (open) {
+    debug(resolve, "Library '%s' already opened", _resolve_handle_tostring(open));
+    _resolve_handle_free(handle);
+    ret = resolve;
+  } else if (_resolve_handle_open(handle)) {
     handle -> next = resolve -> images;
     resolve -> images = handle;
     ret = resolve;
+  } else {
+    _resolve_handle_free(handle);
   }
   mutex_unlock(_resolve_mutex);
   return ret;
@@ -385,16 +494,26 @@ OBLCORE_IMPEXP void_t resolve_resolve(resolve_t *resolve, char *func_name) {
     func_name = copy;
     func_name[strchr(func_name, '(') - func_name] = 0;
   }
-  // TODO synchronize
-  ret = (void_t) dict_get(resolve -> functions, func_name);
-  if (ret) {
+  /*
+   * Hits don't lock. Only functions that were found are cached, since a
+   * library opened later may provide the ones that weren't, so a miss
+   * always goes back to the images.
+   */
+  if ((ret = (void_t) cache_get(resolve -> functions, func_name))) {
     debug(resolve, "Function '%s' was cached", func_name);
+    free(copy);
     return ret;
   }
+  mutex_lock(_resolve_mutex);
 
   debug(resolve, "dlsym('%s')", func_name);
   ret = NULL;
   for (handle = resolve -> images; handle && !err && !ret; handle = handle -> next) {
+    if ((ret = _resolve_registry_lookup(handle, func_name))) {
+      debug(resolve, "Function '%s' found in static table of '%s'",
+            func_name, _resolve_handle_tostring(handle));
+      continue;
+    }
     result = _resolve_handle_get_function(handle, func_name);
     if (result -> errorcode) {
       error("Error resolving function '%s' in library '%s': %s (%d)",
@@ -405,11 +524,51 @@ OBLCORE_IMPEXP void_t resolve_resolve(resolve_t *resolve, char *func_name) {
     ret = result -> result;
     _resolve_result_free(result);
   }
-  dict_put(resolve -> functions, strdup(func_name), ret);
+  if (ret) {
+    cache_put(resolve -> functions, func_name, (void *) ret);
+  }
+  mutex_unlock(_resolve_mutex);
   free(copy);
   return ret;
 }
 
+/*
+ * Registers a static table of functions. The table must be sorted by name
+ * and terminated by an entry with a NULL name. Returns the number of
+ * functions in the table, or -1 if the table is not sorted.
+ *
+ * This is called from library constructors, before core_init has run, so it
+ * can not use logging or any of the container types. Tables are pushed onto
+ * the registry chain with a compare-and-swap. A table belongs to the library
+ * resolve was opening when it was registered, or to the main program image
+ * if there was none. It is only searched when a function is resolved through
+ * that image, in the same order dlsym would search the images, and it is
+ * removed when the image is closed.
+ */
+OBLCORE_IMPEXP int resolve_register_functions(resolve_static_t *functions) {
+  resolve_registry_t *registry;
+  int                 size;
+
+  for (size = 0; functions[size].name; size++) {
+    if (size && (strcmp(functions[size - 1].name, functions[size].name) > 0)) {
+      return -1;
+    }
+  }
+  for (registry = _resolve_registries; registry; registry = registry -> next) {
+    if (registry -> functions == functions) {
+      return size;
+    }
+  }
+  registry = NEW(resolve_registry_t);
+  registry -> functions = functions;
+  registry -> size = size;
+  registry -> owner = _resolve_opening;
+  do {
+    registry -> next = _resolve_registries;
+  } while (!__sync_bool_compare_and_swap(&_resolve_registries, registry -> next, registry));
+  return size;
+}
+
 OBLCORE_IMPEXP int resolve_library(char *library) {
   resolve_t *resolve;
 
@@ -427,3 +586,78 @@ OBLCORE_IMPEXP void_t resolve_function(char *func_name) {
   fnc = resolve_resolve(resolve, func_name);
   return fnc;
 }
+
+/* -- B U I L D  I D S ---------------------------------------------------- */
+
+#if defined(HAVE_LINK_H) && defined(HAVE_DLFCN_H)
+static void _resolve_build_id_note(resolve_build_id_t *build_id, struct dl_phdr_info *info) {
+  const ElfW(Nhdr) *note;
+  const char       *ptr;
+  const char       *end;
+  int               ix;
+
+  for (ix = 0; ix < info -> dlpi_phnum; ix++) {
+    if (info -> dlpi_phdr[ix].p_type != PT_NOTE) {
+      continue;
+    }
+    ptr = (const char *) (info -> dlpi_addr + info -> dlpi_phdr[ix].p_vaddr);
+    end = ptr + info -> dlpi_phdr[ix].p_memsz;
+    while (ptr + sizeof(ElfW(Nhdr)) <= end) {
+      note = (const ElfW(Nhdr) *) ptr;
+      ptr += sizeof(ElfW(Nhdr)) + ((note -> n_namesz + 3) & ~3);
+      if ((note -> n_type == NT_GNU_BUILD_ID) && (ptr + note -> n_descsz <= end)) {
+        build_id -> len = (note -> n_descsz < build_id -> sz) ? note -> n_descsz : build_id -> sz;
+        memcpy(build_id -> buf, ptr, build_id -> len);
+        return;
+      }
+      ptr += (note -> n_descsz + 3) & ~3;
+    }
+  }
+}
+
+/*
+ * The first object reported by dl_iterate_phdr is the executable. Shared
+ * objects are recognized by their load address.
+ */
+static int _resolve_build_id_callback(struct dl_phdr_info *info, _unused_ size_t size, void *data) {
+  resolve_build_id_t *build_id = (resolve_build_id_t *) data;
+  int                 match;
+
+  match = (build_id -> base)
+    ? ((void *) info -> dlpi_addr == build_id -> base)
+    : build_id -> first;
+  build_id -> first = FALSE;
+  if (match) {
+    _resolve_build_id_note(build_id, info);
+  }
+  return match;
+}
+#endif /* HAVE_LINK_H && HAVE_DLFCN_H */
+
+/*
+ * Copies the GNU build id of the executable, or of the shared object
+ * containing addr if addr is not NULL, into buf. Returns the length of the
+ * id, truncated to sz bytes, or 0 if the object has no build id. Images of
+ * runtime state use this to recognize the build that wrote them.
+ */
+OBLCORE_IMPEXP unsigned int resolve_build_id(void *addr, unsigned char *buf, unsigned int sz) {
+  resolve_build_id_t build_id;
+#if defined(HAVE_LINK_H) && defined(HAVE_DLFCN_H)
+  Dl_info            info;
+#endif /* HAVE_LINK_H && HAVE_DLFCN_H */
+
+  memset(&build_id, 0, sizeof(build_id));
+  build_id.first = TRUE;
+  build_id.buf = buf;
+  build_id.sz = sz;
+#if defined(HAVE_LINK_H) && defined(HAVE_DLFCN_H)
+  if (addr) {
+    if (!dladdr(addr, &info)) {
+      return 0;
+    }
+    build_id.base = info.dli_fbase;
+  }
+  dl_iterate_phdr(_resolve_build_id_callback, &build_id);
+#endif /* HAVE_LINK_H && HAVE_DLFCN_H */
+  return build_id.len;
+}
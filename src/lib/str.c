@@ -221,7 +221,7 @@ data_t * _str_deserialize(str_t *str) {
   } else if (!strcmp(str -> buffer, "true")) {
     return data_true();
   } else if (!strcmp(str -> buffer, "false")) {
-    return data_true();
+    return data_false();
   } else {
     return (data_t *) _str_strip_quotes(str);
   }
@@ -281,7 +281,7 @@ str_t * _str_expand(str_t *str, size_t targetlen) {
     targetlen = str -> bufsize;
   }
   if (str -> bufsize < (targetlen + 1)) {
-    for (newsize = (size_t)(str -> bufsize * 1.6);
+    for (newsize = (size_t)(str -> bufsize * 1.6) + 1;
          newsize < (targetlen + 1);
          newsize = (size_t)(newsize * 1.6));
     oldbuf = str -> buffer;
@@ -409,10 +409,11 @@ str_t * str_copy_nchars(const char *buffer, size_t len) {
   str_t *ret;
   char  *b;
 
-  len = (len <= strlen(buffer)) ? len : strlen(buffer);
+  len = strnlen(buffer, len);
   ret = _str_initialize();
   b = (char *) new(len + 1);
-  strncpy(b, buffer, len);
+  memcpy(b, buffer, len);
+  b[len] = 0;
   ret -> buffer = b;
   ret -> len = len;
   ret -> bufsize = ret -> len + 1;
@@ -697,11 +698,14 @@ str_t * str_append_chars(str_t *str, const char *other) {
 str_t * str_append_nchars(str_t *str, const char *other, size_t n) {
   str_t   *ret = NULL;
 
-  if (other && _str_expand(str, str_len(str) + n + 1)) {
-    strncat(str -> buffer, other, n);
-    str -> len += (strlen(other) > n) ? n : strlen(other);
-    str -> buffer[str -> len] = 0;
-    ret = str;
+  if (other) {
+    n = strnlen(other, n);
+    if (_str_expand(str, str -> len + n + 1)) {
+      memcpy(str -> buffer + str -> len, other, n);
+      str -> len += n;
+      str -> buffer[str -> len] = 0;
+      ret = str;
+    }
   }
   return ret;
 }
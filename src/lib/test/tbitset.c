@@ -0,0 +1,116 @@
+/*
+ * tbitset.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tcore.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <bitset.h>
+
+static void * _sum_reducer(void *bit, int *sum) {
+  *sum += (int) (intptr_t) bit;
+  return sum;
+}
+
+START_TEST(test_bitset_create)
+  bitset_t *set = bitset_create(10);
+
+  ck_assert_ptr_ne(set, NULL);
+  ck_assert_int_eq(bitset_size(set), 0);
+  ck_assert(bitset_empty(set));
+  ck_assert_int_eq(bitset_has(set, 3), 0);
+  ck_assert_int_eq(bitset_has(set, 1000), 0);
+  bitset_free(set);
+END_TEST
+
+START_TEST(test_bitset_add_remove)
+  bitset_t *set = bitset_create(10);
+
+  bitset_add(set, 3);
+  bitset_add(set, 7);
+  bitset_add(set, 3);
+  ck_assert_int_eq(bitset_size(set), 2);
+  ck_assert(bitset_has(set, 3));
+  ck_assert(bitset_has(set, 7));
+  bitset_add(set, 500);
+  ck_assert(bitset_has(set, 500));
+  ck_assert_int_eq(bitset_size(set), 3);
+  bitset_remove(set, 3);
+  bitset_remove(set, 2000);
+  ck_assert_int_eq(bitset_has(set, 3), 0);
+  ck_assert_int_eq(bitset_size(set), 2);
+  bitset_clear(set);
+  ck_assert(bitset_empty(set));
+  bitset_free(set);
+END_TEST
+
+START_TEST(test_bitset_union)
+  bitset_t *s1 = bitset_create(10);
+  bitset_t *s2 = bitset_create(200);
+
+  bitset_add(s1, 1);
+  bitset_add(s2, 1);
+  ck_assert_int_eq(bitset_union(s1, s2), 0);
+  bitset_add(s2, 150);
+  ck_assert_int_ne(bitset_union(s1, s2), 0);
+  ck_assert(bitset_has(s1, 150));
+  ck_assert_int_eq(bitset_union(s1, s2), 0);
+  ck_assert_int_eq(bitset_size(s1), 2);
+  bitset_free(s1);
+  bitset_free(s2);
+END_TEST
+
+START_TEST(test_bitset_disjoint)
+  bitset_t *s1 = bitset_create(10);
+  bitset_t *s2 = bitset_create(100);
+
+  bitset_add(s1, 4);
+  bitset_add(s2, 5);
+  bitset_add(s2, 90);
+  ck_assert(bitset_disjoint(s1, s2));
+  ck_assert(bitset_disjoint(s1, NULL));
+  bitset_add(s1, 90);
+  ck_assert_int_eq(bitset_disjoint(s1, s2), 0);
+  bitset_free(s1);
+  bitset_free(s2);
+END_TEST
+
+START_TEST(test_bitset_reduce_tostring)
+  bitset_t *set = bitset_create(10);
+  int       sum = 0;
+
+  bitset_add(set, 2);
+  bitset_add(set, 9);
+  bitset_add(set, 70);
+  bitset_reduce(set, (reduce_t) _sum_reducer, &sum);
+  ck_assert_int_eq(sum, 81);
+  ck_assert_str_eq(bitset_tostring(set), "{2, 9, 70}");
+  bitset_free(set);
+END_TEST
+
+void bitset_init(void) {
+  TCase *tc = tcase_create("Bitset");
+
+  tcase_add_test(tc, test_bitset_create);
+  tcase_add_test(tc, test_bitset_add_remove);
+  tcase_add_test(tc, test_bitset_union);
+  tcase_add_test(tc, test_bitset_disjoint);
+  tcase_add_test(tc, test_bitset_reduce_tostring);
+  add_tcase(tc);
+}
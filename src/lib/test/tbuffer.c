@@ -98,6 +98,50 @@ START_TEST(test_file_read)
   file_free(file);
 END_TEST
 
+START_TEST(test_file_readline)
+  file_t *file;
+  char   *line;
+  char    buf[21];
+  int     ret;
+
+  file = file_open("buffertest.txt");
+  ck_assert_ptr_ne(file, NULL);
+  stream_set_bufsize((stream_t *) file, 4);
+  line = file_readline(file);
+  ck_assert_str_eq(line, "0123456789abcdefghijklmnopqrstuvwxyz");
+  free(line);
+  ck_assert_ptr_eq(file_readline(file), NULL);
+  ck_assert_int_eq(stream_eof((stream_t *) file), 1);
+
+  ck_assert_int_eq(file_seek(file, 10), 10);
+  memset(buf, 0, sizeof(buf));
+  ret = stream_read((stream_t *) file, buf, 5);
+  ck_assert_int_eq(ret, 5);
+  ck_assert_str_eq(buf, "abcde");
+  memset(buf, 0, sizeof(buf));
+  ret = stream_read((stream_t *) file, buf, sizeof(buf) - 1);
+  ck_assert_int_eq(ret, 20);
+  ck_assert_str_eq(buf, "fghijklmnopqrstuvwxy");
+  file_free(file);
+END_TEST
+
+START_TEST(test_file_seek_write)
+  file_t *file;
+  char    buf[11];
+
+  file = file_open_ext("seektest.txt", "w+", "u=rw");
+  ck_assert_ptr_ne(file, NULL);
+  ck_assert_int_eq(stream_write((stream_t *) file, "0123456789", 10), 0);
+  ck_assert_int_eq(file_seek(file, 2), 2);
+  ck_assert_int_eq(stream_write((stream_t *) file, "ab", 2), 0);
+  ck_assert_int_eq(file_seek(file, 0), 0);
+  memset(buf, 0, sizeof(buf));
+  ck_assert_int_eq(stream_read((stream_t *) file, buf, 10), 10);
+  ck_assert_str_eq(buf, "01ab456789");
+  file_free(file);
+  unlink("seektest.txt");
+END_TEST
+
 void read_from_reader(reader_t *reader) {
   char buf[21];
   int  ret;
@@ -152,6 +196,8 @@ static void _init_tbuffer(void) {
   tcase_add_test(tc, test_file_create);
   tcase_add_test(tc, test_file_open);
   tcase_add_test(tc, test_file_read);
+  tcase_add_test(tc, test_file_readline);
+  tcase_add_test(tc, test_file_seek_write);
   tcase_add_test(tc, test_str_create);
   tcase_add_test(tc, test_str_read);
   tcase_add_test(tc, test_reader_read);
@@ -0,0 +1,116 @@
+/*
+ * tcache.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tcore.h"
+#include <stdio.h>
+
+#include <cache.h>
+#include <data.h>
+#include <future.h>
+#include <thread.h>
+
+#define WORKERS       4
+#define KEYS          2000
+
+typedef struct _cacheworker {
+  cache_t  *cache;
+  future_t *future;
+  int       first;
+} cacheworker_t;
+
+static long * _count_reducer(void *value, long *count) {
+  (*count) += (intptr_t) value;
+  return count;
+}
+
+/*
+ * Every worker adds its own keys and the ones of the next worker, and reads
+ * back all keys added so far while the others keep growing the cache.
+ */
+static void * _fill(cacheworker_t *worker) {
+  char  key[20];
+  int   ix;
+  int   found = 0;
+
+  for (ix = worker -> first; ix < worker -> first + 2 * KEYS; ix++) {
+    snprintf(key, 20, "key%d", ix % (WORKERS * KEYS));
+    cache_put(worker -> cache, key, (void *) (intptr_t) 1);
+  }
+  for (ix = worker -> first; ix < worker -> first + 2 * KEYS; ix++) {
+    snprintf(key, 20, "key%d", ix % (WORKERS * KEYS));
+    if (cache_get(worker -> cache, key)) {
+      found++;
+    }
+  }
+  future_complete(worker -> future, int_to_data(found));
+  return NULL;
+}
+
+START_TEST(test_cache_put_get)
+  cache_t *cache = cache_create(NULL);
+  char     key[20];
+  long     count = 0;
+  int      ix;
+
+  ck_assert_ptr_eq(cache_get(cache, "foo"), NULL);
+  ck_assert_ptr_eq(cache_put(cache, "foo", (void *) 1), (void *) 1);
+  ck_assert_ptr_eq(cache_put(cache, "foo", (void *) 2), (void *) 1);
+  ck_assert_ptr_eq(cache_get(cache, "foo"), (void *) 1);
+  for (ix = 0; ix < KEYS; ix++) {
+    snprintf(key, 20, "key%d", ix);
+    cache_put(cache, key, (void *) 1);
+  }
+  ck_assert_int_eq(cache_size(cache), KEYS + 1);
+  ck_assert_ptr_eq(cache_get(cache, "foo"), (void *) 1);
+  ck_assert_ptr_eq(cache_get(cache, "key42"), (void *) 1);
+  ck_assert_ptr_eq(cache_get(cache, "key-1"), NULL);
+  cache_reduce(cache, (reduce_t) _count_reducer, &count);
+  ck_assert_int_eq(count, KEYS + 1);
+  cache_free(cache);
+END_TEST
+
+START_TEST(test_cache_threads)
+  cache_t       *cache = cache_create(NULL);
+  cacheworker_t  workers[WORKERS];
+  thread_t      *thread;
+  int            ix;
+
+  for (ix = 0; ix < WORKERS; ix++) {
+    workers[ix].cache = cache;
+    workers[ix].future = future_create(NULL, NULL);
+    workers[ix].first = ix * KEYS;
+    thread = thread_new("cache", (threadproc_t) _fill, &workers[ix]);
+    ck_assert_ptr_ne(thread, NULL);
+    thread_free(thread);
+  }
+  for (ix = 0; ix < WORKERS; ix++) {
+    ck_assert_int_eq(data_intval(future_wait(workers[ix].future)), 2 * KEYS);
+    future_free(workers[ix].future);
+  }
+  ck_assert_int_eq(cache_size(cache), WORKERS * KEYS);
+  cache_free(cache);
+END_TEST
+
+void tcache_init(void) {
+  TCase *tc = tcase_create("Cache");
+
+  tcase_add_test(tc, test_cache_put_get);
+  tcase_add_test(tc, test_cache_threads);
+  add_tcase(tc);
+}
@@ -0,0 +1,182 @@
+/*
+ * tchannel.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tcore.h"
+#include <errno.h>
+#include <stdio.h>
+
+#include <channel.h>
+#include <coroutine.h>
+#include <data.h>
+#include <future.h>
+#include <thread.h>
+
+#define PRODUCERS     4
+#define CONSUMERS     4
+#define MESSAGES      5000
+
+typedef struct _pipeline {
+  channel_t *channel;
+  future_t  *future;
+  int        first;
+} pipeline_t;
+
+static void * _produce(pipeline_t *p) {
+  int     ix;
+  data_t *value;
+
+  for (ix = p -> first; ix < p -> first + MESSAGES; ix++) {
+    value = int_to_data(ix);
+    channel_send(p -> channel, value, -1);
+    data_free(value);
+  }
+  future_complete(p -> future, int_to_data(MESSAGES));
+  return NULL;
+}
+
+static void * _consume(pipeline_t *p) {
+  long    sum = 0;
+  data_t *value;
+
+  while (!channel_recv(p -> channel, &value, -1)) {
+    sum += data_intval(value);
+    data_free(value);
+  }
+  future_complete(p -> future, int_to_data(sum));
+  return NULL;
+}
+
+static void _run_pipeline(int green) {
+  channel_t  *channel = channel_create(16);
+  pipeline_t  producers[PRODUCERS];
+  pipeline_t  consumers[CONSUMERS];
+  thread_t   *thread;
+  long        sum = 0;
+  long        expected = 0;
+  int         ix;
+
+  for (ix = 0; ix < CONSUMERS; ix++) {
+    consumers[ix].channel = channel;
+    consumers[ix].future = future_create(NULL, NULL);
+    thread = (green)
+      ? coroutine_spawn("consumer", (threadproc_t) _consume, &consumers[ix])
+      : thread_new("consumer", (threadproc_t) _consume, &consumers[ix]);
+    ck_assert_ptr_ne(thread, NULL);
+    thread_free(thread);
+  }
+  for (ix = 0; ix < PRODUCERS; ix++) {
+    producers[ix].channel = channel;
+    producers[ix].future = future_create(NULL, NULL);
+    producers[ix].first = ix * MESSAGES;
+    thread = (green)
+      ? coroutine_spawn("producer", (threadproc_t) _produce, &producers[ix])
+      : thread_new("producer", (threadproc_t) _produce, &producers[ix]);
+    ck_assert_ptr_ne(thread, NULL);
+    thread_free(thread);
+  }
+  for (ix = 0; ix < PRODUCERS; ix++) {
+    ck_assert_int_eq(data_intval(future_wait(producers[ix].future)), MESSAGES);
+    future_free(producers[ix].future);
+  }
+  channel_close(channel);
+  for (ix = 0; ix < CONSUMERS; ix++) {
+    sum += data_intval(future_wait(consumers[ix].future));
+    future_free(consumers[ix].future);
+  }
+  for (ix = 0; ix < PRODUCERS * MESSAGES; ix++) {
+    expected += ix;
+  }
+  ck_assert_int_eq(sum, expected);
+  ck_assert_int_eq(channel_size(channel), 0);
+  channel_free(channel);
+}
+
+START_TEST(test_channel_send_recv)
+  channel_t *channel = channel_create(2);
+  data_t    *value;
+
+  ck_assert_ptr_ne(channel, NULL);
+  ck_assert_ptr_eq(channel_create(0), NULL);
+  ck_assert_int_eq(channel_send(channel, int_to_data(1), 0), 0);
+  ck_assert_int_eq(channel_send(channel, int_to_data(2), 0), 0);
+  ck_assert_int_eq(channel_size(channel), 2);
+  ck_assert_int_eq(channel_send(channel, int_to_data(3), 20), -1);
+  ck_assert_int_eq(errno, ETIMEDOUT);
+  ck_assert_int_eq(channel_recv(channel, &value, 0), 0);
+  ck_assert_int_eq(data_intval(value), 1);
+  ck_assert_int_eq(channel_recv(channel, &value, 0), 0);
+  ck_assert_int_eq(data_intval(value), 2);
+  ck_assert_int_eq(channel_recv(channel, &value, 20), -1);
+  ck_assert_int_eq(errno, ETIMEDOUT);
+  channel_free(channel);
+END_TEST
+
+START_TEST(test_channel_close)
+  channel_t *channel = channel_create(1);
+  data_t    *value;
+
+  ck_assert_int_eq(channel_send(channel, int_to_data(42), 0), 0);
+  ck_assert_int_eq(channel_close(channel), 0);
+  ck_assert(channel_closed(channel));
+  ck_assert_int_eq(channel_send(channel, int_to_data(43), 0), -1);
+  ck_assert_int_eq(errno, EPIPE);
+  ck_assert_int_eq(channel_recv(channel, &value, -1), 0);
+  ck_assert_int_eq(data_intval(value), 42);
+  ck_assert_int_eq(channel_recv(channel, &value, -1), -1);
+  ck_assert_int_eq(errno, EPIPE);
+  channel_free(channel);
+END_TEST
+
+START_TEST(test_channel_select)
+  channel_t *channels[2];
+  data_t    *value;
+
+  channels[0] = channel_create(1);
+  channels[1] = channel_create(1);
+  ck_assert_int_eq(channel_select(channels, 2, &value, 20), -1);
+  ck_assert_int_eq(errno, ETIMEDOUT);
+  ck_assert_int_eq(channel_send(channels[1], int_to_data(7), 0), 0);
+  ck_assert_int_eq(channel_select(channels, 2, &value, -1), 1);
+  ck_assert_int_eq(data_intval(value), 7);
+  channel_close(channels[0]);
+  channel_close(channels[1]);
+  ck_assert_int_eq(channel_select(channels, 2, &value, -1), -1);
+  ck_assert_int_eq(errno, EPIPE);
+  channel_free(channels[0]);
+  channel_free(channels[1]);
+END_TEST
+
+START_TEST(test_channel_threads)
+  _run_pipeline(FALSE);
+END_TEST
+
+START_TEST(test_channel_green)
+  _run_pipeline(TRUE);
+END_TEST
+
+void tchannel_init(void) {
+  TCase *tc = tcase_create("Channel");
+
+  tcase_add_test(tc, test_channel_send_recv);
+  tcase_add_test(tc, test_channel_close);
+  tcase_add_test(tc, test_channel_select);
+  tcase_add_test(tc, test_channel_threads);
+  tcase_add_test(tc, test_channel_green);
+  add_tcase(tc);
+}
@@ -23,7 +23,14 @@
 void init_suite(int argc, char **argv) {
   list_init();
   dict_init();
+  bitset_init();
   tdatalist_init();
+  tpack_init();
+  tfuture_init();
+  tcoroutine_init();
+  tchannel_init();
+  tmutex_init();
+  tcache_init();
   str_test_init();
   str_format_init();
   resolve_init(argv[0]);
@@ -25,7 +25,14 @@
 
 extern void list_init(void);
 extern void dict_init(void);
+extern void bitset_init(void);
 extern void tdatalist_init();
+extern void tpack_init(void);
+extern void tfuture_init(void);
+extern void tcoroutine_init(void);
+extern void tchannel_init(void);
+extern void tmutex_init(void);
+extern void tcache_init(void);
 extern void str_test_init(void);
 extern void str_format_init(void);
 extern void resolve_init(char *);
@@ -0,0 +1,168 @@
+/*
+ * tcoroutine.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tcore.h"
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <coroutine.h>
+#include <data.h>
+#include <future.h>
+#include <mutex.h>
+#include <thread.h>
+
+static int pipefd[2];
+
+static void * _green_self(future_t *future) {
+  thread_t *self = thread_self();
+
+  coroutine_yield();
+  future_complete(future, int_as_bool(self -> coroutine && (self == thread_self())));
+  return NULL;
+}
+
+static void * _green_sleep(future_t *future) {
+  coroutine_sleep(50);
+  future_complete(future, int_to_data(1));
+  return NULL;
+}
+
+static void * _green_wait(future_t *future) {
+  int ret;
+
+  ret = coroutine_wait_fd(pipefd[0], CoroutineRead, 1000);
+  future_complete(future, int_to_data((ret) ? errno : 0));
+  return NULL;
+}
+
+static void * _green_timeout(future_t *future) {
+  int ret;
+
+  ret = coroutine_wait_fd(pipefd[0], CoroutineRead, 50);
+  future_complete(future, int_to_data((ret) ? errno : 0));
+  return NULL;
+}
+
+static void * _green_interrupted(future_t *future) {
+  int ret;
+
+  ret = coroutine_wait_fd(pipefd[0], CoroutineRead, -1);
+  future_complete(future, int_to_data((ret) ? errno : 0));
+  return NULL;
+}
+
+static void * _green_locked(future_t *future) {
+  mutex_t   *mutex = mutex_create();
+  pthread_t  carrier;
+
+  mutex_lock(mutex);
+  carrier = pthread_self();
+  coroutine_sleep(20);
+  future_complete(future, int_as_bool(pthread_equal(carrier, pthread_self())));
+  mutex_unlock(mutex);
+  mutex_free(mutex);
+  return NULL;
+}
+
+START_TEST(test_coroutine_self)
+  future_t *future = future_create(NULL, NULL);
+  thread_t *thread;
+
+  thread = coroutine_spawn("Self Test", (threadproc_t) _green_self, future);
+  ck_assert_ptr_ne(thread, NULL);
+  ck_assert(data_intval(future_wait(future)));
+  ck_assert_ptr_eq(coroutine_current(), NULL);
+  thread_free(thread);
+  future_free(future);
+END_TEST
+
+START_TEST(test_coroutine_sleep)
+  future_t *future = future_create(NULL, NULL);
+  thread_t *thread;
+
+  thread = coroutine_spawn("Sleep Test", (threadproc_t) _green_sleep, future);
+  ck_assert_ptr_ne(thread, NULL);
+  ck_assert(!future_done(future));
+  ck_assert_int_eq(data_intval(future_wait(future)), 1);
+  thread_free(thread);
+  future_free(future);
+END_TEST
+
+START_TEST(test_coroutine_wait_fd)
+  future_t *future = future_create(NULL, NULL);
+  thread_t *thread;
+  char      c;
+
+  ck_assert_int_eq(pipe(pipefd), 0);
+  thread = coroutine_spawn("Wait Test", (threadproc_t) _green_wait, future);
+  usleep(20000);
+  ck_assert(!future_done(future));
+  ck_assert_int_eq(write(pipefd[1], "x", 1), 1);
+  ck_assert_int_eq(data_intval(future_wait(future)), 0);
+  ck_assert_int_eq(read(pipefd[0], &c, 1), 1);
+  thread_free(thread);
+  future_free(future);
+
+  future = future_create(NULL, NULL);
+  thread = coroutine_spawn("Timeout Test", (threadproc_t) _green_timeout, future);
+  ck_assert_int_eq(data_intval(future_wait(future)), ETIMEDOUT);
+  thread_free(thread);
+  future_free(future);
+  close(pipefd[0]);
+  close(pipefd[1]);
+END_TEST
+
+START_TEST(test_coroutine_interrupt)
+  future_t *future = future_create(NULL, NULL);
+  thread_t *thread;
+
+  ck_assert_int_eq(pipe(pipefd), 0);
+  thread = coroutine_spawn("Interrupt Test", (threadproc_t) _green_interrupted, future);
+  usleep(20000);
+  ck_assert(!future_done(future));
+  ck_assert_int_eq(thread_interrupt(thread), 0);
+  ck_assert_int_eq(data_intval(future_wait(future)), EINTR);
+  thread_free(thread);
+  future_free(future);
+  close(pipefd[0]);
+  close(pipefd[1]);
+END_TEST
+
+START_TEST(test_coroutine_locked)
+  future_t *future = future_create(NULL, NULL);
+  thread_t *thread;
+
+  thread = coroutine_spawn("Lock Test", (threadproc_t) _green_locked, future);
+  ck_assert_ptr_ne(thread, NULL);
+  ck_assert(data_intval(future_wait(future)));
+  thread_free(thread);
+  future_free(future);
+END_TEST
+
+void tcoroutine_init(void) {
+  TCase *tc = tcase_create("Coroutine");
+
+  tcase_add_test(tc, test_coroutine_self);
+  tcase_add_test(tc, test_coroutine_sleep);
+  tcase_add_test(tc, test_coroutine_wait_fd);
+  tcase_add_test(tc, test_coroutine_interrupt);
+  tcase_add_test(tc, test_coroutine_locked);
+  add_tcase(tc);
+}
@@ -0,0 +1,72 @@
+/*
+ * tfuture.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tcore.h"
+#include <stdio.h>
+
+#include <data.h>
+#include <future.h>
+#include <thread.h>
+
+static int cancelled = 0;
+
+static void cancel(future_t *future, void *context) {
+  cancelled++;
+}
+
+static void * complete(future_t *future) {
+  future_complete(future, int_to_data(42));
+  return NULL;
+}
+
+START_TEST(test_future_complete)
+  future_t *future;
+  thread_t *thread;
+
+  future = future_create(NULL, NULL);
+  ck_assert(!future_done(future));
+  thread = thread_new("Future Test", (threadproc_t) complete, future);
+  ck_assert_ptr_ne(thread, NULL);
+  ck_assert_int_eq(data_intval(future_wait(future)), 42);
+  ck_assert(future_done(future));
+  ck_assert_int_eq(future_complete(future, int_to_data(12)), -1);
+  ck_assert_int_eq(data_intval(future_wait(future)), 42);
+  future_free(future);
+END_TEST
+
+START_TEST(test_future_cancel)
+  future_t *future;
+
+  cancelled = 0;
+  future = future_create(cancel, NULL);
+  future_free(future);
+  ck_assert_int_eq(cancelled, 1);
+  future = future_completed(int_to_data(1));
+  future -> cancel = cancel;
+  future_free(future);
+  ck_assert_int_eq(cancelled, 1);
+END_TEST
+
+void tfuture_init(void) {
+  TCase *tc = tcase_create("Future");
+
+  tcase_add_test(tc, test_future_complete);
+  tcase_add_test(tc, test_future_cancel);
+  add_tcase(tc);
+}
@@ -0,0 +1,170 @@
+/*
+ * tmutex.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tcore.h"
+#include <stdio.h>
+#include <string.h>
+
+#include <data.h>
+#include <future.h>
+#include <mutex.h>
+#include <thread.h>
+#include <typedescr.h>
+
+#define WORKERS       4
+#define ROUNDS        10000
+
+typedef struct _counter {
+  mutex_t  *mutex;
+  rwlock_t *rwlock;
+  long      count;
+} counter_t;
+
+typedef struct _worker {
+  counter_t *counter;
+  future_t  *future;
+} worker_t;
+
+/* Mutex and RWLock are registered by the type system */
+static void _setup(void) {
+  typedescr_init();
+}
+
+static void * _count_mutex(worker_t *worker) {
+  counter_t *counter = worker -> counter;
+  int        ix;
+
+  for (ix = 0; ix < ROUNDS; ix++) {
+    mutex_lock(counter -> mutex);
+    counter -> count++;
+    mutex_unlock(counter -> mutex);
+  }
+  future_complete(worker -> future, int_to_data(ix));
+  return NULL;
+}
+
+static void * _count_rwlock(worker_t *worker) {
+  counter_t *counter = worker -> counter;
+  long       seen;
+  int        ix;
+
+  for (ix = 0; ix < ROUNDS; ix++) {
+    if (ix % 4) {
+      rwlock_rdlock(counter -> rwlock);
+      seen = counter -> count;
+      rwlock_unlock(counter -> rwlock);
+      (void) seen;
+    } else {
+      rwlock_wrlock(counter -> rwlock);
+      counter -> count++;
+      rwlock_unlock(counter -> rwlock);
+    }
+  }
+  future_complete(worker -> future, int_to_data(ix));
+  return NULL;
+}
+
+static void _run_workers(counter_t *counter, threadproc_t proc) {
+  worker_t  workers[WORKERS];
+  thread_t *thread;
+  int       ix;
+
+  for (ix = 0; ix < WORKERS; ix++) {
+    workers[ix].counter = counter;
+    workers[ix].future = future_create(NULL, NULL);
+  }
+  for (ix = 0; ix < WORKERS; ix++) {
+    thread = thread_new("counter", proc, &workers[ix]);
+    ck_assert_ptr_ne(thread, NULL);
+    thread_free(thread);
+  }
+  for (ix = 0; ix < WORKERS; ix++) {
+    ck_assert_int_eq(data_intval(future_wait(workers[ix].future)), ROUNDS);
+    future_free(workers[ix].future);
+  }
+}
+
+START_TEST(test_mutex_recursive)
+  mutex_t *mutex = mutex_create_withname("recursive");
+  mutex_t *plain = mutex_create_with_flags("plain", MutexNone);
+
+  ck_assert_int_eq(mutex_lock(mutex), 0);
+  ck_assert_int_eq(mutex_trylock(mutex), 0);
+  ck_assert_int_eq(mutex_unlock(mutex), 0);
+  ck_assert_int_eq(mutex_unlock(mutex), 0);
+  ck_assert_int_eq(mutex -> stats.acquisitions, 1);
+  ck_assert_int_eq(mutex -> stats.contended, 0);
+
+  ck_assert_int_eq(mutex_lock(plain), 0);
+  ck_assert_int_eq(mutex_trylock(plain), 1);
+  ck_assert_int_eq(mutex_unlock(plain), 0);
+  mutex_free(mutex);
+  mutex_free(plain);
+END_TEST
+
+START_TEST(test_mutex_contention)
+  counter_t  counter;
+  mutex_t   *mutex = mutex_create_withname("contended");
+  char      *report;
+
+  memset(&counter, 0, sizeof(counter));
+  counter.mutex = mutex;
+  _run_workers(&counter, (threadproc_t) _count_mutex);
+  ck_assert_int_eq(counter.count, WORKERS * ROUNDS);
+  ck_assert_int_eq(mutex -> stats.acquisitions, WORKERS * ROUNDS);
+  ck_assert(mutex -> stats.contended <= mutex -> stats.acquisitions);
+  if (mutex -> stats.contended) {
+    report = mutex_report(0);
+    ck_assert_ptr_ne(strstr(report, "contended"), NULL);
+    free(report);
+  }
+  mutex_free(mutex);
+END_TEST
+
+START_TEST(test_rwlock)
+  counter_t  counter;
+  rwlock_t  *rwlock = rwlock_create("rwlock");
+
+  ck_assert_ptr_ne(rwlock, NULL);
+  ck_assert_int_eq(rwlock_rdlock(rwlock), 0);
+  ck_assert_int_eq(rwlock_tryrdlock(rwlock), 0);
+  ck_assert_int_eq(rwlock_trywrlock(rwlock), 1);
+  ck_assert_int_eq(rwlock_unlock(rwlock), 0);
+  ck_assert_int_eq(rwlock_unlock(rwlock), 0);
+  ck_assert_int_eq(rwlock_wrlock(rwlock), 0);
+  ck_assert_int_eq(rwlock_tryrdlock(rwlock), 1);
+  ck_assert_int_eq(rwlock_unlock(rwlock), 0);
+
+  memset(&counter, 0, sizeof(counter));
+  counter.rwlock = rwlock;
+  _run_workers(&counter, (threadproc_t) _count_rwlock);
+  ck_assert_int_eq(counter.count, WORKERS * ROUNDS / 4);
+  ck_assert_int_eq(rwlock -> stats.acquisitions, WORKERS * ROUNDS + 3);
+  rwlock_free(rwlock);
+END_TEST
+
+void tmutex_init(void) {
+  TCase *tc = tcase_create("Mutex");
+
+  tcase_add_checked_fixture(tc, _setup, NULL);
+  tcase_add_test(tc, test_mutex_recursive);
+  tcase_add_test(tc, test_mutex_contention);
+  tcase_add_test(tc, test_rwlock);
+  add_tcase(tc);
+}
@@ -0,0 +1,143 @@
+/*
+ * tpack.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of Obelix.
+ *
+ * Obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tcore.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <arguments.h>
+#include <data.h>
+#include <dictionary.h>
+#include <exception.h>
+#include <pack.h>
+
+static data_t * roundtrip(data_t *value) {
+  char   *buf;
+  size_t  len;
+  data_t *ret;
+
+  buf = data_pack(value, &len);
+  ck_assert_ptr_ne(buf, NULL);
+  ret = data_unpack(buf, len, NULL);
+  free(buf);
+  ck_assert_ptr_ne(ret, NULL);
+  ck_assert(!data_is_exception(ret));
+  return ret;
+}
+
+START_TEST(test_pack_scalars)
+  data_t *ret;
+
+  ret = roundtrip(int_to_data(42));
+  ck_assert_int_eq(data_intval(ret), 42);
+  data_free(ret);
+  ret = roundtrip(int_to_data(-1234567890123L));
+  ck_assert(data_intval(ret) == -1234567890123L);
+  data_free(ret);
+  ret = roundtrip(flt_to_data(3.25));
+  ck_assert(data_floatval(ret) == 3.25);
+  data_free(ret);
+  ck_assert_ptr_eq(roundtrip(data_true()), data_true());
+  ck_assert_ptr_eq(roundtrip(data_false()), data_false());
+  ck_assert(data_isnull(roundtrip(data_null())));
+  ret = roundtrip((data_t *) str_copy_chars("packed"));
+  ck_assert_str_eq(data_tostring(ret), "packed");
+  data_free(ret);
+END_TEST
+
+START_TEST(test_pack_containers)
+  datalist_t   *list = datalist_create(NULL);
+  dictionary_t *dict = dictionary_create(NULL);
+  data_t       *ret;
+
+  datalist_push(list, int_to_data(1));
+  datalist_push(list, str_to_data("two"));
+  dictionary_set(dict, "list", (data_t *) list);
+  dictionary_set(dict, "pi", flt_to_data(3.14));
+  ret = roundtrip((data_t *) dict);
+  ck_assert(data_is_dictionary(ret));
+  ck_assert_int_eq(dictionary_size(data_as_dictionary(ret)), 2);
+  ck_assert_str_eq(data_tostring(ret), data_tostring(dict));
+  data_free(ret);
+  dictionary_free(dict);
+END_TEST
+
+START_TEST(test_pack_small)
+  char   *buf;
+  size_t  len;
+
+  buf = data_pack(int_to_data(-1), &len);
+  ck_assert_int_eq((int) len, 2);
+  free(buf);
+  buf = data_pack((data_t *) str_copy_chars("abc"), &len);
+  ck_assert_int_eq((int) len, 5);
+  free(buf);
+END_TEST
+
+START_TEST(test_pack_types)
+  arguments_t *args = arguments_create_args(2, int_to_data(1), str_to_data("two"));
+  data_t      *ex = data_exception(ErrorType, "Packed %d", 3);
+  data_t      *ret;
+  char        *buf;
+  size_t       len;
+
+  _arguments_set_kwarg(args, "key", flt_to_data(2.5));
+  ret = roundtrip((data_t *) args);
+  ck_assert(data_is_arguments(ret));
+  ck_assert_int_eq(arguments_args_size(data_as_arguments(ret)), 2);
+  ck_assert_str_eq(data_tostring(arguments_get_arg(data_as_arguments(ret), 1)), "two");
+  ck_assert(data_floatval(arguments_get_kwarg(data_as_arguments(ret), "key")) == 2.5);
+  data_free(ret);
+  arguments_free(args);
+  buf = data_pack(ex, &len);
+  ret = data_unpack(buf, len, NULL);
+  free(buf);
+  ck_assert(data_is_exception(ret));
+  ck_assert_int_eq(data_as_exception(ret) -> code, ErrorType);
+  ck_assert_str_eq(data_as_exception(ret) -> msg, "Packed 3");
+  data_free(ret);
+  data_free(ex);
+  ck_assert_int_eq(pack_register_type(Int, PackTypeArguments), -1);
+END_TEST
+
+START_TEST(test_unpack_malformed)
+  char    bad[] = { PackString, 10, 'a', 'b' };
+  char    tag[] = { 42 };
+  data_t *ret;
+  size_t  consumed = 1;
+
+  ret = data_unpack(bad, sizeof(bad), &consumed);
+  ck_assert(data_is_exception(ret));
+  ck_assert_int_eq((int) consumed, 0);
+  data_free(ret);
+  ret = data_unpack(tag, sizeof(tag), NULL);
+  ck_assert(data_is_exception(ret));
+  data_free(ret);
+END_TEST
+
+void tpack_init(void) {
+  TCase *tc = tcase_create("Pack");
+
+  tcase_add_test(tc, test_pack_scalars);
+  tcase_add_test(tc, test_pack_containers);
+  tcase_add_test(tc, test_pack_small);
+  tcase_add_test(tc, test_pack_types);
+  tcase_add_test(tc, test_unpack_malformed);
+  add_tcase(tc);
+}
@@ -102,6 +102,39 @@ START_TEST(test_resolve_foreign_function)
   ck_assert_ptr_ne(test, NULL);
 END_TEST
 
+static void * _static_hello(char *str) {
+  return str;
+}
+
+static void * _static_world(char *str _unused_) {
+  return NULL;
+}
+
+static resolve_static_t _static_functions[] = {
+  { .name = "test_static_hello", .fnc = (void_t) _static_hello },
+  { .name = "test_static_world", .fnc = (void_t) _static_world },
+  { .name = NULL, .fnc = NULL }
+};
+
+static resolve_static_t _unsorted_functions[] = {
+  { .name = "test_static_world", .fnc = (void_t) _static_world },
+  { .name = "test_static_hello", .fnc = (void_t) _static_hello },
+  { .name = NULL, .fnc = NULL }
+};
+
+START_TEST(test_resolve_register_functions)
+  helloworld_t  hw;
+
+  ck_assert_int_eq(resolve_register_functions(_unsorted_functions), -1);
+  ck_assert_int_eq(resolve_register_functions(_static_functions), 2);
+  ck_assert_int_eq(resolve_register_functions(_static_functions), 2);
+  hw = (helloworld_t) resolve_function("test_static_hello");
+  ck_assert_ptr_eq(hw, (helloworld_t) _static_hello);
+  ck_assert_str_eq(hw("test"), "test");
+  ck_assert_ptr_eq(resolve_function("test_static_world"), (void_t) _static_world);
+  ck_assert_ptr_eq(resolve_function("test_static_nope"), NULL);
+END_TEST
+
 void resolve_init(char *argv0) {
   TCase *tc = tcase_create("Resolve");
 
@@ -112,5 +145,6 @@ void resolve_init(char *argv0) {
   tcase_add_test(tc, test_resolve_library);
   tcase_add_test(tc, test_resolve_function);
   tcase_add_test(tc, test_resolve_foreign_function);
+  tcase_add_test(tc, test_resolve_register_functions);
   add_tcase(tc);
 }
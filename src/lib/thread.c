@@ -22,8 +22,10 @@
 #include <string.h>
 
 #include "libcore.h"
+#include <coroutine.h>
 #include <data.h>
 #include <datastack.h>
+#include <exception.h>
 #include <mutex.h>
 #include <thread.h>
 
@@ -75,6 +77,9 @@ static DWORD          self_ix;
 #endif /* HAVE_PTHREAD_H */
 
 int thread_debug = 0;
+volatile int thread_safepoint = 0;
+
+static volatile int _thread_signal = 0;
 
 /* ------------------------------------------------------------------------ */
 
@@ -97,21 +102,25 @@ void thread_init(void) {
 void * _thread_start_routine_wrapper(thread_ctx_t *ctx) {
   void         *ret = NULL;
   thread_t     *thread = thread_self();
+  char         *name = ctx -> name;
+  threadproc_t  start_routine = ctx -> start_routine;
+  void         *arg = ctx -> arg;
   int           retval = -1;
   int           dummy = 0;
 
-  if (ctx -> name) {
-    thread_setname(thread, ctx -> name);
+  if (name) {
+    thread_setname(thread, name);
   }
-  ctx -> child = thread_copy(thread);
   thread -> parent = thread_copy(ctx -> creator);
   retval = condition_acquire(ctx -> condition);
   if (!retval) {
+    /*
+     * The creator frees the context and its condition as soon as it sees
+     * the child, so neither can be touched after the wakeup.
+     */
+    ctx -> child = thread_copy(thread);
     retval = condition_wakeup(ctx -> condition);
   }
-  if (!retval) {
-    condition_free(ctx -> condition);
-  }
 
 #ifdef HAVE_PTHREAD_H
   if (!retval) {
@@ -128,13 +137,12 @@ void * _thread_start_routine_wrapper(thread_ctx_t *ctx) {
 #ifdef HAVE_PTHREAD_H
     pthread_cleanup_push((void (*)(void *)) _thread_free, thread);
 #endif /* HAVE_PTHREAD_H */
-    ret = ctx -> start_routine(ctx -> arg);
-    free(ctx);
+    ret = start_routine(arg);
 #ifdef HAVE_PTHREAD_H
     pthread_cleanup_pop(1);
 #endif /* HAVE_PTHREAD_H */
   } else {
-    error("Error starting thread '%s': %s", ctx -> name, strerror(errno));
+    error("Error starting thread '%s': %s", name, strerror(errno));
   }
   return ret;
 }
@@ -143,11 +151,19 @@ void _thread_free(thread_t *thread) {
   if (thread) {
     thread_free(thread -> parent);
     data_free(thread -> kernel);
-    data_free(thread -> exit_code);
+    if (thread -> exit_code) {
+      thread_safepoint_release();
+      data_free(thread -> exit_code);
+      thread -> exit_code = NULL;
+    }
+    if (__sync_bool_compare_and_swap(&thread -> interrupted, TRUE, FALSE)) {
+      thread_safepoint_release();
+    }
     if (thread -> onfree) {
       thread -> onfree(thread -> stack);
     }
     free(thread -> name);
+    coroutine_free(thread -> coroutine);
   }
 }
 
@@ -228,11 +244,14 @@ thread_t * thread_new(char *name, threadproc_t start_routine, void *arg) {
     }
 #endif /* HAVE_PTHREAD_H */
   }
-  if (!retval) {
+  while (!retval && !ctx -> child) {
     retval = condition_sleep(ctx -> condition);
   }
   if (!retval) {
     ret = ctx -> child;
+    condition_release(ctx -> condition);
+    condition_free(ctx -> condition);
+    free(ctx);
   }
 #ifdef HAVE_PTHREAD_H
   if (!retval) {
@@ -252,6 +271,7 @@ thread_t * thread_create(_thr_t thr_id, char *name) {
   ret = data_new(Thread, thread_t);
   ret -> thread = thr_id;
   ret -> exit_code = NULL;
+  ret -> interrupted = FALSE;
   ret -> kernel = NULL;
   ret -> stack = NULL;
   ret -> onfree = NULL;
@@ -265,15 +285,58 @@ thread_t * thread_create(_thr_t thr_id, char *name) {
   return ret;
 }
 
+/**
+ * Creates the thread object of a green thread. Its OS thread changes every
+ * time it is resumed, so it is identified by the coroutine instead.
+ */
+thread_t * thread_create_green(coroutine_t *coroutine, char *name) {
+  thread_t *ret;
+
+  ret = data_new(Thread, thread_t);
+  ret -> thread = _thread_self();
+  ret -> coroutine = coroutine;
+  ret -> name = strdup((name) ? name : "Green Thread");
+  ret -> mutex = mutex_create();
+  return ret;
+}
+
+/**
+ * Makes <code>thread</code> the thread object returned by thread_self() in
+ * the calling OS thread, and returns the previous one. Used by carrier
+ * threads when they switch between green threads.
+ */
+thread_t * thread_switch(thread_t *thread) {
+  thread_t *ret = _thread_get_selfobj();
+
+  _thread_set_selfobj(thread);
+  return ret;
+}
+
 unsigned int thread_hash(thread_t *thread) {
+  if (thread && thread -> coroutine) {
+    return hashptr(thread -> coroutine);
+  }
   return (thread) ? hash(&thread -> thread, sizeof(_thr_t)) : 0;
 }
 
 int thread_cmp(thread_t *t1, thread_t *t2) {
+  if (t1 -> coroutine || t2 -> coroutine) {
+    return (int) (((char *) t1 -> coroutine) - ((char *) t2 -> coroutine));
+  }
   return memcmp(&t1 -> thread, &t2 -> thread, sizeof(_thr_t));
 }
 
+/*
+ * Interrupts a thread blocked in a wait, and makes a thread running a
+ * script stop at its next safepoint.
+ */
 int thread_interrupt(thread_t *thread) {
+  if (__sync_bool_compare_and_swap(&thread -> interrupted, FALSE, TRUE)) {
+    thread_safepoint_request();
+  }
+  if (thread -> coroutine) {
+    return coroutine_interrupt(thread -> coroutine);
+  }
 #ifdef HAVE_PTHREAD_H
   errno = pthread_cancel(thread -> thread);
 #elif defined(HAVE_CREATETHREAD)
@@ -285,6 +348,9 @@ int thread_interrupt(thread_t *thread) {
 }
 
 int thread_yield(void) {
+  if (coroutine_current()) {
+    return coroutine_yield();
+  }
   errno = 0;
 #if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_YIELD)
   errno = pthread_yield();
@@ -296,6 +362,9 @@ thread_t * thread_setname(thread_t *thread, char *name) {
   assert(name);
   free(thread -> name);
   thread -> name = strdup(name);
+  if (thread -> coroutine) {
+    return thread;
+  }
 #if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_SETNAME_NP)
 #ifndef __APPLE__
   pthread_setname_np(thread -> thread, thread -> name);
@@ -312,7 +381,11 @@ data_t * thread_resolve(thread_t *thread, char *name) {
   if (!strcmp(name, "name")) {
     return str_to_data(thread -> name);
   } else if (!strcmp(name, "id")) {
-    return int_to_data((long) thread -> thread);
+    return (thread -> coroutine)
+      ? int_to_data((long) thread -> coroutine)
+      : int_to_data((long) thread -> thread);
+  } else if (!strcmp(name, "green")) {
+    return int_as_bool(thread -> coroutine != NULL);
   } else if (!strcmp(name, "exit_code")) {
     while (!ret && thread) {
       ret = data_copy(thread -> exit_code);
@@ -473,6 +546,9 @@ data_t * data_thread_set_exit_code(data_t *code) {
   thread_t    *thread = data_as_thread(data);
 
   while (thread) {
+    if (!thread -> exit_code) {
+      thread_safepoint_request();
+    }
     thread -> exit_code = data_copy(code);
     thread = thread -> parent;
   }
@@ -495,8 +571,57 @@ void data_thread_clear_exit_code(void) {
   thread_t    *thread = data_as_thread(data_current_thread());
 
   while (thread) {
+    if (thread -> exit_code) {
+      thread_safepoint_release();
+    }
     data_free(thread -> exit_code);
     thread -> exit_code = NULL;;
     thread = thread -> parent;
   }
 }
+
+/* ------------------------------------------------------------------------ */
+
+void thread_safepoint_request(void) {
+  __sync_add_and_fetch(&thread_safepoint, 1);
+}
+
+void thread_safepoint_release(void) {
+  __sync_sub_and_fetch(&thread_safepoint, 1);
+}
+
+/**
+ * Called from a signal handler. The next thread to reach a safepoint
+ * turns the signal into an exit of the whole thread tree, with exit code
+ * 128 + <code>sig</code>.
+ */
+void thread_safepoint_signal(int sig) {
+  if (__sync_bool_compare_and_swap(&_thread_signal, 0, sig)) {
+    thread_safepoint_request();
+  }
+}
+
+/**
+ * Slow path of a safepoint. Returns the exit code, which is an ErrorExit
+ * exception, if the current thread or one of its parents is exiting, an
+ * exception if the current thread was interrupted, and NULL otherwise.
+ */
+data_t * thread_safepoint_poll(void) {
+  thread_t *self = thread_self();
+  data_t   *code;
+  int       sig = _thread_signal;
+
+  if (sig && __sync_bool_compare_and_swap(&_thread_signal, sig, 0)) {
+    code = data_exception(ErrorExit, "Interrupted by signal %d", sig);
+    data_as_exception(code) -> throwable = int_to_data(128 + sig);
+    data_thread_set_exit_code(code);
+    data_free(code);
+    thread_safepoint_release();
+  }
+  if (self && __sync_bool_compare_and_swap(&self -> interrupted, TRUE, FALSE)) {
+    thread_safepoint_release();
+    errno = EINTR;
+    return data_exception_from_errno();
+  }
+  return data_thread_exit_code();
+}
@@ -0,0 +1,372 @@
+/*
+ * /obelix/src/lib/threadpool.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libcore.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#include <data.h>
+#include <list.h>
+#include <mutex.h>
+#include <thread.h>
+#include <threadonce.h>
+#include <threadpool.h>
+
+typedef struct _poolworker {
+  int          ix;
+  mutex_t     *mutex;
+  list_t      *jobs;
+} poolworker_t;
+
+typedef struct _poolentry {
+  char        *name;
+  pooljob_t    job;
+  void        *context;
+  free_t       free_context;
+  future_t    *future;
+} poolentry_t;
+
+/*
+ * All counters are protected by the condition. pending is the number of
+ * jobs sitting in the worker queues, active the number of workers running
+ * a job that are not blocked waiting for a future.
+ */
+typedef struct _threadpool {
+  condition_t  *condition;
+  mutex_t      *complete;
+  poolworker_t *workers[THREADPOOL_MAX_WORKERS];
+  int           started;
+  int           size;
+  int           active;
+  int           idle;
+  int           pending;
+  unsigned int  next;
+} threadpool_t;
+
+static void           _threadpool_init(void);
+static void           _threadpool_atfork_child(void);
+static int            _threadpool_default_size(void);
+static void           _threadpool_set_worker(poolworker_t *);
+static poolworker_t * _threadpool_get_worker(void);
+static int            _threadpool_start_worker(void);
+static void *         _threadpool_worker(poolworker_t *);
+static poolentry_t *  _threadpool_take(poolworker_t *, int);
+static void           _threadpool_run(poolentry_t *);
+static void           _threadpool_cancel(future_t *, poolentry_t *);
+
+static threadpool_t   _pool;
+THREAD_ONCE(_threadpool_once);
+
+#ifdef HAVE_PTHREAD_H
+static pthread_key_t  _pool_worker;
+#elif defined(HAVE_CREATETHREAD)
+static DWORD          _pool_worker_ix;
+#endif /* HAVE_PTHREAD_H */
+
+int threadpool_debug = 0;
+
+/* ------------------------------------------------------------------------ */
+
+void _threadpool_init(void) {
+  logging_register_category("threadpool", &threadpool_debug);
+#ifdef HAVE_PTHREAD_H
+  pthread_key_create(&_pool_worker, NULL);
+  pthread_atfork(NULL, NULL, _threadpool_atfork_child);
+#elif defined(HAVE_CREATETHREAD)
+  _pool_worker_ix = TlsAlloc();
+#endif /* HAVE_PTHREAD_H */
+  future_init();
+  _pool.condition = condition_create();
+  _pool.complete = mutex_create();
+  _pool.size = _threadpool_default_size();
+}
+
+/*
+ * Only the forking thread survives fork(), so the child starts out with an
+ * empty pool and starts workers again when jobs come in. The state of the
+ * old workers can't be trusted and is left alone.
+ */
+void _threadpool_atfork_child(void) {
+  int ix;
+
+  for (ix = 0; ix < _pool.started; ix++) {
+    _pool.workers[ix] = NULL;
+  }
+  _pool.condition = condition_create();
+  _pool.complete = mutex_create();
+  _pool.started = 0;
+  _pool.active = 0;
+  _pool.idle = 0;
+  _pool.pending = 0;
+  _pool.next = 0;
+}
+
+int _threadpool_default_size(void) {
+  long cpus = 1;
+
+#ifdef HAVE_SYSCONF
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* HAVE_SYSCONF */
+  return (cpus > 2) ? (int) cpus : 2;
+}
+
+void _threadpool_set_worker(poolworker_t *worker) {
+#ifdef HAVE_PTHREAD_H
+  pthread_setspecific(_pool_worker, worker);
+#elif defined(HAVE_CREATETHREAD)
+  TlsSetValue(_pool_worker_ix, worker);
+#endif /* HAVE_PTHREAD_H */
+}
+
+poolworker_t * _threadpool_get_worker(void) {
+#ifdef HAVE_PTHREAD_H
+  return (poolworker_t *) pthread_getspecific(_pool_worker);
+#elif defined(HAVE_CREATETHREAD)
+  return (poolworker_t *) TlsGetValue(_pool_worker_ix);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/*
+ * Must be called with the pool condition acquired.
+ */
+int _threadpool_start_worker(void) {
+  poolworker_t *worker;
+  thread_t     *thread;
+  char          name[32];
+
+  if (_pool.started >= THREADPOOL_MAX_WORKERS) {
+    return -1;
+  }
+  worker = NEW(poolworker_t);
+  worker -> ix = _pool.started;
+  worker -> mutex = mutex_create();
+  worker -> jobs = list_create();
+  _pool.workers[worker -> ix] = worker;
+  _pool.started++;
+  snprintf(name, sizeof(name), "pool-%d", worker -> ix);
+  if (!(thread = thread_new(name, (threadproc_t) _threadpool_worker, worker))) {
+    error("Could not start thread pool worker: %s", strerror(errno));
+    _pool.started--;
+    _pool.workers[worker -> ix] = NULL;
+    list_free(worker -> jobs);
+    mutex_free(worker -> mutex);
+    free(worker);
+    return -1;
+  }
+  debug(threadpool, "Started worker %d", worker -> ix);
+  thread_free(thread);
+  return 0;
+}
+
+void * _threadpool_worker(poolworker_t *worker) {
+  poolentry_t *entry;
+  int          started;
+
+  _threadpool_set_worker(worker);
+  condition_acquire(_pool.condition);
+  while (TRUE) {
+    while (!_pool.pending || (_pool.active >= _pool.size)) {
+      _pool.idle++;
+      condition_sleep(_pool.condition);
+      _pool.idle--;
+    }
+    _pool.pending--;
+    _pool.active++;
+    started = _pool.started;
+    condition_release(_pool.condition);
+
+    entry = _threadpool_take(worker, started);
+    _threadpool_run(entry);
+
+    condition_acquire(_pool.condition);
+    _pool.active--;
+  }
+  return NULL;
+}
+
+/*
+ * The caller has claimed one of the pending jobs, so there is one in some
+ * queue. It may take a few rounds to find it if other workers are stealing
+ * at the same time.
+ */
+poolentry_t * _threadpool_take(poolworker_t *worker, int started) {
+  poolworker_t *victim;
+  poolentry_t  *entry;
+  int           ix;
+
+  while (TRUE) {
+    mutex_lock(worker -> mutex);
+    entry = list_pop(worker -> jobs);
+    mutex_unlock(worker -> mutex);
+    for (ix = 1; !entry && (ix < started); ix++) {
+      victim = _pool.workers[(worker -> ix + ix) % started];
+      mutex_lock(victim -> mutex);
+      entry = list_shift(victim -> jobs);
+      mutex_unlock(victim -> mutex);
+    }
+    if (entry) {
+      return entry;
+    }
+    thread_yield();
+  }
+}
+
+void _threadpool_run(poolentry_t *entry) {
+  data_t *ret;
+
+  debug(threadpool, "Running '%s'", entry -> name);
+  ret = entry -> job(entry -> context);
+  mutex_lock(_pool.complete);
+  if (entry -> future) {
+    future_complete(entry -> future, ret);
+  } else {
+    data_free(ret);
+  }
+  mutex_unlock(_pool.complete);
+  if (entry -> free_context) {
+    entry -> free_context(entry -> context);
+  }
+  free(entry -> name);
+  free(entry);
+}
+
+/*
+ * The future of a job is freed before the job finished. The job still runs,
+ * but its result is discarded. Once the future is done the entry may already
+ * be gone, and it is only ever completed with the complete mutex held.
+ */
+void _threadpool_cancel(future_t *future, poolentry_t *entry) {
+  mutex_lock(_pool.complete);
+  if (!future_done(future)) {
+    entry -> future = NULL;
+  }
+  mutex_unlock(_pool.complete);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Runs <code>job</code> with <code>context</code> on one of the pool
+ * workers and returns a future for its result. If <code>free_context</code>
+ * is set it is called with the context once the job has run. The job runs
+ * even if the future is freed before it is done.
+ */
+future_t * threadpool_submit(char *name, pooljob_t job, void *context, free_t free_context) {
+  poolentry_t  *entry;
+  poolworker_t *worker;
+  future_t     *ret;
+
+  ONCE(_threadpool_once, _threadpool_init);
+  entry = NEW(poolentry_t);
+  entry -> name = (name) ? strdup(name) : NULL;
+  entry -> job = job;
+  entry -> context = context;
+  entry -> free_context = free_context;
+  ret = future_create((future_cancel_t) _threadpool_cancel, entry);
+  entry -> future = ret;
+
+  condition_acquire(_pool.condition);
+  if (!_pool.idle && (_pool.started < _pool.size)) {
+    _threadpool_start_worker();
+  }
+  if (!_pool.started) {
+    condition_release(_pool.condition);
+    _threadpool_run(entry);
+    return ret;
+  }
+  if (!(worker = _threadpool_get_worker())) {
+    worker = _pool.workers[_pool.next++ % _pool.started];
+  }
+  mutex_lock(worker -> mutex);
+  list_push(worker -> jobs, entry);
+  mutex_unlock(worker -> mutex);
+  _pool.pending++;
+  debug(threadpool, "Queued '%s' on worker %d, %d pending", name, worker -> ix, _pool.pending);
+  if (_pool.idle) {
+    condition_wakeup(_pool.condition);
+  } else {
+    condition_release(_pool.condition);
+  }
+  return ret;
+}
+
+int threadpool_size(void) {
+  int ret;
+
+  ONCE(_threadpool_once, _threadpool_init);
+  condition_acquire(_pool.condition);
+  ret = _pool.size;
+  condition_release(_pool.condition);
+  return ret;
+}
+
+/**
+ * Sets the number of jobs that can run at the same time. Returns -1 if
+ * <code>size</code> is out of range.
+ */
+int threadpool_set_size(int size) {
+  ONCE(_threadpool_once, _threadpool_init);
+  if ((size < 1) || (size > THREADPOOL_MAX_WORKERS)) {
+    return -1;
+  }
+  condition_acquire(_pool.condition);
+  _pool.size = size;
+  while ((_pool.pending > _pool.idle) && (_pool.started < _pool.size)) {
+    if (_threadpool_start_worker()) {
+      break;
+    }
+  }
+  debug(threadpool, "Pool size set to %d", size);
+  condition_broadcast(_pool.condition);
+  return 0;
+}
+
+/**
+ * Called before the current thread blocks waiting for another job. If it is
+ * a pool worker it stops counting as active, and a worker is woken up or
+ * started to take its place. Returns whether threadpool_leave_blocking must
+ * be called once the wait is over.
+ */
+int threadpool_enter_blocking(void) {
+  ONCE(_threadpool_once, _threadpool_init);
+  if (!_threadpool_get_worker()) {
+    return FALSE;
+  }
+  condition_acquire(_pool.condition);
+  _pool.active--;
+  if (_pool.pending && !_pool.idle) {
+    _threadpool_start_worker();
+  }
+  if (_pool.pending && _pool.idle) {
+    condition_wakeup(_pool.condition);
+  } else {
+    condition_release(_pool.condition);
+  }
+  return TRUE;
+}
+
+void threadpool_leave_blocking(void) {
+  condition_acquire(_pool.condition);
+  _pool.active++;
+  condition_release(_pool.condition);
+}
@@ -30,6 +30,7 @@ static typedescr_t **_descriptors = NULL;
 static interface_t **_interfaces = NULL;
 static int           _next_interface = NextInterface;
 static size_t        _num_interfaces = 0;
+static volatile int  _typedescr_lock = 0;
 
 extern int           _data_count;
        int           type_debug = 1;
@@ -54,6 +55,8 @@ static data_t *      _interface_resolve(interface_t *, char *);
 static data_t *      _interface_isimplementedby(interface_t *, char *, arguments_t *);
 static data_t *      _interface_implements(data_t *, char *, arguments_t *);
 
+static void          _typedescr_acquire(void);
+static void          _typedescr_release(void);
 static int *         _typedescr_get_all_interfaces(typedescr_t *);
 static void_t *      _typedescr_get_constructors(typedescr_t *);
 static typedescr_t * _typedescr_initialize_vtable(typedescr_t *, vtable_t[]);
@@ -135,6 +138,8 @@ static code_label_t _function_id_labels[] = {
   { .code = FunctionIs,             .label = "Is" },
   { .code = FunctionConstructor,    .label = "Constructor" },
   { .code = FunctionInterpolate,    .label = "Interpolate" },
+  { .code = FunctionPack,           .label = "Pack" },
+  { .code = FunctionUnpack,         .label = "Unpack" },
   { .code = FunctionEndOfListDummy, .label = "End" },
   { .code = -1,                     .label = NULL }
 };
@@ -239,25 +244,31 @@ kind_t * _kind_init(kind_t * descr, int kind, int type, char *name) {
   descr -> _d.str = NULL;
   descr -> type = type;
   descr -> name = strdup(name);
-  descr -> methods = strdata_dict_create();
+  descr -> methods = cache_create(NULL);
   return descr;
 }
 
+/*
+ * Methods are inherited lazily, when a type turns out to implement an
+ * interface, while other threads look methods up. The method table is
+ * therefore a cache: lookups don't lock, and a method that is registered
+ * twice keeps its first registration.
+ */
 void kind_register_method(kind_t *kind, methoddescr_t *method) {
   if (type_debug) {
     info("kind_register_method(%s, %s)", kind -> name, method -> name);
   }
-  if (!dict_has_key(kind -> methods, method -> name)) {
+  if (!cache_get(kind -> methods, method -> name)) {
     method -> _d.type = Method;
     method -> _d.free_me = Constant;
     method -> _d.refs = 1;
     method -> _d.str = NULL;
-    dict_put(kind -> methods, strdup(method -> name), method);
+    cache_put(kind -> methods, method -> name, method);
   }
 }
 
 methoddescr_t * kind_get_method(kind_t *kind, char *name) {
-  return (methoddescr_t *) dict_get(kind -> methods, name);
+  return (methoddescr_t *) cache_get(kind -> methods, name);
 }
 
 char * _kind_tostring(kind_t *kind) {
@@ -281,7 +292,7 @@ data_t * _kind_resolve(kind_t *kind, char *name) {
     return int_to_data(kind -> type);
   } else if (!strcmp(name, "methods")) {
     list = datalist_create(NULL);
-    dict_reduce_values(kind -> methods, (reduce_t) _add_method_reducer, list);
+    cache_reduce(kind -> methods, (reduce_t) _add_method_reducer, list);
     return (data_t *) list;
   } else {
     return NULL;
@@ -294,7 +305,7 @@ kind_t * _inherit_method_reducer(methoddescr_t *mth, kind_t *kind) {
 }
 
 kind_t * _kind_inherit_methods(kind_t *kind, kind_t *from) {
-  return dict_reduce_values(from -> methods,
+  return cache_reduce(from -> methods,
          (reduce_t) _inherit_method_reducer,
          kind);
 }
@@ -561,19 +572,29 @@ int _typedescr_check_if_implements(typedescr_t *descr, interface_t *iface) {
   return ret;
 }
 
+/*
+ * This is called lazily from typedescr_is and typedescr_get_method, so
+ * other threads may be reading the current array. The new one is filled in
+ * before it is published, and the old one is left in place like the old
+ * descriptor tables.
+ */
 int * _typedescr_get_all_interfaces(typedescr_t *descr) {
-  size_t ix;
-
-  if (!descr -> implements || (_num_interfaces > descr -> implements_sz)) {
-    free(descr -> implements);
-    descr -> implements = NEWARR((size_t) _num_interfaces, int);
-    descr -> implements_sz = _num_interfaces;
-    for (ix = 0; ix < _num_interfaces; ix++) {
-      descr -> implements[ix] = _typedescr_check_if_implements(descr, _interfaces[ix]);
-      if (descr -> implements[ix]) {
+  size_t  num = _num_interfaces;
+  int    *implements;
+  size_t  ix;
+
+  if (!descr -> implements || (num > descr -> implements_sz)) {
+    implements = NEWARR(num, int);
+    for (ix = 0; ix < num; ix++) {
+      implements[ix] = _typedescr_check_if_implements(descr, _interfaces[ix]);
+      if (implements[ix]) {
         _kind_inherit_methods((kind_t *) descr, (kind_t *) _interfaces[ix]);
       }
     }
+    __sync_synchronize();
+    descr -> implements = implements;
+    __sync_synchronize();
+    descr -> implements_sz = num;
   }
   return descr -> implements;
 }
@@ -667,18 +688,35 @@ typedescr_t * _typedescr_initialize_vtable(typedescr_t *type, vtable_t vtable[])
   return type;
 }
 
+/*
+ * Types are registered lazily, possibly from several threads at once, while
+ * typedescr_get reads the descriptor table without locking. Registrations
+ * are serialized with a spin lock, and when the table grows the old one is
+ * left in place for readers that still hold it. It only grows a few times
+ * during the life of a process.
+ */
+void _typedescr_acquire(void) {
+  while (__sync_lock_test_and_set(&_typedescr_lock, 1)) {
+    while (_typedescr_lock);
+  }
+}
+
+void _typedescr_release(void) {
+  __sync_lock_release(&_typedescr_lock);
+}
+
 /* -- T Y P E D E S C R  P U B L I C  F U N C T I O N S ------------------- */
 
 int _typedescr_register(int type, char *type_name, vtable_t *vtable, methoddescr_t *methods) {
   typedescr_t  *d;
-  size_t        cursz;
-  size_t        newsz;
+  typedescr_t **descriptors;
   size_t        newcap;
 
   if ((type != Type) && !_descriptors) {
     typedescr_init();
   }
   debug(type, "Registering type '%s' [%d]", type_name, type);
+  _typedescr_acquire();
   if (type <= 0) {
     type = (_numtypes > (size_t) Dynamic) ? (int) _numtypes : (int) Dynamic;
     _numtypes = (size_t) (type + 1);
@@ -686,17 +724,20 @@ int _typedescr_register(int type, char *type_name, vtable_t *vtable, methoddescr
   }
   if ((size_t) type >= _capacity) {
     for (newcap = (_capacity) ? _capacity * 2 : (size_t) Dynamic;
-         newcap < (size_t) type;
+         newcap <= (size_t) type;
          newcap *= 2);
-    cursz = _capacity * sizeof(typedescr_t *);
-    newsz = newcap * sizeof(typedescr_t *);
-    debug(type, "Expaning type dictionary buffer from %d to %d (%d/%d bytes)",
-        _capacity, newcap, cursz, newsz);
-    _descriptors = (typedescr_t **) resize_block(_descriptors, newsz, cursz);
+    debug(type, "Expaning type dictionary buffer from %d to %d", _capacity, newcap);
+    descriptors = (typedescr_t **) new_ptrarray(newcap);
+    if (_descriptors) {
+      memcpy(descriptors, _descriptors, _capacity * sizeof(typedescr_t *));
+    }
+    __sync_synchronize();
+    _descriptors = descriptors;
     _capacity = newcap;
   }
   d = NEW(typedescr_t);
   _descriptors[type] = d;
+  _typedescr_release();
   _kind_init((kind_t *) d, Type, type, type_name);
   _typedescr_initialize_vtable(d, vtable);
   if (methods) {
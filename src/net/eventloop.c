@@ -0,0 +1,562 @@
+/*
+ * /obelix/src/net/eventloop.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libnet.h"
+#include <errno.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif /* HAVE_SYS_EPOLL_H */
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include <mutex.h>
+#include <thread.h>
+
+extern int socket_debug;
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/*
+ * Event loop server. Every acceptor owns a non-blocking listening socket
+ * and an epoll instance, registered edge-triggered. Accepted connections
+ * are added to the same epoll instance with EPOLLONESHOT. When a client
+ * becomes readable its connection is queued for a fixed pool of worker
+ * threads, which run the service callback. A callback returning
+ * SERVICE_KEEPALIVE hands the connection back to epoll; anything else
+ * closes it. SERVICE_INCOMPLETE
+ * hands it back as well, but waits for more data even if some is buffered.
+ * SERVICE_PAUSE parks the connection without re-arming it, until
+ * connection_resume() queues it again.
+ *
+ * Client sockets are non-blocking. Because they are edge-triggered, a
+ * service should handle everything the client sent before returning
+ * SERVICE_KEEPALIVE. Re-arming the connection reports data that is still
+ * pending in the kernel, and input left in the stream buffer is queued
+ * again right away. socket_read() and socket_write() wait with poll(2)
+ * when the socket is not ready, so a service can still read a message that
+ * arrives in pieces, but a worker is busy for as long as its callback runs.
+ */
+
+#define EVENTLOOP_MAX_EVENTS      64
+#define EVENTLOOP_TIMEOUT_MS      1000
+#define EVENTLOOP_CLIENT_EVENTS   (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+
+typedef struct _eventloop eventloop_t;
+
+typedef struct _acceptor {
+  eventloop_t          *loop;
+  socket_t             *socket;
+  int                   epfd;
+} acceptor_t;
+
+typedef struct _evconnection {
+  connection_t          connection;
+  acceptor_t           *acceptor;
+  int                   busy;
+  int                   paused;
+  struct _evconnection *next;
+  struct _evconnection *prev_live;
+  struct _evconnection *next_live;
+} evconnection_t;
+
+struct _eventloop {
+  socket_t             *server;
+  service_t             service;
+  void                 *context;
+  serve_options_t       options;
+  acceptor_t           *acceptors;
+  int                   num_acceptors;
+  condition_t          *queue;
+  evconnection_t       *head;
+  evconnection_t       *tail;
+  evconnection_t       *live;
+  int                   connections;
+  int                   running;
+  int                   refs;
+};
+
+static eventloop_t * _eventloop_create(socket_t *, service_t, void *, serve_options_t *);
+static void          _eventloop_release(eventloop_t *);
+static void          _eventloop_stop(eventloop_t *);
+static void *        _eventloop_acceptor(acceptor_t *);
+static void          _eventloop_accept(acceptor_t *);
+static void          _eventloop_push(eventloop_t *, evconnection_t *);
+static void          _eventloop_enqueue(eventloop_t *, evconnection_t *);
+static void *        _eventloop_worker(eventloop_t *);
+static void          _eventloop_done(evconnection_t *, void *);
+static void          _eventloop_unlink(eventloop_t *, evconnection_t *);
+static void          _eventloop_close(evconnection_t *);
+static int           _eventloop_serve(socket_t *, service_t, void *, serve_options_t *, int);
+
+/* ------------------------------------------------------------------------ */
+
+static int _eventloop_default_workers(void) {
+  long cpus = 1;
+
+#ifdef HAVE_SYSCONF
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* HAVE_SYSCONF */
+  return (cpus > 2) ? (int) (2 * cpus) : 4;
+}
+
+eventloop_t * _eventloop_create(socket_t *server, service_t service,
+                                void *context, serve_options_t *options) {
+  eventloop_t        *loop = NEW(eventloop_t);
+  acceptor_t         *acceptor;
+  struct epoll_event  ev;
+  int                 ix;
+
+  loop -> server = socket_copy(server);
+  loop -> service = service;
+  loop -> context = context;
+  if (options) {
+    loop -> options = *options;
+  }
+  if (loop -> options.backlog <= 0) {
+    loop -> options.backlog = SOCKET_DEFAULT_BACKLOG;
+  }
+  if (loop -> options.workers <= 0) {
+    loop -> options.workers = _eventloop_default_workers();
+  }
+  if ((loop -> options.acceptors <= 0) || (server -> af == AF_UNIX)) {
+    /* A Unix socket path can only be bound once. */
+    loop -> options.acceptors = 1;
+  }
+  loop -> queue = condition_create();
+  loop -> running = 1;
+  loop -> acceptors = NEWARR(loop -> options.acceptors, acceptor_t);
+  for (ix = 0; ix < loop -> options.acceptors; ix++) {
+    acceptor = loop -> acceptors + loop -> num_acceptors;
+    acceptor -> loop = loop;
+    acceptor -> socket = (ix)
+      ? _serversocket_create_shared(server)
+      : socket_copy(server);
+    acceptor -> epfd = -1;
+    if (acceptor -> socket -> _stream.error) {
+      error("Could not open acceptor %d for '%s': %s", ix,
+            socket_tostring(server),
+            data_tostring(acceptor -> socket -> _stream.error));
+      socket_free(acceptor -> socket);
+      continue;
+    }
+    if (TEMP_FAILURE_RETRY(listen(acceptor -> socket -> fh, loop -> options.backlog))
+        || !socket_nonblock(acceptor -> socket)
+        || ((acceptor -> epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)) {
+      socket_set_errno(acceptor -> socket, "listen()");
+      error("Could not set up acceptor %d for '%s': %s", ix,
+            socket_tostring(server),
+            data_tostring(acceptor -> socket -> _stream.error));
+      if (acceptor -> epfd >= 0) {
+        close(acceptor -> epfd);
+      }
+      socket_free(acceptor -> socket);
+      continue;
+    }
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    epoll_ctl(acceptor -> epfd, EPOLL_CTL_ADD, acceptor -> socket -> fh, &ev);
+    loop -> num_acceptors++;
+  }
+  if (!loop -> num_acceptors) {
+    socket_set_errormsg(server, "Could not set up any listener for '%s'",
+                        socket_tostring(server));
+    loop -> refs = 1;
+    _eventloop_release(loop);
+    return NULL;
+  }
+  return loop;
+}
+
+void _eventloop_release(eventloop_t *loop) {
+  int ix;
+
+  if (__sync_sub_and_fetch(&loop -> refs, 1)) {
+    return;
+  }
+  debug(socket, "Event loop for '%s' shut down", socket_tostring(loop -> server));
+  for (ix = 0; ix < loop -> num_acceptors; ix++) {
+    close(loop -> acceptors[ix].epfd);
+    socket_free(loop -> acceptors[ix].socket);
+  }
+  free(loop -> acceptors);
+  condition_free(loop -> queue);
+  socket_free(loop -> server);
+  free(loop);
+}
+
+/*
+ * Stops accepting and dispatching. Queued and idle connections are closed
+ * right away; connections a worker is serving are closed when the service
+ * call returns.
+ */
+void _eventloop_stop(eventloop_t *loop) {
+  evconnection_t *closing = NULL;
+  evconnection_t *conn;
+  evconnection_t *next;
+  int             ix;
+
+  condition_acquire(loop -> queue);
+  if (!loop -> running) {
+    condition_release(loop -> queue);
+    return;
+  }
+  loop -> running = 0;
+
+  /* Queued connections are busy, but no worker is serving them yet */
+  for (conn = loop -> head; conn; conn = conn -> next) {
+    conn -> busy = 0;
+  }
+  loop -> head = loop -> tail = NULL;
+  for (conn = loop -> live; conn; conn = next) {
+    next = conn -> next_live;
+    if (!conn -> busy) {
+      _eventloop_unlink(loop, conn);
+      conn -> next = closing;
+      closing = conn;
+    }
+  }
+  condition_release(loop -> queue);
+
+  for (conn = closing; conn; conn = next) {
+    next = conn -> next;
+    _eventloop_close(conn);
+  }
+  for (ix = 0; ix < loop -> options.workers; ix++) {
+    condition_acquire(loop -> queue);
+    condition_wakeup(loop -> queue);
+  }
+}
+
+/* ------------------------------------------------------------------------ */
+
+void * _eventloop_acceptor(acceptor_t *acceptor) {
+  eventloop_t        *loop = acceptor -> loop;
+  struct epoll_event  events[EVENTLOOP_MAX_EVENTS];
+  int                 num;
+  int                 ix;
+
+  while (loop -> running && loop -> server -> service_handler) {
+    num = epoll_wait(acceptor -> epfd, events, EVENTLOOP_MAX_EVENTS, EVENTLOOP_TIMEOUT_MS);
+    if (num < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      socket_set_errno(acceptor -> socket, "epoll_wait()");
+      break;
+    }
+    for (ix = 0; ix < num; ix++) {
+      if (!events[ix].data.ptr) {
+        _eventloop_accept(acceptor);
+      } else {
+        _eventloop_enqueue(loop, (evconnection_t *) events[ix].data.ptr);
+      }
+    }
+  }
+  if (acceptor == loop -> acceptors) {
+    _eventloop_stop(loop);
+  }
+  _eventloop_release(loop);
+  return NULL;
+}
+
+void _eventloop_accept(acceptor_t *acceptor) {
+  eventloop_t             *loop = acceptor -> loop;
+  struct sockaddr_storage  client;
+  socklen_t                sz;
+  int                      fd;
+  evconnection_t          *conn;
+  struct epoll_event       ev;
+
+  for (;;) {
+    sz = sizeof(struct sockaddr_storage);
+    fd = accept4(acceptor -> socket -> fh, (struct sockaddr *) &client, &sz,
+                 SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        socket_set_errno(acceptor -> socket, "accept()");
+        error("%s", data_tostring(acceptor -> socket -> _stream.error));
+      }
+      return;
+    }
+    if ((loop -> options.max_connections > 0) &&
+        (loop -> connections >= loop -> options.max_connections)) {
+      debug(socket, "Refusing connection on '%s': limit of %d reached",
+            socket_tostring(loop -> server), loop -> options.max_connections);
+      close(fd);
+      continue;
+    }
+    conn = NEW(evconnection_t);
+    conn -> connection.server = socket_copy(loop -> server);
+    conn -> connection.client = _socket_accepted(acceptor -> socket, fd,
+                                                 (struct sockaddr *) &client, (int) sz);
+    if (!conn -> connection.client) {
+      conn -> connection.client = _socket_create(fd, "unknown", "0");
+    }
+    conn -> connection.context = (data_t *) loop -> context;
+    conn -> acceptor = acceptor;
+
+    condition_acquire(loop -> queue);
+    conn -> next_live = loop -> live;
+    if (loop -> live) {
+      loop -> live -> prev_live = conn;
+    }
+    loop -> live = conn;
+    loop -> connections++;
+    condition_release(loop -> queue);
+
+    ev.events = EVENTLOOP_CLIENT_EVENTS;
+    ev.data.ptr = conn;
+    if (epoll_ctl(acceptor -> epfd, EPOLL_CTL_ADD, fd, &ev)) {
+      error("epoll_ctl(ADD) failed for '%s': %s",
+            socket_tostring(conn -> connection.client), strerror(errno));
+      condition_acquire(loop -> queue);
+      _eventloop_unlink(loop, conn);
+      condition_release(loop -> queue);
+      _eventloop_close(conn);
+    }
+  }
+}
+
+/*
+ * Queues a connection for the workers. The caller holds the queue lock.
+ */
+void _eventloop_push(eventloop_t *loop, evconnection_t *conn) {
+  conn -> busy = 1;
+  conn -> next = NULL;
+  if (loop -> tail) {
+    loop -> tail -> next = conn;
+  } else {
+    loop -> head = conn;
+  }
+  loop -> tail = conn;
+}
+
+void _eventloop_enqueue(eventloop_t *loop, evconnection_t *conn) {
+  condition_acquire(loop -> queue);
+  if (!loop -> running) {
+    condition_release(loop -> queue);
+    return;
+  }
+  _eventloop_push(loop, conn);
+  condition_wakeup(loop -> queue);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void * _eventloop_worker(eventloop_t *loop) {
+  evconnection_t *conn;
+  void           *ret;
+
+  for (;;) {
+    condition_acquire(loop -> queue);
+    while (loop -> running && !loop -> head) {
+      condition_sleep(loop -> queue);
+    }
+    if (!loop -> running) {
+      condition_release(loop -> queue);
+      break;
+    }
+    conn = loop -> head;
+    loop -> head = conn -> next;
+    if (!loop -> head) {
+      loop -> tail = NULL;
+    }
+    conn -> next = NULL;
+    condition_release(loop -> queue);
+
+    conn -> connection.thread = thread_self();
+    ret = loop -> service(&conn -> connection);
+    conn -> connection.thread = NULL;
+    _eventloop_done(conn, ret);
+  }
+  _eventloop_release(loop);
+  return NULL;
+}
+
+void _eventloop_done(evconnection_t *conn, void *ret) {
+  eventloop_t        *loop = conn -> acceptor -> loop;
+  socket_t           *client = conn -> connection.client;
+  struct epoll_event  ev;
+
+  condition_acquire(loop -> queue);
+  conn -> busy = 0;
+  if (loop -> running && (client -> fh >= 0) && (ret == SERVICE_PAUSE)) {
+    if (conn -> connection.resumed) {
+      conn -> connection.resumed = 0;
+      _eventloop_push(loop, conn);
+      condition_wakeup(loop -> queue);
+    } else {
+      conn -> paused = 1;
+      condition_release(loop -> queue);
+    }
+    return;
+  }
+  conn -> connection.resumed = 0;
+  if (loop -> running && (client -> fh >= 0) &&
+      ((ret == SERVICE_KEEPALIVE) || (ret == SERVICE_INCOMPLETE))) {
+    if ((ret == SERVICE_KEEPALIVE) && (client -> _stream.pos < client -> _stream.len)) {
+      /*
+       * The service left input in the stream buffer. The kernel has no
+       * more data for this socket, so epoll would not report it again.
+       */
+      condition_release(loop -> queue);
+      _eventloop_enqueue(loop, conn);
+      return;
+    }
+    ev.events = EVENTLOOP_CLIENT_EVENTS;
+    ev.data.ptr = conn;
+    if (!epoll_ctl(conn -> acceptor -> epfd, EPOLL_CTL_MOD, client -> fh, &ev)) {
+      condition_release(loop -> queue);
+      return;
+    }
+  }
+  _eventloop_unlink(loop, conn);
+  condition_release(loop -> queue);
+  _eventloop_close(conn);
+}
+
+/*
+ * Queues a paused connection again. If the service has not returned yet,
+ * _eventloop_done() does that when it returns SERVICE_PAUSE.
+ */
+void _eventloop_resume(connection_t *connection) {
+  evconnection_t *conn = (evconnection_t *) connection;
+  eventloop_t    *loop = conn -> acceptor -> loop;
+
+  condition_acquire(loop -> queue);
+  if (conn -> paused) {
+    conn -> paused = 0;
+    if (loop -> running) {
+      _eventloop_push(loop, conn);
+      condition_wakeup(loop -> queue);
+      return;
+    }
+  } else if (conn -> busy) {
+    conn -> connection.resumed = 1;
+  }
+  condition_release(loop -> queue);
+}
+
+void _eventloop_unlink(eventloop_t *loop, evconnection_t *conn) {
+  if (conn -> prev_live) {
+    conn -> prev_live -> next_live = conn -> next_live;
+  } else {
+    loop -> live = conn -> next_live;
+  }
+  if (conn -> next_live) {
+    conn -> next_live -> prev_live = conn -> prev_live;
+  }
+  loop -> connections--;
+}
+
+void _eventloop_close(evconnection_t *conn) {
+  socket_t *client = conn -> connection.client;
+
+  /* Before closing, so the state can still finish talking to the client */
+  data_free(conn -> connection.state);
+  if (client -> fh >= 0) {
+    epoll_ctl(conn -> acceptor -> epfd, EPOLL_CTL_DEL, client -> fh, NULL);
+    socket_close(client);
+  }
+  socket_free(client);
+  socket_free(conn -> connection.server);
+  free(conn);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int _eventloop_serve(socket_t *socket, service_t service, void *context,
+                     serve_options_t *options, int async) {
+  eventloop_t *loop;
+  thread_t    *thread;
+  int          ix;
+
+  socket -> service_handler = service;
+  socket -> context = context;
+  loop = _eventloop_create(socket, service, context, options);
+  if (!loop) {
+    socket -> service_handler = NULL;
+    return -1;
+  }
+  loop -> refs = loop -> num_acceptors + loop -> options.workers;
+  for (ix = 0; ix < loop -> options.workers; ix++) {
+    thread = thread_new("Event Loop Worker", (threadproc_t) _eventloop_worker, loop);
+    if (!thread) {
+      error("Could not create event loop worker thread");
+      _eventloop_release(loop);
+    }
+    thread_free(thread);
+  }
+  for (ix = 1; ix < loop -> num_acceptors; ix++) {
+    thread = thread_new("Event Loop Acceptor",
+                        (threadproc_t) _eventloop_acceptor, loop -> acceptors + ix);
+    if (!thread) {
+      error("Could not create event loop acceptor thread");
+      _eventloop_release(loop);
+    }
+    thread_free(thread);
+  }
+  debug(socket, "Serving '%s' with %d acceptor(s) and %d worker(s)",
+        socket_tostring(socket), loop -> num_acceptors, loop -> options.workers);
+  if (!async) {
+    _eventloop_acceptor(loop -> acceptors);
+  } else {
+    thread = thread_new("Event Loop Acceptor",
+                        (threadproc_t) _eventloop_acceptor, loop -> acceptors);
+    if (!thread) {
+      socket_set_errormsg(socket, "Could not create listener thread");
+      socket -> service_handler = NULL;
+      _eventloop_release(loop);
+      return -1;
+    }
+    thread_free(thread);
+  }
+  return 0;
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+/* -- P U B L I C  F U N C T I O N S -------------------------------------- */
+
+/*
+ * Serves connections on socket with an event loop and a pool of worker
+ * threads. On systems without epoll this falls back to socket_listen(),
+ * which runs every connection in its own thread.
+ */
+int socket_serve(socket_t *socket, service_t service, void *context,
+                 serve_options_t *options) {
+#ifdef HAVE_SYS_EPOLL_H
+  return _eventloop_serve(socket, service, context, options, 0);
+#else /* !HAVE_SYS_EPOLL_H */
+  return socket_listen(socket, service, context);
+#endif /* HAVE_SYS_EPOLL_H */
+}
+
+int socket_serve_detach(socket_t *socket, service_t service, void *context,
+                        serve_options_t *options) {
+#ifdef HAVE_SYS_EPOLL_H
+  return _eventloop_serve(socket, service, context, options, 1);
+#else /* !HAVE_SYS_EPOLL_H */
+  return socket_listen_detach(socket, service, context);
+#endif /* HAVE_SYS_EPOLL_H */
+}
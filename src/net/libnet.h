@@ -29,6 +29,10 @@
 #include <net.h>
 
 extern void socket_init(void);
+extern socket_t * _socket_create(SOCKET, char *, char *);
+extern socket_t * _socket_accepted(socket_t *, SOCKET, struct sockaddr *, int);
+extern socket_t * _serversocket_create_shared(socket_t *);
+extern void _eventloop_resume(connection_t *);
 extern void net_init(void);
 
 extern int net_debug;
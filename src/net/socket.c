@@ -20,9 +20,16 @@
 #include "libnet.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <coroutine.h>
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif /* HAVE_NETDB_H */
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif /* HAVE_POLL_H */
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif /* HAVE_SYS_UN_H */
 #ifdef HAVE_WS2TCPIP_H
 #include <ws2tcpip.h>
 #endif /* HAVE_WS2TCPIP_H */
@@ -36,6 +43,9 @@ typedef int socklen_t;
 
 #ifndef HAVE_WINSOCK2_H
 #define closesocket(s) close(s)
+#define SD_BOTH        SHUT_RDWR
+#elif !defined(HAVE_POLL_H)
+#define poll(fds, nfds, timeout) WSAPoll((fds), (nfds), (timeout))
 #endif
 
 #ifndef TEMP_FAILURE_RETRY
@@ -56,11 +66,24 @@ typedef int socklen_t;
 #define ECONNRESET WSAECONNRESET
 #endif
 
+/*
+ * In a green thread a blocking socket call would block the carrier, so
+ * sockets are read and written without blocking there, and the green thread
+ * waits for readiness instead.
+ */
+#ifdef MSG_DONTWAIT
+#define _socket_io_flags()  ((coroutine_current()) ? MSG_DONTWAIT : 0)
+#else /* !MSG_DONTWAIT */
+#define _socket_io_flags()  0
+#endif /* MSG_DONTWAIT */
+
 typedef int         (*socket_fnc_t)(SOCKET, struct sockaddr *, socklen_t);
 
-static socket_t *   _socket_create(SOCKET, char *, char *);
 static socket_t *   _socket_error(char *, char *, char *, ...);
-static socket_t *   _socket_open(char *, char *, socket_fnc_t);
+static socket_t *   _socket_open(char *, char *, socket_fnc_t, int);
+static int          _socket_set_reuseport(SOCKET);
+static socket_t *   _socket_open_unix(char *, char *, socket_fnc_t);
+static int          _socket_unix_stale(struct sockaddr *, socklen_t);
 static socket_t *   _socket_new(socket_t *, va_list);
 static char *       _socket_allocstring(socket_t *);
 static void         _socket_free(socket_t *);
@@ -69,6 +92,8 @@ static int          _socket_accept_loop(socket_t *);
 static int          _socket_accept(socket_t *);
 static void *       _socket_connection_handler(connection_t *);
 static socket_t *   _socket_setopt(socket_t *, int);
+static int          _socket_would_block(void);
+static int          _socket_wait(socket_t *, short, int, char *);
 
 static data_t *     _socket_resolve(socket_t *, char *);
 static data_t *     _socket_leave(socket_t *, data_t *);
@@ -138,9 +163,14 @@ socket_t * _socket_new(socket_t *socket, va_list args) {
   socket -> host = (host) ? strdup(host) : NULL;
   socket -> service = strdup(service);
   socket -> fh = -1;
+  socket -> read_timeout = -1;
+  socket -> write_timeout = -1;
   stream_init((stream_t *) socket,
       (read_t) socket_read,
       (write_t) socket_write);
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UIO_H)
+  socket -> _stream.vwriter = (writev_t) socket_writev;
+#endif
   return socket;
 }
 
@@ -167,6 +197,10 @@ data_t * _socket_resolve(socket_t *s, char *attr) {
     return str_to_data(s -> service);
   } else if (!strcmp(attr, "error")) {
     return data_copy(s -> _stream.error);
+  } else if (!strcmp(attr, "read_timeout")) {
+    return int_to_data(s -> read_timeout);
+  } else if (!strcmp(attr, "write_timeout")) {
+    return int_to_data(s -> write_timeout);
   } else {
     return NULL;
   }
@@ -195,7 +229,26 @@ socket_t * _socket_error(char *host, char *service, char *fmt, ...) {
   return ret;
 }
 
-socket_t * _socket_open(char *host, char *service, socket_fnc_t fnc) {
+/*
+ * Lets several listening sockets, in this process or others, share the
+ * port so the kernel can spread incoming connections over them. All of
+ * them must set this before the next one binds.
+ */
+int _socket_set_reuseport(SOCKET sfd) {
+#ifdef HAVE_SO_REUSEPORT
+  if (setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &(int){ 1 }, sizeof(int)) < 0) {
+    error("setsockopt(SO_REUSEPORT) failed: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+#else /* !HAVE_SO_REUSEPORT */
+  (void) sfd;
+  errno = ENOTSUP;
+  return -1;
+#endif /* HAVE_SO_REUSEPORT */
+}
+
+socket_t * _socket_open(char *host, char *service, socket_fnc_t fnc, int reuseport) {
   struct addrinfo  hints;
   struct addrinfo *result = NULL;
   struct addrinfo *rp;
@@ -203,6 +256,9 @@ socket_t * _socket_open(char *host, char *service, socket_fnc_t fnc) {
   int              s;
   socket_t        *ret = NULL;
 
+  if (socket_is_unix_service(service)) {
+    return _socket_open_unix(host, service, fnc);
+  }
   memset(&hints, 0, sizeof(struct addrinfo));
   hints.ai_family = AF_UNSPEC;     /* Allow IPv4 or IPv6 */
   hints.ai_socktype = SOCK_STREAM; /* Stream (TCP) socket */
@@ -238,6 +294,10 @@ socket_t * _socket_open(char *host, char *service, socket_fnc_t fnc) {
       continue;
     }
 #endif
+    if (reuseport && _socket_set_reuseport(sfd)) {
+      closesocket(sfd);
+      continue;
+    }
 #ifdef HAVE_SO_NOSIGPIPE
     if (setsockopt(sfd, SOL_SOCKET, SO_NOSIGPIPE, &(int){ 1 }, sizeof(int)) < 0) {
       error("setsockopt(SO_NOSIGPIPE) failed");
@@ -261,6 +321,101 @@ socket_t * _socket_open(char *host, char *service, socket_fnc_t fnc) {
   return ret;
 }
 
+/*
+ * Returns TRUE if addr is a Unix socket nobody accepts connections on,
+ * i.e. a socket file left behind by a process that went away.
+ */
+int _socket_unix_stale(struct sockaddr *addr, socklen_t sz) {
+  SOCKET sfd;
+  int    ret;
+
+  if ((sfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+    return FALSE;
+  }
+  ret = connect(sfd, addr, sz) && (errno == ECONNREFUSED);
+  closesocket(sfd);
+  return ret;
+}
+
+/*
+ * Opens a Unix domain stream socket. service is "unix:" followed by the
+ * path. A server socket (host == NULL) first removes a stale socket file
+ * left behind by an earlier process, but fails if another server is still
+ * listening on the path. socket_close() removes the file again, but only
+ * in the process that bound it and only if it was not replaced since.
+ */
+socket_t * _socket_open_unix(char *host, char *service, socket_fnc_t fnc) {
+#ifdef HAVE_SYS_UN_H
+  struct sockaddr_un  addr;
+  struct stat         st;
+  char               *path = service + strlen(SOCKET_UNIX_PREFIX);
+  SOCKET              sfd;
+  socket_t           *ret;
+
+  if (!*path || (strlen(path) >= sizeof(addr.sun_path))) {
+    return _socket_error(host, service, "Invalid Unix socket path '%s'", path);
+  }
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (!host && !stat(path, &st) && S_ISSOCK(st.st_mode) &&
+      _socket_unix_stale((struct sockaddr *) &addr, sizeof(struct sockaddr_un))) {
+    debug(socket, "Removing stale Unix socket '%s'", path);
+    unlink(path);
+  }
+  sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sfd == -1) {
+    return _socket_error(host, service, "Could not create Unix socket: %s",
+                         strerror(errno));
+  }
+  if (fnc(sfd, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) == -1) {
+    ret = _socket_error(host, service, "Could not %s Unix socket '%s': %s",
+                        (host) ? "connect" : "bind", path, strerror(errno));
+    closesocket(sfd);
+    return ret;
+  }
+  ret = _socket_create(sfd, host, service);
+  ret -> af = AF_UNIX;
+  ret -> socktype = SOCK_STREAM;
+  if (!host && !stat(path, &st)) {
+    ret -> unix_owner = (long) getpid();
+    ret -> unix_inode = (long) st.st_ino;
+  }
+  return ret;
+#else /* !HAVE_SYS_UN_H */
+  return _socket_error(host, service,
+                       "Unix domain sockets are not supported on this platform");
+#endif /* HAVE_SYS_UN_H */
+}
+
+/*
+ * Wraps a descriptor returned by accept(2) in a socket_t named after the
+ * peer's numeric address. Unix domain peers are unnamed and are named
+ * after the listening socket instead.
+ */
+socket_t * _socket_accepted(socket_t *server, SOCKET fd, struct sockaddr *addr, int sz) {
+  char      hoststr[80];
+  char      portstr[32];
+  int       err;
+  socket_t *ret;
+
+#ifdef HAVE_SYS_UN_H
+  if (addr -> sa_family == AF_UNIX) {
+    ret = _socket_create(fd, SOCKET_UNIX_HOST, server -> service);
+  } else
+#endif /* HAVE_SYS_UN_H */
+  if ((err = getnameinfo(addr, (socklen_t) sz, hoststr, sizeof(hoststr),
+                         portstr, sizeof(portstr), NI_NUMERICHOST | NI_NUMERICSERV))) {
+    socket_set_errormsg(server, "getnameinfo() failed: %s", gai_strerror(err));
+    return NULL;
+  } else {
+    ret = _socket_create(fd, hoststr, portstr);
+  }
+  ret -> af = addr -> sa_family;
+  ret -> socktype = SOCK_STREAM;
+  return ret;
+}
+
 data_t *_socket_leave(socket_t * socket, data_t *param) {
   int     retval;
   data_t *ret;
@@ -278,7 +433,21 @@ data_t *_socket_leave(socket_t * socket, data_t *param) {
 void * _socket_connection_handler(connection_t *connection) {
   void *ret;
 
-  ret = connection -> server -> service_handler(connection);
+  do {
+    ret = connection -> server -> service_handler(connection);
+    if (ret == SERVICE_PAUSE) {
+      condition_acquire(connection -> resume);
+      while (!connection -> resumed) {
+        condition_sleep(connection -> resume);
+      }
+      connection -> resumed = 0;
+      condition_release(connection -> resume);
+    }
+  } while (((ret == SERVICE_KEEPALIVE) || (ret == SERVICE_INCOMPLETE) ||
+            (ret == SERVICE_PAUSE)) &&
+           (connection -> client -> fh >= 0));
+  data_free(connection -> state);
+  condition_free(connection -> resume);
   socket_free(connection -> client);
   socket_free(connection -> server);
   thread_free(connection -> thread);
@@ -290,23 +459,30 @@ int _socket_accept(socket_t *socket) {
   socklen_t                sz = sizeof(struct sockaddr_storage);
   int                      client_fd;
   connection_t            *connection;
-  char                     hoststr[80];
-  char                     portstr[32];
+  socket_t                *accepted;
 
   client_fd = (int) TEMP_FAILURE_RETRY(accept(socket -> fh, (struct sockaddr *) &client, &sz));
   if (client_fd > 0) {
-    if (TEMP_FAILURE_RETRY(getnameinfo((struct sockaddr *) &client, sz,
-        hoststr, 80, portstr, 32, 0))) {
-      socket_set_errno(socket, "getnameinfo()");
+    accepted = _socket_accepted(socket, client_fd, (struct sockaddr *) &client, (int) sz);
+    if (!accepted) {
+      closesocket(client_fd);
       return -1;
     }
     connection = NEW(connection_t);
     connection -> server = socket_copy(socket);
-    connection -> client = _socket_create(client_fd, hoststr, portstr);
+    connection -> client = accepted;
     connection -> context = socket -> context;
-    connection -> thread = thread_new("Socket Connection Handler",
-                                      (threadproc_t) _socket_connection_handler,
-                                      connection);
+    connection -> resume = condition_create();
+    if (socket -> green) {
+      connection -> thread = coroutine_spawn("Socket Connection Handler",
+                                             (threadproc_t) _socket_connection_handler,
+                                             connection);
+    }
+    if (!connection -> thread) {
+      connection -> thread = thread_new("Socket Connection Handler",
+                                        (threadproc_t) _socket_connection_handler,
+                                        connection);
+    }
     if (!connection -> thread) {
       socket_set_errormsg(socket, "Could not create connection service thread");
       return -1;
@@ -319,20 +495,18 @@ int _socket_accept(socket_t *socket) {
 }
 
 int _socket_accept_loop(socket_t *socket) {
-  fd_set         set;
-  struct timeval timeout;
-  int            err;
+  struct pollfd pfd;
+  int           err;
 
   while (socket -> service_handler) {
-    FD_ZERO(&set);
-    FD_SET(socket -> fh, &set);
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
+    pfd.fd = socket -> fh;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
 
-    /* select returns 0 if timeout, 1 if input available, -1 if error. */
-    err = TEMP_FAILURE_RETRY(select(FD_SETSIZE, &set, NULL, NULL, &timeout));
+    /* Wakes up every second to notice socket_interrupt(). */
+    err = TEMP_FAILURE_RETRY(poll(&pfd, 1, 1000));
     if (err < 0) {
-      socket_set_errno(socket, "select()");
+      socket_set_errno(socket, "poll()");
       return -1;
     } else if (err > 0) {
       err = TEMP_FAILURE_RETRY(_socket_accept(socket));
@@ -346,7 +520,7 @@ int _socket_accept_loop(socket_t *socket) {
 }
 
 int _socket_listen(socket_t *socket, service_t service, void *context, int async) {
-  if (TEMP_FAILURE_RETRY(listen(socket->fh, 5))) {
+  if (TEMP_FAILURE_RETRY(listen(socket->fh, SOCKET_DEFAULT_BACKLOG))) {
     socket_set_errormsg(socket, "Error setting up listener");
     return -1;
   } else {
@@ -396,7 +570,15 @@ socket_t * socket_create(char *host, int port) {
 }
 
 socket_t * socket_open(uri_t *uri) {
-  if (uri -> port) {
+  char     *service;
+  socket_t *ret;
+
+  if (uri -> scheme && !strcmp(uri -> scheme, "unix")) {
+    asprintf(&service, "%s%s", SOCKET_UNIX_PREFIX, uri_path(uri));
+    ret = socket_create_byservice(SOCKET_UNIX_HOST, service);
+    free(service);
+    return ret;
+  } else if (uri -> port) {
     return socket_create(uri -> host, uri -> port);
   } else {
     return socket_create_byservice(uri -> host, uri -> scheme);
@@ -406,7 +588,10 @@ socket_t * socket_open(uri_t *uri) {
 socket_t * socket_create_byservice(char *host, char *service) {
   socket_t        *ret;
 
-  ret = _socket_open(host, service, (socket_fnc_t) connect);
+  if (!host) {
+    host = SOCKET_UNIX_HOST;
+  }
+  ret = _socket_open(host, service, (socket_fnc_t) connect, FALSE);
   return ret;
 }
 
@@ -418,7 +603,19 @@ socket_t * serversocket_create(int port) {
 }
 
 socket_t * serversocket_create_byservice(char *service) {
-  return _socket_open(NULL, service, (socket_fnc_t) bind);
+  return _socket_open(NULL, service, (socket_fnc_t) bind, FALSE);
+}
+
+/*
+ * Opens another listening socket on the port of <code>server</code>, for
+ * event loops with more than one acceptor. Sets SO_REUSEPORT on both.
+ */
+socket_t * _serversocket_create_shared(socket_t *server) {
+  if (_socket_set_reuseport(server -> fh)) {
+    return _socket_error(NULL, server -> service,
+                         "setsockopt(SO_REUSEPORT) failed: %s", strerror(errno));
+  }
+  return _socket_open(NULL, server -> service, (socket_fnc_t) bind, TRUE);
 }
 
 /* -- E R R O R  H A N D L I N G ------------------------------------------ */
@@ -473,15 +670,50 @@ socket_t * socket_set_error(socket_t *socket, data_t *error) {
 /* ------------------------------------------------------------------------ */
 
 int socket_close(socket_t *socket) {
-  int ret;
+  int          ret;
+#ifdef HAVE_SYS_UN_H
+  char        *path;
+  struct stat  st;
+#endif /* HAVE_SYS_UN_H */
 
+  if (socket -> fh < 0) {
+    return 0;
+  }
+  stream_flush((stream_t *) socket);
   socket_interrupt(socket);
   if ((ret = closesocket(socket -> fh))) {
     socket_set_errno(socket, "closesocket()");
   }
+  socket -> fh = -1;
+#ifdef HAVE_SYS_UN_H
+  if (socket -> unix_owner == (long) getpid()) {
+    path = socket -> service + strlen(SOCKET_UNIX_PREFIX);
+    if (!stat(path, &st) && ((long) st.st_ino == socket -> unix_inode)) {
+      unlink(path);
+    }
+    socket -> unix_owner = 0;
+  }
+#endif /* HAVE_SYS_UN_H */
   return ret;
 }
 
+/*
+ * Shuts down both directions of the connection without closing the
+ * descriptor. Unlike closing it, this wakes up another thread that is
+ * blocked reading from the socket.
+ */
+int socket_shutdown(socket_t *socket) {
+  if (socket -> fh < 0) {
+    return 0;
+  }
+  stream_flush((stream_t *) socket);
+  if (shutdown(socket -> fh, SD_BOTH)) {
+    socket_set_errno(socket, "shutdown()");
+    return -1;
+  }
+  return 0;
+}
+
 int socket_cmp(socket_t *s1, socket_t *s2) {
   return (s1 -> fh == s2 -> fh) ? 0 : 1;
 }
@@ -498,6 +730,16 @@ int socket_listen_detach(socket_t *socket, service_t service, void *context) {
   return _socket_listen(socket, service, context, 1);
 }
 
+/**
+ * Like socket_listen, but runs each connection in a green thread instead of
+ * an OS thread. Services that take mutexes or sleep on conditions tie up a
+ * carrier while doing so, and should use socket_listen instead.
+ */
+int socket_listen_green(socket_t *socket, service_t service, void *context) {
+  socket -> green = TRUE;
+  return _socket_listen(socket, service, context, 0);
+}
+
 socket_t * socket_interrupt(socket_t *socket) {
   if (socket -> thread) {
     thread_interrupt(socket -> thread);
@@ -523,61 +765,82 @@ socket_t * socket_nonblock(socket_t *socket) {
   }
 }
 
-int _socket_readblock(socket_t *socket, void *buf, int num) {
-  int  ret = 0;
-  int  num_remaining = num;
-  int  total_numrecv = 0;
-  int  numrecv;
+/*
+ * Sets the read and write timeouts in milliseconds. A negative timeout
+ * waits indefinitely, which is the default.
+ */
+socket_t * socket_set_timeout(socket_t *socket, int read_timeout, int write_timeout) {
+  socket -> read_timeout = read_timeout;
+  socket -> write_timeout = write_timeout;
+  return socket;
+}
 
-  numrecv = TEMP_FAILURE_RETRY(recv(socket -> fh, buf, num_remaining, 0));
-  if (numrecv > 0) {
-    num_remaining -= numrecv;
-    total_numrecv += numrecv;
-    ret += numrecv;
-    buf = (void *)(((char *) buf) + numrecv);
-    debug(socket, "socket_read(%s, %d) = %d", data_tostring((data_t *) socket), num, total_numrecv);
-  } else if ((numrecv == 0) ||
+int _socket_would_block(void) {
 #ifdef HAVE_WINSOCK2_H
-             (WSAGetLastError() == WSAEWOULDBLOCK)) {
+  return WSAGetLastError() == WSAEWOULDBLOCK;
 #else
-             (errno == EWOULDBLOCK)) {
+  return (errno == EWOULDBLOCK) || (errno == EAGAIN);
 #endif /* HAVE_WINSOCK2_H */
-    debug(socket, "socket_read(%s, %d) Blocked", data_tostring((data_t *) socket), num);
-  } else {
-    socket_set_errno(socket, "socket_read()->recv()");
-    ret = -1;
+}
+
+/*
+ * Waits until the socket is ready for the given poll(2) events. Returns 0
+ * when it is, and -1 with the socket error set on timeout or failure.
+ */
+int _socket_wait(socket_t *socket, short events, int timeout, char *op) {
+  struct pollfd pfd;
+  int           ret;
+
+  debug(socket, "%s(%s) waiting, timeout %d", op, socket_tostring(socket), timeout);
+  if (coroutine_current()) {
+    ret = coroutine_wait_fd(socket -> fh,
+                            ((events & POLLIN) ? CoroutineRead : 0) | ((events & POLLOUT) ? CoroutineWrite : 0),
+                            timeout);
+    if (ret) {
+      socket_set_errno(socket, op);
+    }
+    return ret;
   }
-  return ret;
+  pfd.fd = socket -> fh;
+  pfd.events = events;
+  pfd.revents = 0;
+  ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout));
+  if (ret < 0) {
+    socket_set_errno(socket, op);
+    return -1;
+  } else if (!ret) {
+    errno = ETIMEDOUT;
+    socket_set_errno(socket, op);
+    return -1;
+  }
+  return 0;
 }
 
+/*
+ * Reads at most num bytes. Returns as soon as any data is available, 0 at
+ * end of file, and -1 on error or when read_timeout expires.
+ */
 int socket_read(socket_t *socket, void *buf, int num) {
-  int            ret = 0;
-  fd_set         set;
-  struct timeval timeout;
-  int            err;
+  int ret;
 
   if (socket_debug) {
     memset(buf, 0, num);
   }
-  debug(socket, "socket_read(%s, %d)", data_tostring((data_t *) socket), num);
-
-  ret = _socket_readblock(socket, buf, num);
-  if (!ret) {
-    do {
-      FD_ZERO(&set);
-      FD_SET(socket -> fh, &set);
-      timeout.tv_sec = 1;
-      timeout.tv_usec = 0;
-      debug(socket, "socket_read(%s, %d) select()", data_tostring((data_t *) socket), num);
-      err = TEMP_FAILURE_RETRY(select(1, &set, NULL, NULL, &timeout));
-      if (err < 0) {
-        socket_set_errno(socket, "socket_read()->select()");
-        return -1;
-      }
-    } while (!err);
-    debug(socket, "socket_read(%s, %d) _readblock()", data_tostring((data_t *) socket), num);
-    ret = _socket_readblock(socket, buf, num);
+  debug(socket, "socket_read(%s, %d)", socket_tostring(socket), num);
+  if ((socket -> read_timeout >= 0) &&
+      _socket_wait(socket, POLLIN, socket -> read_timeout, "socket_read()")) {
+    return -1;
+  }
+  while ((ret = TEMP_FAILURE_RETRY(recv(socket -> fh, buf, num, _socket_io_flags()))) < 0) {
+    if (!_socket_would_block()) {
+      socket_set_errno(socket, "socket_read()->recv()");
+      return -1;
+    }
+    if (_socket_wait(socket, POLLIN, socket -> read_timeout, "socket_read()")) {
+      return -1;
+    }
   }
+  debug(socket, "socket_read(%s, %d) = %d", socket_tostring(socket), num, ret);
   return ret;
 }
 
@@ -591,19 +854,52 @@ int socket_write(socket_t *socket, void *buf, int num) {
   int ret = num;
   int numsend;
 
-  do {
-    numsend = TEMP_FAILURE_RETRY(send(socket -> fh, buf, num, SOCKET_SEND_FLAGS));
+  while (num > 0) {
+    if ((socket -> write_timeout >= 0) &&
+        _socket_wait(socket, POLLOUT, socket -> write_timeout, "send()")) {
+      return -1;
+    }
+    numsend = TEMP_FAILURE_RETRY(send(socket -> fh, buf, num, SOCKET_SEND_FLAGS | _socket_io_flags()));
     if (numsend > 0) {
       num = num - numsend;
       buf = (void *) (((char *) buf) + numsend);
+    } else if ((numsend < 0) && _socket_would_block()) {
+      if (_socket_wait(socket, POLLOUT, socket -> write_timeout, "send()")) {
+        return -1;
+      }
     } else {
       socket_set_errno(socket, "send()");
-      ret = -1;
+      return -1;
     }
-  } while ((ret > 0) && (num > 0));
+  }
   return ret;
 }
 
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UIO_H)
+int socket_writev(socket_t *socket, struct iovec *iov, int iovcnt) {
+  struct msghdr msg;
+  int           ret;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+  if ((socket -> write_timeout >= 0) &&
+      _socket_wait(socket, POLLOUT, socket -> write_timeout, "sendmsg()")) {
+    return -1;
+  }
+  while ((ret = TEMP_FAILURE_RETRY(sendmsg(socket -> fh, &msg, SOCKET_SEND_FLAGS | _socket_io_flags()))) < 0) {
+    if (!_socket_would_block()) {
+      socket_set_errno(socket, "sendmsg()");
+      break;
+    }
+    if (_socket_wait(socket, POLLOUT, socket -> write_timeout, "sendmsg()")) {
+      break;
+    }
+  }
+  return ret;
+}
+#endif
+
 /* ------------------------------------------------------------------------ */
 
 data_t * _socket_close(data_t *self, char *name, arguments_t *args) {
@@ -653,3 +949,18 @@ void * connection_listener_service(connection_t *connection) {
   arguments_free(args);
   return ret;
 }
+
+/**
+ * Lets a connection paused with SERVICE_PAUSE call its service again.
+ */
+void connection_resume(connection_t *connection) {
+  if (connection -> resume) {
+    condition_acquire(connection -> resume);
+    connection -> resumed = 1;
+    condition_wakeup(connection -> resume);
+#ifdef HAVE_SYS_EPOLL_H
+  } else {
+    _eventloop_resume(connection);
+#endif /* HAVE_SYS_EPOLL_H */
+  }
+}
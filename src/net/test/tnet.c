@@ -17,6 +17,10 @@
  * along with Obelix.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "tnet.h"
 
 /* ----------------------------------------------------------------------- */
@@ -105,6 +109,182 @@ END_TEST
 
 /* ----------------------------------------------------------------------- */
 
+static void * _echo_service(connection_t *connection) {
+  char *line;
+  int   quit;
+
+  line = stream_readline((stream_t *) connection -> client);
+  if (!line) {
+    return NULL;
+  }
+  quit = !strcmp(line, "quit");
+  stream_write((stream_t *) connection -> client, line, strlen(line));
+  stream_write((stream_t *) connection -> client, "\n", 1);
+  stream_flush((stream_t *) connection -> client);
+  free(line);
+  return (quit) ? NULL : SERVICE_KEEPALIVE;
+}
+
+static void * _line_service(connection_t *connection) {
+  stream_t *stream = (stream_t *) connection -> client;
+
+  if (!memchr(stream -> buffer + stream -> pos, '\n', stream -> len - stream -> pos) &&
+      (stream_fill(stream) > 0) &&
+      !memchr(stream -> buffer + stream -> pos, '\n', stream -> len - stream -> pos)) {
+    return SERVICE_INCOMPLETE;
+  }
+  return _echo_service(connection);
+}
+
+static char * _echo(socket_t *client, char *line) {
+  stream_write((stream_t *) client, line, strlen(line));
+  stream_flush((stream_t *) client);
+  return stream_readline((stream_t *) client);
+}
+
+START_TEST(test_socket_serve)
+  socket_t        *server;
+  socket_t        *client;
+  serve_options_t  options = { .workers = 2 };
+  char            *line;
+
+  server = serversocket_create_byservice("14399");
+  ck_assert_ptr_eq(server -> _stream.error, NULL);
+  ck_assert_int_eq(socket_serve_detach(server, _echo_service, NULL, &options), 0);
+  client = socket_create("localhost", 14399);
+  ck_assert_ptr_eq(client -> _stream.error, NULL);
+  line = _echo(client, "Hello\n");
+  ck_assert_str_eq(line, "Hello");
+  free(line);
+  line = _echo(client, "One\nTwo\n");
+  ck_assert_str_eq(line, "One");
+  free(line);
+  line = stream_readline((stream_t *) client);
+  ck_assert_str_eq(line, "Two");
+  free(line);
+  line = _echo(client, "quit\n");
+  ck_assert_str_eq(line, "quit");
+  free(line);
+  socket_free(client);
+  socket_interrupt(server);
+  socket_free(server);
+END_TEST
+
+START_TEST(test_socket_serve_acceptors)
+  socket_t        *server;
+  socket_t        *other;
+  socket_t        *clients[8];
+  serve_options_t  options = { .workers = 2, .acceptors = 3 };
+  char            *line;
+  int              ix;
+
+  server = serversocket_create_byservice("14397");
+  ck_assert_ptr_eq(server -> _stream.error, NULL);
+  ck_assert_int_eq(socket_serve_detach(server, _echo_service, NULL, &options), 0);
+  other = serversocket_create_byservice("14397");
+  ck_assert_ptr_ne(other -> _stream.error, NULL);
+  socket_free(other);
+  for (ix = 0; ix < 8; ix++) {
+    clients[ix] = socket_create("localhost", 14397);
+    ck_assert_ptr_eq(clients[ix] -> _stream.error, NULL);
+  }
+  for (ix = 0; ix < 8; ix++) {
+    line = _echo(clients[ix], "Hello\n");
+    ck_assert_str_eq(line, "Hello");
+    free(line);
+    socket_free(clients[ix]);
+  }
+  socket_interrupt(server);
+  socket_free(server);
+END_TEST
+
+START_TEST(test_socket_serve_incomplete)
+  socket_t        *server;
+  socket_t        *slow;
+  socket_t        *client;
+  serve_options_t  options = { .workers = 1 };
+  char            *line;
+
+  server = serversocket_create_byservice("14396");
+  ck_assert_int_eq(socket_serve_detach(server, _line_service, NULL, &options), 0);
+  slow = socket_create("localhost", 14396);
+  stream_write((stream_t *) slow, "Hel", 3);
+  stream_flush((stream_t *) slow);
+  usleep(100000);
+  client = socket_create("localhost", 14396);
+  line = _echo(client, "Hello\n");
+  ck_assert_str_eq(line, "Hello");
+  free(line);
+  line = _echo(slow, "lo\n");
+  ck_assert_str_eq(line, "Hello");
+  free(line);
+  socket_free(client);
+  socket_free(slow);
+  socket_interrupt(server);
+  socket_free(server);
+END_TEST
+
+START_TEST(test_socket_read_timeout)
+  socket_t        *server;
+  socket_t        *client;
+  serve_options_t  options = { .workers = 1 };
+
+  server = serversocket_create_byservice("14398");
+  ck_assert_int_eq(socket_serve_detach(server, _echo_service, NULL, &options), 0);
+  client = socket_create("localhost", 14398);
+  ck_assert_ptr_eq(client -> _stream.error, NULL);
+  socket_set_timeout(client, 100, -1);
+  ck_assert_ptr_eq(stream_readline((stream_t *) client), NULL);
+  ck_assert_int_eq(socket_errno(client), ETIMEDOUT);
+  socket_free(client);
+  socket_interrupt(server);
+  socket_free(server);
+END_TEST
+
+START_TEST(test_socket_unix)
+  socket_t        *server;
+  socket_t        *client;
+  uri_t           *u;
+  char            *line;
+
+  server = serversocket_create_byservice("unix:/tmp/tnet.sock");
+  ck_assert_ptr_eq(server -> _stream.error, NULL);
+  ck_assert_int_eq(socket_serve_detach(server, _echo_service, NULL, NULL), 0);
+  u = uri_create("unix:/tmp/tnet.sock");
+  client = socket_open(u);
+  ck_assert_ptr_eq(client -> _stream.error, NULL);
+  line = _echo(client, "Hello\n");
+  ck_assert_str_eq(line, "Hello");
+  free(line);
+  socket_free(client);
+  uri_free(u);
+  socket_interrupt(server);
+  socket_free(server);
+END_TEST
+
+START_TEST(test_socket_unix_in_use)
+  socket_t        *server;
+  socket_t        *other;
+  pid_t            pid;
+
+  server = serversocket_create_byservice("unix:/tmp/tnet2.sock");
+  ck_assert_ptr_eq(server -> _stream.error, NULL);
+  ck_assert_int_eq(socket_serve_detach(server, _echo_service, NULL, NULL), 0);
+  other = serversocket_create_byservice("unix:/tmp/tnet2.sock");
+  ck_assert_ptr_ne(other -> _stream.error, NULL);
+  socket_free(other);
+  if (!(pid = fork())) {
+    socket_close(server);
+    _exit(0);
+  }
+  waitpid(pid, NULL, 0);
+  ck_assert_int_eq(access("/tmp/tnet2.sock", F_OK), 0);
+  socket_interrupt(server);
+  socket_close(server);
+  ck_assert_int_ne(access("/tmp/tnet2.sock", F_OK), 0);
+  socket_free(server);
+END_TEST
+
 /* ----------------------------------------------------------------------- */
 
 void create_uri(void) {
@@ -123,6 +303,18 @@ void create_uri(void) {
   add_tcase(tc);
 }
 
+void create_socket(void) {
+  TCase *tc = tcase_create("Socket");
+  tcase_add_test(tc, test_socket_serve);
+  tcase_add_test(tc, test_socket_serve_acceptors);
+  tcase_add_test(tc, test_socket_serve_incomplete);
+  tcase_add_test(tc, test_socket_read_timeout);
+  tcase_add_test(tc, test_socket_unix);
+  tcase_add_test(tc, test_socket_unix_in_use);
+  add_tcase(tc);
+}
+
 extern void init_suite(int argc, char **argv) {
   create_uri();
+  create_socket();
 }
@@ -50,6 +50,10 @@ static parser_t *             _parser_set(entry_t *, parser_t *);
 static int                    _parser_ll1_token_handler(token_t *, parser_t *, int);
 static parser_t *             _parser_ll1(token_t *, parser_t *);
 static parser_t *             _parser_lr1(token_t *, parser_t *);
+static parser_t *             _parser_lr_push(parser_t *, int, token_t *);
+static parser_t *             _parser_lr_reduce(parser_t *, int, token_t *);
+static parser_t *             _parser_execute_action(parser_t *, grammar_action_t *);
+static reduce_t               _parser_driver(parser_t *);
 
 static parser_t *             _parser_new(parser_t *, va_list);
 static void                   _parser_free(parser_t *);
@@ -288,21 +292,7 @@ char * _pse_allocstring_Action(parser_stack_entry_t *e) {
 }
 
 int _pse_execute_Action(parser_stack_entry_t *e, parser_t *parser, token_t *token) {
-  parser_t         *ret;
-  grammar_action_t *action = (grammar_action_t *) e -> subject;
-
-  assert(action && action -> fnc && action -> fnc -> fnc);
-  debug(parser, "Action '%s'", data_tostring(e -> subject));
-  if (action -> data) {
-    ret = ((parser_data_fnc_t) action -> fnc -> fnc)(parser, action -> data);
-  } else {
-    ret = ((parser_fnc_t) action -> fnc -> fnc)(parser);
-  }
-  if (!ret) {
-    parser -> error = data_exception(
-            ErrorSyntax, "Error executing grammar action %s",
-            grammar_action_tostring(action));
-  }
+  _parser_execute_action(parser, (grammar_action_t *) e -> subject);
   return parser -> state;
 }
 
@@ -316,6 +306,9 @@ parser_t * _parser_new(parser_t *parser, va_list args) {
   parser -> error = NULL;
   parser -> stack = datastack_create("__parser__");
   parser -> variables = strdata_dict_create();
+  parser -> lr_stack = NULL;
+  parser -> lr_top = -1;
+  parser -> lr_size = 0;
   datastack_set_debug(parser -> stack, parser_debug);
   return parser;
 }
@@ -327,6 +320,10 @@ void _parser_free(parser_t *parser) {
     list_free(parser -> prod_stack);
     datastack_free(parser -> stack);
     dict_free(parser -> variables);
+    while (parser -> lr_top >= 0) {
+      token_free(parser -> lr_stack[parser -> lr_top--].token);
+    }
+    free(parser -> lr_stack);
   }
 }
 
@@ -368,12 +365,137 @@ data_t * _parser_resolve(parser_t *parser, char *name) {
 
 /* -- P A R S E R  S T A T I C  F U N C T I O N S ------------------------- */
 
-parser_t * _parser_lr1(token_t *token, parser_t *parser) {
-  error("Bottom-up parsing is not yet implemented");
-  assert(0);
+parser_t * _parser_execute_action(parser_t *parser, grammar_action_t *action) {
+  parser_t *ret;
+
+  assert(action && action -> fnc && action -> fnc -> fnc);
+  debug(parser, "Action '%s'", grammar_action_tostring(action));
+  if (action -> data) {
+    ret = ((parser_data_fnc_t) action -> fnc -> fnc)(parser, action -> data);
+  } else {
+    ret = ((parser_fnc_t) action -> fnc -> fnc)(parser);
+  }
+  if (!ret) {
+    parser -> error = data_exception(
+            ErrorSyntax, "Error executing grammar action %s",
+            grammar_action_tostring(action));
+  }
+  return ret;
+}
+
+reduce_t _parser_driver(parser_t *parser) {
+  return (reduce_t) ((parser -> grammar -> strategy == ParsingStrategyBottomUp)
+    ? _parser_lr1
+    : _parser_ll1);
+}
+
+parser_t * _parser_lr_push(parser_t *parser, int state, token_t *token) {
+  if (parser -> lr_top + 1 >= parser -> lr_size) {
+    parser -> lr_stack = resize_block(
+      parser -> lr_stack,
+      ((parser -> lr_size) ? 2 * parser -> lr_size : 32) * sizeof(parser_lr_entry_t),
+      parser -> lr_size * sizeof(parser_lr_entry_t));
+    parser -> lr_size = (parser -> lr_size) ? 2 * parser -> lr_size : 32;
+  }
+  parser -> lr_top++;
+  parser -> lr_stack[parser -> lr_top].state = state;
+  parser -> lr_stack[parser -> lr_top].token = token_copy(token);
   return parser;
 }
 
+/*
+ * Reduces the top of the LR stack by the given production. The actions of
+ * the production are executed with last_token set to the token the top-down
+ * parser would have seen when executing them: the lookahead for actions
+ * which are executed at the start of a rule, and the last token consumed by
+ * the production otherwise.
+ */
+parser_t * _parser_lr_reduce(parser_t *parser, int p, token_t *lookahead) {
+  lr_table_t      *table = parser -> grammar -> lr_table;
+  lr_production_t *production = &table -> productions[p];
+  token_t         *token;
+  int              ix;
+
+  token = token_copy((production -> lookahead)
+    ? lookahead
+    : parser -> lr_stack[parser -> lr_top].token);
+  debug(parser, "Reduce %d (%s) with token '%s'", p,
+        (production -> rule) ? rule_tostring(production -> rule) : "marker",
+        token_tostring(token));
+  for (ix = 0; !parser -> error && (ix < production -> num_actions); ix++) {
+    token_free(parser -> last_token);
+    parser -> last_token = token_copy(token);
+    _parser_execute_action(parser, production -> actions[ix]);
+  }
+  for (ix = 0; ix < production -> length; ix++) {
+    token_free(parser -> lr_stack[parser -> lr_top--].token);
+  }
+  _parser_lr_push(parser,
+                  lr_table_goto(table, parser -> lr_stack[parser -> lr_top].state,
+                                production -> lhs),
+                  token);
+  token_free(token);
+  return (parser -> error) ? NULL : parser;
+}
+
+parser_t * _parser_lr1(token_t *token, parser_t *parser) {
+  lr_table_t *table = parser -> grammar -> lr_table;
+  int         code = token_code(token);
+  int         action;
+  int         p;
+
+  if (code == TokenCodeEOF) {
+    return parser;
+  }
+  assert(table);
+  if (parser -> state & ParserStateDone) {
+    parser -> error = data_exception(ErrorSyntax,
+      "Expected end of text, read unexpected token '%s'", token_tostring(token));
+    return NULL;
+  }
+  while (!parser -> error) {
+    action = lr_table_action(table, parser -> lr_stack[parser -> lr_top].state, code);
+    if (action > 0) {
+      debug(parser, "Shift '%s', goto state %d", token_tostring(token), action - 1);
+      token_free(parser -> last_token);
+      parser -> last_token = token_copy(token);
+      _parser_lr_push(parser, action - 1, token);
+
+      /*
+       * Perform reductions that don't depend on the next token right away,
+       * so that actions following a terminal are executed before the lexer
+       * scans the next token, like the top-down parser does:
+       */
+      while (!parser -> error) {
+        p = table -> default_reduction[parser -> lr_stack[parser -> lr_top].state];
+        if ((p <= 0) || table -> productions[p].lookahead) {
+          break;
+        }
+        _parser_lr_reduce(parser, p, token);
+      }
+      break;
+    } else if (action < 0) {
+      p = -action - 1;
+      if (!p) {
+        debug(parser, "Accept");
+        parser -> state = ParserStateDone;
+        break;
+      }
+      _parser_lr_reduce(parser, p, token);
+    } else {
+      if (code != TokenCodeEnd) {
+        parser -> error = data_exception(ErrorSyntax,
+          "Unexpected token '%s'", token_tostring(token));
+      } else {
+        parser -> error = data_exception(ErrorSyntax,
+          "Unexpected end of program text");
+      }
+      parser -> state = ParserStateError;
+    }
+  }
+  return (parser -> error) ? NULL : parser;
+}
+
 parser_t * _parser_dump_prod_stack(parser_t *parser) {
   parser_stack_entry_t *entry;
 
@@ -491,13 +613,21 @@ parser_t * parser_clear(parser_t *parser) {
   parser -> error = NULL;
   lexer_free(parser -> lexer);
   parser -> lexer = NULL;
+  while (parser -> lr_top >= 0) {
+    token_free(parser -> lr_stack[parser -> lr_top--].token);
+  }
+  parser -> state = ParserStateNone;
   return parser;
 }
 
 parser_t * parser_start(parser_t *parser) {
   parser_clear(parser);
-  list_append(parser -> prod_stack,
-              _parser_stack_entry_for_nonterminal(parser -> grammar -> entrypoint));
+  if (parser -> grammar -> strategy == ParsingStrategyBottomUp) {
+    _parser_lr_push(parser, 0, NULL);
+  } else {
+    list_append(parser -> prod_stack,
+                _parser_stack_entry_for_nonterminal(parser -> grammar -> entrypoint));
+  }
   return parser;
 }
 
@@ -519,7 +649,7 @@ data_t * parser_parse_reader(parser_t *parser, data_t *reader) {
   debug(parser, "Parsing reader '%s'.", data_tostring(reader))
   parser -> lexer = lexer_create(parser -> grammar -> lexer, reader);
   parser -> lexer -> data = parser;
-  lexer_tokenize(parser -> lexer, _parser_ll1, parser);
+  lexer_tokenize(parser -> lexer, _parser_driver(parser), parser);
   ret = parser -> error;
   parser -> error = NULL;
   debug(parser, "Parsed reader '%s'. Result: '%s'",
@@ -536,7 +666,7 @@ data_t * parser_parse_reader(parser_t *parser, data_t *reader) {
 data_t * parser_send_token(parser_t *parser, token_t *token) {
   data_t *ret;
 
-  _parser_ll1(token, parser);
+  _parser_driver(parser)(token, parser);
   ret = parser -> error;
   parser -> error = NULL;
   debug(parser, "Parsed token '%s'. Result: '%s'",
@@ -31,7 +31,7 @@ static parser_t         *parser = NULL;
 
 static data_t           *result = NULL;
 
-static void _create_parser(char *grammarfile) {
+static void _create_parser_with_strategy(char *grammarfile, strategy_t strategy) {
   char             *grammar_path;
 
   asprintf(&grammar_path, "../share/grammar/%s.grammar", grammarfile);
@@ -41,10 +41,18 @@ static void _create_parser(char *grammarfile) {
   ck_assert(gp);
   grammar = grammar_parser_parse(gp);
   ck_assert(grammar);
+  if (strategy != grammar_get_parsing_strategy(grammar)) {
+    grammar_set_parsing_strategy(grammar, strategy);
+    ck_assert(grammar_analyze(grammar));
+  }
   parser = parser_create(gp -> grammar);
   ck_assert(parser);
 }
 
+static void _create_parser(char *grammarfile) {
+  _create_parser_with_strategy(grammarfile, ParsingStrategyTopDown);
+}
+
 static void _teardown(void) {
   data_free(result);
   parser_free(parser);
@@ -86,11 +94,11 @@ __DLL_EXPORT__ parser_t * expr_call_op(parser_t *parser) {
   return parser;
 }
 
-data_t * evaluate(char *str) {
+data_t * evaluate_with_strategy(char *str, strategy_t strategy) {
   str_t  *text = str_copy_chars(str);
   data_t *ret;
 
-  _create_parser("expr");
+  _create_parser_with_strategy("expr", strategy);
   // grammar_dump(grammar);
   ret = parser_parse(parser, (data_t *) text);
   str_free(text);
@@ -102,6 +110,10 @@ data_t * evaluate(char *str) {
   return result;
 }
 
+data_t * evaluate(char *str) {
+  return evaluate_with_strategy(str, ParsingStrategyTopDown);
+}
+
 /* ----------------------------------------------------------------------- */
 
 START_TEST(test_parser_create)
@@ -145,6 +157,26 @@ END_TEST
 
 /* ----------------------------------------------------------------------- */
 
+START_TEST(test_parser_lr_create)
+  _create_parser_with_strategy("expr", ParsingStrategyBottomUp);
+  ck_assert(grammar -> lr_table);
+END_TEST
+
+START_TEST(test_parser_lr_parse)
+  evaluate_with_strategy("1+1", ParsingStrategyBottomUp);
+  ck_assert_int_eq(data_intval(result), 2);
+END_TEST
+
+START_TEST(test_parser_lr_signed_number)
+  evaluate_with_strategy("1 - -2", ParsingStrategyBottomUp);
+  ck_assert_int_eq(data_intval(result), 3);
+END_TEST
+
+START_TEST(test_parser_lr_precedence)
+  evaluate_with_strategy("2 * ((3*2) + 4)", ParsingStrategyBottomUp);
+  ck_assert_int_eq(data_intval(result), 20);
+END_TEST
+
 /* ----------------------------------------------------------------------- */
 
 void create_parser(void) {
@@ -161,6 +193,17 @@ void create_parser(void) {
   add_tcase(tc);
 }
 
+void create_parser_lr(void) {
+  TCase *tc = tcase_create("ParserLR");
+  tcase_add_checked_fixture(tc, NULL, _teardown);
+  tcase_add_test(tc, test_parser_lr_create);
+  tcase_add_test(tc, test_parser_lr_parse);
+  tcase_add_test(tc, test_parser_lr_signed_number);
+  tcase_add_test(tc, test_parser_lr_precedence);
+  add_tcase(tc);
+}
+
 extern void init_suite(int argc, char **argv) {
   create_parser();
+  create_parser_lr();
 }
@@ -21,6 +21,7 @@
 #include <unistd.h>
 
 #include <array.h>
+#include <coroutine.h>
 #include <data.h>
 
 __DLL_EXPORT__ _unused_ data_t * _function_print(char *_unused_ func_name, arguments_t *args) {
@@ -52,6 +53,9 @@ __DLL_EXPORT__ _unused_ data_t * _function_sleep(char _unused_ *func_name, argum
   assert(args && arguments_args_size(args));
   naptime = data_uncopy(arguments_get_arg(args, 0));
   assert(naptime);
+  if (coroutine_current()) {
+    return int_to_data(coroutine_sleep(data_intval(naptime) * 1000L));
+  }
   return int_to_data(sleep((unsigned int) data_intval(naptime)));
 }
 
@@ -61,5 +65,8 @@ __DLL_EXPORT__ _unused_ data_t * _function_usleep(char _unused_ *func_name, argu
   assert(args && arguments_args_size(args));
   naptime = data_uncopy(arguments_get_arg(args, 0));
   assert(naptime);
+  if (coroutine_current()) {
+    return int_to_data(coroutine_sleep(data_intval(naptime) / 1000L));
+  }
   return int_to_data(usleep((useconds_t) data_intval(naptime)));
 }
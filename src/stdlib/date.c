@@ -24,6 +24,7 @@
 #include <data.h>
 #include <dictionary.h>
 #include <exception.h>
+#include <pack.h>
 #include <str.h>
 
 typedef enum _datetime_flag {
@@ -58,6 +59,8 @@ static int            _timebase_intval(datetime_t *);
 static data_t *       _timebase_cast(datetime_t *, int);
 static dictionary_t * _timebase_serialize(datetime_t *);
 static data_t *       _timebase_deserialize(dictionary_t *);
+static data_t *       _timebase_pack(datetime_t *);
+static data_t *       _timebase_unpack(int, data_t *);
 static struct tm *    _timebase_tm(datetime_t *);
 static datetime_t *   _timebase_assign(datetime_t *);
 
@@ -68,6 +71,8 @@ static vtable_t _vtable_Timebase[] = {
   { .id = FunctionCast,        .fnc = (void_t) _timebase_cast },
   { .id = FunctionSerialize,   .fnc = (void_t) _timebase_serialize },
   { .id = FunctionDeserialize, .fnc = (void_t) _timebase_deserialize },
+  { .id = FunctionPack,        .fnc = (void_t) _timebase_pack },
+  { .id = FunctionUnpack,      .fnc = (void_t) _timebase_unpack },
   { .id = FunctionNone,        .fnc = NULL }
 };
 
@@ -156,6 +161,9 @@ void _date_init(void) {
     typedescr_register_with_methods(Datetime, datetime_t);
     typedescr_assign_inheritance(Datetime, Time);
     typedescr_assign_inheritance(Datetime, Date);
+    pack_register_type(Datetime, PackTypeDatetime);
+    pack_register_type(Date, PackTypeDate);
+    pack_register_type(Time, PackTypeTime);
   }
   assert(Datetime);
 }
@@ -231,6 +239,16 @@ data_t * _timebase_deserialize(dictionary_t *serialized) {
       data_intval(dictionary_get(serialized, "timestamp")));
 }
 
+data_t * _timebase_pack(datetime_t *timebase) {
+  return int_to_data(timebase -> dt);
+}
+
+data_t * _timebase_unpack(int type, data_t *packed) {
+  return (data_is_int(packed))
+    ? data_create(type, DatetimeFlagTimeT, (time_t) data_intval(packed))
+    : NULL;
+}
+
 struct tm * _timebase_tm(datetime_t *timebase) {
   if (!timebase -> tm_set) {
     if (!gmtime_r(&timebase -> dt, &timebase -> tm)) {
@@ -21,27 +21,38 @@
 
 /* -------------------------------------------------------------------------*/
 
+/*
+ * connect(host, service) opens a TCP connection. connect("unix:/path")
+ * connects to a Unix domain socket.
+ */
 __DLL_EXPORT__ _unused_ socket_t * _function_connect(_unused_ char *name, arguments_t *args) {
   char     *host;
   char     *service;
   socket_t *socket;
 
-  assert(args && (arguments_args_size(args) >= 2));
-  host = arguments_arg_tostring(args, 0);
-  service = arguments_arg_tostring(args, 1);
+  assert(args && (arguments_args_size(args) >= 1));
+  if (arguments_args_size(args) == 1) {
+    host = NULL;
+    service = arguments_arg_tostring(args, 0);
+  } else {
+    host = arguments_arg_tostring(args, 0);
+    service = arguments_arg_tostring(args, 1);
+  }
 
   socket = socket_create_byservice(host, service);
   return socket;
 }
 
 /*
+ * The service is a TCP port or "unix:/path" for a Unix domain socket.
+ *
  * TODO: Parameterize what interface we want to listen on.
  */
 __DLL_EXPORT__ _unused_ socket_t * _function_server(_unused_ char *name, arguments_t *args) {
   char *service;
 
   assert(args && (arguments_args_size(args) >= 1));
-  service = arguments_arg_tostring(args, 1);
+  service = arguments_arg_tostring(args, 0);
 
   return serversocket_create_byservice(service);
 }
@@ -55,7 +66,7 @@ __DLL_EXPORT__ _unused_ data_t * _function_listener(_unused_ char *name, argumen
   if (listener) {
     server = arguments_get_arg(args, 1);
     assert(data_is_callable(server));
-    socket_listen(listener, connection_listener_service, server);
+    socket_serve(listener, connection_listener_service, server, NULL);
   }
   return data_exception_from_errno();
 }
@@ -0,0 +1,65 @@
+/*
+ * obelix/src/stdlib/pack.c - Copyright (c) 2026 Jan de Visser <jan@finiandarcy.com>
+ *
+ * This file is part of obelix.
+ *
+ * obelix is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * obelix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obelix.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libstdlib.h"
+
+#include <string.h>
+
+#include <exception.h>
+#include <pack.h>
+#include <str.h>
+
+/* -------------------------------------------------------------------------*/
+
+/*
+ * pack(value) returns the binary encoding of value as a string. It is
+ * usually a good deal smaller than encode(value), and faster to produce and
+ * read back.
+ */
+__DLL_EXPORT__ _unused_ data_t * _function_pack(_unused_ char *name, arguments_t *args) {
+  char   *buf;
+  size_t  len;
+  str_t  *ret;
+
+  assert(args && (arguments_args_size(args) >= 1));
+  if (!(buf = data_pack(arguments_get_arg(args, 0), &len))) {
+    return data_exception(ErrorParameterValue, "Value is nested too deeply to pack");
+  }
+  /* The encoding contains NULs, so the string is built by hand */
+  ret = str_create(len + 1);
+  memcpy(ret -> buffer, buf, len);
+  ret -> len = len;
+  free(buf);
+  return (data_t *) ret;
+}
+
+/*
+ * unpack(packed) rebuilds the value a call to pack() returned.
+ */
+__DLL_EXPORT__ _unused_ data_t * _function_unpack(_unused_ char *name, arguments_t *args) {
+  data_t *packed;
+
+  assert(args && (arguments_args_size(args) >= 1));
+  packed = arguments_get_arg(args, 0);
+  if (!data_is_string(packed)) {
+    return data_exception(ErrorType,
+        "unpack() expects a string, not '%s'", data_typename(packed));
+  }
+  return data_unpack(str_chars((str_t *) packed), str_len((str_t *) packed), NULL);
+}
@@ -32,6 +32,8 @@
 #endif /* HAVE_UNISTD_H */
 
 #include <data.h>
+#include <exception.h>
+#include <threadpool.h>
 #include <user.h>
 
 extern char   **environ;
@@ -251,6 +253,25 @@ __DLL_EXPORT__ _unused_ data_t * _function_exit(_unused_ char *name, arguments_t
 
 /* ------------------------------------------------------------------------ */
 
+/*
+ * poolsize() returns the number of async functions that can run at the same
+ * time. poolsize(n) changes it to n.
+ */
+__DLL_EXPORT__ _unused_ data_t * _function_poolsize(_unused_ char *name, arguments_t *args) {
+  data_t *size;
+
+  if (args && arguments_args_size(args)) {
+    size = arguments_get_arg(args, 0);
+    if (!data_is_int(size) || threadpool_set_size((int) data_intval(size))) {
+      return data_exception(ErrorParameterValue,
+          "Invalid pool size '%s'", data_tostring(size));
+    }
+  }
+  return int_to_data(threadpool_size());
+}
+
+/* ------------------------------------------------------------------------ */
+
 __DLL_EXPORT__ _unused_ data_t * _function_user(char *name, arguments_t *args) {
   int_t *uid;
 
@@ -18,7 +18,7 @@
  */
 
 #include "libvm.h"
-#include <thread.h>
+#include <threadpool.h>
 
 static inline void  _closure_init(void);
 
@@ -284,9 +284,9 @@ data_t * closure_execute(closure_t *closure, arguments_t *args) {
 
   switch (script -> type) {
     case STASync:
-      return (data_t *) thread_new(closure_tostring(closure),
-                                   (threadproc_t) _closure_start,
-                                   closure_copy(closure));
+      return (data_t *) threadpool_submit(closure_tostring(closure),
+                                          (pooljob_t) _closure_start,
+                                          closure_copy(closure), NULL);
     case STGenerator:
       return (data_t *) generator_create(closure, vm_create(closure -> bytecode), NULL);
     default:
@@ -19,6 +19,8 @@
 
 #include "libvm.h"
 #include <stdio.h>
+
+#include <mutex.h>
 #ifdef WITH_READLINE
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -99,6 +101,13 @@ static void _debug_print_var(debugger_t *debugger, char *cmd) {
   }
 }
 
+static void _debug_lock_report(void) {
+  char *report = mutex_report(10);
+
+  printf("%s\n", report);
+  free(report);
+}
+
 /* ----------------------------------------------------------------------- */
 
 OBLVM_IMPEXP debugger_t * debugger_create(vm_t *vm, data_t *scope) {
@@ -153,6 +162,10 @@ OBLVM_IMPEXP debugcmd_t debugger_step_before(debugger_t *debugger, instruction_t
         case 'l':
           _debug_list(debugger, instr);
           break;
+        case 'M':
+        case 'm':
+          _debug_lock_report();
+          break;
         case 'P':
         case 'p':
           _debug_print_var(debugger, trimmed);
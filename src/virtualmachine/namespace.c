@@ -18,6 +18,7 @@
  */
 
 #include "libvm.h"
+#include <coroutine.h>
 
 static inline void   _namespace_init(void);
 
@@ -32,6 +33,11 @@ static void          _ns_free(namespace_t *);
 static char *        _ns_tostring(namespace_t *);
 static module_t *    _ns_add(namespace_t *, name_t *);
 static data_t *      _ns_import(namespace_t *, name_t *, arguments_t *);
+static int           _ns_wait_cycle(namespace_t *, module_t *, thread_t *);
+static data_t *      _ns_import_slow(namespace_t *, name_t *, arguments_t *);
+static void          _ns_wait(namespace_t *);
+static void *        _ns_immortal_reducer(data_t *, void *);
+static module_t *    _ns_immortal_mod_reducer(module_t *, namespace_t *);
 
 int namespace_debug = 0;
 int Module = -1;
@@ -211,6 +217,7 @@ module_t * _mod_new(module_t *mod, va_list args) {
 
   debug(namespace, "  Creating module '%s'", name_tostring(name));
   mod -> state = ModStateUninitialized;
+  mod -> loader = NULL;
   mod -> name = name_copy(name);
   mod -> ns = ns_copy(ns);
   mod -> obj = object_create(NULL);
@@ -364,7 +371,7 @@ data_t * mod_exit_code(module_t *mod) {
 
 module_t * _ns_add_module(namespace_t *ns, name_t *name, module_t *mod) {
   debug(namespace, "_ns_add_module(%s, %s)", ns_tostring(ns), name_tostring(name));
-  dict_put(ns -> modules, strdup(name_tostring(name)), mod);
+  cache_put(ns -> modules, name_tostring(name), mod);
   return mod;
 }
 
@@ -377,7 +384,7 @@ module_t * _ns_add(namespace_t *ns, name_t *name) {
 }
 
 module_t * _ns_get(namespace_t *ns, name_t *name) {
-  return dict_get(ns -> modules, (name) ? name_tostring(name) : "");
+  return cache_get(ns -> modules, (name) ? name_tostring(name) : "");
 }
 
 data_t * _ns_load(namespace_t *ns, module_t *module,
@@ -424,6 +431,90 @@ data_t * _ns_load(namespace_t *ns, module_t *module,
   return ret;
 }
 
+/*
+ * Follows the chain from the thread loading the module to the module that
+ * thread is waiting for, the thread loading that one, and so on. If the
+ * chain leads back to self, waiting would deadlock. Called with the
+ * condition held.
+ */
+int _ns_wait_cycle(namespace_t *ns, module_t *module, thread_t *self) {
+  thread_t *loader;
+  int       hops;
+
+  for (hops = 0;
+       module && (loader = module -> loader) && (hops <= dict_size(ns -> waits));
+       hops++) {
+    if (loader == self) {
+      return TRUE;
+    }
+    module = (module_t *) dict_get_int(ns -> waits, loader);
+  }
+  return FALSE;
+}
+
+/*
+ * Called with the condition held. Green threads can't sleep on the
+ * condition, since the module may be loaded by another green thread on the
+ * same carrier.
+ */
+void _ns_wait(namespace_t *ns) {
+  if (coroutine_current()) {
+    condition_release(ns -> loaded);
+    coroutine_sleep(1);
+    condition_acquire(ns -> loaded);
+  } else {
+    condition_sleep(ns -> loaded);
+  }
+}
+
+/*
+ * Only one thread loads a module. Other threads importing it wait until
+ * it's done, unless the loading thread is itself waiting, directly or
+ * through other threads, for a module this thread is loading. Then the
+ * module is returned while it is loading, just like in a circular import
+ * on a single thread.
+ */
+data_t * _ns_import_slow(namespace_t *ns, name_t *name, arguments_t *args) {
+  thread_t *self = thread_self();
+  data_t   *ret = NULL;
+  module_t *module;
+
+  condition_acquire(ns -> loaded);
+  module = _ns_get(ns, name);
+  while (module && module -> loader && (module -> loader != self)) {
+    if (_ns_wait_cycle(ns, module, self)) {
+      debug(namespace, "  Module '%s' is being loaded by a thread waiting for this one", name_tostring(name));
+      break;
+    }
+    debug(namespace, "  Module '%s' is being loaded by another thread", name_tostring(name));
+    dict_put_int(ns -> waits, self, module);
+    _ns_wait(ns);
+    dict_remove_int(ns -> waits, self);
+  }
+  if (module && (module -> state != ModStateUninitialized)) {
+    debug(namespace, "  Module '%s' %s in %s", name_tostring(name),
+          ((module -> state == ModStateLoading)
+            ? "currently loading"
+            : "already imported"), ns_tostring(ns));
+    condition_release(ns -> loaded);
+    return data_copy((data_t *) module);
+  }
+  if (!module) {
+    debug(namespace, "  Module not found");
+    module = _ns_add(ns, name);
+  }
+  module -> state = ModStateLoading;
+  module -> loader = self;
+  condition_release(ns -> loaded);
+
+  ret = _ns_load(ns, module, name, args);
+
+  condition_acquire(ns -> loaded);
+  module -> loader = NULL;
+  condition_broadcast(ns -> loaded);
+  return ret;
+}
+
 data_t * _ns_import(namespace_t *ns, name_t *name, arguments_t *args) {
   data_t   *ret = NULL;
   module_t *module = NULL;
@@ -435,22 +526,17 @@ data_t * _ns_import(namespace_t *ns, name_t *name, arguments_t *args) {
     name = dummy;
   }
   debug(namespace, "  Importing module '%s' into %s", name_tostring(name), ns_tostring(ns));
+
+  /*
+   * Modules that are already imported are found without locking:
+   */
   module = _ns_get(ns, name);
-  if (module) {
-    if (module -> state != ModStateUninitialized) {
-      debug(namespace, "  Module '%s' %s in %s", name_tostring(name),
-            ((module -> state == ModStateLoading)
-              ? "currently loading"
-              : "already imported"), ns_tostring(ns));
-      ret = data_copy((data_t *) module);
-    } else {
-      debug(namespace, "  Module found but it's Uninitialized. Somebody must be busy loading it.");
-    }
+  if (module && (module -> state == ModStateActive)) {
+    debug(namespace, "  Module '%s' already imported in %s",
+          name_tostring(name), ns_tostring(ns));
+    ret = data_copy((data_t *) module);
   } else {
-    debug(namespace, "  Module not found");
-  }
-  if (!ret) {
-    ret = _ns_load(ns, module, name, args);
+    ret = _ns_import_slow(ns, name, args);
   }
   name_free(dummy);
   return ret;
@@ -465,13 +551,17 @@ namespace_t * _ns_new(namespace_t *ns, va_list args) {
   ns -> import_ctx = importer;
   ns -> import_fnc = import_fnc;
   ns -> exit_code = NULL;
-  ns -> modules = strdata_dict_create();
+  ns -> modules = cache_create((free_t) data_free);
+  ns -> loaded = condition_create();
+  ns -> waits = intvoid_dict_create();
   return ns;
 }
 
 void _ns_free(namespace_t *ns) {
   if (ns) {
-    dict_free(ns -> modules);
+    cache_free(ns -> modules);
+    condition_free(ns -> loaded);
+    dict_free(ns -> waits);
     free(ns -> name);
     data_free(ns -> exit_code);
   }
@@ -508,10 +598,96 @@ data_t * ns_import(namespace_t *ns, name_t *name) {
   return _ns_import(ns, name, NULL);
 }
 
+/**
+ * Returns the module with the given name, adding it to the namespace
+ * without loading it if it isn't there yet. This lets a loader prepare a
+ * module before it is imported.
+ */
+module_t * ns_declare(namespace_t *ns, name_t *name) {
+  module_t *module;
+
+  condition_acquire(ns -> loaded);
+  if (!(module = _ns_get(ns, name))) {
+    module = _ns_add(ns, name);
+  }
+  condition_release(ns -> loaded);
+  return mod_copy(module);
+}
+
+/*
+ * Marks a value and the module structure hanging off it (scripts, closures,
+ * objects, bytecode and instruction values) immortal. Values that already
+ * are immortal are not descended into, which also takes care of cycles.
+ */
+void * _ns_immortal_reducer(data_t *data, void *ctx) {
+  script_t       *script;
+  closure_t      *closure;
+  object_t       *obj;
+  bytecode_t     *bytecode;
+  instruction_t  *instr;
+  bound_method_t *bm;
+
+  if (!data || (data -> free_me == Constant)) {
+    return ctx;
+  }
+  data_make_immortal(data);
+  if ((script = data_as_script(data))) {
+    _ns_immortal_reducer((data_t *) script -> name, ctx);
+    _ns_immortal_reducer((data_t *) script -> fullname, ctx);
+    _ns_immortal_reducer((data_t *) script -> bytecode, ctx);
+    if (script -> functions) {
+      dict_reduce_values(script -> functions -> attributes, (reduce_t) _ns_immortal_reducer, ctx);
+    }
+  } else if ((closure = data_as_closure(data))) {
+    _ns_immortal_reducer((data_t *) closure -> script, ctx);
+    _ns_immortal_reducer((data_t *) closure -> bytecode, ctx);
+    _ns_immortal_reducer(closure -> self, ctx);
+    if (closure -> variables) {
+      dict_reduce_values(closure -> variables -> attributes, (reduce_t) _ns_immortal_reducer, ctx);
+    }
+  } else if ((obj = data_as_object(data))) {
+    _ns_immortal_reducer(obj -> constructor, ctx);
+    if (obj -> variables) {
+      dict_reduce_values(obj -> variables -> attributes, (reduce_t) _ns_immortal_reducer, ctx);
+    }
+  } else if ((bm = data_as_bound_method(data))) {
+    _ns_immortal_reducer((data_t *) bm -> script, ctx);
+    _ns_immortal_reducer((data_t *) bm -> self, ctx);
+    _ns_immortal_reducer((data_t *) bm -> closure, ctx);
+  } else if ((bytecode = data_as_bytecode(data))) {
+    list_reduce(bytecode -> instructions, _ns_immortal_reducer, ctx);
+  } else if ((instr = data_as_instruction(data))) {
+    _ns_immortal_reducer(instr -> value, ctx);
+  }
+  return ctx;
+}
+
+module_t * _ns_immortal_mod_reducer(module_t *mod, namespace_t *ns) {
+  if (mod -> state == ModStateActive) {
+    data_make_immortal(mod);
+    _ns_immortal_reducer((data_t *) mod -> name, ns);
+    _ns_immortal_reducer((data_t *) mod -> obj, ns);
+    _ns_immortal_reducer((data_t *) mod -> closure, ns);
+  }
+  return mod;
+}
+
+/**
+ * Makes the modules loaded so far immortal, with their objects and code,
+ * so that running them no longer touches their reference counts. This is
+ * for a process that forks children sharing these modules: the pages they
+ * live in then stay shared. Nothing marked is ever freed.
+ */
+namespace_t * ns_make_immortal(namespace_t *ns) {
+  data_make_immortal(ns);
+  cache_reduce(ns -> modules, (reduce_t) _ns_immortal_mod_reducer, ns);
+  return ns;
+}
+
 data_t * ns_get(namespace_t *ns, name_t *name) {
   module_t *mod;
 
-  mod = dict_get(ns -> modules, (name) ? name_tostring(name) : "");
+  mod = cache_get(ns -> modules, (name) ? name_tostring(name) : "");
   if (!mod || !mod -> obj -> constructor) {
     return data_exception(
       ErrorName, "Import '%s' not found in %s",
@@ -27,6 +27,7 @@ static char *       _vm_tostring(vm_t *);
 static data_t *     _vm_call(vm_t *, array_t *, dict_t *);
 static vm_t *       _vm_prepare(vm_t *, data_t *);
 static listnode_t * _vm_execute_instruction(data_t *, arguments_t *);
+static listnode_t * _vm_debug_instruction(data_t *, arguments_t *);
 
 int VM = -1;
 
@@ -56,6 +57,7 @@ vm_t * _vm_new(vm_t *vm, va_list args) {
   vm -> contexts = NULL;
   vm -> processor = NULL;
   vm -> exception = NULL;
+  vm -> debugger = NULL;
   return vm;
 }
 
@@ -99,7 +101,9 @@ vm_t * _vm_prepare(vm_t *vm, data_t *scope) {
 
     args = arguments_create_args(3, scope, vm, vm -> bytecode);
     vm -> processor = lp_create(vm -> bytecode -> instructions,
-                                (reduce_t) _vm_execute_instruction,
+                                (vm -> debugger)
+                                  ? (reduce_t) _vm_debug_instruction
+                                  : (reduce_t) _vm_execute_instruction,
                                 args);
   }
   return vm;
@@ -116,58 +120,69 @@ vm_t * _vm_cleanup(vm_t *vm) {
   return vm;
 }
 
-listnode_t * _vm_execute_instruction(data_t *instr, arguments_t *args) {
-  data_t      *ret = NULL;
-  data_t      *exit_code = NULL;
-  int          call_me = FALSE;
-  data_t      *label = NULL;
-  listnode_t  *node = NULL;
-  vm_t        *vm = (vm_t *) data_uncopy(arguments_get_arg(args, 1));
-  bytecode_t  *bytecode = (bytecode_t *) data_uncopy(arguments_get_arg(args, 2));
-  exception_t *ex = NULL;
-  data_t      *ex_data;
-  nvp_t       *catchpoint;
-  debugcmd_t   debugcmd;
+/*
+ * Back-edges of loops are jumps, so polling the safepoint at jumps and
+ * calls is enough to make any script notice an exit or interrupt soon.
+ * An exit found here becomes the result of the VM, so that it bubbles up
+ * to the callers. An ErrorExit returned by an instruction in this VM is
+ * handled right away, without waiting for a safepoint.
+ */
+static inline data_t * _vm_safepoint(vm_t *vm, data_t *instr) {
+  data_t *ret = NULL;
 
-  if (vm -> status != VMStatusExit) {
-    exit_code = data_thread_exit_code();
-    if (exit_code) {
+  if (thread_safepoint && (vm -> status != VMStatusExit) &&
+      ((instr -> type == ITJump) || (instr -> type == ITFunctionCall))) {
+    ret = thread_safepoint_poll();
+    if (data_is_exception_with_code(ret, ErrorExit)) {
       vm -> status = VMStatusExit;
+      if (!vm -> exception) {
+        vm -> exception = ret;
+      } else {
+        data_free(ret);
+      }
+      ret = NULL;
     }
   }
+  return ret;
+}
 
+/*
+ * Returns TRUE if the instruction should be executed given the current
+ * status of the VM. When breaking out of a loop or exiting, only the
+ * instructions that unwind loops and contexts are executed.
+ */
+static inline int _vm_call_instruction(vm_t *vm, data_t *instr) {
   switch (vm -> status) {
     case VMStatusExit:
-      if (thread_has_status(thread_self(), TSFLeave) || (instr -> type == ITLeaveContext)) {
-        call_me = TRUE;
-      }
-      break;
+      return thread_has_status(thread_self(), TSFLeave) || (instr -> type == ITLeaveContext);
     case VMStatusContinue:
     case VMStatusBreak:
-      call_me = (instr -> type == ITEndLoop) || (instr -> type == ITLeaveContext);
-      break;
+      return (instr -> type == ITEndLoop) || (instr -> type == ITLeaveContext);
     default:
-      call_me = TRUE;
-      break;
+      return TRUE;
   }
+}
 
-  if (call_me) {
-    debugcmd = debugger_step_before(vm -> debugger, data_as_instruction(instr));
-    if (debugcmd == DebugCmdHalt) {
-      ret = data_exception(ErrorExit, "Cancelled by debugger");
-    } else {
-      ret = data_call(instr, args);
-      debugger_step_after(vm -> debugger, data_as_instruction(instr), ret);
-    }
-  }
+/*
+ * Processes the value returned by an instruction and returns the node to
+ * jump to, or NULL to continue with the next instruction. Consumes ret.
+ */
+static listnode_t * _vm_instruction_result(vm_t *vm, bytecode_t *bytecode,
+                                           data_t *instr, data_t *ret) {
+  data_t      *label = NULL;
+  listnode_t  *node = NULL;
+  exception_t *ex = NULL;
+  data_t      *ex_data;
+  nvp_t       *catchpoint;
 
-  if (!exit_code && ret) {
+  if ((vm -> status != VMStatusExit) && ret) {
     if (data_type(ret) == String) {
       label = data_copy(ret);
     } else if (data_type(ret) == Exception) {
       ex =  exception_copy(data_as_exception(ret));
       if (ex -> code == ErrorExit) {
         data_thread_set_exit_code(data_copy(ret));
+        vm -> status = VMStatusExit;
       }
     } else {
       ex_data = data_exception(ErrorInternalError,
@@ -208,6 +223,48 @@ listnode_t * _vm_execute_instruction(data_t *instr, arguments_t *args) {
   return node;
 }
 
+/*
+ * The regular dispatch path. This is the reducer of the VM's list
+ * processor unless a debugger is active, and should stay free of anything
+ * that is only needed for debugging.
+ */
+listnode_t * _vm_execute_instruction(data_t *instr, arguments_t *args) {
+  vm_t       *vm = (vm_t *) data_uncopy(arguments_get_arg(args, 1));
+  bytecode_t *bytecode = (bytecode_t *) data_uncopy(arguments_get_arg(args, 2));
+  data_t     *ret;
+
+  ret = _vm_safepoint(vm, instr);
+  if (!ret && _vm_call_instruction(vm, instr)) {
+    ret = data_call(instr, args);
+  }
+  return _vm_instruction_result(vm, bytecode, instr, ret);
+}
+
+/*
+ * The instrumented dispatch path, used while a debugger is active. Once
+ * tracing is switched off and the debugger is no longer single stepping,
+ * the VM is switched back to the regular path.
+ */
+listnode_t * _vm_debug_instruction(data_t *instr, arguments_t *args) {
+  vm_t       *vm = (vm_t *) data_uncopy(arguments_get_arg(args, 1));
+  bytecode_t *bytecode = (bytecode_t *) data_uncopy(arguments_get_arg(args, 2));
+  data_t     *ret;
+
+  ret = _vm_safepoint(vm, instr);
+  if (!ret && _vm_call_instruction(vm, instr)) {
+    if (debugger_step_before(vm -> debugger, data_as_instruction(instr)) == DebugCmdHalt) {
+      ret = data_exception(ErrorExit, "Cancelled by debugger");
+    } else {
+      ret = data_call(instr, args);
+      debugger_step_after(vm -> debugger, data_as_instruction(instr), ret);
+    }
+  }
+  if (!script_trace && (vm -> debugger -> status != DebugStatusSingleStep)) {
+    vm -> processor -> processor = (reduce_t) _vm_execute_instruction;
+  }
+  return _vm_instruction_result(vm, bytecode, instr, ret);
+}
+
 /* ------------------------------------------------------------------------ */
 
 vm_t * vm_create(bytecode_t *bytecode) {
@@ -291,6 +348,10 @@ data_t * vm_execute(vm_t *vm, data_t *scope) {
   data_t      *ret = NULL;
   exception_t *ex;
 
+  if (script_trace) {
+    vm -> debugger = debugger_create(vm, scope);
+    vm -> debugger -> status = DebugStatusSingleStep;
+  }
   _vm_prepare(vm, scope);
   ret = data_thread_push_stackframe((data_t *) vm);
   if (!data_is_exception(ret)) {
@@ -298,11 +359,9 @@ data_t * vm_execute(vm_t *vm, data_t *scope) {
     data_free(vm -> exception);
     vm -> exception = NULL;
 
-    vm -> debugger = debugger_create(vm, scope);
-    if (script_trace) {
-      vm -> debugger -> status = DebugStatusSingleStep;
+    if (vm -> debugger) {
+      debugger_start(vm -> debugger);
     }
-    debugger_start(vm -> debugger);
     while (lp_step(vm -> processor)) {
       if (vm -> exception) {
         ex = data_as_exception(vm -> exception);
@@ -328,10 +387,13 @@ data_t * vm_execute(vm_t *vm, data_t *scope) {
         ret = (datastack_notempty(vm -> stack) ? vm_pop(vm) : data_null());
       }
     }
-    debugger_exit(vm -> debugger, ret);
-    debugger_free(vm -> debugger);
+    if (vm -> debugger) {
+      debugger_exit(vm -> debugger, ret);
+    }
     data_thread_pop_stackframe();
   }
+  debugger_free(vm -> debugger);
+  vm -> debugger = NULL;
   _vm_cleanup(vm);
   return ret;
 }
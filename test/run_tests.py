@@ -21,8 +21,12 @@
 
 import sys
 import os
+import socket
 import subprocess
 import json
+import time
+
+FORKSERVER = "forkserver.sock"
 
 def check_stream(script, which, stream):
     ret = 0
@@ -37,6 +41,63 @@ def check_stream(script, which, stream):
             ret = 1
     return ret
 
+def check_files(script):
+    ret = 0
+    for fname, expected in script.get("files", {}).items():
+        if os.path.exists(fname):
+            with open(fname) as fd:
+                written = [ line.strip() for line in fd ]
+            os.remove(fname)
+        else:
+            written = None
+        if written != expected:
+            print("%s: file %s %s != %s" % (script["name"], fname, written, expected))
+            ret = 1
+    return ret
+
+def record_files(script):
+    for fname in script.get("files", {}):
+        written = None
+        if os.path.exists(fname):
+            with open(fname) as fd:
+                written = [ line.strip() for line in fd ]
+            os.remove(fname)
+        script["files"][fname] = written
+
+# Scripts with "forkserver" set run through an "obelix -F" fork server that
+# is started for them. The client quietly runs the script itself if nobody
+# is listening yet, so wait until the server accepts connections.
+def start_forkserver(script):
+    if not script.get("forkserver"):
+        return None
+    os.path.exists(FORKSERVER) and os.remove(FORKSERVER)
+    with open(os.devnull, "w") as null:
+        server = subprocess.Popen(["obelix", "-F", FORKSERVER], stdout = null, stderr = null)
+    for attempt in range(50):
+        probe = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            probe.connect(FORKSERVER)
+            break
+        except socket.error:
+            time.sleep(0.1)
+        finally:
+            probe.close()
+    return server
+
+def stop_forkserver(server):
+    if server:
+        server.terminate()
+        server.wait()
+        os.path.exists(FORKSERVER) and os.remove(FORKSERVER)
+
+def run_script(script, f, out, err):
+    server = start_forkserver(script)
+    cmd = ["obelix", "-F", FORKSERVER, f] if server else ["obelix", f]
+    try:
+        return subprocess.call(cmd, stdout = out, stderr = err)
+    finally:
+        stop_forkserver(server)
+
 def test_script(name):
     os.path.exists("stdout") and os.remove("stdout")
     os.path.exists("stdout") and os.remove("stderr")
@@ -46,11 +107,11 @@ def test_script(name):
     with open(name + ".json") as fd:
         script = json.load(fd)
     with open("stdout", "w+") as out, open("stderr", "w+") as err:
-        ex = subprocess.call(["obelix", f], stdout = out, stderr = err)
+        ex = run_script(script, f, out, err)
         out.seek(0)
         err.seek(0)
 
-        error = 0
+        error = check_files(script)
         if "exit" in script:
             expected = script["exit"]
             if ex != expected and ex != expected + 256 and ex != expected - 256:
@@ -88,10 +149,18 @@ def config_test(name):
 
     print(name)
     script = { "name": name }
+    if os.path.exists(name + ".json"):
+        # Keep how the script is run and which files it writes
+        with open(name + ".json") as fd:
+            old = json.load(fd)
+        for key in ("forkserver", "files"):
+            if key in old:
+                script[key] = old[key]
     with open("stdout", "w+") as out, open("stderr", "w+") as err:
-        ex = subprocess.call(["obelix", f], stdout = out, stderr = err)
+        ex = run_script(script, f, out, err)
         out.seek(0)
         err.seek(0)
+        record_files(script)
         script["exit"] = ex
         script["stdout"] = [ line.strip() for line in out ]
         script["stderr"] = [ line.strip() for line in err ]
@@ -143,6 +212,8 @@ def help():
     print("Options:")
     print(" -c <test>:   Add test script <test>.obl to test suite.")
     print("              Execute script, capture and register exit code and stdout/stderr.")
+    print("              Keeps the \"forkserver\" and \"files\" settings of an existing")
+    print("              <test>.json, and registers the contents of those files.")
     print(" -f <file>:   Add all tests in <file>. <file> contains test script names,")
     print("              one per line, without .obl extension.")
     print(" -x <test>:   Run test <test>.")